@@ -10,7 +10,7 @@ pgagroal_cli_completions()
     if [ "${#COMP_WORDS[@]}" == "2" ]; then
         # main completion: the user has specified nothing at all
         # or a single word, that is a command
-        COMPREPLY=($(compgen -W "flush ping enable disable shutdown status switch-to conf clear" "${COMP_WORDS[1]}"))
+        COMPREPLY=($(compgen -W "flush ping enable disable shutdown status switch-to tracker flight-recorder conf clear" "${COMP_WORDS[1]}"))
     else
         # the user has specified something else
         # subcommand required?
@@ -22,7 +22,7 @@ pgagroal_cli_completions()
                 COMPREPLY+=($(compgen -W "gracefully immediate cancel" "${COMP_WORDS[2]}"))
                 ;;
             clear)
-                COMPREPLY+=($(compgen -W "server prometheus" "${COMP_WORDS[2]}"))
+                COMPREPLY+=($(compgen -W "server prometheus auth-query" "${COMP_WORDS[2]}"))
                 ;;
 	    conf)
 		COMPREPLY+=($(compgen -W "reload get set ls alias" "${COMP_WORDS[2]}"))
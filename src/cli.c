@@ -60,6 +60,7 @@
 #define COMMAND_CANCELSHUTDOWN "cancel-shutdown"
 #define COMMAND_CLEAR          "clear"
 #define COMMAND_CLEAR_SERVER   "clear-server"
+#define COMMAND_CLEARAUTHQUERY "clear-auth-query"
 #define COMMAND_DISABLEDB      "disable-db"
 #define COMMAND_ENABLEDB       "enable-db"
 #define COMMAND_FLUSH          "flush"
@@ -70,6 +71,8 @@
 #define COMMAND_STATUS         "status"
 #define COMMAND_STATUS_DETAILS "status-details"
 #define COMMAND_SWITCH_TO      "switch-to"
+#define COMMAND_TRACKER        "tracker"
+#define COMMAND_FLIGHTRECORDER "flight-recorder"
 #define COMMAND_CONFIG_LS      "conf-ls"
 #define COMMAND_CONFIG_GET     "conf-get"
 #define COMMAND_CONFIG_SET     "conf-set"
@@ -80,6 +83,11 @@
 
 #define UNSPECIFIED            "Unspecified"
 
+#define BATCH_PROMPT           "pgagroal-cli> "
+#define BATCH_TOKENS           16
+
+#define DETAILS_PAGE           1000
+
 static void display_helper(char* command);
 static void help_cancel_shutdown(void);
 /* static void help_config(void); */
@@ -92,12 +100,14 @@ static void help_ping(void);
 static void help_shutdown(void);
 static void help_status_details(void);
 static void help_switch_to(void);
+static void help_tracker(void);
+static void help_flight_recorder(void);
 
 static int cancel_shutdown(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int conf_get(SSL* ssl, int socket, char* config_key, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int conf_ls(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int conf_set(SSL* ssl, int socket, char* config_key, char* config_value, uint8_t compression, uint8_t encryption, int32_t output_format);
-static int details(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int details(SSL* ssl, int socket, bool remote_connection, char** args, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int disabledb(SSL* ssl, int socket, char* database, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int enabledb(SSL* ssl, int socket, char* database, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int flush(SSL* ssl, int socket, int32_t mode, char* database, int64_t timeout, uint8_t compression, uint8_t encryption, int32_t output_format);
@@ -107,8 +117,14 @@ static int ping(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, i
 static int reload(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int clear(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int clear_server(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int clear_auth_query(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int status(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
 static int switch_to(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int tracker(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int flight_recorder(SSL* ssl, int socket, char* slot, uint8_t compression, uint8_t encryption, int32_t output_format);
+
+static int execute(struct pgagroal_parsed_command* parsed, bool remote_connection, SSL* ssl, int socket, int64_t timeout, uint8_t compression, uint8_t encryption, int32_t output_format);
+static int batch(FILE* input, bool remote_connection, SSL* ssl, int* socket, int64_t timeout, uint8_t compression, uint8_t encryption, int32_t output_format);
 
 static int process_result(SSL* ssl, int socket, int32_t output_format);
 static int process_get_result(SSL* ssl, int socket, char* config_key, int32_t output_format);
@@ -305,14 +321,39 @@ const struct pgagroal_command command_table[] = {
       .deprecated = false,
       .log_message = "<clear prometheus>"
    },
+   {
+      .command = "clear",
+      .subcommand = "auth-query",
+      .accepted_argument_count = {0},
+      .action = MANAGEMENT_CLEAR_AUTH_QUERY,
+      .deprecated = false,
+      .log_message = "<clear auth-query>"
+   },
    {
       .command = "status",
       .subcommand = "details",
-      .accepted_argument_count = {0},
+      .accepted_argument_count = {0, 1, 2, 3, 4, 5},
       .action = MANAGEMENT_DETAILS,
       .deprecated = false,
       .log_message = "<status details>"
    },
+   {
+      .command = "tracker",
+      .subcommand = "",
+      .accepted_argument_count = {0},
+      .action = MANAGEMENT_TRACKER,
+      .deprecated = false,
+      .log_message = "<tracker>"
+   },
+   {
+      .command = "flight-recorder",
+      .subcommand = "",
+      .accepted_argument_count = {0, 1},
+      .action = MANAGEMENT_FLIGHT_RECORDER,
+      .default_argument = "all",
+      .deprecated = false,
+      .log_message = "<flight-recorder> [%s]"
+   },
 };
 // clang-format on
 
@@ -354,6 +395,8 @@ usage(void)
    printf("                                                 'flush_timeout' from pgagroal.conf. '--timeout 0'\n");
    printf("                                                 explicitly disables the timer (runs unbounded);\n");
    printf("                                                 same meaning as 'flush_timeout = 0' in pgagroal.conf.\n");
+   printf("  -B, --batch FILE|-                           Execute the commands of FILE (or standard input),\n");
+   printf("                                                 one per line, over a single session\n");
    printf("  -v, --verbose                                Output text string of result\n");
    printf("  -V, --version                                Display version information\n");
    printf("  -?, --help                                   Display help\n");
@@ -377,7 +420,11 @@ usage(void)
    printf("                           With '--timeout DURATION' on 'gracefully', pgagroal forces an\n");
    printf("                           immediate shutdown on expiry.\n");
    printf("  status [details]         Status of pgagroal, with optional details\n");
+   printf("                           The details accept the filters 'state=<state>', 'user=<user>'\n");
+   printf("                           and 'database=<database>', and 'offset=<slot>' 'limit=<n>' for a page\n");
    printf("  switch-to <server>       Switches to the specified primary server\n");
+   printf("  tracker                  Dumps the tracker events\n");
+   printf("  flight-recorder [slot]   Dumps the last protocol messages of the connections (or a slot)\n");
    printf("  conf <action>            Manages the configuration (e.g., reloads the configuration\n");
    printf("                           The subcommand <action> can be:\n");
    printf("                           - 'reload' to issue a configuration reload;\n");
@@ -393,6 +440,7 @@ usage(void)
    printf("                           - 'server' (default) followed by a server name\n");
    printf("                           - a server name on its own\n");
    printf("                           - 'prometheus' to reset the Prometheus metrics\n");
+   printf("                           - 'auth-query' to drop the cached authentication query results\n");
    printf("\n");
    printf("pgagroal: <%s>\n", PGAGROAL_HOMEPAGE);
    printf("Report bugs: <%s>\n", PGAGROAL_ISSUES);
@@ -412,6 +460,8 @@ main(int argc, char** argv)
    char* password = NULL;
    bool verbose = false;
    char* logfile = NULL;
+   char* batch_file = NULL;
+   FILE* batch_input = NULL;
    int c;
    int option_index = 0;
    size_t size;
@@ -440,11 +490,12 @@ main(int argc, char** argv)
             {"compress", required_argument, 0, 'C'},
             {"encrypt", required_argument, 0, 'E'},
             {"timeout", required_argument, 0, 'T'},
+            {"batch", required_argument, 0, 'B'},
             {"verbose", no_argument, 0, 'v'},
             {"version", no_argument, 0, 'V'},
             {"help", no_argument, 0, '?'}};
 
-      c = getopt_long(argc, argv, "vV?c:h:p:U:P:L:F:C:E:T:",
+      c = getopt_long(argc, argv, "vV?c:h:p:U:P:L:F:C:E:T:B:",
                       long_options, &option_index);
 
       if (c == -1)
@@ -560,6 +611,9 @@ main(int argc, char** argv)
             timeout = v;
             break;
          }
+         case 'B':
+            batch_file = optarg;
+            break;
          case 'v':
             verbose = true;
             break;
@@ -677,7 +731,31 @@ main(int argc, char** argv)
       }
    }
 
-   if (!parse_command(argc, argv, optind, &parsed, command_table, command_count))
+   if (batch_file != NULL)
+   {
+      if (argc > optind)
+      {
+         warnx("pgagroal-cli: A command can not be combined with --batch");
+         exit_code = 1;
+         goto done;
+      }
+
+      if (!strcmp(batch_file, "-"))
+      {
+         batch_input = stdin;
+      }
+      else
+      {
+         batch_input = fopen(batch_file, "r");
+         if (batch_input == NULL)
+         {
+            warnx("pgagroal-cli: Could not open %s", batch_file);
+            exit_code = 1;
+            goto done;
+         }
+      }
+   }
+   else if (!parse_command(argc, argv, optind, &parsed, command_table, command_count))
    {
       if (argc > optind)
       {
@@ -787,107 +865,257 @@ username:
       }
    }
 
-   if (parsed.cmd->action == MANAGEMENT_FLUSH)
+   if (batch_input != NULL)
+   {
+      exit_code = batch(batch_input, remote_connection, s_ssl, &socket, timeout, compression, encryption, output_format);
+   }
+   else
+   {
+      exit_code = execute(&parsed, remote_connection, s_ssl, socket, timeout, compression, encryption, output_format);
+   }
+
+done:
+
+   if (s_ssl != NULL)
+   {
+      int res;
+      res = SSL_shutdown(s_ssl);
+      if (res == 0)
+      {
+         SSL_shutdown(s_ssl);
+      }
+      SSL_free(s_ssl);
+   }
+
+   if (batch_input != NULL && batch_input != stdin)
+   {
+      fclose(batch_input);
+   }
+
+   pgagroal_disconnect(socket);
+   pgagroal_stop_logging();
+   pgagroal_destroy_shared_memory(shmem, size);
+
+   free(password);
+
+   if (verbose)
+   {
+      warnx("%s (%d)", exit_code == 0 ? "Success" : "Error", exit_code);
+   }
+
+   return exit_code;
+}
+
+static int
+execute(struct pgagroal_parsed_command* parsed, bool remote_connection, SSL* ssl, int socket, int64_t timeout, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   int ret = 0;
+
+   if (parsed->cmd->action == MANAGEMENT_FLUSH)
    {
-      exit_code = flush(s_ssl, socket, parsed.cmd->mode, parsed.args[0], timeout, compression, encryption, output_format);
+      ret = flush(ssl, socket, parsed->cmd->mode, parsed->args[0], timeout, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_ENABLEDB)
+   else if (parsed->cmd->action == MANAGEMENT_ENABLEDB)
    {
-      exit_code = enabledb(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+      ret = enabledb(ssl, socket, parsed->args[0], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_DISABLEDB)
+   else if (parsed->cmd->action == MANAGEMENT_DISABLEDB)
    {
-      exit_code = disabledb(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+      ret = disabledb(ssl, socket, parsed->args[0], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_GRACEFULLY)
+   else if (parsed->cmd->action == MANAGEMENT_GRACEFULLY)
    {
-      exit_code = gracefully(s_ssl, socket, timeout, compression, encryption, output_format);
+      ret = gracefully(ssl, socket, timeout, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_SHUTDOWN)
+   else if (parsed->cmd->action == MANAGEMENT_SHUTDOWN)
    {
-      exit_code = pgagroal_shutdown(s_ssl, socket, compression, encryption, output_format);
+      ret = pgagroal_shutdown(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_CANCEL_SHUTDOWN)
+   else if (parsed->cmd->action == MANAGEMENT_CANCEL_SHUTDOWN)
    {
-      exit_code = cancel_shutdown(s_ssl, socket, compression, encryption, output_format);
+      ret = cancel_shutdown(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_STATUS)
+   else if (parsed->cmd->action == MANAGEMENT_STATUS)
    {
-      exit_code = status(s_ssl, socket, compression, encryption, output_format);
+      ret = status(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_DETAILS)
+   else if (parsed->cmd->action == MANAGEMENT_DETAILS)
    {
-      exit_code = details(s_ssl, socket, compression, encryption, output_format);
+      ret = details(ssl, socket, remote_connection, &parsed->args[0], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_PING)
+   else if (parsed->cmd->action == MANAGEMENT_PING)
    {
-      exit_code = ping(s_ssl, socket, compression, encryption, output_format);
+      ret = ping(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_CLEAR)
+   else if (parsed->cmd->action == MANAGEMENT_CLEAR)
    {
-      exit_code = clear(s_ssl, socket, compression, encryption, output_format);
+      ret = clear(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_CLEAR_SERVER)
+   else if (parsed->cmd->action == MANAGEMENT_CLEAR_SERVER)
    {
-      exit_code = clear_server(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+      ret = clear_server(ssl, socket, parsed->args[0], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_SWITCH_TO)
+   else if (parsed->cmd->action == MANAGEMENT_CLEAR_AUTH_QUERY)
    {
-      exit_code = switch_to(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+      ret = clear_auth_query(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_RELOAD)
+   else if (parsed->cmd->action == MANAGEMENT_SWITCH_TO)
    {
-      exit_code = reload(s_ssl, socket, compression, encryption, output_format);
+      ret = switch_to(ssl, socket, parsed->args[0], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_CONFIG_LS)
+   else if (parsed->cmd->action == MANAGEMENT_TRACKER)
    {
-      exit_code = conf_ls(s_ssl, socket, compression, encryption, output_format);
+      ret = tracker(ssl, socket, compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_CONFIG_GET)
+   else if (parsed->cmd->action == MANAGEMENT_FLIGHT_RECORDER)
    {
-      if (parsed.args[0])
+      ret = flight_recorder(ssl, socket, parsed->args[0], compression, encryption, output_format);
+   }
+   else if (parsed->cmd->action == MANAGEMENT_RELOAD)
+   {
+      ret = reload(ssl, socket, compression, encryption, output_format);
+   }
+   else if (parsed->cmd->action == MANAGEMENT_CONFIG_LS)
+   {
+      ret = conf_ls(ssl, socket, compression, encryption, output_format);
+   }
+   else if (parsed->cmd->action == MANAGEMENT_CONFIG_GET)
+   {
+      if (parsed->args[0])
       {
-         exit_code = conf_get(s_ssl, socket, parsed.args[0], compression, encryption, output_format);
+         ret = conf_get(ssl, socket, parsed->args[0], compression, encryption, output_format);
       }
       else
       {
-         exit_code = conf_get(s_ssl, socket, NULL, compression, encryption, output_format);
+         ret = conf_get(ssl, socket, NULL, compression, encryption, output_format);
       }
    }
-   else if (parsed.cmd->action == MANAGEMENT_CONFIG_SET)
+   else if (parsed->cmd->action == MANAGEMENT_CONFIG_SET)
    {
-      exit_code = conf_set(s_ssl, socket, parsed.args[0], parsed.args[1], compression, encryption, output_format);
+      ret = conf_set(ssl, socket, parsed->args[0], parsed->args[1], compression, encryption, output_format);
    }
-   else if (parsed.cmd->action == MANAGEMENT_CONFIG_ALIAS)
+   else if (parsed->cmd->action == MANAGEMENT_CONFIG_ALIAS)
    {
-      exit_code = conf_alias(s_ssl, socket, compression, encryption, output_format);
+      ret = conf_alias(ssl, socket, compression, encryption, output_format);
    }
 
-done:
+   return ret;
+}
 
-   if (s_ssl != NULL)
+static int
+batch(FILE* input, bool remote_connection, SSL* ssl, int* socket, int64_t timeout, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   int ret = 0;
+   int count;
+   int c;
+   size_t length;
+   bool interactive;
+   char line[MAX_PATH];
+   char* tokens[BATCH_TOKENS];
+   char* saveptr = NULL;
+   char* token = NULL;
+   struct main_configuration* config;
+   size_t command_count = sizeof(command_table) / sizeof(struct pgagroal_command);
+   struct pgagroal_parsed_command parsed;
+
+   config = (struct main_configuration*)shmem;
+   interactive = isatty(fileno(input));
+
+   while (true)
    {
-      int res;
-      res = SSL_shutdown(s_ssl);
-      if (res == 0)
+      if (interactive)
       {
-         SSL_shutdown(s_ssl);
+         printf(BATCH_PROMPT);
+         fflush(stdout);
       }
-      SSL_free(s_ssl);
-   }
 
-   pgagroal_disconnect(socket);
-   pgagroal_stop_logging();
-   pgagroal_destroy_shared_memory(shmem, size);
+      memset(&line[0], 0, sizeof(line));
+      if (fgets(&line[0], sizeof(line), input) == NULL)
+      {
+         break;
+      }
 
-   free(password);
+      length = strlen(&line[0]);
+      if (length == sizeof(line) - 1 && line[length - 1] != '\n')
+      {
+         /* Skip the rest of the line, it must not run as a command of its own */
+         while ((c = fgetc(input)) != EOF && c != '\n')
+         {
+         }
 
-   if (verbose)
-   {
-      warnx("%s (%d)", exit_code == 0 ? "Success" : "Error", exit_code);
+         warnx("pgagroal-cli: Batch line is longer than %d characters", (int)sizeof(line) - 2);
+         ret = 1;
+         continue;
+      }
+
+      if (strpbrk(&line[0], "\"'") != NULL && line[strspn(&line[0], " \t")] != '#')
+      {
+         warnx("pgagroal-cli: Quoting is not supported in batch mode");
+         ret = 1;
+         continue;
+      }
+
+      count = 0;
+      saveptr = NULL;
+      token = strtok_r(&line[0], " \t\r\n", &saveptr);
+      while (token != NULL && count <= BATCH_TOKENS)
+      {
+         if (count < BATCH_TOKENS)
+         {
+            tokens[count] = token;
+         }
+         count++;
+         token = strtok_r(NULL, " \t\r\n", &saveptr);
+      }
+
+      if (count == 0 || tokens[0][0] == '#')
+      {
+         continue;
+      }
+
+      if (count > BATCH_TOKENS)
+      {
+         warnx("pgagroal-cli: Batch line has more than %d arguments: %s", BATCH_TOKENS, tokens[0]);
+         ret = 1;
+         continue;
+      }
+
+      if (!strcmp(tokens[0], "quit") || !strcmp(tokens[0], "exit"))
+      {
+         break;
+      }
+
+      memset(&parsed, 0, sizeof(parsed));
+      if (!parse_command(count, &tokens[0], 0, &parsed, command_table, command_count))
+      {
+         display_helper(tokens[0]);
+         ret = 1;
+         continue;
+      }
+
+      /* The main process answers one request per connection, a remote session serves them all */
+      if (!remote_connection && *socket == -1)
+      {
+         if (pgagroal_connect_unix_socket(config->unix_socket_dir, MAIN_UDS, socket))
+         {
+            ret = 1;
+            break;
+         }
+      }
+
+      if (execute(&parsed, remote_connection, ssl, *socket, timeout, compression, encryption, output_format))
+      {
+         ret = 1;
+      }
+
+      if (!remote_connection)
+      {
+         pgagroal_disconnect(*socket);
+         *socket = -1;
+      }
    }
 
-   return exit_code;
+   return ret;
 }
 
 static void
@@ -925,6 +1153,8 @@ help_status_details(void)
 {
    printf("Status of pgagroal\n");
    printf("  pgagroal-cli status [details]\n");
+   printf("  pgagroal-cli status details [state=<state>] [user=<user>] [database=<database>]\n");
+   printf("                              [offset=<slot>] [limit=<n>]\n");
 }
 
 static void
@@ -956,7 +1186,7 @@ static void
 help_clear(void)
 {
    printf("Reset data\n");
-   printf("  pgagroal-cli clear [prometheus]\n");
+   printf("  pgagroal-cli clear [prometheus|auth-query]\n");
 }
 
 static void
@@ -982,6 +1212,20 @@ help_switch_to(void)
    printf("  pgagroal-cli switch-to <server>\n");
 }
 
+static void
+help_tracker(void)
+{
+   printf("Dump the tracker events\n");
+   printf("  pgagroal-cli tracker\n");
+}
+
+static void
+help_flight_recorder(void)
+{
+   printf("Dump the flight recorder\n");
+   printf("  pgagroal-cli flight-recorder [all|<slot>]\n");
+}
+
 static void
 display_helper(char* command)
 {
@@ -1014,7 +1258,8 @@ display_helper(char* command)
       help_ping();
    }
    else if (!strcmp(command, COMMAND_CLEAR) ||
-            !strcmp(command, COMMAND_CLEAR_SERVER))
+            !strcmp(command, COMMAND_CLEAR_SERVER) ||
+            !strcmp(command, COMMAND_CLEARAUTHQUERY))
    {
       help_clear();
    }
@@ -1030,6 +1275,14 @@ display_helper(char* command)
    {
       help_switch_to();
    }
+   else if (!strcmp(command, COMMAND_TRACKER))
+   {
+      help_tracker();
+   }
+   else if (!strcmp(command, COMMAND_FLIGHTRECORDER))
+   {
+      help_flight_recorder();
+   }
    else
    {
       usage();
@@ -1177,22 +1430,183 @@ error:
 }
 
 static int
-details(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format)
+details(SSL* ssl, int socket, bool remote_connection, char** args, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
-   if (pgagroal_management_request_details(ssl, socket, compression, encryption, output_format))
+   int page_socket = socket;
+   char* key = NULL;
+   char* value = NULL;
+   char* end = NULL;
+   char* state = NULL;
+   char* username = NULL;
+   char* database = NULL;
+   int64_t offset = 0;
+   int64_t limit = 0;
+   int64_t n = 0;
+   struct json* read = NULL;
+   struct json* page = NULL;
+   struct json* response = NULL;
+   struct json* connections = NULL;
+   struct json* row = NULL;
+   struct json_iterator* iter = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   for (int i = 0; i < MISC_LENGTH && args[i] != NULL; i++)
    {
-      goto error;
+      key = args[i];
+      value = strchr(key, '=');
+      if (value == NULL)
+      {
+         warnx("pgagroal-cli: Expected <key>=<value> instead of %s", key);
+         goto error;
+      }
+      *value++ = '\0';
+
+      if (!strcmp(key, "offset") || !strcmp(key, "limit"))
+      {
+         errno = 0;
+         n = strtoll(value, &end, 10);
+         if (errno != 0 || end == value || *end != '\0' || n < 0)
+         {
+            warnx("pgagroal-cli: Invalid %s %s", key, value);
+            goto error;
+         }
+      }
+
+      if (!strcmp(key, "state"))
+      {
+         state = value;
+      }
+      else if (!strcmp(key, "user"))
+      {
+         username = value;
+      }
+      else if (!strcmp(key, "database"))
+      {
+         database = value;
+      }
+      else if (!strcmp(key, "offset"))
+      {
+         offset = n;
+      }
+      else if (!strcmp(key, "limit"))
+      {
+         limit = n;
+      }
+      else
+      {
+         warnx("pgagroal-cli: Unknown filter %s", key);
+         goto error;
+      }
    }
 
-   if (process_result(ssl, socket, output_format))
+   /* An explicit limit asks for that page only */
+   if (limit > 0)
    {
-      goto error;
+      if (pgagroal_management_request_details(ssl, socket, state, username, database, offset, limit, compression, encryption, output_format))
+      {
+         goto error;
+      }
+
+      return process_result(ssl, socket, output_format);
+   }
+
+   /* Otherwise the connections are fetched a page at a time, so the server never builds them all */
+   while (offset >= 0)
+   {
+      if (page_socket == -1)
+      {
+         if (pgagroal_connect_unix_socket(config->unix_socket_dir, MAIN_UDS, &page_socket))
+         {
+            goto error;
+         }
+      }
+
+      if (pgagroal_management_request_details(ssl, page_socket, state, username, database, offset, DETAILS_PAGE, compression, encryption, output_format))
+      {
+         goto error;
+      }
+
+      if (pgagroal_management_read_json(ssl, page_socket, NULL, NULL, &page))
+      {
+         goto error;
+      }
+
+      /* The main process answers one request per connection */
+      if (!remote_connection)
+      {
+         if (page_socket != socket)
+         {
+            pgagroal_disconnect(page_socket);
+         }
+         page_socket = -1;
+      }
+
+      response = (struct json*)pgagroal_json_get(page, MANAGEMENT_CATEGORY_RESPONSE);
+      offset = -1;
+      if (pgagroal_json_contains_key(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET))
+      {
+         offset = (int64_t)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET);
+         pgagroal_json_remove(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET);
+      }
+
+      if (read == NULL)
+      {
+         read = page;
+         page = NULL;
+         connections = (struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS);
+         pgagroal_json_remove((struct json*)pgagroal_json_get(read, MANAGEMENT_CATEGORY_REQUEST), MANAGEMENT_ARGUMENT_OFFSET);
+         pgagroal_json_remove((struct json*)pgagroal_json_get(read, MANAGEMENT_CATEGORY_REQUEST), MANAGEMENT_ARGUMENT_LIMIT);
+         continue;
+      }
+
+      if (pgagroal_json_iterator_create((struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS), &iter) == 0)
+      {
+         while (pgagroal_json_iterator_next(iter))
+         {
+            row = NULL;
+            if (pgagroal_json_clone((struct json*)iter->value->data, &row) == 0)
+            {
+               pgagroal_json_append(connections, (uintptr_t)row, ValueJSON);
+            }
+         }
+         pgagroal_json_iterator_destroy(iter);
+         iter = NULL;
+      }
+
+      pgagroal_json_destroy(page);
+      page = NULL;
+   }
+
+   if (MANAGEMENT_OUTPUT_FORMAT_RAW != output_format)
+   {
+      translate_json_object(read);
+   }
+
+   if (MANAGEMENT_OUTPUT_FORMAT_TEXT == output_format)
+   {
+      pgagroal_json_print(read, FORMAT_TEXT);
+   }
+   else
+   {
+      pgagroal_json_print(read, FORMAT_JSON);
    }
 
+   pgagroal_json_destroy(read);
+
    return 0;
 
 error:
 
+   if (page_socket != -1 && page_socket != socket)
+   {
+      pgagroal_disconnect(page_socket);
+   }
+
+   pgagroal_json_destroy(page);
+   pgagroal_json_destroy(read);
+
    return 1;
 }
 
@@ -1256,6 +1670,26 @@ error:
    return 1;
 }
 
+static int
+clear_auth_query(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   if (pgagroal_management_request_clear_auth_query(ssl, socket, compression, encryption, output_format))
+   {
+      goto error;
+   }
+
+   if (process_result(ssl, socket, output_format))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
 static int
 switch_to(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
@@ -1276,6 +1710,60 @@ error:
    return 1;
 }
 
+static int
+tracker(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   if (pgagroal_management_request_tracker(ssl, socket, compression, encryption, output_format))
+   {
+      goto error;
+   }
+
+   if (process_result(ssl, socket, output_format))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+flight_recorder(SSL* ssl, int socket, char* slot, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   char* end = NULL;
+   long s = -1;
+
+   if (slot != NULL && strcmp(slot, "all"))
+   {
+      errno = 0;
+      s = strtol(slot, &end, 10);
+      if (errno != 0 || end == slot || *end != '\0' || s < 0 || s > INT32_MAX)
+      {
+         warnx("pgagroal-cli: Invalid slot %s", slot);
+         goto error;
+      }
+   }
+
+   if (pgagroal_management_request_flight_recorder(ssl, socket, (int32_t)s, compression, encryption, output_format))
+   {
+      goto error;
+   }
+
+   if (process_result(ssl, socket, output_format))
+   {
+      goto error;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
 static int
 reload(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
@@ -2086,6 +2574,9 @@ translate_command(int32_t cmd_code)
       case MANAGEMENT_CLEAR_SERVER:
          command_output = pgagroal_append(command_output, COMMAND_CLEAR_SERVER);
          break;
+      case MANAGEMENT_CLEAR_AUTH_QUERY:
+         command_output = pgagroal_append(command_output, COMMAND_CLEARAUTHQUERY);
+         break;
       case MANAGEMENT_SHUTDOWN:
          command_output = pgagroal_append(command_output, COMMAND_SHUTDOWN);
          break;
@@ -2095,6 +2586,12 @@ translate_command(int32_t cmd_code)
       case MANAGEMENT_SWITCH_TO:
          command_output = pgagroal_append(command_output, COMMAND_SWITCH_TO);
          break;
+      case MANAGEMENT_TRACKER:
+         command_output = pgagroal_append(command_output, COMMAND_TRACKER);
+         break;
+      case MANAGEMENT_FLIGHT_RECORDER:
+         command_output = pgagroal_append(command_output, COMMAND_FLIGHTRECORDER);
+         break;
       default:
          break;
    }
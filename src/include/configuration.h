@@ -91,6 +91,7 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_LOG_ROTATION_SIZE                      "log_rotation_size"
 #define CONFIGURATION_ARGUMENT_LOG_LINE_PREFIX                        "log_line_prefix"
 #define CONFIGURATION_ARGUMENT_LOG_MODE                               "log_mode"
+#define CONFIGURATION_ARGUMENT_LOG_FORMAT                             "log_format"
 #define CONFIGURATION_ARGUMENT_LOG_CONNECTIONS                        "log_connections"
 #define CONFIGURATION_ARGUMENT_LOG_DISCONNECTIONS                     "log_disconnections"
 #define CONFIGURATION_ARGUMENT_BLOCKING_TIMEOUT                       "blocking_timeout"
@@ -113,6 +114,8 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_AUTHENTICATION_TIMEOUT                 "authentication_timeout"
 #define CONFIGURATION_ARGUMENT_PIPELINE                               "pipeline"
 #define CONFIGURATION_ARGUMENT_AUTH_QUERY                             "auth_query"
+#define CONFIGURATION_ARGUMENT_AUTH_QUERY_CACHE_TTL                   "auth_query_cache_ttl"
+#define CONFIGURATION_ARGUMENT_AUTH_QUERY_NEGATIVE_TTL                "auth_query_negative_ttl"
 #define CONFIGURATION_ARGUMENT_FAILOVER                               "failover"
 #define CONFIGURATION_ARGUMENT_FAILOVER_SCRIPT                        "failover_script"
 #define CONFIGURATION_ARGUMENT_FAILOVER_NOTIFY_SCRIPT                 "failover_notify_script"
@@ -127,8 +130,20 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_KEEP_ALIVE                             "keep_alive"
 #define CONFIGURATION_ARGUMENT_NODELAY                                "nodelay"
 #define CONFIGURATION_ARGUMENT_BACKLOG                                "backlog"
+#define CONFIGURATION_ARGUMENT_MAX_PENDING_CLIENTS                    "max_pending_clients"
+#define CONFIGURATION_ARGUMENT_BUSY_POLL                              "busy_poll"
+#define CONFIGURATION_ARGUMENT_EV_STATS                               "ev_stats"
+#define CONFIGURATION_ARGUMENT_DNS_CACHE_TTL                          "dns_cache_ttl"
+#define CONFIGURATION_ARGUMENT_CONNECT_TIMEOUT                        "connect_timeout"
+#define CONFIGURATION_ARGUMENT_TLS_SESSION_TICKETS                    "tls_session_tickets"
+#define CONFIGURATION_ARGUMENT_TLS_TICKET_LIFETIME                    "tls_ticket_lifetime"
 #define CONFIGURATION_ARGUMENT_HUGEPAGE                               "hugepage"
 #define CONFIGURATION_ARGUMENT_TRACKER                                "tracker"
+#define CONFIGURATION_ARGUMENT_TRACKER_EVENTS                         "tracker_events"
+#define CONFIGURATION_ARGUMENT_FLIGHT_RECORDER                        "flight_recorder"
+#define CONFIGURATION_ARGUMENT_FLIGHT_RECORDER_THRESHOLD              "flight_recorder_threshold"
+#define CONFIGURATION_ARGUMENT_LOG_QUEUE                              "log_queue"
+#define CONFIGURATION_ARGUMENT_MANAGEMENT_IDLE_TIMEOUT                "management_idle_timeout"
 #define CONFIGURATION_ARGUMENT_TRACK_PREPARED_STATEMENTS              "track_prepared_statements"
 #define CONFIGURATION_ARGUMENT_SERVER_RESET_QUERY                     "server_reset_query"
 #define CONFIGURATION_ARGUMENT_SERVER_RESET_QUERY_ALWAYS              "server_reset_query_always"
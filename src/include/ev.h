@@ -46,6 +46,7 @@ extern "C" {
 #include <signal.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -66,10 +67,14 @@ extern "C" {
 #define EXPERIMENTAL_FEATURE_IOVECS                 0
 #define PGAGROAL_CONTEXT_MAIN                       0
 #define PGAGROAL_CONTEXT_VAULT                      1
+#define PGAGROAL_CONTEXT_WORKER                     2
 
 #define ALIGNMENT                                   sysconf(_SC_PAGESIZE)
 #define MAX_EVENTS                                  32
+#define MAX_ACCEPT_BATCH                            64
 #define INITIAL_BUFFER_COUNT                        1
+#define FIXED_FILES_NR                              (2 * MAX_EVENTS)
+#define FIXED_BUFFERS_NR                            MAX_EVENTS
 #if HAVE_LINUX
 #define PGAGROAL_NSIG _NSIG
 #else
@@ -102,6 +107,7 @@ enum event_type {
    PGAGROAL_EVENT_TYPE_WORKER,
    PGAGROAL_EVENT_TYPE_SIGNAL,
    PGAGROAL_EVENT_TYPE_PERIODIC,
+   PGAGROAL_EVENT_TYPE_CLIENT,
 };
 
 /* Defines return codes for event operations */
@@ -147,7 +153,16 @@ struct io_watcher
       int __fds[2];
    } fds;                                  /**< Set of file descriptors used for I/O */
    bool ssl;                               /**< Indicates if SSL/TLS is used on this connection. */
+   bool writable;                          /**< A client watcher is also called when the descriptor can be written */
    struct message* msg;                    /**< Per-watcher message buffer to avoid global state races */
+#if HAVE_LINUX && HAVE_IO_URING
+   struct
+   {
+      int rcv; /**< Registered file index of the receive descriptor */
+      int snd; /**< Registered file index of the send descriptor */
+      int buf; /**< Registered buffer index of the message buffer */
+   } fixed;    /**< io_uring registered resources, only valid while owned in the loop */
+#endif
    void (*cb)(struct io_watcher* watcher); /**< Event callback. */
 };
 
@@ -185,6 +200,27 @@ struct periodic_watcher
    void (*cb)(void);  /**< Event callback. */
 };
 
+/**
+ * @struct event_loop_stats
+ * @brief Event loop counters of the process.
+ *
+ * Collected without atomics by the owning process and published to
+ * shared memory (see pgagroal_prometheus_event_loop()) about once a second.
+ */
+struct event_loop_stats
+{
+   uint64_t iterations;                                   /**< The number of loop wakeups */
+   uint64_t events;                                       /**< The number of dispatched events */
+   uint64_t wait_time;                                    /**< Time blocked waiting for events (us) */
+   uint64_t busy_time;                                    /**< Time spent handling events (us) */
+   uint64_t sends;                                        /**< The number of send operations */
+   uint64_t partial_sends;                                /**< The number of sends that needed another round */
+   uint64_t events_per_wakeup[EV_STATS_WAKEUP_BUCKETS];   /**< Histogram of events per wakeup */
+   uint64_t callback_time[EV_STATS_CALLBACK_BUCKETS];     /**< Histogram of callback durations */
+   uint64_t callback_time_sum;                            /**< Total callback duration (us) */
+   uint64_t published;                                    /**< Time of the last publish (us) */
+};
+
 /**
  * @struct event_loop
  * @brief Main event loop structure.
@@ -211,6 +247,17 @@ struct event_loop
    struct io_uring ring_rcv; /**< io_uring ring for receive operations */
    struct io_uring ring_snd; /**< io_uring ring for send operations (separate to avoid CQE mixing) */
    int bid;                  /**< Next buffer id */
+
+   struct
+   {
+      bool files;                                      /**< The registered file table is available */
+      bool buffers;                                    /**< The registered buffer table is available */
+      bool send_buffers;                               /**< The kernel accepts registered buffers for send */
+      int fds[FIXED_FILES_NR];                         /**< Descriptors in the registered file table, -1 if free */
+      struct io_watcher* file_owners[FIXED_FILES_NR];  /**< Watcher owning each registered file slot */
+      void* bufs[FIXED_BUFFERS_NR];                    /**< Buffers in the registered buffer table */
+      struct io_watcher* buf_owners[FIXED_BUFFERS_NR]; /**< Watcher owning each registered buffer slot */
+   } fixed;                                            /**< io_uring registered files and buffers */
 #if EXPERIMENTAL_FEATURE_IOVECS
    /* XXX: Test with iovecs for send/recv io_uring */
    int iovecs_nr;
@@ -225,6 +272,8 @@ struct event_loop
    void* buffer;       /**< Pointer to a buffer used to read in bytes. */
    pid_t owner_pid;    /**< PID of the process that owns this event loop instance. */
    atomic_bool forked; /**< True in children after pgagroal_event_loop_fork() is called. */
+   bool stats_enabled;            /**< Collect event loop metrics */
+   struct event_loop_stats stats; /**< Event loop metrics */
 };
 
 /**
@@ -305,6 +354,20 @@ pgagroal_event_accept_init(struct io_watcher* watcher, int fd, io_cb cb);
 int
 pgagroal_event_worker_init(struct io_watcher* watcher, int rcv_fd, int snd_fd, io_cb cb);
 
+/**
+ * Initialize the watcher for read readiness of a client socket in the main
+ * loop. The callback does its own non-blocking I/O, and is only called again
+ * once more data arrives. Set writable before the watcher is started to also
+ * be called when the descriptor can be written again, once a send has filled
+ * the socket buffer. These watchers don't count against MAX_EVENTS
+ * @param watcher Pointer to the io event watcher struct
+ * @param fd The client descriptor
+ * @param cb Callback executed when the descriptor becomes readable
+ * @return Return code
+ */
+int
+pgagroal_event_client_init(struct io_watcher* watcher, int fd, io_cb cb);
+
 /**
  * Start the watcher for an IO event in the event loop
  * @param loop Pointer to the event loop struct
@@ -442,7 +505,7 @@ pgagroal_wait_recv(void);
 
 /**
  * Set the execution context for event loop initialization
- * @param context PGAGROAL_CONTEXT_MAIN or PGAGROAL_CONTEXT_VAULT
+ * @param context PGAGROAL_CONTEXT_MAIN, PGAGROAL_CONTEXT_WORKER or PGAGROAL_CONTEXT_VAULT
  */
 void pgagroal_event_set_context(int context);
 
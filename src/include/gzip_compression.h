@@ -33,6 +33,7 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 /**
@@ -55,6 +56,35 @@ pgagroal_gzip_string(char* s, unsigned char** buffer, size_t* buffer_size);
 int
 pgagroal_gunzip_string(unsigned char* compressed_buffer, size_t compressed_size, char** output_string);
 
+/**
+ * Create a GZip stream
+ * @param stream The stream
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_gzip_stream_create(void** stream);
+
+/**
+ * GZip data into a stream. The compressed data may be empty
+ * until enough data has been given, or the stream is finished
+ * @param stream The stream
+ * @param data The data
+ * @param length The length of the data
+ * @param finish Is this the end of the data
+ * @param buffer The point to the compressed data buffer
+ * @param buffer_size The size of the compressed buffer will be stored.
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_gzip_stream(void* stream, void* data, size_t length, bool finish, unsigned char** buffer, size_t* buffer_size);
+
+/**
+ * Destroy a GZip stream
+ * @param stream The stream
+ */
+void
+pgagroal_gzip_stream_destroy(void* stream);
+
 #ifdef __cplusplus
 }
 #endif
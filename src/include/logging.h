@@ -35,7 +35,10 @@ extern "C" {
 
 #include <utils.h>
 
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 #define PGAGROAL_LOGGING_TYPE_CONSOLE            0
 #define PGAGROAL_LOGGING_TYPE_FILE               1
@@ -54,10 +57,20 @@ extern "C" {
 #define PGAGROAL_LOGGING_MODE_CREATE             0
 #define PGAGROAL_LOGGING_MODE_APPEND             1
 
+#define PGAGROAL_LOGGING_FORMAT_TEXT             0
+#define PGAGROAL_LOGGING_FORMAT_JSON             1
+#define PGAGROAL_LOGGING_FORMAT_LOGFMT           2
+
 #define PGAGROAL_LOGGING_ROTATION_DISABLED       0
 
 #define PGAGROAL_LOGGING_DEFAULT_LOG_LINE_PREFIX "%Y-%m-%d %H:%M:%S"
 
+#define PGAGROAL_LOGGING_QUEUES                  8
+#define PGAGROAL_LOGGING_FILE_LENGTH             32
+#define PGAGROAL_LOGGING_NAME_LENGTH             64
+#define PGAGROAL_LOGGING_EVENT_LENGTH            24
+#define PGAGROAL_LOGGING_MESSAGE_LENGTH          768
+
 #define pgagroal_log_trace(...)                  pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_DEBUG5, __FILE__, __LINE__, __VA_ARGS__)
 #define pgagroal_log_debug(...)                  pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_DEBUG1, __FILE__, __LINE__, __VA_ARGS__)
 #define pgagroal_log_info(...)                   pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_INFO, __FILE__, __LINE__, __VA_ARGS__)
@@ -65,12 +78,57 @@ extern "C" {
 #define pgagroal_log_error(...)                  pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_ERROR, __FILE__, __LINE__, __VA_ARGS__)
 #define pgagroal_log_fatal(...)                  pgagroal_log_line(PGAGROAL_LOGGING_LEVEL_FATAL, __FILE__, __LINE__, __VA_ARGS__)
 
+#define pgagroal_log_event_info(event, duration, ...) pgagroal_log_event(PGAGROAL_LOGGING_LEVEL_INFO, __FILE__, __LINE__, event, duration, __VA_ARGS__)
+#define pgagroal_log_event_warn(event, duration, ...) pgagroal_log_event(PGAGROAL_LOGGING_LEVEL_WARN, __FILE__, __LINE__, event, duration, __VA_ARGS__)
+
 #ifdef DEBUG
 #define PGAGROAL_LOG_POSTGRES(x) pgagroal_log_postgres(x)
 #else
 #define PGAGROAL_LOG_POSTGRES(x) ((void)(x))
 #endif
 
+/** @struct log_entry
+ * Defines a log line in a log queue
+ */
+struct log_entry
+{
+   atomic_ullong sequence;                        /**< The position the entry is ready for */
+   time_t time;                                   /**< The time of the line */
+   int64_t duration;                              /**< The duration in milliseconds, or -1 */
+   int32_t millis;                                /**< The milliseconds of the time */
+   int32_t level;                                 /**< The level */
+   int32_t line;                                  /**< The line number */
+   int32_t length;                                /**< The length of the message */
+   int32_t pid;                                   /**< The process identifier */
+   int32_t slot;                                  /**< The slot, or -1 */
+   atomic_int owner;                              /**< The process filling the entry, or 0 */
+   char file[PGAGROAL_LOGGING_FILE_LENGTH];       /**< The file name */
+   char username[PGAGROAL_LOGGING_NAME_LENGTH];   /**< The user name, or empty */
+   char database[PGAGROAL_LOGGING_NAME_LENGTH];   /**< The database, or empty */
+   char event[PGAGROAL_LOGGING_EVENT_LENGTH];     /**< The event, or empty */
+   char message[PGAGROAL_LOGGING_MESSAGE_LENGTH]; /**< The message */
+} __attribute__((aligned(64)));
+
+/** @struct log_queue
+ * Defines a log queue, filled by the processes that log and emptied by the log writer
+ */
+struct log_queue
+{
+   atomic_ullong tail; /**< The next position for a line */
+   uint64_t head;      /**< The next position for the log writer */
+} __attribute__((aligned(64)));
+
+/** @struct log_queues
+ * Defines the log queues, followed by their entries
+ */
+struct log_queues
+{
+   atomic_bool running;                              /**< Is the log writer accepting lines */
+   atomic_ullong dropped;                            /**< The number of dropped lines */
+   uint64_t size;                                    /**< The number of entries of a queue */
+   struct log_queue queues[PGAGROAL_LOGGING_QUEUES]; /**< The queues */
+} __attribute__((aligned(64)));
+
 /**
  * Initialize the logging system
  * @return 0 upon success, otherwise 1
@@ -103,6 +161,59 @@ pgagroal_stop_logging(void);
 void
 pgagroal_log_line(int level, char* file, int line, char* fmt, ...);
 
+/**
+ * Create the log queues
+ * @param p_size The resulting size of the shared memory segment
+ * @param p_shmem The resulting shared memory segment
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_log_queue_init(size_t* p_size, void** p_shmem);
+
+/**
+ * Accept or refuse log lines in the log queues.
+ * When refused the processes write their log lines themselves
+ * @param enable Accept the log lines
+ */
+void
+pgagroal_log_queue_enable(bool enable);
+
+/**
+ * Get the number of log lines dropped because a log queue was full
+ * @return The number of lines
+ */
+uint64_t
+pgagroal_log_queue_dropped(void);
+
+/**
+ * Write the log lines of the log queues until they are refused
+ * and empty. This function doesn't return
+ */
+void
+pgagroal_log_writer(void);
+
+/**
+ * Log a line for an event. The event and the duration are
+ * fields of their own in the json and logfmt log formats
+ * @param level The level
+ * @param file The file
+ * @param line The line number
+ * @param event The event
+ * @param duration The duration in milliseconds, or -1
+ * @param fmt The formatting code
+ */
+void
+pgagroal_log_event(int level, char* file, int line, char* event, int64_t duration, char* fmt, ...);
+
+/**
+ * Set the connection of the log lines of this process
+ * @param slot The slot, or -1
+ * @param username The user name, or NULL to keep it
+ * @param database The database, or NULL to keep it
+ */
+void
+pgagroal_log_context(int slot, char* username, char* database);
+
 /**
  * Log a memory segment
  * @param data The data
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGAGROAL_LOGGING_INTERNAL_H
+#define PGAGROAL_LOGGING_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <logging.h>
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** @struct log_stall
+ * Defines the log writer view of an entry that was taken but not filled
+ */
+struct log_stall
+{
+   time_t since;       /**< When the head entry was found unfilled, or 0 */
+   uint64_t abandoned; /**< The sequence of the abandoned entry, or 0 */
+};
+
+/**
+ * Format a log line in the json or logfmt log format. The strings are
+ * escaped, and cut such that the line always ends within the buffer
+ * @param entry The log line
+ * @param format The log format
+ * @param buffer The buffer
+ * @param size The size of the buffer
+ * @return The length of the formatted line
+ */
+size_t
+pgagroal_log_entry_format(struct log_entry* entry, int format, char* buffer, size_t size);
+
+/**
+ * Get an entry of a log queue
+ * @param queues The log queues
+ * @param queue The queue
+ * @param position The position
+ * @return The entry
+ */
+struct log_entry*
+pgagroal_log_queue_entry(struct log_queues* queues, int queue, uint64_t position);
+
+/**
+ * Add a log line to the queue of the process
+ * @param level The level
+ * @param file The file
+ * @param line The line number
+ * @param event The event, or NULL
+ * @param duration The duration in milliseconds, or -1
+ * @param fmt The format
+ * @param ap The arguments
+ * @return True if the line was queued or counted as dropped, false if the
+ *         process must write it itself
+ */
+bool
+pgagroal_log_queue_add(int level, char* file, int line, char* event, int64_t duration, char* fmt, va_list ap);
+
+/**
+ * Write the filled entries at the head of a log queue, and skip an entry
+ * that stays unfilled
+ * @param queues The log queues
+ * @param queue The queue
+ * @param stall The log writer view of the queue
+ * @return The number of lines written
+ */
+int
+pgagroal_log_queue_write(struct log_queues* queues, int queue, struct log_stall* stall);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
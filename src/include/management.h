@@ -67,37 +67,45 @@ extern "C" {
 /**
  * Management commands
  */
-#define MANAGEMENT_UNKNOWN         0
-#define MANAGEMENT_CANCEL_SHUTDOWN 1
-#define MANAGEMENT_CONFIG_LS       2
-#define MANAGEMENT_CONFIG_GET      3
-#define MANAGEMENT_CONFIG_SET      4
-#define MANAGEMENT_DETAILS         5
-#define MANAGEMENT_DISABLEDB       6
-#define MANAGEMENT_ENABLEDB        7
-#define MANAGEMENT_FLUSH           8
-#define MANAGEMENT_GET_PASSWORD    9
-#define MANAGEMENT_GRACEFULLY      10
-#define MANAGEMENT_PING            11
-#define MANAGEMENT_RELOAD          12
-#define MANAGEMENT_CLEAR           13
-#define MANAGEMENT_CLEAR_SERVER    14
-#define MANAGEMENT_SHUTDOWN        15
-#define MANAGEMENT_STATUS          16
-#define MANAGEMENT_SWITCH_TO       17
-#define MANAGEMENT_CONFIG_ALIAS    18
-
-#define MANAGEMENT_MASTER_KEY      19
-#define MANAGEMENT_ADD_USER        20
-#define MANAGEMENT_UPDATE_USER     21
-#define MANAGEMENT_REMOVE_USER     22
-#define MANAGEMENT_LIST_USERS      23
+#define MANAGEMENT_UNKNOWN          0
+#define MANAGEMENT_CANCEL_SHUTDOWN  1
+#define MANAGEMENT_CONFIG_LS        2
+#define MANAGEMENT_CONFIG_GET       3
+#define MANAGEMENT_CONFIG_SET       4
+#define MANAGEMENT_DETAILS          5
+#define MANAGEMENT_DISABLEDB        6
+#define MANAGEMENT_ENABLEDB         7
+#define MANAGEMENT_FLUSH            8
+#define MANAGEMENT_GET_PASSWORD     9
+#define MANAGEMENT_GRACEFULLY       10
+#define MANAGEMENT_PING             11
+#define MANAGEMENT_RELOAD           12
+#define MANAGEMENT_CLEAR            13
+#define MANAGEMENT_CLEAR_SERVER     14
+#define MANAGEMENT_SHUTDOWN         15
+#define MANAGEMENT_STATUS           16
+#define MANAGEMENT_SWITCH_TO        17
+#define MANAGEMENT_CONFIG_ALIAS     18
+
+#define MANAGEMENT_MASTER_KEY       19
+#define MANAGEMENT_ADD_USER         20
+#define MANAGEMENT_UPDATE_USER      21
+#define MANAGEMENT_REMOVE_USER      22
+#define MANAGEMENT_LIST_USERS       23
+
+#define MANAGEMENT_CLEAR_AUTH_QUERY 24
+
+#define MANAGEMENT_TRACKER          25
+#define MANAGEMENT_FLIGHT_RECORDER  26
+
 /**
  * Management arguments
  */
 #define MANAGEMENT_ARGUMENT_ACTIVE_CONNECTIONS  "ActiveConnections"
 #define MANAGEMENT_ARGUMENT_APPNAME             "AppName"
 #define MANAGEMENT_ARGUMENT_BEHIND              "Behind"
+#define MANAGEMENT_ARGUMENT_BUSY_TIME           "BusyTime"
+#define MANAGEMENT_ARGUMENT_CALLBACK_TIME       "CallbackTime"
 #define MANAGEMENT_ARGUMENT_CLIENT_VERSION      "ClientVersion"
 #define MANAGEMENT_ARGUMENT_COMMAND             "Command"
 #define MANAGEMENT_ARGUMENT_COMPRESSION         "Compression"
@@ -106,29 +114,48 @@ extern "C" {
 #define MANAGEMENT_ARGUMENT_CONNECTIONS         "Connections"
 #define MANAGEMENT_ARGUMENT_DATABASE            "Database"
 #define MANAGEMENT_ARGUMENT_DATABASES           "Databases"
+#define MANAGEMENT_ARGUMENT_DIRECTION           "Direction"
 #define MANAGEMENT_ARGUMENT_ENABLED             "Enabled"
 #define MANAGEMENT_ARGUMENT_ENCRYPTION          "Encryption"
 #define MANAGEMENT_ARGUMENT_ERROR               "Error"
+#define MANAGEMENT_ARGUMENT_EVENT               "Event"
+#define MANAGEMENT_ARGUMENT_EVENT_LOOP          "EventLoop"
+#define MANAGEMENT_ARGUMENT_EVENTS              "Events"
 #define MANAGEMENT_ARGUMENT_FD                  "FD"
 #define MANAGEMENT_ARGUMENT_HOST                "Host"
 #define MANAGEMENT_ARGUMENT_INITIAL_CONNECTIONS "InitialConnections"
+#define MANAGEMENT_ARGUMENT_ITERATIONS          "Iterations"
+#define MANAGEMENT_ARGUMENT_KIND                "Kind"
+#define MANAGEMENT_ARGUMENT_LENGTH              "Length"
+#define MANAGEMENT_ARGUMENT_LIMIT               "Limit"
 #define MANAGEMENT_ARGUMENT_LIMITS              "Limits"
+#define MANAGEMENT_ARGUMENT_LIMIT_RULE          "LimitRule"
 #define MANAGEMENT_ARGUMENT_MAJOR_VERSION       "MajorVersion"
 #define MANAGEMENT_ARGUMENT_MAX_CONNECTIONS     "MaxConnections"
 #define MANAGEMENT_ARGUMENT_MIN_CONNECTIONS     "MinConnections"
 #define MANAGEMENT_ARGUMENT_MODE                "Mode"
+#define MANAGEMENT_ARGUMENT_NEW                 "New"
+#define MANAGEMENT_ARGUMENT_NEXT_OFFSET         "NextOffset"
 #define MANAGEMENT_ARGUMENT_TIMEOUT             "Timeout"
 #define MANAGEMENT_ARGUMENT_NUMBER_OF_SERVERS   "NumberOfServers"
+#define MANAGEMENT_ARGUMENT_OFFSET              "Offset"
 #define MANAGEMENT_ARGUMENT_SPLIT_BRAIN         "SplitBrain"
 #define MANAGEMENT_ARGUMENT_OUTPUT              "Output"
+#define MANAGEMENT_ARGUMENT_PARTIAL_SENDS       "PartialSends"
 #define MANAGEMENT_ARGUMENT_PASSWORD            "Password"
 #define MANAGEMENT_ARGUMENT_PID                 "PID"
 #define MANAGEMENT_ARGUMENT_PORT                "Port"
 #define MANAGEMENT_ARGUMENT_PRIMARY             "Primary"
+#define MANAGEMENT_ARGUMENT_REQUEST_ID          "RequestId"
 #define MANAGEMENT_ARGUMENT_RESTART             "Restart"
+#define MANAGEMENT_ARGUMENT_SENDS               "Sends"
 #define MANAGEMENT_ARGUMENT_SERVER              "Server"
 #define MANAGEMENT_ARGUMENT_SERVERS             "Servers"
 #define MANAGEMENT_ARGUMENT_SERVER_VERSION      "ServerVersion"
+#define MANAGEMENT_ARGUMENT_SECURITY            "Security"
+#define MANAGEMENT_ARGUMENT_SLOT                "Slot"
+#define MANAGEMENT_ARGUMENT_SLOTS               "Slots"
+#define MANAGEMENT_ARGUMENT_SOCKET              "Socket"
 #define MANAGEMENT_ARGUMENT_START_TIME          "StartTime"
 #define MANAGEMENT_ARGUMENT_STATE               "State"
 #define MANAGEMENT_ARGUMENT_SYSTEM_IDENTIFIER   "SystemIdentifier"
@@ -137,7 +164,9 @@ extern "C" {
 #define MANAGEMENT_ARGUMENT_TIME                "Time"
 #define MANAGEMENT_ARGUMENT_TIMESTAMP           "Timestamp"
 #define MANAGEMENT_ARGUMENT_TOTAL_CONNECTIONS   "TotalConnections"
+#define MANAGEMENT_ARGUMENT_TX_MODE             "TxMode"
 #define MANAGEMENT_ARGUMENT_USERNAME            "Username"
+#define MANAGEMENT_ARGUMENT_WAIT_TIME           "WaitTime"
 #define MANAGEMENT_ARGUMENT_STANDBYS            "Standbys"
 #define MANAGEMENT_ARGUMENT_STREAMING           "Streaming"
 #define MANAGEMENT_ARGUMENT_WAL_RECEIVER_STATUS "WALReceiverStatus"
@@ -181,6 +210,15 @@ extern "C" {
 
 #define MANAGEMENT_ERROR_SWITCH_TO_FAILED                   1300
 
+#define MANAGEMENT_ERROR_TRACKER_NOFORK                     1400
+#define MANAGEMENT_ERROR_TRACKER_NETWORK                    1401
+#define MANAGEMENT_ERROR_TRACKER_DISABLED                   1402
+
+#define MANAGEMENT_ERROR_FLIGHT_RECORDER_NOFORK             1500
+#define MANAGEMENT_ERROR_FLIGHT_RECORDER_NETWORK            1501
+#define MANAGEMENT_ERROR_FLIGHT_RECORDER_DISABLED           1502
+#define MANAGEMENT_ERROR_FLIGHT_RECORDER_SLOT               1503
+
 /**
  * Output formats
  */
@@ -330,13 +368,18 @@ pgagroal_management_request_status(SSL* ssl, int socket, uint8_t compression, ui
  * Management operation: Details
  * @param ssl The SSL connection
  * @param socket The socket
+ * @param state The connection state filter, or NULL
+ * @param username The username filter, or NULL
+ * @param database The database filter, or NULL
+ * @param offset The slot to start from
+ * @param limit The maximum number of connections, or 0 for all
  * @param compression The compress method for wire protocol
  * @param encryption The encrypt method for wire protocol (None or *_GCM)
  * @param output_format The output format
  * @return 0 upon success, otherwise 1
  */
 int
-pgagroal_management_request_details(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
+pgagroal_management_request_details(SSL* ssl, int socket, char* state, char* username, char* database, int64_t offset, int64_t limit, uint8_t compression, uint8_t encryption, int32_t output_format);
 
 /**
  * Management operation: isalive
@@ -374,6 +417,43 @@ pgagroal_management_request_clear(SSL* ssl, int socket, uint8_t compression, uin
 int
 pgagroal_management_request_clear_server(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format);
 
+/**
+ * Management operation: Clear the auth_query cache
+ * @param ssl The SSL connection
+ * @param socket The socket
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol (None or *_GCM)
+ * @param output_format The output format
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_management_request_clear_auth_query(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
+
+/**
+ * Management operation: Dump the tracker events
+ * @param ssl The SSL connection
+ * @param socket The socket
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol (None or *_GCM)
+ * @param output_format The output format
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_management_request_tracker(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format);
+
+/**
+ * Management operation: Dump the flight recorder
+ * @param ssl The SSL connection
+ * @param socket The socket
+ * @param slot The slot, or -1 for all slots
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol (None or *_GCM)
+ * @param output_format The output format
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_management_request_flight_recorder(SSL* ssl, int socket, int32_t slot, uint8_t compression, uint8_t encryption, int32_t output_format);
+
 /**
  * Management operation: Switch to
  * @param ssl The SSL connection
@@ -81,6 +81,25 @@ pgagroal_remove_unix_socket(const char* directory, const char* file);
 int
 pgagroal_connect(const char* hostname, int port, int* fd, bool keep_alive, bool no_delay);
 
+/**
+ * Connect to a configured server. The addresses are taken from the
+ * shared DNS cache when dns_cache_ttl is set, and all resolved addresses
+ * are tried in parallel with a short stagger (happy eyeballs)
+ * @param server The server index
+ * @param fd The resulting descriptor
+ * @param keep_alive Use keep alive
+ * @param no_delay Use NODELAY
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_connect_server(int server, int* fd, bool keep_alive, bool no_delay);
+
+/**
+ * Refresh the cached addresses of all servers
+ */
+void
+pgagroal_resolve_servers(void);
+
 /**
  * Connect to a Unix Domain Socket
  * @param directory The directory
@@ -132,6 +151,15 @@ pgagroal_get_address(struct sockaddr* sa, char* address, size_t length);
 int
 pgagroal_tcp_nodelay(int fd);
 
+/**
+ * Apply SO_BUSY_POLL to a descriptor
+ * @param fd The descriptor
+ * @param usec The busy poll budget in microseconds, 0 to skip
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_socket_busy_poll(int fd, int usec);
+
 /**
  * Does the socket have an error associated
  * @param fd The descriptor
@@ -40,6 +40,7 @@ extern "C" {
 #if HAVE_OPENBSD
 #include <sys/limits.h>
 #endif
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <openssl/ssl.h>
 
@@ -85,6 +86,7 @@ extern "C" {
 #define DEFAULT_BACKGROUND_INTERVAL              300
 #define DEFAULT_HEALTH_CHECK_PERIOD              30
 #define DEFAULT_HEALTH_CHECK_TIMEOUT             5
+#define DEFAULT_MAX_PENDING_CLIENTS              256
 #define DEFAULT_AUTHENTICATION_TIMEOUT           5
 
 #define MAX_USERNAME_LENGTH                      128
@@ -101,6 +103,13 @@ extern "C" {
 #define MAX_PATH                                 1024
 #define MISC_LENGTH                              128
 #define NUMBER_OF_SERVERS                        64
+#define MAX_SERVER_ADDRESSES                     8
+#define MAX_PENDING_CLIENTS                      1024
+#define CONNECT_ATTEMPT_DELAY                    250
+#define NUMBER_OF_TLS_TICKET_KEYS                2
+#define SCRAM_KEY_LENGTH                         32
+#define SCRAM_SALT_LENGTH                        16
+#define MAX_SHADOW_LENGTH                        256
 #ifdef DEBUG
 #define MAX_NUMBER_OF_CONNECTIONS 8
 #else
@@ -111,6 +120,7 @@ extern "C" {
 #define NUMBER_OF_USERS                                64
 #define NUMBER_OF_ADMINS                               8
 #define NUMBER_OF_DISABLED                             64
+#define NUMBER_OF_AUTH_QUERY_ENTRIES                   256
 
 #define NUMBER_OF_SECURITY_MESSAGES                    5
 
@@ -175,6 +185,21 @@ extern "C" {
 #define VALIDATION_BACKGROUND                          2
 
 #define HISTOGRAM_BUCKETS                              18
+#define PROMETHEUS_SHARDS                              64
+#define LATENCY_HISTOGRAM_BUCKETS                      44
+#define NUMBER_OF_TRAFFIC_ENTRIES                      128
+#define MAX_FLIGHT_RECORDER                            4096
+
+#define METRICS_ENCODING_NONE                          0
+#define METRICS_ENCODING_GZIP                          1
+#define METRICS_ENCODING_ZSTD                          2
+#define METRICS_ENCODINGS                              3
+
+#define EV_STATS_ROLE_MAIN                             0
+#define EV_STATS_ROLE_WORKER                           1
+#define EV_STATS_ROLES                                 2
+#define EV_STATS_WAKEUP_BUCKETS                        7
+#define EV_STATS_CALLBACK_BUCKETS                      10
 
 #define HUGEPAGE_OFF                                   0
 #define HUGEPAGE_TRY                                   1
@@ -391,6 +416,54 @@ extern void* prometheus_shmem;
  */
 extern void* prometheus_cache_shmem;
 
+/**
+ * The shared memory segment for the tracker events
+ */
+extern void* tracker_shmem;
+
+/**
+ * The shared memory segment for the flight recorder
+ */
+extern void* recorder_shmem;
+
+/**
+ * The shared memory segment for the log queues
+ */
+extern void* log_shmem;
+
+/** @struct tls_ticket_key
+ * Defines a TLS session ticket key shared by all processes
+ */
+struct tls_ticket_key
+{
+   unsigned char name[16];     /**< The key name carried in the ticket */
+   unsigned char aes_key[32];  /**< The AES-256-CBC key */
+   unsigned char hmac_key[32]; /**< The HMAC-SHA256 key */
+   time_t created;             /**< When the key was generated (0 = unused) */
+};
+
+/** @struct auth_query_entry
+ * Defines a cached auth_query result
+ */
+struct auth_query_entry
+{
+   atomic_schar lock;                  /**< Protects the entry */
+   bool found;                         /**< Was a shadow entry returned */
+   time_t expires;                     /**< When the entry expires (0 = unused) */
+   char username[MAX_USERNAME_LENGTH]; /**< The user name */
+   char database[MAX_DATABASE_LENGTH]; /**< The database */
+   char shadow[MAX_SHADOW_LENGTH];     /**< The shadow entry */
+} __attribute__((aligned(64)));
+
+/** @struct server_address
+ * Defines a resolved server address
+ */
+struct server_address
+{
+   socklen_t length;                /**< The length of the address */
+   struct sockaddr_storage address; /**< The address */
+};
+
 /** @struct server
  * Defines a server
  */
@@ -414,6 +487,11 @@ struct server
    unsigned int failures;         /**< The number of failures */
    atomic_schar auth_type;        /**< The authentication type used for health check */
    int lineno;                    /**< The line number within the configuration file */
+
+   atomic_schar dns_lock;                                 /**< Protects the resolved addresses */
+   time_t dns_expire;                                     /**< When the resolved addresses expire */
+   int number_of_addresses;                               /**< The number of resolved addresses */
+   struct server_address addresses[MAX_SERVER_ADDRESSES]; /**< The resolved addresses */
 } __attribute__((aligned(64)));
 
 #define FOREACH_SERVER for (int i = 0; i < config->number_of_servers; i++)
@@ -490,8 +568,14 @@ struct limit
  */
 struct user
 {
-   char username[MAX_USERNAME_LENGTH]; /**< The user name */
-   char password[MAX_PASSWORD_LENGTH]; /**< The password */
+   char username[MAX_USERNAME_LENGTH];               /**< The user name */
+   char password[MAX_PASSWORD_LENGTH];               /**< The password */
+   atomic_schar scram_lock;                          /**< Protects the SCRAM keys */
+   bool scram_valid;                                 /**< Are the SCRAM keys valid */
+   unsigned char scram_password[SCRAM_KEY_LENGTH];   /**< SHA-256 of the password the keys belong to */
+   char scram_salt[SCRAM_SALT_LENGTH];               /**< The SCRAM salt */
+   unsigned char scram_stored_key[SCRAM_KEY_LENGTH]; /**< The SCRAM StoredKey */
+   unsigned char scram_server_key[SCRAM_KEY_LENGTH]; /**< The SCRAM ServerKey */
 } __attribute__((aligned(64)));
 
 /** @struct vault_server
@@ -556,26 +640,91 @@ struct prometheus_connection
    atomic_ullong query_count; /**< The number of queries per connection */
 } __attribute__((aligned(64)));
 
+/** @struct prometheus_shard
+ * Defines a shard of the hot Prometheus counters. Each worker
+ * updates its own shard, and the shards are summed at scrape time
+ */
+struct prometheus_shard
+{
+   atomic_ullong query_count;      /**< The number of queries */
+   atomic_ullong tx_count;         /**< The number of transactions */
+   atomic_ullong network_sent;     /**< The bytes sent by clients */
+   atomic_ullong network_received; /**< The bytes received from servers */
+} __attribute__((aligned(64)));
+
+/** @struct prometheus_traffic
+ * Defines the traffic of a database or a user. The entries are claimed
+ * on first use and kept until restart
+ */
+struct prometheus_traffic
+{
+   atomic_schar state;             /**< The state of the entry */
+   atomic_ullong bytes_sent;       /**< The bytes sent by clients */
+   atomic_ullong bytes_received;   /**< The bytes received from servers */
+   atomic_ullong queries;          /**< The number of queries */
+   atomic_ullong transactions;     /**< The number of transactions */
+   atomic_ullong errors;           /**< The number of errors */
+   char name[MAX_DATABASE_LENGTH]; /**< The database or user name */
+} __attribute__((aligned(64)));
+
+/** @struct prometheus_latency
+ * Defines a log-linear latency histogram in microseconds. The first
+ * bucket holds up to 16us, then every power of two is split in two
+ * buckets, and the last bucket is +Inf
+ */
+struct prometheus_latency
+{
+   atomic_ullong buckets[LATENCY_HISTOGRAM_BUCKETS]; /**< The histogram buckets */
+   atomic_ullong sum;                                /**< The total time (us) */
+} __attribute__((aligned(64)));
+
+/** @struct prometheus_event_loop
+ * Defines the event loop metrics of the main or the worker processes
+ */
+struct prometheus_event_loop
+{
+   atomic_ullong iterations;                                /**< The number of loop wakeups */
+   atomic_ullong events;                                    /**< The number of dispatched events */
+   atomic_ullong wait_time;                                 /**< Time blocked waiting for events (us) */
+   atomic_ullong busy_time;                                 /**< Time spent handling events (us) */
+   atomic_ullong sends;                                     /**< The number of send operations */
+   atomic_ullong partial_sends;                             /**< The number of sends that needed another round */
+   atomic_ullong events_per_wakeup[EV_STATS_WAKEUP_BUCKETS]; /**< Histogram of events per wakeup */
+   atomic_ullong callback_time[EV_STATS_CALLBACK_BUCKETS];   /**< Histogram of callback durations */
+   atomic_ullong callback_time_sum;                         /**< Total callback duration (us) */
+} __attribute__((aligned(64)));
+
 /** @struct prometheus_cache
  * A structure to handle the Prometheus response
  * so that it is possible to serve the very same
  * response over and over depending on the cache
  * settings.
  *
+ * The response is double-buffered: readers copy the
+ * `current` buffer without taking a lock, and check its
+ * `sequence`, which is odd while the buffer is written,
+ * before and after the copy. Only the process holding
+ * `lock` renders the other buffer and publishes it.
+ *
  * The `valid_until` field stores the result
  * of `time(2)`.
  *
- * The cache is protected by the `lock` field.
+ * Each buffer holds the plain response, and the same
+ * response in each of the compressed encodings.
  *
- * The `size` field stores the size of the allocated
- * `data` payload.
+ * The `size` field stores the size of each buffer
+ * in the `data` payload.
  */
 struct prometheus_cache
 {
-   time_t valid_until; /**< when the cache will become not valid */
-   atomic_schar lock;  /**< lock to protect the cache */
-   size_t size;        /**< size of the cache */
-   char data[];        /**< the payload */
+   atomic_llong valid_until;                  /**< when the cache will become not valid */
+   atomic_schar lock;                         /**< elects the process refreshing the cache */
+   atomic_int current;                        /**< the published buffer, or -1 */
+   atomic_ulong generation;                   /**< bumped on invalidation, a refresh started before is discarded */
+   atomic_ulong sequence[2];                  /**< the sequence of each buffer, odd while written */
+   atomic_ulong length[METRICS_ENCODINGS][2]; /**< the length of each buffer per encoding, 0 if not available */
+   size_t size;                               /**< size of each buffer */
+   char data[];                               /**< the payload */
 } __attribute__((aligned(64)));
 
 /** @struct prometheus
@@ -628,15 +777,19 @@ struct main_prometheus
    atomic_ulong client_active;    /**< The number of active clients */
    atomic_ulong client_wait_time; /**< The time the client waits */
 
-   atomic_ullong query_count; /**< The number of queries */
-   atomic_ullong tx_count;    /**< The number of transactions */
+   struct prometheus_shard shards[PROMETHEUS_SHARDS]; /**< The sharded counters */
 
-   atomic_ullong network_sent;     /**< The bytes sent by clients */
-   atomic_ullong network_received; /**< The bytes received from servers */
+   struct prometheus_latency acquire_time[NUMBER_OF_LIMITS + 1]; /**< Connection acquisition wait, index 0 is without a limit */
+   struct prometheus_latency connect_time[NUMBER_OF_LIMITS + 1]; /**< Backend connect time, index 0 is without a limit */
+   struct prometheus_latency auth_time[NUMBER_OF_LIMITS + 1];    /**< Authentication time, index 0 is without a limit */
+
+   struct prometheus_traffic databases[NUMBER_OF_TRAFFIC_ENTRIES + 1]; /**< Traffic per database, the last entry is the overflow */
+   struct prometheus_traffic users[NUMBER_OF_TRAFFIC_ENTRIES + 1];     /**< Traffic per user, the last entry is the overflow */
 
    atomic_ulong server_error[NUMBER_OF_SERVERS];          /**< The number of errors for a server */
    atomic_ulong failed_servers;                           /**< The number of failed servers */
    struct certificate_metrics cert_metrics;               /**< TLS certificate metrics */
+   struct prometheus_event_loop event_loop[EV_STATS_ROLES]; /**< Event loop metrics (main, worker) */
    struct prometheus_connection prometheus_connections[]; /**< The number of prometheus connections (FMA) */
 
 } __attribute__((aligned(64)));
@@ -666,6 +819,7 @@ struct configuration
    bool log_connections;               /**< Log successful logins */
    bool log_disconnections;            /**< Log disconnects */
    int log_mode;                       /**< The logging mode */
+   int log_format;                     /**< The logging format */
    unsigned int log_rotation_size;     /**< bytes to force log rotation */
    pgagroal_time_t log_rotation_age;   /**< The duration of log rotation age (Default seconds) */
    char log_line_prefix[MISC_LENGTH];  /**< The logging prefix */
@@ -729,7 +883,9 @@ struct main_configuration
 
    unsigned int update_process_title; /**< Behaviour for updating the process title */
 
-   bool authquery; /**< Is authentication query enabled */
+   bool authquery;                          /**< Is authentication query enabled */
+   pgagroal_time_t auth_query_cache_ttl;    /**< How long auth_query results are cached */
+   pgagroal_time_t auth_query_negative_ttl; /**< How long unknown users are cached by auth_query */
 
    atomic_ushort active_connections; /**< The active number of connections */
    int max_connections;              /**< The maximum number of connections */
@@ -755,12 +911,24 @@ struct main_configuration
    bool disconnect_client_force;                     /**< Force a disconnect client if active for more than the specified seconds */
    char pidfile[MAX_PATH];                           /**< File containing the PID */
 
-   int ev_backend;                 /**< Selected ev backend */
-   bool keep_alive;                /**< Use keep alive */
-   bool nodelay;                   /**< Use NODELAY */
-   int backlog;                    /**< The backlog for listen */
-   bool tracker;                   /**< Tracker support */
-   bool track_prepared_statements; /**< Track prepared statements (transaction pooling) */
+   int ev_backend;                      /**< Selected ev backend */
+   bool keep_alive;                     /**< Use keep alive */
+   bool nodelay;                        /**< Use NODELAY */
+   int backlog;                         /**< The backlog for listen */
+   int max_pending_clients;             /**< The number of clients held until their startup packet arrives */
+   int busy_poll;                       /**< Busy poll budget in microseconds (0 = off) */
+   bool ev_stats;                       /**< Collect event loop metrics */
+   pgagroal_time_t dns_cache_ttl;       /**< How long resolved server addresses are cached (0 = off) */
+   pgagroal_time_t connect_timeout;     /**< Timeout for establishing a server connection (0 = system default) */
+   bool tls_session_tickets;            /**< Issue TLS session tickets to clients */
+   pgagroal_time_t tls_ticket_lifetime; /**< The rotation interval of the TLS ticket keys */
+   bool tracker;                        /**< Tracker support */
+   int tracker_events;                  /**< The number of events in the tracker ring */
+   int flight_recorder;                 /**< The number of protocol events recorded per slot */
+   int flight_recorder_threshold;       /**< The transaction duration (ms) that logs the flight recorder */
+   int log_queue;                       /**< The number of log lines queued for the log writer */
+   pgagroal_time_t management_idle_timeout; /**< The idle time of a remote management session */
+   bool track_prepared_statements;      /**< Track prepared statements (transaction pooling) */
 
    char server_reset_query[MISC_LENGTH]; /**< Statement run on a backend connection before it is reused (transaction pooling) */
    bool server_reset_query_always;       /**< Also run server_reset_query in session pooling */
@@ -771,6 +939,12 @@ struct main_configuration
 
    atomic_schar su_connection; /**< The superuser connection */
 
+   atomic_schar tls_ticket_lock;                                     /**< Protects the TLS ticket keys */
+   int tls_ticket_key;                                               /**< The current TLS ticket key */
+   struct tls_ticket_key tls_ticket_keys[NUMBER_OF_TLS_TICKET_KEYS]; /**< The TLS ticket keys */
+
+   struct auth_query_entry auth_query_cache[NUMBER_OF_AUTH_QUERY_ENTRIES]; /**< The auth_query cache */
+
    int number_of_servers;        /**< The number of servers */
    int number_of_hbas;           /**< The number of HBA entries */
    int number_of_limits;         /**< The number of limit entries */
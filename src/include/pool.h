@@ -68,7 +68,8 @@ long
 pgagroal_pool_next_retry_delay(long current_ns, int cap_ms);
 
 /**
- * Return a connection
+ * Return a connection. A backend TLS session is parked in the slot, and
+ * the SSL connection is released in all cases
  * @param slot The slot
  * @param ssl The SSL connection (can be NULL)
  * @param transaction_mode Is the connection returned in transaction mode
@@ -36,6 +36,7 @@ extern "C" {
 
 #include <ev.h>
 #include <stdlib.h>
+#include <time.h>
 
 // Certificate type constants
 #define PGAGROAL_CERT_TYPE_MAIN    "main"
@@ -68,12 +69,53 @@ extern "C" {
 #define PROMETHEUS_DEFAULT_CACHE_SIZE (256 * 1024)
 
 /**
- * Create a prometheus instance
- * @param client_ssl The client SSL structure
- * @param fd The client descriptor
+ * The maximum number of kept alive metrics connections
+ */
+#define MAX_METRICS_CLIENTS 64
+
+/**
+ * The maximum size of a request to the metrics endpoint
+ */
+#define MAX_METRICS_REQUEST 8192
+
+/**
+ * The states of a metrics connection
+ */
+#define METRICS_CLIENT_DETECT    0
+#define METRICS_CLIENT_HANDSHAKE 1
+#define METRICS_CLIENT_REQUEST   2
+#define METRICS_CLIENT_REDIRECT  3
+
+/** @struct metrics_client
+ * Defines a kept alive connection to the metrics endpoint. The socket
+ * is non-blocking, so what can't be read or written yet is kept here
+ * until the watcher is called again
+ */
+struct metrics_client
+{
+   struct io_watcher watcher;       /**< The I/O (always first) */
+   bool active;                     /**< Is the entry in use */
+   bool closing;                    /**< Is the connection closed once the output is sent */
+   int state;                       /**< The state of the connection */
+   int fd;                          /**< The client descriptor */
+   SSL* ssl;                        /**< The client SSL structure */
+   time_t deadline;                 /**< When the connection is closed if idle */
+   char input[MAX_METRICS_REQUEST]; /**< The bytes read, which can hold the start of the next request */
+   size_t input_length;             /**< The length of the bytes read */
+   char* output;                    /**< The bytes that couldn't be sent yet */
+   size_t output_offset;            /**< The offset of the first byte not sent */
+   size_t output_length;            /**< The length of the output */
+   size_t output_size;              /**< The allocated size of the output */
+};
+
+/**
+ * Run the metrics worker. It serves the metrics endpoint from its
+ * own event loop, and keeps the connections alive between scrapes
+ * @param fds The metrics descriptors
+ * @param length The number of descriptors
  */
 void
-pgagroal_prometheus(SSL* client_ssl, int fd);
+pgagroal_prometheus_worker(int* fds, int length);
 
 /**
  * Create a prometheus instance for vault
@@ -95,6 +137,30 @@ pgagroal_init_prometheus(size_t* p_size, void** p_shmem);
 int
 pgagroal_vault_init_prometheus(size_t* p_size, void** p_shmem);
 
+/**
+ * Add a connection acquisition wait to the histogram
+ * @param limit The limit rule, or -1
+ * @param us The wait in microseconds
+ */
+void
+pgagroal_prometheus_acquire_time(int limit, uint64_t us);
+
+/**
+ * Add a server connect time to the histogram
+ * @param limit The limit rule, or -1
+ * @param us The time in microseconds
+ */
+void
+pgagroal_prometheus_connect_time(int limit, uint64_t us);
+
+/**
+ * Add an authentication time to the histogram
+ * @param limit The limit rule, or -1
+ * @param us The time in microseconds
+ */
+void
+pgagroal_prometheus_auth_time(int limit, uint64_t us);
+
 /**
  * Add session time information
  * @param time The time
@@ -248,6 +314,12 @@ pgagroal_prometheus_client_active_add(void);
 void
 pgagroal_prometheus_client_active_sub(void);
 
+/**
+ * Select the counter shard of the current process
+ */
+void
+pgagroal_prometheus_shard_select(void);
+
 /**
  * Increase query_count by 1
  */
@@ -288,6 +360,26 @@ pgagroal_prometheus_network_sent_add(ssize_t s);
 void
 pgagroal_prometheus_network_received_add(ssize_t s);
 
+/**
+ * Select the traffic entries of the current process
+ * @param database The database
+ * @param username The user name
+ */
+void
+pgagroal_prometheus_traffic_select(char* database, char* username);
+
+/**
+ * Increase the errors of the current database and user
+ */
+void
+pgagroal_prometheus_traffic_error_add(void);
+
+/**
+ * Flush the pending traffic of the current process
+ */
+void
+pgagroal_prometheus_traffic_flush(void);
+
 /**
  * Increase client_sockets by 1
  */
@@ -331,6 +423,14 @@ pgagroal_prometheus_server_error(int server);
 void
 pgagroal_prometheus_failed_servers(void);
 
+/**
+ * Add the event loop counters of a process
+ * @param role EV_STATS_ROLE_MAIN or EV_STATS_ROLE_WORKER
+ * @param stats The counters collected since the last call
+ */
+void
+pgagroal_prometheus_event_loop(int role, struct event_loop_stats* stats);
+
 /**
  * Add a logging count
  * @param logging The logging type
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGAGROAL_RECORDER_H
+#define PGAGROAL_RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgagroal.h>
+#include <json.h>
+
+#include <stdlib.h>
+
+#define RECORDER_CLIENT 'F'
+#define RECORDER_SERVER 'B'
+
+/** @struct recorder_event
+ * Defines a protocol message seen on a slot
+ */
+struct recorder_event
+{
+   int64_t timestamp; /**< The time of the message (us) */
+   int32_t length;    /**< The length of the message */
+   int32_t pid;       /**< The process identifier of the client */
+   char kind;         /**< The kind of the message */
+   char direction;    /**< The direction, RECORDER_CLIENT or RECORDER_SERVER */
+};
+
+/** @struct recorder
+ * Defines the flight recorder of a slot. The events follow the
+ * structure in shared memory
+ */
+struct recorder
+{
+   atomic_ullong head; /**< The position of the next event */
+} __attribute__((aligned(64)));
+
+/**
+ * Create the shared memory of the flight recorder
+ * @param p_size The resulting size
+ * @param p_shmem The resulting shared memory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_recorder_init(size_t* p_size, void** p_shmem);
+
+/**
+ * Read the clock for the messages of a network read
+ */
+void
+pgagroal_recorder_clock(void);
+
+/**
+ * Record a protocol message
+ * @param slot The slot
+ * @param direction The direction
+ * @param kind The kind of the message
+ * @param length The length of the message
+ */
+void
+pgagroal_recorder_add(int slot, char direction, char kind, int length);
+
+/**
+ * Record a ReadyForQuery message, and log the flight recorder of the
+ * slot when the transaction took longer than flight_recorder_threshold
+ * @param slot The slot
+ * @param tx_state The transaction state
+ */
+void
+pgagroal_recorder_ready(int slot, char tx_state);
+
+/**
+ * Dump the flight recorder to a management client
+ * @param ssl The SSL connection
+ * @param client_fd The client
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol (None or *_GCM)
+ * @param payload The payload
+ */
+void
+pgagroal_recorder_dump(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
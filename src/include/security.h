@@ -148,6 +148,37 @@ pgagroal_generate_password(int password_length, char** password);
 int
 accept_ssl_vault(struct vault_configuration* config, int client_fd, SSL** c_ssl);
 
+/**
+ * Resume the backend TLS session parked in a slot. The carrier SSL is never
+ * handshaken; only the imported record layer moves traffic
+ * @param slot The slot
+ * @param server_ssl The resulting SSL structure
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_resume_backend_tls(int slot, SSL** server_ssl);
+
+/**
+ * Compile the HBA entries into the indexes used to authorize clients. Called
+ * in the main process at startup and after a reload, so every fork() inherits
+ * the result
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_hba_compile(void);
+
+/**
+ * Release the compiled HBA entries
+ */
+void
+pgagroal_hba_destroy(void);
+
+/**
+ * Drop all cached auth_query results
+ */
+void
+pgagroal_auth_query_cache_clear(void);
+
 /**
  * Close a SSL structure
  * @param ssl The SSL structure
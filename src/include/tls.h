@@ -48,6 +48,11 @@ extern "C" {
 #define PGAGROAL_TLS_AEAD_AES_128_GCM 1
 #define PGAGROAL_TLS_AEAD_AES_256_GCM 2
 
+/* The server-role contexts shared across workers */
+#define PGAGROAL_TLS_CTX_FRONTEND 0
+#define PGAGROAL_TLS_CTX_METRICS  1
+#define PGAGROAL_TLS_CTX_SIZE     2
+
 /* Maximum size of one TLS 1.3 record on the wire (header + 2^14 + expansion) */
 #define PGAGROAL_TLS_RECORD_MAX 16645
 
@@ -299,6 +304,62 @@ pgagroal_create_ssl_server(SSL_CTX* ctx, char* key_file, char* cert_file, char*
 int
 pgagroal_create_ssl_client(SSL_CTX* ctx, char* key, char* cert, char* root, int socket, SSL** ssl);
 
+/**
+ * Build the frontend, metrics and backend SSL contexts once in the main
+ * process. Workers inherit them through fork(), so the certificate, key
+ * and CA files are not parsed per connection. Any previous contexts are
+ * released; connections still using them keep their own reference
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tls_contexts_init(void);
+
+/**
+ * Have any of the certificate, key or CA files changed since the
+ * contexts were built
+ * @return True if changed, otherwise false
+ */
+bool
+pgagroal_tls_contexts_changed(void);
+
+/**
+ * Release the shared SSL contexts
+ */
+void
+pgagroal_tls_contexts_destroy(void);
+
+/**
+ * Get a configured server-role SSL context. The shared context is used
+ * when available, otherwise a new one is built. The caller owns one
+ * reference to the result
+ * @param type The context type (PGAGROAL_TLS_CTX_*)
+ * @param ctx The resulting SSL context
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tls_server_ctx(int type, SSL_CTX** ctx);
+
+/**
+ * Get a configured client-role SSL context for a backend server. The
+ * shared context is used when available, otherwise a new one is built.
+ * The caller owns one reference to the result
+ * @param server The server index
+ * @param ctx The resulting SSL context
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tls_client_ctx(int server, SSL_CTX** ctx);
+
+/**
+ * Create a SSL server on a socket from a server-role context
+ * @param type The context type (PGAGROAL_TLS_CTX_*)
+ * @param socket The socket
+ * @param ssl The SSL structure
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tls_create_ssl_server(int type, int socket, SSL** ssl);
+
 /**
  * Harvest the negotiated TLS 1.3 record state (cipher + application traffic
  * secrets) from a completed handshake into a serializable record context. The
@@ -34,6 +34,7 @@ extern "C" {
 #endif
 
 #include <pgagroal.h>
+#include <json.h>
 
 #include <stdlib.h>
 
@@ -74,6 +75,52 @@ extern "C" {
 #define TRACKER_SOCKET_DISASSOCIATE_CLIENT 102
 #define TRACKER_SOCKET_DISASSOCIATE_SERVER 103
 
+#define TRACKER_NAME_LENGTH                32
+#define TRACKER_APPNAME_LENGTH             16
+
+/** @struct tracker_event
+ * Defines a tracker event. An event is written in place in the ring, and
+ * its sequence is zero while it is written
+ */
+struct tracker_event
+{
+   atomic_ullong sequence;               /**< The position of the event plus one */
+   int64_t timestamp;                    /**< The time of the event (us) */
+   int32_t pid;                          /**< The process identifier */
+   int32_t slot;                         /**< The slot, -1 if none */
+   int32_t socket;                       /**< The socket, or the server socket of the slot */
+   int32_t server;                       /**< The server of the slot, or the primary */
+   int32_t active_connections;           /**< The number of active connections */
+   int16_t id;                           /**< The event identifier */
+   int16_t limit_rule;                   /**< The limit rule of the slot */
+   int8_t state;                         /**< The state of the slot */
+   int8_t new;                           /**< Is the connection new */
+   int8_t tx_mode;                       /**< The transaction mode of the slot */
+   int8_t has_security;                  /**< The security of the slot */
+   char username[TRACKER_NAME_LENGTH];   /**< The user name, truncated */
+   char database[TRACKER_NAME_LENGTH];   /**< The database, truncated */
+   char appname[TRACKER_APPNAME_LENGTH]; /**< The application name, truncated */
+} __attribute__((aligned(64)));
+
+/** @struct tracker_ring
+ * Defines the ring of tracker events in shared memory
+ */
+struct tracker_ring
+{
+   atomic_ullong head;            /**< The position of the next event */
+   uint64_t size;                 /**< The number of events, a power of two */
+   struct tracker_event events[]; /**< The events */
+} __attribute__((aligned(64)));
+
+/**
+ * Create the shared memory of the tracker ring
+ * @param p_size The resulting size
+ * @param p_shmem The resulting shared memory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgagroal_tracker_init(size_t* p_size, void** p_shmem);
+
 /**
  * Tracking event: Basic
  * @param id The event identifier
@@ -99,6 +146,17 @@ pgagroal_tracking_event_slot(int id, int slot);
 void
 pgagroal_tracking_event_socket(int id, int socket);
 
+/**
+ * Dump the tracker events to a management client
+ * @param ssl The SSL connection
+ * @param client_fd The client
+ * @param compression The compress method for wire protocol
+ * @param encryption The encrypt method for wire protocol (None or *_GCM)
+ * @param payload The payload
+ */
+void
+pgagroal_tracker_dump(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryption, struct json* payload);
+
 #ifdef __cplusplus
 }
 #endif
@@ -56,6 +56,21 @@ struct accept_io
    char** argv;               /**< The argv */
 };
 
+/** @struct pending_client
+ * Defines a client whose startup packet hasn't arrived yet
+ */
+struct pending_client
+{
+   struct io_watcher watcher;        /**< The I/O (always first) */
+   bool active;                      /**< Is the entry in use */
+   int state;                        /**< The handshake state */
+   int fd;                           /**< The client descriptor */
+   int32_t length;                   /**< The length of the startup packet */
+   time_t deadline;                  /**< When the client is dropped */
+   char** argv;                      /**< The argv */
+   char address[MAX_ADDRESS_LENGTH]; /**< The client address */
+};
+
 /** @struct client
  * Defines the client structure
  */
@@ -386,6 +401,13 @@ pgagroal_set_proc_title(int argc, char** argv, char* s1, char* s2);
 void
 pgagroal_set_connection_proc_title(int argc, char** argv, struct connection* connection);
 
+/**
+ * Get the monotonic clock in microseconds
+ * @return The microseconds
+ */
+uint64_t
+pgagroal_monotonic_us(void);
+
 /**
  * Get the timestramp difference as a string
  * @param start_time The start time
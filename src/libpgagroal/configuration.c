@@ -47,6 +47,7 @@
 #include <errno.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -78,6 +79,7 @@ int pgagroal_as_bool(char* str, bool* b);
 int pgagroal_as_logging_type(char* str, int* type);
 int pgagroal_as_logging_level(char* str);
 int pgagroal_as_logging_mode(char* str, int* mode);
+int pgagroal_as_logging_format(char* str, int* format);
 
 int pgagroal_as_logging_rotation_size(char* str, unsigned int* size);
 int pgagroal_as_validation(char* str, int* val);
@@ -133,6 +135,7 @@ static int to_hugepage(char* where, int value);
 static int to_channel_binding(char* where, int value);
 static int to_pipeline(char* where, int value);
 static int to_log_mode(char* where, int value);
+static int to_log_format(char* where, int value);
 static int to_log_level(char* where, int value);
 static int to_log_type(char* where, int value);
 int to_server_reset_query_behavior_on_failure(char* where, int value);
@@ -173,6 +176,8 @@ pgagroal_init_configuration(void* shm)
    config->console = 0;
    config->pipeline = PIPELINE_AUTO;
    config->authquery = false;
+   config->auth_query_cache_ttl = PGAGROAL_TIME_DISABLED;
+   config->auth_query_negative_ttl = PGAGROAL_TIME_DISABLED;
    config->blocking_timeout = PGAGROAL_TIME_SEC(DEFAULT_BLOCKING_TIMEOUT);
    config->connection_retry_delay = DEFAULT_CONNECTION_RETRY_DELAY;
    config->idle_timeout = PGAGROAL_TIME_SEC(DEFAULT_IDLE_TIMEOUT);
@@ -198,8 +203,20 @@ pgagroal_init_configuration(void* shm)
    config->keep_alive = true;
    config->nodelay = true;
    config->backlog = -1;
+   config->max_pending_clients = DEFAULT_MAX_PENDING_CLIENTS;
+   config->busy_poll = 0;
+   config->ev_stats = false;
+   config->dns_cache_ttl = PGAGROAL_TIME_DISABLED;
+   config->connect_timeout = PGAGROAL_TIME_DISABLED;
+   config->tls_session_tickets = false;
+   config->tls_ticket_lifetime = PGAGROAL_TIME_HOUR(1);
    config->common.hugepage = HUGEPAGE_TRY;
    config->tracker = false;
+   config->tracker_events = 16384;
+   config->flight_recorder = 0;
+   config->flight_recorder_threshold = 0;
+   config->log_queue = 0;
+   config->management_idle_timeout = PGAGROAL_TIME_SEC(60);
    config->track_prepared_statements = false;
    pgagroal_snprintf(config->server_reset_query, MISC_LENGTH, "DISCARD ALL");
    config->server_reset_query_always = false;
@@ -212,6 +229,7 @@ pgagroal_init_configuration(void* shm)
    config->common.log_connections = false;
    config->common.log_disconnections = false;
    config->common.log_mode = PGAGROAL_LOGGING_MODE_APPEND;
+   config->common.log_format = PGAGROAL_LOGGING_FORMAT_TEXT;
    atomic_init(&config->common.log_lock, STATE_FREE);
 
    memcpy(config->common.default_log_path, "pgagroal.log", strlen("pgagroal.log"));
@@ -492,6 +510,22 @@ pgagroal_validate_configuration(void* shm, bool has_unix_socket, bool has_main_s
       config->backlog = MAX(config->max_connections / 4, 16);
    }
 
+   if (config->max_pending_clients < 0)
+   {
+      config->max_pending_clients = 0;
+   }
+
+   if (config->max_pending_clients > MAX_PENDING_CLIENTS)
+   {
+      pgagroal_log_warn("pgagroal: max_pending_clients (%d) is greater than allowed (%d)", config->max_pending_clients, MAX_PENDING_CLIENTS);
+      config->max_pending_clients = MAX_PENDING_CLIENTS;
+   }
+
+   if (config->busy_poll < 0)
+   {
+      config->busy_poll = 0;
+   }
+
    if (!pgagroal_time_is_valid(config->common.authentication_timeout))
    {
       config->common.authentication_timeout = PGAGROAL_TIME_SEC(DEFAULT_AUTHENTICATION_TIMEOUT);
@@ -551,6 +585,12 @@ pgagroal_validate_configuration(void* shm, bool has_unix_socket, bool has_main_s
       config->max_connections = MAX_NUMBER_OF_CONNECTIONS;
    }
 
+   if (config->flight_recorder > MAX_FLIGHT_RECORDER)
+   {
+      pgagroal_log_warn("pgagroal: flight_recorder (%d) is greater than allowed (%d)", config->flight_recorder, MAX_FLIGHT_RECORDER);
+      config->flight_recorder = MAX_FLIGHT_RECORDER;
+   }
+
    if (config->health_check && pgagroal_time_convert(config->health_check_period, FORMAT_TIME_S) < HEALTH_CHECK_MIN_INTERVAL)
    {
       pgagroal_log_warn("pgagroal: health_check_period is invalid (< %d), disabling health check", HEALTH_CHECK_MIN_INTERVAL);
@@ -955,6 +995,7 @@ pgagroal_vault_init_configuration(void* shm)
    config->common.log_connections = false;
    config->common.log_disconnections = false;
    config->common.log_mode = PGAGROAL_LOGGING_MODE_APPEND;
+   config->common.log_format = PGAGROAL_LOGGING_FORMAT_TEXT;
    atomic_init(&config->common.log_lock, STATE_FREE);
    config->ev_backend = PGAGROAL_EVENT_BACKEND_AUTO;
    memcpy(config->common.default_log_path, "pgagroal-vault.log", strlen("pgagroal-vault.log"));
@@ -2948,6 +2989,30 @@ pgagroal_as_logging_mode(char* str, int* mode)
    return 1;
 }
 
+int
+pgagroal_as_logging_format(char* str, int* format)
+{
+   if (!strcasecmp(str, "text"))
+   {
+      *format = PGAGROAL_LOGGING_FORMAT_TEXT;
+      return 0;
+   }
+
+   if (!strcasecmp(str, "json"))
+   {
+      *format = PGAGROAL_LOGGING_FORMAT_JSON;
+      return 0;
+   }
+
+   if (!strcasecmp(str, "logfmt"))
+   {
+      *format = PGAGROAL_LOGGING_FORMAT_LOGFMT;
+      return 0;
+   }
+
+   return 1;
+}
+
 int
 pgagroal_as_validation(char* str, int* val)
 {
@@ -3665,6 +3730,26 @@ check_restart_required(struct main_configuration* config, struct main_configurat
    {
       restart = true;
    }
+   if (restart_int("log_queue", config->log_queue, reload->log_queue))
+   {
+      restart = true;
+   }
+   if (restart_int("flight_recorder", config->flight_recorder, reload->flight_recorder))
+   {
+      restart = true;
+   }
+   if (restart_int("tracker_events", config->tracker_events, reload->tracker_events))
+   {
+      restart = true;
+   }
+   if (restart_int("max_pending_clients", config->max_pending_clients, reload->max_pending_clients))
+   {
+      restart = true;
+   }
+   if (restart_int("busy_poll", config->busy_poll, reload->busy_poll))
+   {
+      restart = true;
+   }
    if (restart_string("unix_socket_dir", config->unix_socket_dir, reload->unix_socket_dir, false))
    {
       restart = true;
@@ -3753,6 +3838,7 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
    /* log_type */
    config->common.log_type = reload->common.log_type;
    config->common.log_level = reload->common.log_level;
+   config->common.log_format = reload->common.log_format;
 
    /* log_path */
    if (strncmp(config->common.log_path, reload->common.log_path, MISC_LENGTH) ||
@@ -3773,6 +3859,8 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
    config->common.log_connections = reload->common.log_connections;
    config->common.log_disconnections = reload->common.log_disconnections;
    config->authquery = reload->authquery;
+   memcpy(&config->auth_query_cache_ttl, &reload->auth_query_cache_ttl, sizeof(config->auth_query_cache_ttl));
+   memcpy(&config->auth_query_negative_ttl, &reload->auth_query_negative_ttl, sizeof(config->auth_query_negative_ttl));
 
    config->common.tls = reload->common.tls;
    memcpy(config->common.tls_cert_file, reload->common.tls_cert_file, MAX_PATH);
@@ -3816,8 +3904,20 @@ transfer_configuration(struct main_configuration* config, struct main_configurat
    config->keep_alive = reload->keep_alive;
    config->nodelay = reload->nodelay;
    config->backlog = reload->backlog;
+   config->max_pending_clients = reload->max_pending_clients;
+   config->busy_poll = reload->busy_poll;
+   config->ev_stats = reload->ev_stats;
+   memcpy(&config->dns_cache_ttl, &reload->dns_cache_ttl, sizeof(config->dns_cache_ttl));
+   memcpy(&config->connect_timeout, &reload->connect_timeout, sizeof(config->connect_timeout));
+   config->tls_session_tickets = reload->tls_session_tickets;
+   memcpy(&config->tls_ticket_lifetime, &reload->tls_ticket_lifetime, sizeof(config->tls_ticket_lifetime));
    config->common.hugepage = reload->common.hugepage;
    config->tracker = reload->tracker;
+   config->tracker_events = reload->tracker_events;
+   config->flight_recorder = reload->flight_recorder;
+   config->flight_recorder_threshold = reload->flight_recorder_threshold;
+   config->log_queue = reload->log_queue;
+   memcpy(&config->management_idle_timeout, &reload->management_idle_timeout, sizeof(config->management_idle_timeout));
    config->track_prepared_statements = reload->track_prepared_statements;
    memcpy(config->server_reset_query, reload->server_reset_query, MISC_LENGTH);
    config->server_reset_query_always = reload->server_reset_query_always;
@@ -4047,9 +4147,12 @@ copy_server(struct server* dst, struct server* src)
    int version;
    int minor_version;
    char system_identifier[sizeof(dst->system_identifier)];
+   signed char free;
+   bool same;
 
    // check the server cloned "seems" the same
-   if (is_same_server(dst, src))
+   same = is_same_server(dst, src);
+   if (same)
    {
       state = atomic_load(&dst->state);
       health_state = atomic_load(&dst->health_state);
@@ -4070,7 +4173,26 @@ copy_server(struct server* dst, struct server* src)
       memset(system_identifier, 0, sizeof(system_identifier));
    }
 
-   memset(dst, 0, sizeof(struct server));
+   /* Workers may hold dns_lock, so the resolved addresses are kept for the same server */
+   memset(dst, 0, offsetof(struct server, dns_lock));
+
+   if (!same)
+   {
+retry:
+      free = STATE_FREE;
+      if (atomic_compare_exchange_strong(&dst->dns_lock, &free, STATE_IN_USE))
+      {
+         dst->dns_expire = 0;
+         dst->number_of_addresses = 0;
+
+         atomic_store(&dst->dns_lock, STATE_FREE);
+      }
+      else
+      {
+         SLEEP_AND_GOTO(1000L, retry);
+      }
+   }
+
    memcpy(&dst->name[0], &src->name[0], MISC_LENGTH);
    memcpy(&dst->host[0], &src->host[0], MISC_LENGTH);
    dst->port = src->port;
@@ -4789,6 +4911,10 @@ pgagroal_write_config_value(char* buffer, char* config_key, size_t buffer_size)
       {
          return to_log_mode(buffer, config->common.log_mode);
       }
+      else if (!strncmp(key, "log_format", MISC_LENGTH))
+      {
+         return to_log_format(buffer, config->common.log_format);
+      }
       else if (!strncmp(key, "log_line_prefix", MISC_LENGTH))
       {
          return to_string(buffer, config->common.log_line_prefix, buffer_size);
@@ -4874,6 +5000,14 @@ pgagroal_write_config_value(char* buffer, char* config_key, size_t buffer_size)
       {
          return to_bool(buffer, config->authquery);
       }
+      else if (!strncmp(key, "auth_query_cache_ttl", MISC_LENGTH))
+      {
+         return to_int(buffer, (int)pgagroal_time_convert(config->auth_query_cache_ttl, FORMAT_TIME_S));
+      }
+      else if (!strncmp(key, "auth_query_negative_ttl", MISC_LENGTH))
+      {
+         return to_int(buffer, (int)pgagroal_time_convert(config->auth_query_negative_ttl, FORMAT_TIME_S));
+      }
       else if (!strncmp(key, "tls_ca_file", MAX_PATH))
       {
          return to_string(buffer, config->common.tls_ca_file, buffer_size);
@@ -4982,10 +5116,58 @@ pgagroal_write_config_value(char* buffer, char* config_key, size_t buffer_size)
       {
          return to_int(buffer, config->backlog);
       }
+      else if (!strncmp(key, "max_pending_clients", MISC_LENGTH))
+      {
+         return to_int(buffer, config->max_pending_clients);
+      }
+      else if (!strncmp(key, "busy_poll", MISC_LENGTH))
+      {
+         return to_int(buffer, config->busy_poll);
+      }
+      else if (!strncmp(key, "ev_stats", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->ev_stats);
+      }
+      else if (!strncmp(key, "dns_cache_ttl", MISC_LENGTH))
+      {
+         return to_int(buffer, (int)pgagroal_time_convert(config->dns_cache_ttl, FORMAT_TIME_S));
+      }
+      else if (!strncmp(key, "connect_timeout", MISC_LENGTH))
+      {
+         return to_int(buffer, (int)pgagroal_time_convert(config->connect_timeout, FORMAT_TIME_S));
+      }
+      else if (!strncmp(key, "tls_session_tickets", MISC_LENGTH))
+      {
+         return to_bool(buffer, config->tls_session_tickets);
+      }
+      else if (!strncmp(key, "tls_ticket_lifetime", MISC_LENGTH))
+      {
+         return to_int(buffer, (int)pgagroal_time_convert(config->tls_ticket_lifetime, FORMAT_TIME_S));
+      }
       else if (!strncmp(key, "hugepage", MISC_LENGTH))
       {
          return to_hugepage(buffer, config->common.hugepage);
       }
+      else if (!strncmp(key, "tracker_events", MISC_LENGTH))
+      {
+         return to_int(buffer, config->tracker_events);
+      }
+      else if (!strncmp(key, "flight_recorder", MISC_LENGTH))
+      {
+         return to_int(buffer, config->flight_recorder);
+      }
+      else if (!strncmp(key, "flight_recorder_threshold", MISC_LENGTH))
+      {
+         return to_int(buffer, config->flight_recorder_threshold);
+      }
+      else if (!strncmp(key, "log_queue", MISC_LENGTH))
+      {
+         return to_int(buffer, config->log_queue);
+      }
+      else if (!strncmp(key, "management_idle_timeout", MISC_LENGTH))
+      {
+         return to_int(buffer, (int)pgagroal_time_convert(config->management_idle_timeout, FORMAT_TIME_S));
+      }
       else if (!strncmp(key, "track_prepared_statements", MISC_LENGTH))
       {
          return to_bool(buffer, config->track_prepared_statements);
@@ -5633,6 +5815,38 @@ to_log_mode(char* where, int value)
    return 0;
 }
 
+/**
+ * An utility function to convert the enumeration of values for the log_format setting
+ * into one of its possible string descriptions.
+ *
+ * @param where the buffer used to store the stringy thing
+ * @param value the config->common.log_format setting
+ * @return 0 on success, 1 otherwise
+ */
+static int
+to_log_format(char* where, int value)
+{
+   if (!where || value < 0)
+   {
+      return 1;
+   }
+
+   switch (value)
+   {
+      case PGAGROAL_LOGGING_FORMAT_TEXT:
+         pgagroal_snprintf(where, MISC_LENGTH, "%s", "text");
+         break;
+      case PGAGROAL_LOGGING_FORMAT_JSON:
+         pgagroal_snprintf(where, MISC_LENGTH, "%s", "json");
+         break;
+      case PGAGROAL_LOGGING_FORMAT_LOGFMT:
+         pgagroal_snprintf(where, MISC_LENGTH, "%s", "logfmt");
+         break;
+   }
+
+   return 0;
+}
+
 /**
  * An utility function to convert the enumeration of values for the log_type setting
  * into one of its possible string descriptions.
@@ -5936,6 +6150,20 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("auth_query_cache_ttl", section, key, true, &unknown))
+   {
+      if (pgagroal_as_seconds(value, &config->auth_query_cache_ttl, PGAGROAL_TIME_DISABLED))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("auth_query_negative_ttl", section, key, true, &unknown))
+   {
+      if (pgagroal_as_seconds(value, &config->auth_query_negative_ttl, PGAGROAL_TIME_DISABLED))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("tls", section, key, true, NULL))
    {
       if (pgagroal_as_bool(value, &config->common.tls))
@@ -6246,6 +6474,13 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("log_format", section, key, true, &unknown))
+   {
+      if (pgagroal_as_logging_format(value, &config->common.log_format))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("max_connections", section, key, true, &unknown))
    {
       if (pgagroal_as_int(value, &config->max_connections))
@@ -6288,6 +6523,55 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("max_pending_clients", section, key, true, &unknown))
+   {
+      if (pgagroal_as_int(value, &config->max_pending_clients))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("busy_poll", section, key, true, &unknown))
+   {
+      if (pgagroal_as_int(value, &config->busy_poll))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("ev_stats", section, key, true, &unknown))
+   {
+      if (pgagroal_as_bool(value, &config->ev_stats))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("dns_cache_ttl", section, key, true, &unknown))
+   {
+      if (pgagroal_as_seconds(value, &config->dns_cache_ttl, PGAGROAL_TIME_DISABLED))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("connect_timeout", section, key, true, &unknown))
+   {
+      if (pgagroal_as_seconds(value, &config->connect_timeout, PGAGROAL_TIME_DISABLED))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("tls_session_tickets", section, key, true, &unknown))
+   {
+      if (pgagroal_as_bool(value, &config->tls_session_tickets))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("tls_ticket_lifetime", section, key, true, &unknown))
+   {
+      if (pgagroal_as_seconds(value, &config->tls_ticket_lifetime, PGAGROAL_TIME_HOUR(1)))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("hugepage", section, key, true, &unknown))
    {
       if (pgagroal_as_hugepage(value, &config->common.hugepage))
@@ -6302,6 +6586,41 @@ pgagroal_apply_main_configuration(struct main_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("tracker_events", section, key, true, &unknown))
+   {
+      if (pgagroal_as_int(value, &config->tracker_events))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("flight_recorder", section, key, true, &unknown))
+   {
+      if (pgagroal_as_int(value, &config->flight_recorder))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("flight_recorder_threshold", section, key, true, &unknown))
+   {
+      if (pgagroal_as_int(value, &config->flight_recorder_threshold))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("log_queue", section, key, true, &unknown))
+   {
+      if (pgagroal_as_int(value, &config->log_queue))
+      {
+         unknown = true;
+      }
+   }
+   else if (key_in_section("management_idle_timeout", section, key, true, &unknown))
+   {
+      if (pgagroal_as_seconds(value, &config->management_idle_timeout, PGAGROAL_TIME_SEC(60)))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("track_prepared_statements", section, key, true, &unknown))
    {
       if (pgagroal_as_bool(value, &config->track_prepared_statements))
@@ -6600,6 +6919,13 @@ pgagroal_apply_vault_configuration(struct vault_configuration* config,
          unknown = true;
       }
    }
+   else if (key_in_section("log_format", section, key, true, &unknown))
+   {
+      if (pgagroal_as_logging_format(value, &config->common.log_format))
+      {
+         unknown = true;
+      }
+   }
    else if (key_in_section("hugepage", section, key, true, &unknown))
    {
       if (pgagroal_as_hugepage(value, &config->common.hugepage))
@@ -6924,6 +7250,7 @@ add_configuration_response(struct json* res)
    pgagroal_json_put_size_value(res, CONFIGURATION_ARGUMENT_LOG_ROTATION_SIZE, config->common.log_rotation_size);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_LINE_PREFIX, (uintptr_t)config->common.log_line_prefix, ValueString);
    pgagroal_json_put_enum_value(res, CONFIGURATION_ARGUMENT_LOG_MODE, config->common.log_mode, to_log_mode);
+   pgagroal_json_put_enum_value(res, CONFIGURATION_ARGUMENT_LOG_FORMAT, config->common.log_format, to_log_format);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_CONNECTIONS, (uintptr_t)config->common.log_connections, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_DISCONNECTIONS, (uintptr_t)config->common.log_disconnections, ValueBool);
    pgagroal_json_put_time_value(res, CONFIGURATION_ARGUMENT_BLOCKING_TIMEOUT, config->blocking_timeout, FORMAT_TIME_S);
@@ -6946,6 +7273,8 @@ add_configuration_response(struct json* res)
    pgagroal_json_put_time_value(res, CONFIGURATION_ARGUMENT_AUTHENTICATION_TIMEOUT, config->common.authentication_timeout, FORMAT_TIME_S);
    pgagroal_json_put_enum_value(res, CONFIGURATION_ARGUMENT_PIPELINE, config->pipeline, to_pipeline);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_AUTH_QUERY, (uintptr_t)config->authquery, ValueBool);
+   pgagroal_json_put_time_value(res, CONFIGURATION_ARGUMENT_AUTH_QUERY_CACHE_TTL, config->auth_query_cache_ttl, FORMAT_TIME_S);
+   pgagroal_json_put_time_value(res, CONFIGURATION_ARGUMENT_AUTH_QUERY_NEGATIVE_TTL, config->auth_query_negative_ttl, FORMAT_TIME_S);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_FAILOVER, (uintptr_t)config->failover, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_FAILOVER_SCRIPT, (uintptr_t)config->failover_script, ValueString);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_FAILOVER_NOTIFY_SCRIPT, (uintptr_t)config->failover_notify_script, ValueString);
@@ -6960,8 +7289,20 @@ add_configuration_response(struct json* res)
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_KEEP_ALIVE, (uintptr_t)config->keep_alive, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_NODELAY, (uintptr_t)config->nodelay, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_BACKLOG, (uintptr_t)config->backlog, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_MAX_PENDING_CLIENTS, (uintptr_t)config->max_pending_clients, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_BUSY_POLL, (uintptr_t)config->busy_poll, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_EV_STATS, (uintptr_t)config->ev_stats, ValueBool);
+   pgagroal_json_put_time_value(res, CONFIGURATION_ARGUMENT_DNS_CACHE_TTL, config->dns_cache_ttl, FORMAT_TIME_S);
+   pgagroal_json_put_time_value(res, CONFIGURATION_ARGUMENT_CONNECT_TIMEOUT, config->connect_timeout, FORMAT_TIME_S);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_TLS_SESSION_TICKETS, (uintptr_t)config->tls_session_tickets, ValueBool);
+   pgagroal_json_put_time_value(res, CONFIGURATION_ARGUMENT_TLS_TICKET_LIFETIME, config->tls_ticket_lifetime, FORMAT_TIME_S);
    pgagroal_json_put_enum_value(res, CONFIGURATION_ARGUMENT_HUGEPAGE, config->common.hugepage, to_hugepage);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_TRACKER, (uintptr_t)config->tracker, ValueBool);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_TRACKER_EVENTS, (uintptr_t)config->tracker_events, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_FLIGHT_RECORDER, (uintptr_t)config->flight_recorder, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_FLIGHT_RECORDER_THRESHOLD, (uintptr_t)config->flight_recorder_threshold, ValueInt64);
+   pgagroal_json_put(res, CONFIGURATION_ARGUMENT_LOG_QUEUE, (uintptr_t)config->log_queue, ValueInt64);
+   pgagroal_json_put_time_value(res, CONFIGURATION_ARGUMENT_MANAGEMENT_IDLE_TIMEOUT, config->management_idle_timeout, FORMAT_TIME_S);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_TRACK_PREPARED_STATEMENTS, (uintptr_t)config->track_prepared_statements, ValueBool);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_SERVER_RESET_QUERY, (uintptr_t)config->server_reset_query, ValueString);
    pgagroal_json_put(res, CONFIGURATION_ARGUMENT_SERVER_RESET_QUERY_ALWAYS, (uintptr_t)config->server_reset_query_always, ValueBool);
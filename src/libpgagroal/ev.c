@@ -33,6 +33,7 @@
 #include <memory.h>
 #include <network.h>
 #include <pgagroal.h>
+#include <prometheus.h>
 #include <shmem.h>
 
 /* system */
@@ -43,6 +44,7 @@
 #include <netinet/in.h>
 #include <signal.h>
 #include <stdatomic.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -53,10 +55,12 @@
 #if HAVE_LINUX
 #if HAVE_IO_URING
 #include <liburing.h>
+#include <poll.h>
 #endif
 #include <netdb.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/timerfd.h>
 #else
 #include <sys/event.h>
@@ -84,12 +88,18 @@ static int (*periodic_stop)(struct periodic_watcher*);
 static int ev_io_uring_init(void);
 static int ev_io_uring_destroy(void);
 static int ev_io_uring_loop(void);
+static void ev_io_uring_busy_poll(void);
 static int ev_io_uring_fork(void);
 static int ev_io_uring_handler(struct io_uring_cqe*);
 #if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
 static int ev_io_uring_setup_buffers(void);
 #endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
 
+static int ev_io_uring_fixed_init(void);
+static int ev_io_uring_fixed_file(struct io_watcher*, int, int*);
+static int ev_io_uring_fixed_buffer(struct io_watcher*, struct message*);
+static void ev_io_uring_fixed_release(struct io_watcher*);
+
 static int ev_io_uring_io_start(struct io_watcher*);
 static int ev_io_uring_io_stop(struct io_watcher*);
 
@@ -101,6 +111,7 @@ static int ev_io_uring_periodic_stop(struct periodic_watcher*);
 static int ev_epoll_init(void);
 static int ev_epoll_destroy(void);
 static int ev_epoll_loop(void);
+static int ev_epoll_busy_poll(struct epoll_event* events);
 static int ev_epoll_fork(void);
 static int ev_epoll_handler(void*);
 
@@ -160,6 +171,131 @@ static int kqueue_flags; /* Flags for kqueue instance creation */
 #endif /* HAVE_LINUX */
 
 static int execution_context = PGAGROAL_CONTEXT_MAIN;
+static int busy_poll = 0; /* Busy poll budget in microseconds, 0 when disabled */
+
+static inline uint64_t
+ev_monotonic_us(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* Upper bounds (us) of the callback duration histogram, the last bucket is +Inf */
+static const uint64_t ev_stats_callback_bounds[EV_STATS_CALLBACK_BUCKETS - 1] = {
+   10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000
+};
+
+static void
+ev_stats_publish(void)
+{
+   int role;
+
+   role = execution_context == PGAGROAL_CONTEXT_WORKER ? EV_STATS_ROLE_WORKER : EV_STATS_ROLE_MAIN;
+
+   pgagroal_prometheus_event_loop(role, &loop->stats);
+
+   memset(&loop->stats, 0, offsetof(struct event_loop_stats, published));
+}
+
+/**
+ * Follow a reload of ev_stats. The counters of a disabled loop are
+ * published first, and an enabled loop starts from zero
+ */
+static inline void
+ev_stats_reload(void)
+{
+   bool enabled;
+
+   if (execution_context == PGAGROAL_CONTEXT_VAULT || shmem == NULL)
+   {
+      return;
+   }
+
+   enabled = ((struct main_configuration*)shmem)->ev_stats;
+
+   if (unlikely(enabled != loop->stats_enabled))
+   {
+      if (loop->stats_enabled)
+      {
+         ev_stats_publish();
+      }
+      else
+      {
+         memset(&loop->stats, 0, sizeof(struct event_loop_stats));
+         loop->stats.published = ev_monotonic_us();
+      }
+
+      loop->stats_enabled = enabled;
+   }
+}
+
+/**
+ * Account for one wakeup of the loop
+ * @param wait_start When the loop started to wait
+ * @param woken When the wait returned
+ * @param events The number of events returned by the wait
+ */
+static inline void
+ev_stats_wakeup(uint64_t wait_start, uint64_t woken, int events)
+{
+   struct event_loop_stats* s = &loop->stats;
+   int bucket = 0;
+
+   s->iterations++;
+   s->wait_time += woken - wait_start;
+
+   if (events > 0)
+   {
+      s->events += events;
+      while (bucket < EV_STATS_WAKEUP_BUCKETS - 1 && events > (1 << bucket))
+      {
+         bucket++;
+      }
+      s->events_per_wakeup[bucket]++;
+   }
+}
+
+/**
+ * Account for the time spent dispatching the events of a wakeup,
+ * and publish the counters once a second
+ * @param woken When the wait returned
+ */
+static inline void
+ev_stats_dispatched(uint64_t woken)
+{
+   struct event_loop_stats* s = &loop->stats;
+   uint64_t now = ev_monotonic_us();
+
+   s->busy_time += now - woken;
+
+   if (now - s->published >= 1000000ULL)
+   {
+      s->published = now;
+      ev_stats_publish();
+   }
+}
+
+/**
+ * Account for one callback
+ * @param start When the callback started
+ */
+static inline void
+ev_stats_callback(uint64_t start)
+{
+   struct event_loop_stats* s = &loop->stats;
+   uint64_t duration = ev_monotonic_us() - start;
+   int bucket = 0;
+
+   while (bucket < EV_STATS_CALLBACK_BUCKETS - 1 && duration > ev_stats_callback_bounds[bucket])
+   {
+      bucket++;
+   }
+
+   s->callback_time[bucket]++;
+   s->callback_time_sum += duration;
+}
 
 static bool
 event_loop_called_from_child(const char* fn)
@@ -205,6 +341,7 @@ setup_ops(void)
       if (main_config)
       {
          backend_type = main_config->ev_backend;
+         busy_poll = main_config->busy_poll;
       }
    }
 
@@ -284,6 +421,12 @@ pgagroal_event_loop_init(void)
 
    sigemptyset(&loop->sigset);
 
+   if (execution_context != PGAGROAL_CONTEXT_VAULT && shmem != NULL)
+   {
+      loop->stats_enabled = ((struct main_configuration*)shmem)->ev_stats;
+      loop->stats.published = ev_monotonic_us();
+   }
+
    if (!context_is_set)
    {
 #if HAVE_LINUX
@@ -386,6 +529,11 @@ pgagroal_event_loop_destroy(void)
       return 0;
    }
 
+   if (loop->stats_enabled)
+   {
+      ev_stats_publish();
+   }
+
    rc = loop_destroy();
 
 #if HAVE_LINUX
@@ -455,6 +603,19 @@ pgagroal_event_accept_init(struct io_watcher* watcher, int listen_fd, io_cb cb)
    return PGAGROAL_EVENT_RC_OK;
 }
 
+int
+pgagroal_event_client_init(struct io_watcher* watcher, int fd, io_cb cb)
+{
+   watcher->event_watcher.type = PGAGROAL_EVENT_TYPE_CLIENT;
+   watcher->fds.main.client_fd = fd;
+   watcher->fds.main.listen_fd = -1;
+   watcher->writable = false;
+   watcher->msg = NULL;
+   watcher->cb = cb;
+
+   return PGAGROAL_EVENT_RC_OK;
+}
+
 int
 pgagroal_event_worker_init(struct io_watcher* watcher, int rcv_fd, int snd_fd, io_cb cb)
 {
@@ -491,6 +652,12 @@ pgagroal_io_start(struct io_watcher* watcher)
       return PGAGROAL_EVENT_RC_ERROR;
    }
 
+   /* Client watchers are many and short-lived, so they stay out of the registry */
+   if (watcher->event_watcher.type == PGAGROAL_EVENT_TYPE_CLIENT)
+   {
+      return io_start(watcher);
+   }
+
    if (loop->events_nr >= MAX_EVENTS)
    {
       pgagroal_log_warn("pgagroal_io_start: MAX_EVENTS (%d) reached - cannot register new watcher (fd rcv=%d, snd=%d)",
@@ -516,6 +683,16 @@ pgagroal_io_stop(struct io_watcher* watcher)
 
    assert(loop != NULL && watcher != NULL);
 
+   if (watcher->event_watcher.type == PGAGROAL_EVENT_TYPE_CLIENT)
+   {
+      int rc = io_stop(watcher);
+
+      /* Completions still in flight for the watcher are dropped */
+      watcher->event_watcher.type = PGAGROAL_EVENT_TYPE_INVALID;
+
+      return rc;
+   }
+
    for (i = 0; i < loop->events_nr; i++)
    {
       if (watcher == (struct io_watcher*)loop->events[i])
@@ -639,6 +816,8 @@ pgagroal_event_prep_submit_send(struct io_watcher* watcher, struct message* msg)
    struct io_uring_sqe* sqe = NULL;
    struct io_uring_cqe* cqe = NULL;
    int send_flags = 0;
+   int snd_idx = -1;
+   int buf_idx = -1;
    int ret;
    int cqe_res;
 
@@ -662,8 +841,25 @@ pgagroal_event_prep_submit_send(struct io_watcher* watcher, struct message* msg)
     * main ring while we're waiting for a send completion. With a separate
     * ring, we're guaranteed to only receive send CQEs here.
     */
+   /*
+    * Use the registered file table (and the registered buffer of the
+    * watcher, when the message lives there) so the kernel skips the
+    * per-operation descriptor lookup and page pinning.
+    */
+   snd_idx = ev_io_uring_fixed_file(watcher, watcher->fds.worker.snd_fd, &watcher->fixed.snd);
+
+   if (loop->stats_enabled)
+   {
+      loop->stats.sends++;
+   }
+
    while (total_sent < to_send)
    {
+      if (total_sent > 0 && loop->stats_enabled)
+      {
+         loop->stats.partial_sends++;
+      }
+
       sqe = io_uring_get_sqe(&loop->ring_snd);
       if (!sqe)
       {
@@ -671,21 +867,37 @@ pgagroal_event_prep_submit_send(struct io_watcher* watcher, struct message* msg)
          return -1;
       }
 
+      buf_idx = -1;
+      if (msg == watcher->msg && loop->fixed.send_buffers)
+      {
+         buf_idx = ev_io_uring_fixed_buffer(watcher, msg);
+      }
+
 #if EXPERIMENTAL_FEATURE_ZERO_COPY_ENABLED
       /* XXX: Implement zero copy send (this has been shown to speed up a little some
        * workloads, but the implementation is still problematic). */
-      io_uring_prep_send_zc(sqe, watcher->fds.worker.snd_fd,
+      io_uring_prep_send_zc(sqe, snd_idx >= 0 ? snd_idx : watcher->fds.worker.snd_fd,
                             (char*)msg->data + total_sent,
                             to_send - total_sent,
                             send_flags, 0);
 #else
       send_flags |= MSG_NOSIGNAL;
-      io_uring_prep_send(sqe, watcher->fds.worker.snd_fd,
+      io_uring_prep_send(sqe, snd_idx >= 0 ? snd_idx : watcher->fds.worker.snd_fd,
                          (char*)msg->data + total_sent,
                          to_send - total_sent,
                          send_flags);
 #endif /* EXPERIMENTAL_FEATURE_ZERO_COPY_ENABLED */
 
+      if (snd_idx >= 0)
+      {
+         sqe->flags |= IOSQE_FIXED_FILE;
+      }
+      if (buf_idx >= 0)
+      {
+         sqe->ioprio |= IORING_RECVSEND_FIXED_BUF;
+         sqe->buf_index = buf_idx;
+      }
+
       io_uring_sqe_set_data(sqe, NULL);
 
       ret = io_uring_submit(&loop->ring_snd);
@@ -707,6 +919,14 @@ pgagroal_event_prep_submit_send(struct io_watcher* watcher, struct message* msg)
       cqe_res = cqe->res;
       io_uring_cqe_seen(&loop->ring_snd, cqe);
 
+      if (cqe_res == -EINVAL && buf_idx >= 0)
+      {
+         /* Registered buffers for send need a recent kernel, fall back to plain buffers */
+         pgagroal_log_debug("io_uring: registered buffers not supported for send");
+         loop->fixed.send_buffers = false;
+         continue;
+      }
+
       if (cqe_res < 0)
       {
          pgagroal_log_debug("io_uring send error fd=%d: %s",
@@ -852,7 +1072,7 @@ ev_io_uring_init(void)
    }
 #endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
 
-   return PGAGROAL_EVENT_RC_OK;
+   return ev_io_uring_fixed_init();
 }
 
 static int
@@ -875,6 +1095,8 @@ ev_io_uring_io_start(struct io_watcher* watcher)
 {
    struct io_uring_sqe* sqe = io_uring_get_sqe(&loop->ring_rcv);
    struct message* msg = NULL;
+   int rcv_idx = -1;
+   int buf_idx = -1;
 
    if (unlikely(!sqe))
    {
@@ -886,7 +1108,11 @@ ev_io_uring_io_start(struct io_watcher* watcher)
    switch (watcher->event_watcher.type)
    {
       case PGAGROAL_EVENT_TYPE_MAIN:
-         io_uring_prep_multishot_accept(sqe, watcher->fds.main.listen_fd, NULL, NULL, 0);
+         io_uring_prep_multishot_accept(sqe, watcher->fds.main.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+         break;
+      case PGAGROAL_EVENT_TYPE_CLIENT:
+         /* A multishot poll posts once per wakeup, so unread data doesn't spin */
+         io_uring_prep_poll_multishot(sqe, watcher->fds.main.client_fd, watcher->writable ? POLLIN | POLLOUT : POLLIN);
          break;
       case PGAGROAL_EVENT_TYPE_WORKER:
 #if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
@@ -895,9 +1121,28 @@ ev_io_uring_io_start(struct io_watcher* watcher)
          sqe->flags |= IOSQE_BUFFER_SELECT;
 #else
          msg = pgagroal_get_watcher_message(watcher);
+         rcv_idx = ev_io_uring_fixed_file(watcher, watcher->fds.worker.rcv_fd, &watcher->fixed.rcv);
+         if (rcv_idx >= 0 && msg == watcher->msg)
+         {
+            buf_idx = ev_io_uring_fixed_buffer(watcher, msg);
+         }
+
          /* Use MESSAGE_PARSE_BUFFER_SIZE to leave headroom and prevent buffer
           * overflow when parsing message headers near the end of received data */
-         io_uring_prep_recv(sqe, watcher->fds.worker.rcv_fd, msg->data, MESSAGE_PARSE_BUFFER_SIZE, 0);
+         if (buf_idx >= 0)
+         {
+            /* A read on a socket is a recv without flags */
+            io_uring_prep_read_fixed(sqe, rcv_idx, msg->data, MESSAGE_PARSE_BUFFER_SIZE, 0, buf_idx);
+         }
+         else
+         {
+            io_uring_prep_recv(sqe, rcv_idx >= 0 ? rcv_idx : watcher->fds.worker.rcv_fd,
+                               msg->data, MESSAGE_PARSE_BUFFER_SIZE, 0);
+         }
+         if (rcv_idx >= 0)
+         {
+            sqe->flags |= IOSQE_FIXED_FILE;
+         }
 #endif /* EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED */
          break;
       default:
@@ -938,6 +1183,8 @@ ev_io_uring_io_stop(struct io_watcher* target)
 
    io_uring_submit_and_wait_timeout(&loop->ring_rcv, &cqe, 0, &ts, NULL);
 
+   ev_io_uring_fixed_release(target);
+
    return rc;
 }
 
@@ -1053,6 +1300,9 @@ ev_io_uring_loop(void)
    unsigned int events;
    int to_wait = 1; /* at first, wait for any 1 event */
    unsigned int head;
+   uint64_t wait_start = 0;
+   uint64_t woken = 0;
+   uint64_t callback_start = 0;
    struct io_uring_cqe* cqe = NULL;
    struct __kernel_timespec* ts = NULL;
    struct __kernel_timespec idle_ts = {
@@ -1065,8 +1315,26 @@ ev_io_uring_loop(void)
    {
       ts = &idle_ts;
 
+      ev_stats_reload();
+
+      if (loop->stats_enabled)
+      {
+         wait_start = ev_monotonic_us();
+      }
+
+      if (busy_poll > 0)
+      {
+         ev_io_uring_busy_poll();
+      }
+
       io_uring_submit_and_wait_timeout(&loop->ring_rcv, &cqe, to_wait, ts, NULL);
 
+      if (loop->stats_enabled)
+      {
+         woken = ev_monotonic_us();
+         ev_stats_wakeup(wait_start, woken, (int)io_uring_cq_ready(&loop->ring_rcv));
+      }
+
       if (*loop->ring_rcv.cq.koverflow)
       {
          pgagroal_log_fatal("io_uring overflow %u", *loop->ring_rcv.cq.koverflow);
@@ -1075,15 +1343,25 @@ ev_io_uring_loop(void)
       }
       if (*loop->ring_rcv.sq.kflags & IORING_SQ_CQ_OVERFLOW)
       {
-         pgagroal_log_fatal("io_uring overflow");
-         pgagroal_event_loop_break();
-         return PGAGROAL_EVENT_RC_FATAL;
+         /* A burst of multishot accepts can outrun the completion queue.
+          * The kernel holds the extra completions (IORING_FEAT_NODROP) and
+          * hands them over on the next wait, once this batch is consumed. */
+         pgagroal_log_debug("io_uring: completion queue full, flushing on next wait");
       }
 
       events = 0;
       io_uring_for_each_cqe(&loop->ring_rcv, head, cqe)
       {
-         rc = ev_io_uring_handler(cqe);
+         if (loop->stats_enabled)
+         {
+            callback_start = ev_monotonic_us();
+            rc = ev_io_uring_handler(cqe);
+            ev_stats_callback(callback_start);
+         }
+         else
+         {
+            rc = ev_io_uring_handler(cqe);
+         }
          if (rc)
          {
             pgagroal_event_loop_break();
@@ -1096,11 +1374,39 @@ ev_io_uring_loop(void)
       {
          io_uring_cq_advance(&loop->ring_rcv, events);
       }
+
+      if (loop->stats_enabled)
+      {
+         ev_stats_dispatched(woken);
+      }
    }
 
    return rc;
 }
 
+/**
+ * Spin on the receive ring for up to busy_poll microseconds before the
+ * loop goes to sleep. With DEFER_TASKRUN completions only show up after
+ * entering the kernel, so each iteration flushes pending task work.
+ */
+static void
+ev_io_uring_busy_poll(void)
+{
+   uint64_t deadline;
+
+   io_uring_submit(&loop->ring_rcv);
+
+   deadline = ev_monotonic_us() + (uint64_t)busy_poll;
+   while (io_uring_cq_ready(&loop->ring_rcv) == 0 && pgagroal_event_loop_is_running())
+   {
+      io_uring_get_events(&loop->ring_rcv);
+      if (ev_monotonic_us() >= deadline)
+      {
+         break;
+      }
+   }
+}
+
 static int
 ev_io_uring_fork(void)
 {
@@ -1226,6 +1532,18 @@ ev_io_uring_handler(struct io_uring_cqe* cqe)
             }
          }
 
+         break;
+      case PGAGROAL_EVENT_TYPE_CLIENT:
+         io = (struct io_watcher*)watcher;
+         io->cb(io);
+
+         /* Rearm unless the callback stopped the watcher */
+         if (!(cqe->flags & IORING_CQE_F_MORE) &&
+             io->event_watcher.type == PGAGROAL_EVENT_TYPE_CLIENT &&
+             pgagroal_event_loop_is_running())
+         {
+            ev_io_uring_io_start(io);
+         }
          break;
       default:
          /* reaching here is a bug, do not recover */
@@ -1235,6 +1553,261 @@ ev_io_uring_handler(struct io_uring_cqe* cqe)
    return rc;
 }
 
+static int
+ev_io_uring_fixed_init(void)
+{
+   int rc;
+
+   for (int i = 0; i < FIXED_FILES_NR; i++)
+   {
+      loop->fixed.fds[i] = -1;
+      loop->fixed.file_owners[i] = NULL;
+   }
+   for (int i = 0; i < FIXED_BUFFERS_NR; i++)
+   {
+      loop->fixed.bufs[i] = NULL;
+      loop->fixed.buf_owners[i] = NULL;
+   }
+   loop->fixed.files = false;
+   loop->fixed.buffers = false;
+   loop->fixed.send_buffers = true;
+
+   /* Both tables start sparse and are filled as watchers start. Failing to
+    * register them is not fatal, the loop then uses plain descriptors and
+    * buffers. */
+   rc = io_uring_register_files(&loop->ring_rcv, loop->fixed.fds, FIXED_FILES_NR);
+   if (!rc)
+   {
+      rc = io_uring_register_files(&loop->ring_snd, loop->fixed.fds, FIXED_FILES_NR);
+      if (rc)
+      {
+         io_uring_unregister_files(&loop->ring_rcv);
+      }
+   }
+   if (rc)
+   {
+      pgagroal_log_debug("io_uring: registered files not available: %s", strerror(-rc));
+   }
+   else
+   {
+      loop->fixed.files = true;
+   }
+
+   rc = io_uring_register_buffers_sparse(&loop->ring_rcv, FIXED_BUFFERS_NR);
+   if (!rc)
+   {
+      rc = io_uring_register_buffers_sparse(&loop->ring_snd, FIXED_BUFFERS_NR);
+      if (rc)
+      {
+         io_uring_unregister_buffers(&loop->ring_rcv);
+      }
+   }
+   if (rc)
+   {
+      pgagroal_log_debug("io_uring: registered buffers not available: %s", strerror(-rc));
+   }
+   else
+   {
+      loop->fixed.buffers = true;
+   }
+
+   return PGAGROAL_EVENT_RC_OK;
+}
+
+static int
+ev_io_uring_fixed_file_update(int idx, int fd)
+{
+   int none = -1;
+   int rc;
+
+   rc = io_uring_register_files_update(&loop->ring_rcv, idx, &fd, 1);
+   if (rc < 0)
+   {
+      return rc;
+   }
+
+   rc = io_uring_register_files_update(&loop->ring_snd, idx, &fd, 1);
+   if (rc < 0)
+   {
+      io_uring_register_files_update(&loop->ring_rcv, idx, &none, 1);
+      return rc;
+   }
+
+   return 0;
+}
+
+static int
+ev_io_uring_fixed_buffer_update(int idx, void* data, size_t length)
+{
+   struct iovec iov = {.iov_base = data, .iov_len = length};
+   struct iovec none = {.iov_base = NULL, .iov_len = 0};
+   int rc;
+
+   rc = io_uring_register_buffers_update_tag(&loop->ring_rcv, idx, &iov, NULL, 1);
+   if (rc < 0)
+   {
+      return rc;
+   }
+
+   rc = io_uring_register_buffers_update_tag(&loop->ring_snd, idx, &iov, NULL, 1);
+   if (rc < 0)
+   {
+      io_uring_register_buffers_update_tag(&loop->ring_rcv, idx, &none, NULL, 1);
+      return rc;
+   }
+
+   return 0;
+}
+
+/**
+ * Get the registered file index of a descriptor used by a watcher,
+ * claiming a slot in the file table if needed
+ * @param watcher The watcher
+ * @param fd The descriptor
+ * @param idx The cached index in the watcher
+ * @return The index, or -1 if the descriptor must be used as is
+ */
+static int
+ev_io_uring_fixed_file(struct io_watcher* watcher, int fd, int* idx)
+{
+   int rc;
+
+   if (!loop->fixed.files || fd < 0)
+   {
+      return -1;
+   }
+
+   if (*idx < 0 || *idx >= FIXED_FILES_NR || loop->fixed.file_owners[*idx] != watcher)
+   {
+      *idx = -1;
+      for (int i = 0; i < FIXED_FILES_NR; i++)
+      {
+         if (loop->fixed.file_owners[i] == NULL)
+         {
+            loop->fixed.file_owners[i] = watcher;
+            *idx = i;
+            break;
+         }
+      }
+
+      if (*idx == -1)
+      {
+         return -1;
+      }
+   }
+
+   /* The pipelines may point a watcher at a new descriptor */
+   if (loop->fixed.fds[*idx] != fd)
+   {
+      rc = ev_io_uring_fixed_file_update(*idx, fd);
+      if (rc)
+      {
+         pgagroal_log_debug("io_uring: unable to register fd=%d: %s", fd, strerror(-rc));
+         loop->fixed.fds[*idx] = -1;
+         loop->fixed.file_owners[*idx] = NULL;
+         *idx = -1;
+         return -1;
+      }
+      loop->fixed.fds[*idx] = fd;
+   }
+
+   return *idx;
+}
+
+/**
+ * Get the registered buffer index of the message buffer of a watcher,
+ * claiming a slot in the buffer table if needed
+ * @param watcher The watcher
+ * @param msg The message of the watcher
+ * @return The index, or -1 if the buffer must be used as is
+ */
+static int
+ev_io_uring_fixed_buffer(struct io_watcher* watcher, struct message* msg)
+{
+   int idx = watcher->fixed.buf;
+   int rc;
+
+   if (!loop->fixed.buffers || msg == NULL || msg->data == NULL)
+   {
+      return -1;
+   }
+
+   if (idx < 0 || idx >= FIXED_BUFFERS_NR || loop->fixed.buf_owners[idx] != watcher)
+   {
+      idx = -1;
+      for (int i = 0; i < FIXED_BUFFERS_NR; i++)
+      {
+         if (loop->fixed.buf_owners[i] == NULL)
+         {
+            loop->fixed.buf_owners[i] = watcher;
+            idx = i;
+            break;
+         }
+      }
+
+      watcher->fixed.buf = idx;
+      if (idx == -1)
+      {
+         return -1;
+      }
+   }
+
+   if (loop->fixed.bufs[idx] != msg->data)
+   {
+      rc = ev_io_uring_fixed_buffer_update(idx, msg->data, DEFAULT_BUFFER_SIZE);
+      if (rc)
+      {
+         /* Most likely RLIMIT_MEMLOCK, stop trying for this loop */
+         pgagroal_log_debug("io_uring: unable to register buffer: %s", strerror(-rc));
+         loop->fixed.bufs[idx] = NULL;
+         loop->fixed.buf_owners[idx] = NULL;
+         loop->fixed.buffers = false;
+         watcher->fixed.buf = -1;
+         return -1;
+      }
+      loop->fixed.bufs[idx] = msg->data;
+   }
+
+   return idx;
+}
+
+static void
+ev_io_uring_fixed_release(struct io_watcher* watcher)
+{
+   for (int i = 0; i < FIXED_FILES_NR; i++)
+   {
+      if (loop->fixed.file_owners[i] == watcher)
+      {
+         if (loop->fixed.fds[i] != -1)
+         {
+            ev_io_uring_fixed_file_update(i, -1);
+            loop->fixed.fds[i] = -1;
+         }
+         loop->fixed.file_owners[i] = NULL;
+      }
+   }
+
+   for (int i = 0; i < FIXED_BUFFERS_NR; i++)
+   {
+      if (loop->fixed.buf_owners[i] == watcher)
+      {
+         if (loop->fixed.bufs[i] != NULL)
+         {
+            ev_io_uring_fixed_buffer_update(i, NULL, 0);
+            loop->fixed.bufs[i] = NULL;
+         }
+         loop->fixed.buf_owners[i] = NULL;
+      }
+   }
+
+   if (watcher->event_watcher.type == PGAGROAL_EVENT_TYPE_WORKER)
+   {
+      watcher->fixed.rcv = -1;
+      watcher->fixed.snd = -1;
+      watcher->fixed.buf = -1;
+   }
+}
+
 #if EXPERIMENTAL_FEATURE_RECV_MULTISHOT_ENABLED
 static int
 ev_io_uring_setup_buffers(void)
@@ -1294,6 +1867,9 @@ ev_epoll_loop(void)
 {
    int rc = PGAGROAL_EVENT_RC_OK;
    int nfds;
+   uint64_t wait_start = 0;
+   uint64_t woken = 0;
+   uint64_t callback_start = 0;
    struct epoll_event events[MAX_EVENTS];
 #if HAVE_EPOLL_PWAIT2
    struct timespec timeout_ts = {
@@ -1307,12 +1883,28 @@ ev_epoll_loop(void)
    pgagroal_event_loop_start();
    while (pgagroal_event_loop_is_running())
    {
+      ev_stats_reload();
+
+      if (loop->stats_enabled)
+      {
+         wait_start = ev_monotonic_us();
+      }
+
+      nfds = 0;
+      if (busy_poll > 0)
+      {
+         nfds = ev_epoll_busy_poll(events);
+      }
+
+      if (nfds == 0)
+      {
 #if HAVE_EPOLL_PWAIT2
-      nfds = epoll_pwait2(loop->epollfd, events, MAX_EVENTS, &timeout_ts,
-                          &loop->sigset);
+         nfds = epoll_pwait2(loop->epollfd, events, MAX_EVENTS, &timeout_ts,
+                             &loop->sigset);
 #else
-      nfds = epoll_pwait(loop->epollfd, events, MAX_EVENTS, timeout, &loop->sigset);
+         nfds = epoll_pwait(loop->epollfd, events, MAX_EVENTS, timeout, &loop->sigset);
 #endif
+      }
 
       if (nfds == -1)
       {
@@ -1326,19 +1918,64 @@ ev_epoll_loop(void)
          break;
       }
 
+      if (loop->stats_enabled)
+      {
+         woken = ev_monotonic_us();
+         ev_stats_wakeup(wait_start, woken, nfds);
+      }
+
       for (int i = 0; i < nfds; i++)
       {
-         rc = ev_epoll_handler((void*)events[i].data.u64);
+         if (loop->stats_enabled)
+         {
+            callback_start = ev_monotonic_us();
+            rc = ev_epoll_handler((void*)events[i].data.u64);
+            ev_stats_callback(callback_start);
+         }
+         else
+         {
+            rc = ev_epoll_handler((void*)events[i].data.u64);
+         }
          if (rc)
          {
             pgagroal_event_loop_break();
             break;
          }
       }
+
+      if (loop->stats_enabled)
+      {
+         ev_stats_dispatched(woken);
+      }
    }
    return rc;
 }
 
+/**
+ * Poll the epoll instance without sleeping for up to busy_poll microseconds
+ * @param events The event array
+ * @return The number of ready events, 0 if the budget ran out, -1 on error
+ */
+static int
+ev_epoll_busy_poll(struct epoll_event* events)
+{
+   int nfds;
+   uint64_t deadline;
+
+   deadline = ev_monotonic_us() + (uint64_t)busy_poll;
+   do
+   {
+      nfds = epoll_pwait(loop->epollfd, events, MAX_EVENTS, 0, &loop->sigset);
+      if (nfds != 0)
+      {
+         return nfds;
+      }
+   }
+   while (pgagroal_event_loop_is_running() && ev_monotonic_us() < deadline);
+
+   return 0;
+}
+
 static int
 ev_epoll_init(void)
 {
@@ -1349,6 +1986,24 @@ ev_epoll_init(void)
       pgagroal_log_fatal("epoll_init error: %s", strerror(errno));
       return PGAGROAL_EVENT_RC_FATAL;
    }
+
+#ifdef EPIOCSPARAMS
+   if (busy_poll > 0)
+   {
+      struct epoll_params ep = {0};
+
+      /* Let the kernel busy poll the NAPI contexts of the registered sockets */
+      ep.busy_poll_usecs = (uint32_t)busy_poll;
+      ep.busy_poll_budget = MAX_EVENTS;
+      ep.prefer_busy_poll = 1;
+      if (ioctl(loop->epollfd, EPIOCSPARAMS, &ep) == -1)
+      {
+         pgagroal_log_debug("epoll busy poll parameters not applied: %s", strerror(errno));
+         errno = 0;
+      }
+   }
+#endif
+
    return PGAGROAL_EVENT_RC_OK;
 }
 
@@ -1498,6 +2153,15 @@ ev_epoll_io_start(struct io_watcher* watcher)
          /* XXX: lookup the possibility to add EPOLLET here */
          event.events = EPOLLIN;
          break;
+      case PGAGROAL_EVENT_TYPE_CLIENT:
+         fd = watcher->fds.main.client_fd;
+         /* Edge-triggered, so a partial packet left unread doesn't spin */
+         event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+         if (watcher->writable)
+         {
+            event.events |= EPOLLOUT;
+         }
+         break;
       default:
          /* reaching here is a bug, do not recover */
          pgagroal_log_fatal("BUG: Unknown event type: %d", type);
@@ -1540,6 +2204,9 @@ ev_epoll_io_stop(struct io_watcher* watcher)
       case PGAGROAL_EVENT_TYPE_WORKER:
          fd = watcher->fds.worker.rcv_fd;
          break;
+      case PGAGROAL_EVENT_TYPE_CLIENT:
+         fd = watcher->fds.main.client_fd;
+         break;
       default:
          /* reaching here is a bug, do not recover */
          pgagroal_log_fatal("BUG: Unknown event type: %d", type);
@@ -1568,24 +2235,41 @@ ev_epoll_io_handler(struct io_watcher* watcher)
    switch (type)
    {
       case PGAGROAL_EVENT_TYPE_MAIN:
-         client_fd = accept(watcher->fds.main.listen_fd, NULL, NULL);
-         if (client_fd == -1)
+         /* Drain up to MAX_ACCEPT_BATCH pending connections per wakeup so a
+          * connect burst is absorbed in a few iterations. The listener is
+          * level-triggered, so whatever is left is reported again by the
+          * next epoll_wait. */
+         for (int i = 0; i < MAX_ACCEPT_BATCH && pgagroal_event_loop_is_running(); i++)
          {
-            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            client_fd = accept4(watcher->fds.main.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (client_fd == -1)
             {
-               pgagroal_log_error("accept error: %s", strerror(errno));
-               return PGAGROAL_EVENT_RC_ERROR;
+               if (errno == EINTR || errno == ECONNABORTED)
+               {
+                  /* The client gave up while in the backlog */
+                  errno = 0;
+                  continue;
+               }
+               if (errno != EAGAIN && errno != EWOULDBLOCK)
+               {
+                  pgagroal_log_error("accept error: %s", strerror(errno));
+                  return PGAGROAL_EVENT_RC_ERROR;
+               }
+               errno = 0;
+               break;
             }
-         }
-         else
-         {
+
             watcher->fds.main.client_fd = client_fd;
             watcher->cb(watcher);
          }
          break;
       case PGAGROAL_EVENT_TYPE_WORKER:
+      case PGAGROAL_EVENT_TYPE_CLIENT:
          watcher->cb(watcher);
          break;
+      case PGAGROAL_EVENT_TYPE_INVALID:
+         /* A client watcher stopped earlier in the same batch */
+         break;
       default:
          /* shouldn't happen, do not recover */
          pgagroal_log_fatal("BUG: Unknown event type: %d", type);
@@ -1601,6 +2285,9 @@ ev_kqueue_loop(void)
 {
    int rc = PGAGROAL_EVENT_RC_OK;
    int nfds;
+   uint64_t wait_start = 0;
+   uint64_t woken = 0;
+   uint64_t callback_start = 0;
    struct kevent events[MAX_EVENTS];
    struct timespec timeout;
    timeout.tv_sec = 0;
@@ -1609,6 +2296,13 @@ ev_kqueue_loop(void)
    pgagroal_event_loop_start();
    while (pgagroal_event_loop_is_running())
    {
+      ev_stats_reload();
+
+      if (loop->stats_enabled)
+      {
+         wait_start = ev_monotonic_us();
+      }
+
       nfds = kevent(loop->kqueuefd, NULL, 0, events, MAX_EVENTS, &timeout);
       if (nfds == -1)
       {
@@ -1622,15 +2316,36 @@ ev_kqueue_loop(void)
          pgagroal_event_loop_break();
          break;
       }
+
+      if (loop->stats_enabled)
+      {
+         woken = ev_monotonic_us();
+         ev_stats_wakeup(wait_start, woken, nfds);
+      }
+
       for (int i = 0; i < nfds; i++)
       {
-         rc = ev_kqueue_handler(&events[i]);
+         if (loop->stats_enabled)
+         {
+            callback_start = ev_monotonic_us();
+            rc = ev_kqueue_handler(&events[i]);
+            ev_stats_callback(callback_start);
+         }
+         else
+         {
+            rc = ev_kqueue_handler(&events[i]);
+         }
          if (rc)
          {
             pgagroal_event_loop_break();
             break;
          }
       }
+
+      if (loop->stats_enabled)
+      {
+         ev_stats_dispatched(woken);
+      }
    }
    return rc;
 }
@@ -1793,6 +2508,10 @@ ev_kqueue_io_start(struct io_watcher* watcher)
          filter = EVFILT_READ;
          fd = watcher->fds.worker.rcv_fd;
          break;
+      case PGAGROAL_EVENT_TYPE_CLIENT:
+         filter = EVFILT_READ;
+         fd = watcher->fds.main.client_fd;
+         break;
       default:
          /* shouldn't happen, do not recover */
          pgagroal_log_fatal("Unknown event type: %d", type);
@@ -1815,6 +2534,17 @@ ev_kqueue_io_start(struct io_watcher* watcher)
       }
    }
 
+   if (type == PGAGROAL_EVENT_TYPE_CLIENT && watcher->writable)
+   {
+      EV_SET(&kev, fd, EVFILT_WRITE, EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, watcher);
+
+      if (kevent(loop->kqueuefd, &kev, 1, NULL, 0, NULL) == -1 && errno != EBADF)
+      {
+         pgagroal_log_error("kevent error: %s", strerror(errno));
+         return PGAGROAL_EVENT_RC_ERROR;
+      }
+   }
+
    return PGAGROAL_EVENT_RC_OK;
 }
 
@@ -1854,6 +2584,16 @@ ev_kqueue_io_stop(struct io_watcher* watcher)
       }
    }
 
+   if (watcher->event_watcher.type == PGAGROAL_EVENT_TYPE_CLIENT && watcher->writable)
+   {
+      EV_SET(&kev, watcher->fds.main.client_fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+      if (kevent(loop->kqueuefd, &kev, 1, NULL, 0, NULL) == -1 && errno != EBADF && errno != ENOENT)
+      {
+         pgagroal_log_error("%s: kevent delete failed for the write filter: %s", __func__, strerror(errno));
+         return PGAGROAL_EVENT_RC_ERROR;
+      }
+   }
+
    return PGAGROAL_EVENT_RC_OK;
 }
 
@@ -1901,6 +2641,13 @@ ev_kqueue_io_handler(struct kevent* kev)
             watcher->cb(watcher);
          }
          break;
+      case PGAGROAL_EVENT_TYPE_CLIENT:
+         /* The callback sees the end of file itself; it must not stop the loop */
+         watcher->cb(watcher);
+         break;
+      case PGAGROAL_EVENT_TYPE_INVALID:
+         /* A client watcher stopped earlier in the same batch */
+         break;
       default:
          pgagroal_log_fatal("unknown event type: %d", type);
          return PGAGROAL_EVENT_RC_FATAL;
@@ -206,3 +206,114 @@ pgagroal_gunzip_string(unsigned char* compressed_buffer, size_t compressed_size,
 
    return 0;
 }
+
+int
+pgagroal_gzip_stream_create(void** stream)
+{
+   int ret;
+   z_stream* s = NULL;
+
+   *stream = NULL;
+
+   s = (z_stream*)calloc(1, sizeof(z_stream));
+   if (s == NULL)
+   {
+      pgagroal_log_error("Gzip: Allocation error");
+      return 1;
+   }
+
+   ret = deflateInit2(s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+   if (ret != Z_OK)
+   {
+      free(s);
+      pgagroal_log_error("Gzip: Initialization failed");
+      return 1;
+   }
+
+   *stream = s;
+
+   return 0;
+}
+
+int
+pgagroal_gzip_stream(void* stream, void* data, size_t length, bool finish, unsigned char** buffer, size_t* buffer_size)
+{
+   int ret;
+   size_t chunk_size;
+   size_t total_out = 0;
+   unsigned char* temp_buffer;
+   z_stream* s = (z_stream*)stream;
+
+   *buffer = NULL;
+   *buffer_size = 0;
+
+   chunk_size = BUFFER_LENGTH;
+
+   temp_buffer = (unsigned char*)malloc(chunk_size);
+   if (temp_buffer == NULL)
+   {
+      pgagroal_log_error("Gzip: Allocation error");
+      return 1;
+   }
+
+   s->next_in = (unsigned char*)data;
+   s->avail_in = length;
+
+   do
+   {
+      if (total_out >= chunk_size)
+      {
+         chunk_size *= 2;
+         unsigned char* new_buffer = (unsigned char*)realloc(temp_buffer, chunk_size);
+         if (new_buffer == NULL)
+         {
+            free(temp_buffer);
+            pgagroal_log_error("Gzip: Allocation error");
+            return 1;
+         }
+         temp_buffer = new_buffer;
+      }
+
+      s->next_out = temp_buffer + total_out;
+      s->avail_out = chunk_size - total_out;
+
+      ret = deflate(s, finish ? Z_FINISH : Z_NO_FLUSH);
+      if (ret == Z_STREAM_ERROR)
+      {
+         free(temp_buffer);
+         pgagroal_log_error("Gzip: Compression failed");
+         return 1;
+      }
+
+      total_out = chunk_size - s->avail_out;
+   }
+   while (s->avail_out == 0);
+
+   if (finish && ret != Z_STREAM_END)
+   {
+      free(temp_buffer);
+      pgagroal_log_error("Gzip: Compression failed");
+      return 1;
+   }
+
+   if (total_out == 0)
+   {
+      free(temp_buffer);
+      return 0;
+   }
+
+   *buffer = temp_buffer;
+   *buffer_size = total_out;
+
+   return 0;
+}
+
+void
+pgagroal_gzip_stream_destroy(void* stream)
+{
+   if (stream != NULL)
+   {
+      deflateEnd((z_stream*)stream);
+      free(stream);
+   }
+}
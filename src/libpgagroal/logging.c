@@ -29,24 +29,72 @@
 /* pgagroal */
 #include <pgagroal.h>
 #include <logging.h>
+#include <logging_internal.h>
 #include <prometheus.h>
+#include <shmem.h>
 #include <utils.h>
 
 /* system */
 #include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
-#define LINE_LENGTH 32
-#define MAX_LENGTH  4096
+#define LINE_LENGTH   32
+#define MAX_LENGTH    4096
+#define HEADER_LENGTH 256
+#define BATCH_LENGTH  64
+#define STALL_TIMEOUT 2
+
+#define IDLE_SLEEP_MIN 1000000L
+#define IDLE_SLEEP_MAX 64000000L
+
+/* The sequence of an entry the log writer gave up on, next to the position it was taken at */
+#define ABANDONED (1ULL << 63)
+
+/* Every field of an entry escaped at six bytes a character, so a queued line is never cut */
+#define STRUCTURED_LENGTH (6 * (PGAGROAL_LOGGING_FILE_LENGTH + 2 * PGAGROAL_LOGGING_NAME_LENGTH + \
+                                PGAGROAL_LOGGING_EVENT_LENGTH + PGAGROAL_LOGGING_MESSAGE_LENGTH) + 512)
+
+/* Room kept at the end of a structured line for the truncated marker, the end of the line and a nul */
+#define STRUCTURED_RESERVE 24
 
 static void output_log_line(char* l);
+static void log_vline(int level, char* file, int line, char* event, int64_t duration, char* fmt, va_list ap);
+static void log_structured(int level, char* file, int line, char* event, int64_t duration, char* fmt, va_list ap);
+static void log_entry_fill(struct log_entry* entry, int level, char* file, int line, char* event, int64_t duration);
+static size_t log_format_line(struct log_entry* entry, char* message, size_t length, bool truncated, int format, char* buffer, size_t size);
+static size_t log_format_printf(char* buffer, size_t end, size_t offset, bool* truncated, char* fmt, ...);
+static size_t log_format_field(char* buffer, size_t end, size_t offset, bool* truncated, char* key, char* s, size_t length, int format, bool quote);
+static void log_writev(int fd, struct iovec* iov, int count);
+static char* log_prefix(time_t t);
+
+/* Is this process the log writer */
+static bool log_writer = false;
+
+/* The log line prefix of the log writer, formatted once per second */
+static time_t log_prefix_time = -1;
+static char log_prefix_buffer[HEADER_LENGTH];
+
+/* The time of the json and logfmt log lines, formatted once per second */
+static time_t log_timestamp_time = -1;
+static char log_timestamp_buffer[LINE_LENGTH];
+
+/* The connection of this process */
+static int log_slot = -1;
+static char log_username[PGAGROAL_LOGGING_NAME_LENGTH];
+static char log_database[PGAGROAL_LOGGING_NAME_LENGTH];
+
+/* The json and logfmt log lines of a batch of the log writer */
+static char log_batch[BATCH_LENGTH][STRUCTURED_LENGTH];
 
 FILE* log_file;
 
@@ -302,6 +350,44 @@ pgagroal_stop_logging(void)
 
 void
 pgagroal_log_line(int level, char* file, int line, char* fmt, ...)
+{
+   va_list ap;
+
+   va_start(ap, fmt);
+   log_vline(level, file, line, NULL, -1, fmt, ap);
+   va_end(ap);
+}
+
+void
+pgagroal_log_event(int level, char* file, int line, char* event, int64_t duration, char* fmt, ...)
+{
+   va_list ap;
+
+   va_start(ap, fmt);
+   log_vline(level, file, line, event, duration, fmt, ap);
+   va_end(ap);
+}
+
+void
+pgagroal_log_context(int slot, char* username, char* database)
+{
+   log_slot = slot;
+
+   if (username != NULL)
+   {
+      memset(&log_username[0], 0, sizeof(log_username));
+      snprintf(&log_username[0], sizeof(log_username), "%s", username);
+   }
+
+   if (database != NULL)
+   {
+      memset(&log_database[0], 0, sizeof(log_database));
+      snprintf(&log_database[0], sizeof(log_database), "%s", database);
+   }
+}
+
+static void
+log_vline(int level, char* file, int line, char* event, int64_t duration, char* fmt, va_list ap)
 {
    signed char isfree;
    struct configuration* config;
@@ -333,6 +419,27 @@ pgagroal_log_line(int level, char* file, int line, char* fmt, ...)
             break;
       }
 
+      if (log_shmem != NULL && !log_writer && config->log_type != PGAGROAL_LOGGING_TYPE_SYSLOG)
+      {
+         va_list vl;
+         bool queued;
+
+         va_copy(vl, ap);
+         queued = pgagroal_log_queue_add(level, file, line, event, duration, fmt, vl);
+         va_end(vl);
+
+         if (queued)
+         {
+            return;
+         }
+      }
+
+      if (config->log_format != PGAGROAL_LOGGING_FORMAT_TEXT && config->log_type != PGAGROAL_LOGGING_TYPE_SYSLOG)
+      {
+         log_structured(level, file, line, event, duration, fmt, ap);
+         return;
+      }
+
 retry:
       isfree = STATE_FREE;
 
@@ -362,7 +469,7 @@ retry:
             memcpy(config->log_line_prefix, PGAGROAL_LOGGING_DEFAULT_LOG_LINE_PREFIX, strlen(PGAGROAL_LOGGING_DEFAULT_LOG_LINE_PREFIX));
          }
 
-         va_start(vl, fmt);
+         va_copy(vl, ap);
 
          if (config->log_type == PGAGROAL_LOGGING_TYPE_CONSOLE)
          {
@@ -438,6 +545,187 @@ retry:
    }
 }
 
+int
+pgagroal_log_queue_init(size_t* p_size, void** p_shmem)
+{
+   uint64_t size = 1;
+   size_t tmp_p_size = 0;
+   void* tmp_p_shmem = NULL;
+   struct log_queues* queues = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   if (config->log_queue <= 0)
+   {
+      return 0;
+   }
+
+   while (size * PGAGROAL_LOGGING_QUEUES < (uint64_t)config->log_queue)
+   {
+      size <<= 1;
+   }
+
+   tmp_p_size = sizeof(struct log_queues) + PGAGROAL_LOGGING_QUEUES * size * sizeof(struct log_entry);
+   if (pgagroal_create_shared_memory(tmp_p_size, config->common.hugepage, &tmp_p_shmem))
+   {
+      goto error;
+   }
+
+   memset(tmp_p_shmem, 0, tmp_p_size);
+
+   queues = (struct log_queues*)tmp_p_shmem;
+
+   atomic_init(&queues->running, false);
+   atomic_init(&queues->dropped, 0);
+   queues->size = size;
+
+   for (int i = 0; i < PGAGROAL_LOGGING_QUEUES; i++)
+   {
+      atomic_init(&queues->queues[i].tail, 0);
+      queues->queues[i].head = 0;
+
+      for (uint64_t j = 0; j < size; j++)
+      {
+         atomic_init(&pgagroal_log_queue_entry(queues, i, j)->sequence, j);
+         atomic_init(&pgagroal_log_queue_entry(queues, i, j)->owner, 0);
+      }
+   }
+
+   *p_size = tmp_p_size;
+   *p_shmem = tmp_p_shmem;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+void
+pgagroal_log_queue_enable(bool enable)
+{
+   struct log_queues* queues;
+
+   queues = (struct log_queues*)log_shmem;
+
+   if (queues != NULL)
+   {
+      atomic_store_explicit(&queues->running, enable, memory_order_release);
+   }
+}
+
+uint64_t
+pgagroal_log_queue_dropped(void)
+{
+   struct log_queues* queues;
+
+   queues = (struct log_queues*)log_shmem;
+
+   if (queues == NULL)
+   {
+      return 0;
+   }
+
+   return atomic_load_explicit(&queues->dropped, memory_order_relaxed);
+}
+
+void
+pgagroal_log_writer(void)
+{
+   bool stopping = false;
+   int count;
+   int type;
+   long idle = IDLE_SLEEP_MIN;
+   char path[MISC_LENGTH];
+   struct log_stall stalled[PGAGROAL_LOGGING_QUEUES];
+   time_t reported_time = 0;
+   uint64_t reported = 0;
+   uint64_t dropped;
+   struct log_queues* queues;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+   queues = (struct log_queues*)log_shmem;
+
+   log_writer = true;
+
+   memset(&stalled, 0, sizeof(stalled));
+   type = config->log_type;
+   memcpy(&path[0], config->log_path, MISC_LENGTH);
+   reported = atomic_load_explicit(&queues->dropped, memory_order_relaxed);
+
+   while (true)
+   {
+      count = 0;
+
+      for (int i = 0; i < PGAGROAL_LOGGING_QUEUES; i++)
+      {
+         count += pgagroal_log_queue_write(queues, i, &stalled[i]);
+      }
+
+      if (count > 0 && log_file != NULL && log_rotation_required())
+      {
+         log_file_rotate();
+      }
+
+      dropped = atomic_load_explicit(&queues->dropped, memory_order_relaxed);
+      if (dropped != reported && time(NULL) != reported_time)
+      {
+         pgagroal_log_warn("Logging: %" PRIu64 " lines dropped", dropped - reported);
+         reported = dropped;
+         reported_time = time(NULL);
+      }
+
+      /* The main process reopened its log after a reload */
+      if (type != config->log_type || strncmp(&path[0], config->log_path, MISC_LENGTH))
+      {
+         pgagroal_stop_logging();
+         pgagroal_start_logging();
+         type = config->log_type;
+         memcpy(&path[0], config->log_path, MISC_LENGTH);
+      }
+
+      if (count == 0)
+      {
+         if (stopping)
+         {
+            break;
+         }
+
+         if (!atomic_load_explicit(&queues->running, memory_order_acquire))
+         {
+            /* Let the lines already taken be written before the last pass */
+            stopping = true;
+            SLEEP(10000000L);
+         }
+         else
+         {
+            /* An idle pooler has the writer wake up a few times a second */
+            SLEEP(idle);
+            idle = MIN(idle * 2, IDLE_SLEEP_MAX);
+         }
+      }
+      else
+      {
+         idle = IDLE_SLEEP_MIN;
+      }
+   }
+
+   dropped = atomic_load_explicit(&queues->dropped, memory_order_relaxed);
+   if (dropped != reported)
+   {
+      pgagroal_log_warn("Logging: %" PRIu64 " lines dropped", dropped - reported);
+   }
+
+   pgagroal_stop_logging();
+
+   exit(0);
+}
+
 void
 pgagroal_log_mem(void* data, size_t size)
 {
@@ -764,6 +1052,631 @@ output_log_line(char* l)
    }
 }
 
+struct log_entry*
+pgagroal_log_queue_entry(struct log_queues* queues, int queue, uint64_t position)
+{
+   struct log_entry* entries;
+
+   entries = (struct log_entry*)((char*)queues + sizeof(struct log_queues));
+
+   return entries + (uint64_t)queue * queues->size + (position & (queues->size - 1));
+}
+
+bool
+pgagroal_log_queue_add(int level, char* file, int line, char* event, int64_t duration, char* fmt, va_list ap)
+{
+   int queue;
+   int length;
+   char message[PGAGROAL_LOGGING_MESSAGE_LENGTH];
+   uint64_t position;
+   uint64_t sequence;
+   uint64_t expected;
+   struct log_entry* entry;
+   struct log_queues* queues;
+
+   queues = (struct log_queues*)log_shmem;
+
+   if (!atomic_load_explicit(&queues->running, memory_order_acquire))
+   {
+      return false;
+   }
+
+   /* A line longer than an entry is written by the process itself, so it is never cut */
+   length = vsnprintf(&message[0], sizeof(message), fmt, ap);
+   if (length < 0)
+   {
+      length = 0;
+   }
+   else if (length >= (int)sizeof(message))
+   {
+      return false;
+   }
+
+   /* Each process has its queue, shared only with the processes of the same remainder */
+   queue = getpid() % PGAGROAL_LOGGING_QUEUES;
+   position = atomic_load_explicit(&queues->queues[queue].tail, memory_order_relaxed);
+
+   while (true)
+   {
+      entry = pgagroal_log_queue_entry(queues, queue, position);
+      sequence = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+
+      if (sequence & ABANDONED)
+      {
+         /* The entry is not handed back yet, so the queue is full at this position */
+         atomic_fetch_add_explicit(&queues->dropped, 1, memory_order_relaxed);
+         return true;
+      }
+      else if (sequence == position)
+      {
+         if (atomic_compare_exchange_weak_explicit(&queues->queues[queue].tail, &position, position + 1,
+                                                   memory_order_relaxed, memory_order_relaxed))
+         {
+            break;
+         }
+      }
+      else if ((int64_t)(sequence - position) < 0)
+      {
+         /* The queue is full, so the line is counted but not written */
+         atomic_fetch_add_explicit(&queues->dropped, 1, memory_order_relaxed);
+         return true;
+      }
+      else
+      {
+         position = atomic_load_explicit(&queues->queues[queue].tail, memory_order_relaxed);
+      }
+   }
+
+   /* The log writer hands the entry back only when this process is gone */
+   atomic_store_explicit(&entry->owner, getpid(), memory_order_relaxed);
+
+   log_entry_fill(entry, level, file, line, event, duration);
+   memcpy(&entry->message[0], &message[0], length);
+   entry->length = length;
+
+   atomic_store_explicit(&entry->owner, 0, memory_order_relaxed);
+
+   expected = position;
+   if (!atomic_compare_exchange_strong_explicit(&entry->sequence, &expected, position + 1,
+                                                memory_order_release, memory_order_relaxed))
+   {
+      /* The log writer gave up on this process, and counted the line as dropped; hand the entry back */
+      expected = position | ABANDONED;
+      atomic_compare_exchange_strong_explicit(&entry->sequence, &expected, position + queues->size,
+                                              memory_order_release, memory_order_relaxed);
+   }
+
+   return true;
+}
+
+static void
+log_structured(int level, char* file, int line, char* event, int64_t duration, char* fmt, va_list ap)
+{
+   signed char isfree;
+   int size;
+   size_t length;
+   FILE* out;
+   char buffer[STRUCTURED_LENGTH];
+   char* message = NULL;
+   char* line_buffer = NULL;
+   char* output = &buffer[0];
+   va_list vl;
+   struct log_entry entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   log_entry_fill(&entry, level, file, line, event, duration);
+
+   va_copy(vl, ap);
+   size = vsnprintf(&entry.message[0], sizeof(entry.message), fmt, vl);
+   va_end(vl);
+
+   if (size < 0)
+   {
+      size = 0;
+   }
+   entry.length = size;
+
+   /* A longer message is formatted again into a buffer of its size */
+   if (size >= (int)sizeof(entry.message))
+   {
+      message = malloc(size + 1);
+      line_buffer = malloc(STRUCTURED_LENGTH + 6 * (size_t)size);
+
+      if (message != NULL && line_buffer != NULL)
+      {
+         vsnprintf(message, size + 1, fmt, ap);
+         length = log_format_line(&entry, message, size, false, config->log_format, line_buffer, STRUCTURED_LENGTH + 6 * (size_t)size);
+         output = line_buffer;
+      }
+      else
+      {
+         length = log_format_line(&entry, &entry.message[0], sizeof(entry.message) - 1, true, config->log_format, &buffer[0], sizeof(buffer));
+      }
+   }
+   else
+   {
+      length = log_format_line(&entry, &entry.message[0], entry.length, false, config->log_format, &buffer[0], sizeof(buffer));
+   }
+
+retry:
+   isfree = STATE_FREE;
+
+   if (atomic_compare_exchange_strong(&config->log_lock, &isfree, STATE_IN_USE))
+   {
+      if (config->log_type == PGAGROAL_LOGGING_TYPE_FILE)
+      {
+         out = log_file != NULL ? log_file : stderr;
+      }
+      else
+      {
+         out = stdout;
+      }
+
+      fwrite(output, 1, length, out);
+      fflush(out);
+
+      if (out == log_file && log_rotation_required())
+      {
+         log_file_rotate();
+      }
+
+      atomic_store(&config->log_lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000000L, retry)
+   }
+
+   free(message);
+   free(line_buffer);
+}
+
+static void
+log_entry_fill(struct log_entry* entry, int level, char* file, int line, char* event, int64_t duration)
+{
+   char* filename;
+   struct timespec ts;
+
+   filename = strrchr(file, '/');
+   if (filename != NULL)
+   {
+      filename = filename + 1;
+   }
+   else
+   {
+      filename = file;
+   }
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+
+   entry->time = ts.tv_sec;
+   entry->millis = ts.tv_nsec / 1000000;
+   entry->duration = duration;
+   entry->level = level;
+   entry->line = line;
+   entry->pid = getpid();
+   entry->slot = log_slot;
+   snprintf(&entry->file[0], sizeof(entry->file), "%s", filename);
+   memcpy(&entry->username[0], &log_username[0], sizeof(entry->username));
+   memcpy(&entry->database[0], &log_database[0], sizeof(entry->database));
+   snprintf(&entry->event[0], sizeof(entry->event), "%s", event != NULL ? event : "");
+}
+
+size_t
+pgagroal_log_entry_format(struct log_entry* entry, int format, char* buffer, size_t size)
+{
+   return log_format_line(entry, &entry->message[0], entry->length, false, format, buffer, size);
+}
+
+static size_t
+log_format_line(struct log_entry* entry, char* message, size_t length, bool truncated, int format, char* buffer, size_t size)
+{
+   bool json = format == PGAGROAL_LOGGING_FORMAT_JSON;
+   bool cut = false;
+   size_t end;
+   size_t offset = 0;
+   char* marker;
+   struct tm tm;
+
+   if (size <= STRUCTURED_RESERVE)
+   {
+      return 0;
+   }
+
+   /* The fields stop at end, which leaves room for the marker and the end of the line */
+   end = size - STRUCTURED_RESERVE;
+
+   if (entry->time != log_timestamp_time)
+   {
+      gmtime_r(&entry->time, &tm);
+      strftime(&log_timestamp_buffer[0], sizeof(log_timestamp_buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+      log_timestamp_time = entry->time;
+   }
+
+   if (json)
+   {
+      buffer[offset++] = '{';
+   }
+
+   offset = log_format_printf(buffer, end, offset, &cut, json ? "\"time\":\"%s.%03dZ\",\"level\":\"%s\",\"pid\":%d" : "time=%s.%03dZ level=%s pid=%d",
+                              &log_timestamp_buffer[0], entry->millis, levels[entry->level - 1], entry->pid);
+
+   if (entry->slot >= 0)
+   {
+      offset = log_format_printf(buffer, end, offset, &cut, json ? ",\"slot\":%d" : " slot=%d", entry->slot);
+   }
+
+   if (entry->username[0] != '\0')
+   {
+      offset = log_format_field(buffer, end, offset, &cut, json ? ",\"user\":" : " user=",
+                                &entry->username[0], strlen(&entry->username[0]), format, false);
+   }
+
+   if (entry->database[0] != '\0')
+   {
+      offset = log_format_field(buffer, end, offset, &cut, json ? ",\"database\":" : " database=",
+                                &entry->database[0], strlen(&entry->database[0]), format, false);
+   }
+
+   if (entry->event[0] != '\0')
+   {
+      offset = log_format_field(buffer, end, offset, &cut, json ? ",\"event\":" : " event=",
+                                &entry->event[0], strlen(&entry->event[0]), format, false);
+   }
+
+   if (entry->duration >= 0)
+   {
+      offset = log_format_printf(buffer, end, offset, &cut, json ? ",\"duration_ms\":%" PRId64 : " duration_ms=%" PRId64, entry->duration);
+   }
+
+   offset = log_format_field(buffer, end, offset, &cut, json ? ",\"file\":" : " file=",
+                             &entry->file[0], strlen(&entry->file[0]), format, false);
+   offset = log_format_printf(buffer, end, offset, &cut, json ? ",\"line\":%d" : " line=%d", entry->line);
+   offset = log_format_field(buffer, end, offset, &cut, json ? ",\"msg\":" : " msg=", message, length, format, true);
+
+   /* A cut line says so, and is closed either way */
+   if (cut || truncated)
+   {
+      if (json)
+      {
+         marker = offset > 1 ? ",\"truncated\":true" : "\"truncated\":true";
+      }
+      else
+      {
+         marker = offset > 0 ? " truncated=true" : "truncated=true";
+      }
+
+      memcpy(buffer + offset, marker, strlen(marker));
+      offset += strlen(marker);
+   }
+
+   if (json)
+   {
+      buffer[offset++] = '}';
+   }
+   buffer[offset++] = '\n';
+   buffer[offset] = '\0';
+
+   return offset;
+}
+
+static size_t
+log_format_printf(char* buffer, size_t end, size_t offset, bool* truncated, char* fmt, ...)
+{
+   int length;
+   va_list ap;
+
+   if (*truncated)
+   {
+      return offset;
+   }
+
+   va_start(ap, fmt);
+   length = vsnprintf(buffer + offset, end - offset, fmt, ap);
+   va_end(ap);
+
+   /* A field is written whole or not at all */
+   if (length < 0 || offset + length >= end)
+   {
+      *truncated = true;
+      return offset;
+   }
+
+   return offset + length;
+}
+
+static size_t
+log_format_field(char* buffer, size_t end, size_t offset, bool* truncated, char* key, char* s, size_t length, int format, bool quote)
+{
+   size_t key_length = strlen(key);
+   size_t escape_length;
+   char escape[8];
+   unsigned char c;
+
+   if (*truncated)
+   {
+      return offset;
+   }
+
+   if (format == PGAGROAL_LOGGING_FORMAT_LOGFMT && !quote)
+   {
+      for (size_t i = 0; i < length && !quote; i++)
+      {
+         c = (unsigned char)s[i];
+         quote = c <= ' ' || c == '"' || c == '=' || c == '\\';
+      }
+      quote = quote || length == 0;
+   }
+
+   quote = quote || format == PGAGROAL_LOGGING_FORMAT_JSON;
+
+   /* The key and both quotes, so a cut value is still closed */
+   if (offset + key_length + 2 > end)
+   {
+      *truncated = true;
+      return offset;
+   }
+
+   memcpy(buffer + offset, key, key_length);
+   offset += key_length;
+
+   if (quote)
+   {
+      buffer[offset++] = '"';
+   }
+
+   for (size_t i = 0; i < length; i++)
+   {
+      c = (unsigned char)s[i];
+
+      if (c == '"' || c == '\\')
+      {
+         escape_length = snprintf(&escape[0], sizeof(escape), "\\%c", c);
+      }
+      else if (c == '\n')
+      {
+         escape_length = snprintf(&escape[0], sizeof(escape), "\\n");
+      }
+      else if (c == '\t')
+      {
+         escape_length = snprintf(&escape[0], sizeof(escape), "\\t");
+      }
+      else if (c == '\r')
+      {
+         escape_length = snprintf(&escape[0], sizeof(escape), "\\r");
+      }
+      else if (c < 0x20)
+      {
+         escape_length = snprintf(&escape[0], sizeof(escape), "\\u%04x", c);
+      }
+      else
+      {
+         escape[0] = c;
+         escape_length = 1;
+      }
+
+      /* Room for the closing quote, and never half an escape */
+      if (offset + escape_length + 1 > end)
+      {
+         *truncated = true;
+         break;
+      }
+
+      memcpy(buffer + offset, &escape[0], escape_length);
+      offset += escape_length;
+   }
+
+   if (quote)
+   {
+      buffer[offset++] = '"';
+   }
+
+   return offset;
+}
+
+int
+pgagroal_log_queue_write(struct log_queues* queues, int queue, struct log_stall* stall)
+{
+   int fd;
+   int count = 0;
+   int length;
+   pid_t owner;
+   time_t now;
+   uint64_t head;
+   uint64_t expected;
+   char headers[BATCH_LENGTH][HEADER_LENGTH];
+   struct iovec iov[BATCH_LENGTH * 3];
+   struct log_entry* entries[BATCH_LENGTH];
+   struct log_entry* entry;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+   head = queues->queues[queue].head;
+
+   /* An abandoned entry is handed back by its process, or here once that process is gone */
+   if (stall->abandoned != 0)
+   {
+      entry = pgagroal_log_queue_entry(queues, queue, stall->abandoned & ~ABANDONED);
+      expected = stall->abandoned;
+
+      if (atomic_load_explicit(&entry->sequence, memory_order_acquire) != expected)
+      {
+         stall->abandoned = 0;
+      }
+      else
+      {
+         owner = atomic_load_explicit(&entry->owner, memory_order_relaxed);
+
+         if (owner != 0 && kill(owner, 0) == -1 && errno == ESRCH)
+         {
+            atomic_store_explicit(&entry->owner, 0, memory_order_relaxed);
+            atomic_compare_exchange_strong_explicit(&entry->sequence, &expected, (stall->abandoned & ~ABANDONED) + queues->size,
+                                                    memory_order_release, memory_order_relaxed);
+            stall->abandoned = 0;
+         }
+
+         errno = 0;
+      }
+   }
+
+   while (count < BATCH_LENGTH)
+   {
+      entry = pgagroal_log_queue_entry(queues, queue, head + count);
+
+      if (atomic_load_explicit(&entry->sequence, memory_order_acquire) != head + count + 1)
+      {
+         break;
+      }
+
+      entries[count] = entry;
+      count++;
+   }
+
+   if (count == 0)
+   {
+      if (atomic_load_explicit(&queues->queues[queue].tail, memory_order_relaxed) == head)
+      {
+         stall->since = 0;
+         return 0;
+      }
+
+      /* An entry was taken but not filled, skip it when its process is gone */
+      now = time(NULL);
+      if (stall->since == 0)
+      {
+         stall->since = now;
+      }
+      else if (now - stall->since >= STALL_TIMEOUT && stall->abandoned == 0)
+      {
+         /* A late publish then fails, so the entry is never reused while its process writes it */
+         expected = head;
+         if (atomic_compare_exchange_strong_explicit(&pgagroal_log_queue_entry(queues, queue, head)->sequence, &expected, head | ABANDONED,
+                                                     memory_order_acq_rel, memory_order_relaxed))
+         {
+            queues->queues[queue].head = head + 1;
+            atomic_fetch_add_explicit(&queues->dropped, 1, memory_order_relaxed);
+            stall->abandoned = head | ABANDONED;
+         }
+         stall->since = 0;
+      }
+
+      return 0;
+   }
+
+   stall->since = 0;
+
+   for (int i = 0; i < count && config->log_format != PGAGROAL_LOGGING_FORMAT_TEXT; i++)
+   {
+      iov[i].iov_base = &log_batch[i][0];
+      iov[i].iov_len = pgagroal_log_entry_format(entries[i], config->log_format, &log_batch[i][0], STRUCTURED_LENGTH);
+   }
+
+   for (int i = 0; i < count && config->log_format == PGAGROAL_LOGGING_FORMAT_TEXT; i++)
+   {
+      entry = entries[i];
+
+      if (config->log_type == PGAGROAL_LOGGING_TYPE_CONSOLE)
+      {
+         length = snprintf(&headers[i][0], HEADER_LENGTH, "%s %s%-5s\x1b[0m \x1b[90m%s:%d\x1b[0m ",
+                           log_prefix(entry->time), colors[entry->level - 1], levels[entry->level - 1],
+                           entry->file, entry->line);
+      }
+      else
+      {
+         length = snprintf(&headers[i][0], HEADER_LENGTH, "%s %-5s %s:%d ",
+                           log_prefix(entry->time), levels[entry->level - 1], entry->file, entry->line);
+      }
+
+      iov[i * 3].iov_base = &headers[i][0];
+      iov[i * 3].iov_len = MIN(length, HEADER_LENGTH - 1);
+      iov[i * 3 + 1].iov_base = &entry->message[0];
+      iov[i * 3 + 1].iov_len = entry->length;
+      iov[i * 3 + 2].iov_base = "\n";
+      iov[i * 3 + 2].iov_len = 1;
+   }
+
+   if (config->log_type == PGAGROAL_LOGGING_TYPE_FILE)
+   {
+      fd = log_file != NULL ? fileno(log_file) : STDERR_FILENO;
+   }
+   else
+   {
+      fd = STDOUT_FILENO;
+   }
+
+   log_writev(fd, &iov[0], config->log_format == PGAGROAL_LOGGING_FORMAT_TEXT ? count * 3 : count);
+
+   for (int i = 0; i < count; i++)
+   {
+      atomic_store_explicit(&entries[i]->sequence, head + i + queues->size, memory_order_release);
+   }
+   queues->queues[queue].head = head + count;
+
+   return count;
+}
+
+static void
+log_writev(int fd, struct iovec* iov, int count)
+{
+   ssize_t written;
+
+   while (count > 0)
+   {
+      written = writev(fd, iov, count);
+
+      if (written < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+
+         errno = 0;
+         return;
+      }
+
+      while (count > 0 && (size_t)written >= iov->iov_len)
+      {
+         written -= iov->iov_len;
+         iov++;
+         count--;
+      }
+
+      if (count > 0)
+      {
+         iov->iov_base = (char*)iov->iov_base + written;
+         iov->iov_len -= written;
+      }
+   }
+}
+
+static char*
+log_prefix(time_t t)
+{
+   struct tm tm;
+   const char* prefix;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (t != log_prefix_time)
+   {
+      prefix = config->log_line_prefix;
+      if (strlen(prefix) == 0)
+      {
+         prefix = PGAGROAL_LOGGING_DEFAULT_LOG_LINE_PREFIX;
+      }
+
+      localtime_r(&t, &tm);
+      log_prefix_buffer[strftime(&log_prefix_buffer[0], sizeof(log_prefix_buffer), prefix, &tm)] = '\0';
+      log_prefix_time = t;
+   }
+
+   return &log_prefix_buffer[0];
+}
+
 bool
 pgagroal_log_is_enabled(int level)
 {
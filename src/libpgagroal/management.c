@@ -452,7 +452,7 @@ error:
 }
 
 int
-pgagroal_management_request_details(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format)
+pgagroal_management_request_details(SSL* ssl, int socket, char* state, char* username, char* database, int64_t offset, int64_t limit, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
    struct json* j = NULL;
    struct json* request = NULL;
@@ -467,6 +467,27 @@ pgagroal_management_request_details(SSL* ssl, int socket, uint8_t compression, u
       goto error;
    }
 
+   if (state != NULL)
+   {
+      pgagroal_json_put(request, MANAGEMENT_ARGUMENT_STATE, (uintptr_t)state, ValueString);
+   }
+
+   if (username != NULL)
+   {
+      pgagroal_json_put(request, MANAGEMENT_ARGUMENT_USERNAME, (uintptr_t)username, ValueString);
+   }
+
+   if (database != NULL)
+   {
+      pgagroal_json_put(request, MANAGEMENT_ARGUMENT_DATABASE, (uintptr_t)database, ValueString);
+   }
+
+   if (limit > 0)
+   {
+      pgagroal_json_put(request, MANAGEMENT_ARGUMENT_OFFSET, (uintptr_t)offset, ValueInt64);
+      pgagroal_json_put(request, MANAGEMENT_ARGUMENT_LIMIT, (uintptr_t)limit, ValueInt64);
+   }
+
    if (pgagroal_management_write_json(ssl, socket, compression, encryption, j))
    {
       goto error;
@@ -581,6 +602,104 @@ error:
    return 1;
 }
 
+int
+pgagroal_management_request_clear_auth_query(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   struct json* j = NULL;
+   struct json* request = NULL;
+
+   if (pgagroal_management_create_header(MANAGEMENT_CLEAR_AUTH_QUERY, compression, encryption, output_format, &j))
+   {
+      goto error;
+   }
+
+   if (pgagroal_management_create_request(j, &request))
+   {
+      goto error;
+   }
+
+   if (pgagroal_management_write_json(ssl, socket, compression, encryption, j))
+   {
+      goto error;
+   }
+
+   pgagroal_json_destroy(j);
+
+   return 0;
+
+error:
+
+   pgagroal_json_destroy(j);
+
+   return 1;
+}
+
+int
+pgagroal_management_request_tracker(SSL* ssl, int socket, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   struct json* j = NULL;
+   struct json* request = NULL;
+
+   if (pgagroal_management_create_header(MANAGEMENT_TRACKER, compression, encryption, output_format, &j))
+   {
+      goto error;
+   }
+
+   if (pgagroal_management_create_request(j, &request))
+   {
+      goto error;
+   }
+
+   if (pgagroal_management_write_json(ssl, socket, compression, encryption, j))
+   {
+      goto error;
+   }
+
+   pgagroal_json_destroy(j);
+
+   return 0;
+
+error:
+
+   pgagroal_json_destroy(j);
+
+   return 1;
+}
+
+int
+pgagroal_management_request_flight_recorder(SSL* ssl, int socket, int32_t slot, uint8_t compression, uint8_t encryption, int32_t output_format)
+{
+   struct json* j = NULL;
+   struct json* request = NULL;
+
+   if (pgagroal_management_create_header(MANAGEMENT_FLIGHT_RECORDER, compression, encryption, output_format, &j))
+   {
+      goto error;
+   }
+
+   if (pgagroal_management_create_request(j, &request))
+   {
+      goto error;
+   }
+
+   pgagroal_json_put(request, MANAGEMENT_ARGUMENT_SLOT, (uintptr_t)slot, ValueInt32);
+
+   if (pgagroal_management_write_json(ssl, socket, compression, encryption, j))
+   {
+      goto error;
+   }
+
+   pgagroal_json_destroy(j);
+
+   return 0;
+
+error:
+
+   pgagroal_json_destroy(j);
+
+   return 1;
+}
+
 int
 pgagroal_management_request_switch_to(SSL* ssl, int socket, char* server, uint8_t compression, uint8_t encryption, int32_t output_format)
 {
@@ -749,6 +868,7 @@ error:
 int
 pgagroal_management_create_header(int32_t command, uint8_t compression, uint8_t encryption, int32_t output_format, struct json** json)
 {
+   static int64_t request_id = 0;
    time_t t;
    char timestamp[128];
    struct tm* time_info;
@@ -777,6 +897,7 @@ pgagroal_management_create_header(int32_t command, uint8_t compression, uint8_t
    pgagroal_json_put(header, MANAGEMENT_ARGUMENT_TIMESTAMP, (uintptr_t)timestamp, ValueString);
    pgagroal_json_put(header, MANAGEMENT_ARGUMENT_COMPRESSION, (uintptr_t)compression, ValueUInt8);
    pgagroal_json_put(header, MANAGEMENT_ARGUMENT_ENCRYPTION, (uintptr_t)encryption, ValueUInt8);
+   pgagroal_json_put(header, MANAGEMENT_ARGUMENT_REQUEST_ID, (uintptr_t)++request_id, ValueInt64);
 
    pgagroal_json_put(j, MANAGEMENT_CATEGORY_HEADER, (uintptr_t)header, ValueJSON);
 
@@ -37,10 +37,13 @@
 #include <fcntl.h>
 #include <ifaddrs.h>
 #include <netdb.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <net/if.h>
@@ -56,6 +59,10 @@
 
 static int bind_host(const char* hostname, int port, int** fds, int* length, int* buffer_size, bool no_delay, int backlog);
 static int socket_buffers(int fd);
+static int resolve(const char* hostname, int port, struct server_address* addresses, int* count);
+static void store_addresses(struct server* srv, struct server_address* addresses, int count, time_t expire);
+static int connect_socket(struct server_address* address, bool keep_alive, bool no_delay, int* fd);
+static int connect_addresses(struct server_address* addresses, int count, int timeout_ms, bool keep_alive, bool no_delay, int* fd);
 
 /**
  *
@@ -243,119 +250,101 @@ pgagroal_remove_unix_socket(const char* directory, const char* file)
 int
 pgagroal_connect(const char* hostname, int port, int* fd, bool keep_alive, bool no_delay)
 {
-   int default_buffer_size = DEFAULT_BUFFER_SIZE;
-   struct addrinfo hints = {0};
-   struct addrinfo* servinfo = NULL;
-   struct addrinfo* p = NULL;
-   int yes = 1;
-   socklen_t optlen = sizeof(int);
-   int rv;
-   char sport[6];
-   int error = 0;
+   int count = 0;
+   struct server_address addresses[MAX_SERVER_ADDRESSES];
 
-   memset(&sport, 0, sizeof(sport));
-   pgagroal_snprintf(&sport[0], sizeof(sport), "%d", port);
-
-   /* Connect to server */
-   memset(&hints, 0, sizeof hints);
-   hints.ai_family = AF_UNSPEC;
-   hints.ai_socktype = SOCK_STREAM;
+   *fd = -1;
 
-   if ((rv = getaddrinfo(hostname, &sport[0], &hints, &servinfo)) != 0)
+   if (resolve(hostname, port, &addresses[0], &count))
    {
-      pgagroal_log_debug("getaddrinfo: %s", gai_strerror(rv));
-      if (servinfo != NULL)
-      {
-         freeaddrinfo(servinfo);
-      }
       return 1;
    }
 
-   *fd = -1;
-
-   /* Loop through all the results and connect to the first we can */
-   for (p = servinfo; *fd == -1 && p != NULL; p = p->ai_next)
-   {
-      if ((*fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
-      {
-         error = errno;
-         errno = 0;
-      }
+   return connect_addresses(&addresses[0], count, 0, keep_alive, no_delay, fd);
+}
 
-      if (*fd != -1)
-      {
-         if (keep_alive)
-         {
-            if (setsockopt(*fd, SOL_SOCKET, SO_KEEPALIVE, &yes, optlen) == -1)
-            {
-               error = errno;
-               pgagroal_disconnect(*fd);
-               errno = 0;
-               *fd = -1;
-               continue;
-            }
-         }
+int
+pgagroal_connect_server(int server, int* fd, bool keep_alive, bool no_delay)
+{
+   int count = 0;
+   int timeout;
+   time_t now;
+   signed char free;
+   struct server* srv;
+   struct server_address addresses[MAX_SERVER_ADDRESSES];
+   struct main_configuration* config;
 
-         if (no_delay)
-         {
-            if (setsockopt(*fd, IPPROTO_TCP, TCP_NODELAY, &yes, optlen) == -1)
-            {
-               error = errno;
-               pgagroal_disconnect(*fd);
-               errno = 0;
-               *fd = -1;
-               continue;
-            }
-         }
+   config = (struct main_configuration*)shmem;
+   srv = &config->servers[server];
+   timeout = (int)pgagroal_time_convert(config->connect_timeout, FORMAT_TIME_S);
 
-         if (setsockopt(*fd, SOL_SOCKET, SO_RCVBUF, &default_buffer_size, optlen) == -1)
-         {
-            error = errno;
-            pgagroal_disconnect(*fd);
-            errno = 0;
-            *fd = -1;
-            continue;
-         }
+   *fd = -1;
 
-         if (setsockopt(*fd, SOL_SOCKET, SO_SNDBUF, &default_buffer_size, optlen) == -1)
-         {
-            error = errno;
-            pgagroal_disconnect(*fd);
-            errno = 0;
-            *fd = -1;
-            continue;
-         }
+   if (pgagroal_time_is_valid(config->dns_cache_ttl))
+   {
+      now = time(NULL);
 
-         if (connect(*fd, p->ai_addr, p->ai_addrlen) == -1)
+      free = STATE_FREE;
+      if (atomic_compare_exchange_strong(&srv->dns_lock, &free, STATE_IN_USE))
+      {
+         if (srv->dns_expire > now)
          {
-            error = errno;
-            pgagroal_disconnect(*fd);
-            errno = 0;
-            *fd = -1;
-            continue;
+            count = srv->number_of_addresses;
+            memcpy(&addresses[0], &srv->addresses[0], count * sizeof(struct server_address));
          }
+         atomic_store(&srv->dns_lock, STATE_FREE);
       }
    }
 
-   if (*fd == -1)
+   if (count == 0)
    {
-      goto error;
-   }
+      if (resolve(srv->host, srv->port, &addresses[0], &count))
+      {
+         return 1;
+      }
 
-   freeaddrinfo(servinfo);
+      if (pgagroal_time_is_valid(config->dns_cache_ttl))
+      {
+         store_addresses(srv, &addresses[0], count,
+                         time(NULL) + pgagroal_time_convert(config->dns_cache_ttl, FORMAT_TIME_S));
+      }
+   }
 
-   return 0;
+   return connect_addresses(&addresses[0], count, timeout > 0 ? timeout * 1000 : 0, keep_alive, no_delay, fd);
+}
 
-error:
+void
+pgagroal_resolve_servers(void)
+{
+   int count;
+   struct server_address addresses[MAX_SERVER_ADDRESSES];
+   struct main_configuration* config;
 
-   pgagroal_log_debug("pgagroal_connect: %s", strerror(error));
+   config = (struct main_configuration*)shmem;
 
-   if (servinfo != NULL)
+   if (!pgagroal_time_is_valid(config->dns_cache_ttl))
    {
-      freeaddrinfo(servinfo);
+      return;
    }
 
-   return 1;
+   FOREACH_VALID_SERVER
+   {
+      if (config->servers[i].host[0] == '/')
+      {
+         continue;
+      }
+
+      count = 0;
+      if (resolve(config->servers[i].host, config->servers[i].port, &addresses[0], &count))
+      {
+         /* Keep serving the previous addresses until they expire */
+         pgagroal_log_debug("Could not refresh the addresses of %s (%s)", config->servers[i].name, config->servers[i].host);
+         continue;
+      }
+
+      store_addresses(&config->servers[i], &addresses[0], count,
+                      time(NULL) + pgagroal_time_convert(config->dns_cache_ttl, FORMAT_TIME_S));
+   }
 }
 
 /**
@@ -506,6 +495,48 @@ pgagroal_tcp_nodelay(int fd)
    return 0;
 }
 
+int
+pgagroal_socket_busy_poll(int fd, int usec)
+{
+   static bool warned = false;
+   int value = usec;
+   socklen_t optlen = sizeof(int);
+
+   if (usec <= 0)
+   {
+      return 0;
+   }
+
+#ifdef SO_BUSY_POLL
+   if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, optlen) == -1)
+   {
+      /* Without CAP_NET_ADMIN every socket fails the same way */
+      if (!warned)
+      {
+         pgagroal_log_warn("busy_poll: %d %s", fd, strerror(errno));
+         warned = true;
+      }
+      else
+      {
+         pgagroal_log_debug("busy_poll: %d %s", fd, strerror(errno));
+      }
+      errno = 0;
+      return 1;
+   }
+#endif
+
+#ifdef SO_PREFER_BUSY_POLL
+   value = 1;
+   if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, optlen) == -1)
+   {
+      pgagroal_log_debug("prefer_busy_poll: %d %s", fd, strerror(errno));
+      errno = 0;
+   }
+#endif
+
+   return 0;
+}
+
 int
 pgagroal_socket_nonblocking(int fd)
 {
@@ -700,3 +731,310 @@ bind_host(const char* hostname, int port, int** fds, int* length, int* buffer_si
 
    return 0;
 }
+
+static int
+resolve(const char* hostname, int port, struct server_address* addresses, int* count)
+{
+   struct addrinfo hints = {0};
+   struct addrinfo* servinfo = NULL;
+   struct addrinfo* p = NULL;
+   struct server_address v4[MAX_SERVER_ADDRESSES];
+   struct server_address v6[MAX_SERVER_ADDRESSES];
+   int n4 = 0;
+   int n6 = 0;
+   int i4 = 0;
+   int i6 = 0;
+   bool ipv6_first = true;
+   int rv;
+   char sport[6];
+
+   *count = 0;
+
+   memset(&sport, 0, sizeof(sport));
+   pgagroal_snprintf(&sport[0], sizeof(sport), "%d", port);
+
+   memset(&hints, 0, sizeof hints);
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+
+   if ((rv = getaddrinfo(hostname, &sport[0], &hints, &servinfo)) != 0)
+   {
+      pgagroal_log_debug("getaddrinfo: %s", gai_strerror(rv));
+      if (servinfo != NULL)
+      {
+         freeaddrinfo(servinfo);
+      }
+      return 1;
+   }
+
+   for (p = servinfo; p != NULL; p = p->ai_next)
+   {
+      if (p->ai_addrlen > sizeof(struct sockaddr_storage))
+      {
+         continue;
+      }
+
+      if (p->ai_family == AF_INET6 && n6 < MAX_SERVER_ADDRESSES)
+      {
+         if (n4 == 0 && n6 == 0)
+         {
+            ipv6_first = true;
+         }
+         v6[n6].length = p->ai_addrlen;
+         memcpy(&v6[n6].address, p->ai_addr, p->ai_addrlen);
+         n6++;
+      }
+      else if (p->ai_family == AF_INET && n4 < MAX_SERVER_ADDRESSES)
+      {
+         if (n4 == 0 && n6 == 0)
+         {
+            ipv6_first = false;
+         }
+         v4[n4].length = p->ai_addrlen;
+         memcpy(&v4[n4].address, p->ai_addr, p->ai_addrlen);
+         n4++;
+      }
+   }
+
+   freeaddrinfo(servinfo);
+
+   /* Interleave the address families, starting with the preferred one (RFC 8305) */
+   while (*count < MAX_SERVER_ADDRESSES && (i4 < n4 || i6 < n6))
+   {
+      if (ipv6_first ? i6 < n6 : i4 >= n4)
+      {
+         addresses[(*count)++] = v6[i6++];
+         if (i4 < n4 && *count < MAX_SERVER_ADDRESSES)
+         {
+            addresses[(*count)++] = v4[i4++];
+         }
+      }
+      else
+      {
+         addresses[(*count)++] = v4[i4++];
+         if (i6 < n6 && *count < MAX_SERVER_ADDRESSES)
+         {
+            addresses[(*count)++] = v6[i6++];
+         }
+      }
+   }
+
+   if (*count == 0)
+   {
+      pgagroal_log_debug("getaddrinfo: no usable address for %s", hostname);
+      return 1;
+   }
+
+   return 0;
+}
+
+static void
+store_addresses(struct server* srv, struct server_address* addresses, int count, time_t expire)
+{
+   signed char free;
+
+retry:
+   free = STATE_FREE;
+   if (atomic_compare_exchange_strong(&srv->dns_lock, &free, STATE_IN_USE))
+   {
+      memcpy(&srv->addresses[0], addresses, count * sizeof(struct server_address));
+      srv->number_of_addresses = count;
+      srv->dns_expire = expire;
+
+      atomic_store(&srv->dns_lock, STATE_FREE);
+   }
+   else
+   {
+      /* Readers only hold the lock for a copy */
+      SLEEP_AND_GOTO(1000L, retry);
+   }
+}
+
+static int
+connect_socket(struct server_address* address, bool keep_alive, bool no_delay, int* fd)
+{
+   int default_buffer_size = DEFAULT_BUFFER_SIZE;
+   int yes = 1;
+   socklen_t optlen = sizeof(int);
+   int s;
+
+   *fd = -1;
+
+   if ((s = socket(address->address.ss_family, SOCK_STREAM, 0)) == -1)
+   {
+      return errno;
+   }
+
+   if ((keep_alive && setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &yes, optlen) == -1) ||
+       (no_delay && setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &yes, optlen) == -1) ||
+       setsockopt(s, SOL_SOCKET, SO_RCVBUF, &default_buffer_size, optlen) == -1 ||
+       setsockopt(s, SOL_SOCKET, SO_SNDBUF, &default_buffer_size, optlen) == -1 ||
+       fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) == -1)
+   {
+      goto error;
+   }
+
+   if (connect(s, (struct sockaddr*)&address->address, address->length) == -1 && errno != EINPROGRESS)
+   {
+      goto error;
+   }
+
+   *fd = s;
+   errno = 0;
+
+   return 0;
+
+error:
+
+   yes = errno;
+   pgagroal_disconnect(s);
+   errno = 0;
+
+   return yes;
+}
+
+/**
+ * Connect to the first address that answers. A new attempt is started every
+ * CONNECT_ATTEMPT_DELAY ms (or as soon as the previous one fails) while the
+ * earlier ones are still in flight (RFC 8305)
+ */
+static int
+connect_addresses(struct server_address* addresses, int count, int timeout_ms, bool keep_alive, bool no_delay, int* fd)
+{
+   struct pollfd pending[MAX_SERVER_ADDRESSES];
+   int number_of_pending = 0;
+   int next = 0;
+   int error = 0;
+   int wait;
+   int n;
+   int s;
+   int so_error;
+   socklen_t optlen;
+   bool start_next = true;
+   struct timespec now;
+   int64_t deadline = 0;
+
+   *fd = -1;
+
+   if (timeout_ms > 0)
+   {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      deadline = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeout_ms;
+   }
+
+   while (*fd == -1)
+   {
+      if (start_next && next < count)
+      {
+         start_next = false;
+
+         error = connect_socket(&addresses[next++], keep_alive, no_delay, &s);
+         if (s == -1)
+         {
+            start_next = true;
+            continue;
+         }
+
+         pending[number_of_pending].fd = s;
+         pending[number_of_pending].events = POLLOUT;
+         pending[number_of_pending].revents = 0;
+         number_of_pending++;
+      }
+
+      if (number_of_pending == 0)
+      {
+         break;
+      }
+
+      wait = next < count ? CONNECT_ATTEMPT_DELAY : -1;
+      if (deadline > 0)
+      {
+         int64_t remaining;
+
+         clock_gettime(CLOCK_MONOTONIC, &now);
+         remaining = deadline - ((int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+         if (remaining <= 0)
+         {
+            error = ETIMEDOUT;
+            break;
+         }
+         wait = wait < 0 ? (int)remaining : (int)MIN(wait, remaining);
+      }
+
+      n = poll(&pending[0], number_of_pending, wait);
+      if (n == -1)
+      {
+         if (errno == EINTR)
+         {
+            errno = 0;
+            continue;
+         }
+         error = errno;
+         errno = 0;
+         break;
+      }
+
+      if (n == 0)
+      {
+         start_next = true;
+         continue;
+      }
+
+      for (int i = 0; i < number_of_pending;)
+      {
+         if (pending[i].revents == 0)
+         {
+            i++;
+            continue;
+         }
+
+         so_error = 0;
+         optlen = sizeof(so_error);
+         if (getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &so_error, &optlen) == -1)
+         {
+            so_error = errno;
+            errno = 0;
+         }
+
+         if (so_error == 0)
+         {
+            *fd = pending[i].fd;
+         }
+         else
+         {
+            error = so_error;
+            pgagroal_disconnect(pending[i].fd);
+            start_next = true;
+         }
+
+         pending[i] = pending[--number_of_pending];
+
+         if (*fd != -1)
+         {
+            break;
+         }
+      }
+   }
+
+   for (int i = 0; i < number_of_pending; i++)
+   {
+      pgagroal_disconnect(pending[i].fd);
+   }
+
+   if (*fd == -1)
+   {
+      pgagroal_log_debug("pgagroal_connect: %s", strerror(error));
+      return 1;
+   }
+
+   if (fcntl(*fd, F_SETFL, fcntl(*fd, F_GETFL) & ~O_NONBLOCK) == -1)
+   {
+      pgagroal_log_debug("pgagroal_connect: %s", strerror(errno));
+      pgagroal_disconnect(*fd);
+      errno = 0;
+      *fd = -1;
+      return 1;
+   }
+
+   return 0;
+}
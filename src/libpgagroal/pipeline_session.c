@@ -35,6 +35,7 @@
 #include <network.h>
 #include <pipeline.h>
 #include <prometheus.h>
+#include <recorder.h>
 #include <server.h>
 #include <shmem.h>
 #include <utils.h>
@@ -246,7 +247,7 @@ session_periodic(void)
                   }
                   else
                   {
-                     ret = pgagroal_connect(config->servers[server].host, config->servers[server].port, &socket, config->keep_alive, config->nodelay);
+                     ret = pgagroal_connect_server(server, &socket, config->keep_alive, config->nodelay);
                   }
 
                   if (ret == 0)
@@ -300,6 +301,7 @@ session_client(struct io_watcher* watcher)
    if (likely(status == MESSAGE_STATUS_OK))
    {
       pgagroal_prometheus_network_sent_add(msg->length);
+      pgagroal_recorder_clock();
 
       if (likely(msg->kind != 'X'))
       {
@@ -312,6 +314,8 @@ session_client(struct io_watcher* watcher)
                char kind = pgagroal_read_byte(msg->data + offset);
                int length = pgagroal_read_int32(msg->data + offset + 1);
 
+               pgagroal_recorder_add(wi->slot, RECORDER_CLIENT, kind, length);
+
                /* The Q and E message tell us the execute of the simple query and the prepared statement */
                if (kind == 'Q' || kind == 'E')
                {
@@ -451,6 +455,7 @@ session_server(struct io_watcher* watcher)
    if (likely(status == MESSAGE_STATUS_OK))
    {
       pgagroal_prometheus_network_received_add(msg->length);
+      pgagroal_recorder_clock();
 
       int offset = 0;
 
@@ -461,6 +466,8 @@ session_server(struct io_watcher* watcher)
             char kind = pgagroal_read_byte(msg->data + offset);
             int length = pgagroal_read_int32(msg->data + offset + 1);
 
+            pgagroal_recorder_add(wi->slot, RECORDER_SERVER, kind, length);
+
             /* The Z message tell us the transaction state */
             if (kind == 'Z')
             {
@@ -472,6 +479,13 @@ session_server(struct io_watcher* watcher)
                }
 
                in_tx = tx_state != 'I';
+
+               pgagroal_prometheus_traffic_flush();
+               pgagroal_recorder_ready(wi->slot, tx_state);
+            }
+            else if (kind == 'E')
+            {
+               pgagroal_prometheus_traffic_error_add();
             }
 
             /* Calculate the offset to the next message */
@@ -36,6 +36,7 @@
 #include <pipeline.h>
 #include <pool.h>
 #include <prometheus.h>
+#include <recorder.h>
 #include <server.h>
 #include <shmem.h>
 #include <tracker.h>
@@ -62,6 +63,7 @@ static void transaction_periodic(void);
 static void start_mgt(struct event_loop* loop);
 static void shutdown_mgt(struct event_loop* loop);
 static void accept_cb(struct io_watcher* watcher);
+static void release_server_ssl(void);
 
 static int slot;
 static char username[MAX_USERNAME_LENGTH];
@@ -77,6 +79,7 @@ static int fds[MAX_NUMBER_OF_CONNECTIONS];
 static bool saw_x = false;
 static struct io_watcher io_mgt;
 static struct worker_io server_io;
+static struct worker_io* client_io = NULL;
 static bool io_watcher_active = false;
 
 struct pipeline
@@ -111,6 +114,7 @@ transaction_start(struct event_loop* loop, struct worker_io* w)
    config = (struct main_configuration*)shmem;
 
    slot = -1;
+   client_io = w;
    memcpy(&username[0], config->connections[w->slot].username, MAX_USERNAME_LENGTH);
    memcpy(&database[0], config->connections[w->slot].database, MAX_DATABASE_LENGTH);
    memcpy(&appname[0], config->connections[w->slot].appname, MAX_APPLICATION_NAME);
@@ -140,6 +144,7 @@ transaction_start(struct event_loop* loop, struct worker_io* w)
 
    is_new = config->connections[w->slot].new;
    pgagroal_return_connection(w->slot, w->server_ssl, true);
+   release_server_ssl();
 
    w->server_fd = -1;
    w->slot = -1;
@@ -182,6 +187,7 @@ transaction_stop(struct event_loop* loop, struct worker_io* w)
       }
       pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION_STOP, w->slot);
       pgagroal_return_connection(slot, w->server_ssl, true);
+      release_server_ssl();
       slot = -1;
    }
 
@@ -223,6 +229,7 @@ transaction_client(struct io_watcher* watcher)
       wi->server_fd = fds[slot];
       wi->server_ssl = s_ssl;
       wi->slot = slot;
+      pgagroal_log_context(slot, NULL, NULL);
 
       pgagroal_event_worker_init(&wi->io, wi->client_fd, wi->server_fd, transaction_client);
 
@@ -247,6 +254,7 @@ transaction_client(struct io_watcher* watcher)
    if (likely(status == MESSAGE_STATUS_OK))
    {
       pgagroal_prometheus_network_sent_add(msg->length);
+      pgagroal_recorder_clock();
 
       if (likely(msg->kind != 'X'))
       {
@@ -259,6 +267,8 @@ transaction_client(struct io_watcher* watcher)
                char kind = pgagroal_read_byte(msg->data + offset);
                int length = pgagroal_read_int32(msg->data + offset + 1);
 
+               pgagroal_recorder_add(wi->slot, RECORDER_CLIENT, kind, length);
+
                if (config->track_prepared_statements)
                {
                   /* The P message tell us the prepared statement */
@@ -412,6 +422,7 @@ transaction_server(struct io_watcher* watcher)
    if (likely(status == MESSAGE_STATUS_OK))
    {
       pgagroal_prometheus_network_received_add(msg->length);
+      pgagroal_recorder_clock();
 
       int offset = 0;
 
@@ -422,6 +433,8 @@ transaction_server(struct io_watcher* watcher)
             char kind = pgagroal_read_byte(msg->data + offset);
             int length = pgagroal_read_int32(msg->data + offset + 1);
 
+            pgagroal_recorder_add(wi->slot, RECORDER_SERVER, kind, length);
+
             /* The Z message tell us the transaction state */
             if (kind == 'Z')
             {
@@ -433,6 +446,13 @@ transaction_server(struct io_watcher* watcher)
                }
 
                in_tx = tx_state != 'I';
+
+               pgagroal_prometheus_traffic_flush();
+               pgagroal_recorder_ready(wi->slot, tx_state);
+            }
+            else if (kind == 'E')
+            {
+               pgagroal_prometheus_traffic_error_add();
             }
 
             /* Calculate the offset to the next message */
@@ -506,6 +526,7 @@ transaction_server(struct io_watcher* watcher)
                          * connection; any unrecognised future value also falls here safely. */
                         pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION, slot);
                         pgagroal_kill_connection(slot, wi->server_ssl);
+                        release_server_ssl();
                         slot = -1;
                         goto return_error;
                   }
@@ -526,10 +547,13 @@ transaction_server(struct io_watcher* watcher)
             pgagroal_tracking_event_slot(TRACKER_TX_RETURN_CONNECTION, slot);
             if (pgagroal_return_connection(slot, wi->server_ssl, true))
             {
+               release_server_ssl();
                goto return_error;
             }
+            release_server_ssl();
 
             slot = -1;
+            pgagroal_log_context(-1, NULL, NULL);
          }
          else
          {
@@ -591,6 +615,18 @@ return_error:
    return;
 }
 
+/* Returning or killing the backend releases its TLS state; with an encrypted
+ * backend the next transaction resumes the session parked in its slot */
+static void
+release_server_ssl(void)
+{
+   server_io.server_ssl = NULL;
+   if (client_io != NULL)
+   {
+      client_io->server_ssl = NULL;
+   }
+}
+
 static void
 start_mgt(struct event_loop* loop __attribute__((unused)))
 {
@@ -77,6 +77,8 @@ pgagroal_get_connection(char* username, char* database, bool reuse, bool transac
    int server;
    int fd;
    time_t start_time;
+   uint64_t start_us;
+   uint64_t connect_us;
    int best_rule;
    int retries;
    long retry_delay;
@@ -95,6 +97,7 @@ pgagroal_get_connection(char* username, char* database, bool reuse, bool transac
    retries = 0;
    retry_delay = 0; /* seeds the back-off at 1ms on the first blocking retry; persists across goto start */
    start_time = time(NULL);
+   start_us = pgagroal_monotonic_us();
    pgagroal_prometheus_connection_awaiting(best_rule);
 
 start:
@@ -248,6 +251,8 @@ start:
 
          pgagroal_log_debug("connect: server %d", server);
 
+         connect_us = pgagroal_monotonic_us();
+
          if (config->servers[server].host[0] == '/')
          {
             char pgsql[MISC_LENGTH];
@@ -258,7 +263,11 @@ start:
          }
          else
          {
-            ret = pgagroal_connect(config->servers[server].host, config->servers[server].port, &fd, config->keep_alive, config->nodelay);
+            ret = pgagroal_connect_server(server, &fd, config->keep_alive, config->nodelay);
+            if (ret == 0)
+            {
+               pgagroal_socket_busy_poll(fd, config->busy_poll);
+            }
          }
 
          if (ret)
@@ -292,6 +301,8 @@ start:
 
          pgagroal_log_debug("connect: %s:%d using slot %d fd %d", config->servers[server].host, config->servers[server].port, *slot, fd);
 
+         pgagroal_prometheus_connect_time(best_rule, pgagroal_monotonic_us() - connect_us);
+
          config->connections[*slot].server = server;
 
          memset(&config->connections[*slot].username, 0, MAX_USERNAME_LENGTH);
@@ -329,6 +340,12 @@ start:
             kill = !pgagroal_connection_isvalid(config->connections[*slot].fd);
          }
 
+         if (!kill && transaction_mode && config->connections[*slot].tls_context_length > 0)
+         {
+            /* Session pooling resumes in use_pooled_connection */
+            kill = pgagroal_resume_backend_tls(*slot, ssl) != 0;
+         }
+
          if (kill)
          {
             int status;
@@ -361,6 +378,7 @@ start:
       {
          atomic_store(&prometheus->client_wait_time, difftime(time(NULL), start_time));
       }
+      pgagroal_prometheus_acquire_time(best_rule, pgagroal_monotonic_us() - start_us);
       pgagroal_prometheus_connection_success();
       pgagroal_tracking_event_slot(TRACKER_GET_CONNECTION_SUCCESS, *slot);
       pgagroal_prometheus_connection_unawaiting(best_rule);
@@ -437,6 +455,7 @@ timeout:
    {
       atomic_store(&prometheus->client_wait_time, difftime(time(NULL), start_time));
    }
+   pgagroal_prometheus_acquire_time(best_rule, pgagroal_monotonic_us() - start_us);
    pgagroal_prometheus_connection_timeout();
    pgagroal_tracking_event_basic(TRACKER_GET_CONNECTION_TIMEOUT, username, database);
    pgagroal_prometheus_connection_unawaiting(best_rule);
@@ -452,6 +471,7 @@ error:
    {
       atomic_store(&prometheus->client_wait_time, difftime(time(NULL), start_time));
    }
+   pgagroal_prometheus_acquire_time(best_rule, pgagroal_monotonic_us() - start_us);
    pgagroal_prometheus_connection_error();
    pgagroal_prometheus_connection_unawaiting(best_rule);
    pgagroal_tracking_event_basic(TRACKER_GET_CONNECTION_ERROR, username, database);
@@ -510,9 +530,10 @@ pgagroal_return_connection(int slot, SSL* ssl, bool transaction_mode)
    config = (struct main_configuration*)shmem;
 
    /* Park a backend whose record layer we own: its TLS 1.3 state is serializable.
-    * Confined to non-transaction mode -- only use_pooled_connection resumes it. */
+    * use_pooled_connection resumes it in session mode, pgagroal_get_connection
+    * at every transaction boundary in transaction mode. */
    t = pgagroal_tls_from_ssl(ssl);
-   tls_owned = (t != NULL && t->owned && !transaction_mode);
+   tls_owned = (t != NULL && t->owned);
 
    /* Kill the connection, if it lives longer than max_connection_age */
    if (pgagroal_time_is_valid(config->max_connection_age))
@@ -664,6 +685,12 @@ pgagroal_return_connection(int slot, SSL* ssl, bool transaction_mode)
 
          pgagroal_prometheus_connection_return();
 
+         if (tls_owned)
+         {
+            /* The slot holds the session now; release this process' copy */
+            pgagroal_close_ssl(ssl);
+         }
+
          return 0;
       }
       else if (state == STATE_GRACEFULLY)
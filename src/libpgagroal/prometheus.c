@@ -30,6 +30,7 @@
 #include <security.h>
 #include <pgagroal.h>
 #include <art.h>
+#include <gzip_compression.h>
 #include <logging.h>
 #include <memory.h>
 #include <message.h>
@@ -38,12 +39,20 @@
 #include <utils.h>
 #include <value.h>
 #include <shmem.h>
+#include <tls.h>
+#include <zstandard_compression.h>
 
 /* system */
+#include <ctype.h>
 #include <ev.h>
+#include <limits.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <openssl/pem.h>
 #include <openssl/x509.h>
@@ -79,6 +88,27 @@
 
 #define CERT_EXPIRING_THRESHOLD_DAYS 30
 
+#define LATENCY_FIRST_BOUND          16
+#define LATENCY_FIRST_POWER          4
+
+#define TRAFFIC_ENTRY_RETRIES        100
+
+#define METRICS_CHUNK_HEADER         10
+#define METRICS_CHUNK_SIZE           65536
+#define METRICS_CONNECTION_LENGTH    160
+#define METRICS_CACHE_RETRIES        4
+#define METRICS_IDLE_INTERVAL        1000
+#define METRICS_IDLE_TIMEOUT         120
+#define METRICS_REQUEST_LENGTH       1024
+#define MAX_METRICS_LISTENERS        64
+#define METRICS_CONTENT_TYPE         "text/plain; version=0.0.3; charset=utf-8"
+
+static const unsigned long session_time_bounds[HISTOGRAM_BUCKETS - 1] = {
+   FIVE_SECONDS, TEN_SECONDS, TWENTY_SECONDS, THIRTY_SECONDS, FOURTYFIVE_SECONDS, ONE_MINUTE,
+   FIVE_MINUTES, TEN_MINUTES, TWENTY_MINUTES, THIRTY_MINUTES, FOURTYFIVE_MINUTES, ONE_HOUR,
+   TWO_HOURS, FOUR_HOURS, SIX_HOURS, TWELVE_HOURS, TWENTYFOUR_HOURS
+};
+
 /**
  * ART-based metric value with timestamp
  */
@@ -109,6 +139,17 @@ typedef struct prometheus_metrics_container
    struct art* certificate_metrics_tree;
 } prometheus_metrics_container_t;
 
+/**
+ * A growable buffer that keeps its length, so appending
+ * doesn't need to scan or reallocate the data every time
+ */
+struct metrics_buffer
+{
+   char* data;    /**< The data */
+   size_t length; /**< The length of the data */
+   size_t size;   /**< The allocated size of the data */
+};
+
 static void prometheus_metric_value_destroy_cb(uintptr_t data);
 static char* prometheus_metric_value_string_cb(uintptr_t data, int32_t format, char* tag, int indent);
 static int create_metrics_container(prometheus_metrics_container_t** container);
@@ -123,149 +164,192 @@ static int badrequest_page(SSL* client_ssl, int client_fd);
 static int unknown_page(SSL* client_ssl, int client_fd);
 static int home_page(SSL* client_ssl, int client_fd);
 static int home_vault_page(SSL* client_ssl, int client_fd);
-static int metrics_page(SSL* client_ssl, int client_fd);
-static int metrics_vault_page(SSL* client_ssl, int client_fd);
+static int metrics_page(SSL* client_ssl, int client_fd, int encoding);
+static int metrics_vault_page(SSL* client_ssl, int client_fd, int encoding);
+static int metrics_header(SSL* client_ssl, int client_fd);
 static int bad_request(SSL* client_ssl, int client_fd);
 static int redirect_page(SSL* client_ssl, int client_fd, char* path);
-
-static void general_information(prometheus_metrics_container_t* container);
+static char* response_header(char* content_type, int encoding, size_t length);
+
+static void metrics_shutdown_cb(void);
+static void metrics_idle_cb(void);
+static void metrics_accept_cb(struct io_watcher* watcher);
+static void metrics_client_cb(struct io_watcher* watcher);
+static int metrics_client_handshake(struct metrics_client* client);
+static int metrics_client_read(struct metrics_client* client);
+static size_t metrics_client_request_length(struct metrics_client* client);
+static bool metrics_client_request(struct metrics_client* client, size_t length);
+static void metrics_client_redirect(struct metrics_client* client, size_t length);
+static ssize_t metrics_client_write(struct metrics_client* client, void* data, size_t length);
+static int metrics_client_send(struct metrics_client* client, void* data, size_t length);
+static int metrics_client_flush(struct metrics_client* client);
+static void metrics_client_close(struct metrics_client* client);
+static bool metrics_drained(void);
+static int metrics_send(SSL* client_ssl, int client_fd, struct message* msg);
+static void request_headers(struct message* msg, char* request, size_t size);
+static bool is_keep_alive(struct message* msg);
+static int accept_encoding(struct message* msg);
+
+static int general_information(prometheus_metrics_container_t* container);
 static void general_vault_information(prometheus_metrics_container_t* container);
-static void connection_information(prometheus_metrics_container_t* container);
+static int connection_information(prometheus_metrics_container_t* container);
 static void limit_information(prometheus_metrics_container_t* container);
 static void session_information(prometheus_metrics_container_t* container);
+static void latency_information(prometheus_metrics_container_t* container);
+static void traffic_information(prometheus_metrics_container_t* container);
 static void pool_information(prometheus_metrics_container_t* container);
 static void auth_information(prometheus_metrics_container_t* container);
 static void client_information(prometheus_metrics_container_t* container);
 static void internal_information(prometheus_metrics_container_t* container);
 static void internal_vault_information(prometheus_metrics_container_t* container);
 static void connection_awaiting_information(prometheus_metrics_container_t* container);
+static void event_loop_information(prometheus_metrics_container_t* container);
 static void write_os_kernel_version(prometheus_metrics_container_t* container);
 static int parse_certificate_file(const char* cert_path, struct certificate_info* cert_info);
 static void certificate_information(prometheus_metrics_container_t* container);
 
 static int send_chunk(SSL* cilent_ssl, int client_fd, char* data);
+static bool metrics_buffer_reserve(struct metrics_buffer* buffer, size_t length);
+static bool metrics_buffer_append(struct metrics_buffer* buffer, char* data);
+static bool metrics_buffer_append_int(struct metrics_buffer* buffer, int i);
+static bool metrics_buffer_append_ullong(struct metrics_buffer* buffer, unsigned long long l);
+static int metrics_write(SSL* client_ssl, int client_fd, char* data);
+static int metrics_flush(SSL* client_ssl, int client_fd);
+static void metrics_stream_begin(int encoding);
+static void metrics_stream_end(void);
+static int metrics_stream_write(SSL* client_ssl, int client_fd, void* data, size_t length, bool finish);
+static int stream_create(int encoding, void** stream);
+static int stream_compress(int encoding, void* stream, void* data, size_t length, bool finish, unsigned char** buffer, size_t* buffer_size);
+static void stream_destroy(int encoding, void* stream);
 
 static bool is_metrics_cache_configured(void);
-static bool is_metrics_cache_valid(void);
+static bool metrics_cache_serve(SSL* client_ssl, int client_fd, int encoding, int* status);
+static void metrics_cache_begin(void);
 static bool metrics_cache_append(char* data);
 static bool metrics_cache_finalize(void);
+static void metrics_cache_abort(void);
+static size_t metrics_cache_compress(int encoding, char* data, size_t length, char* buffer, size_t size);
 static size_t metrics_cache_size_to_alloc(void);
 static void metrics_cache_invalidate(void);
 static bool is_prometheus_enabled(void);
+static unsigned long long sum_shards(struct main_prometheus* prometheus, size_t offset);
+static void latency_init(struct prometheus_latency* latency);
+static void latency_clear(struct prometheus_latency* latency);
+static void latency_add(struct prometheus_latency* latencies, int limit, uint64_t us);
+static uint64_t latency_bound(int bucket);
+
+static void traffic_init(struct prometheus_traffic* entry);
+static void traffic_clear(struct prometheus_traffic* entry);
+static int traffic_entry(struct prometheus_traffic* entries, char* name);
+static void traffic_add(struct prometheus_traffic* entry);
+static void traffic_counter(prometheus_metrics_container_t* container, char* name, char* help, char* label,
+                            struct prometheus_traffic* entries, int offset);
+
+static int prometheus_shard = 0;
+
+/* The traffic entries of this process, and the traffic not flushed yet */
+static int traffic_database = -1;
+static int traffic_user = -1;
+static uint64_t traffic_sent = 0;
+static uint64_t traffic_received = 0;
+static uint64_t traffic_queries = 0;
+static uint64_t traffic_transactions = 0;
+static uint64_t traffic_errors = 0;
+
+/* The chunk buffer of the metrics endpoint, kept between scrapes */
+static struct metrics_buffer chunk_buffer = {NULL, 0, 0};
+
+/* The compression of the metrics response being written */
+static int metrics_encoding = METRICS_ENCODING_NONE;
+static void* metrics_stream = NULL;
+
+/* The state of this process while it refreshes the metrics cache */
+static bool cache_producer = false;
+static bool cache_overflow = false;
+static int cache_buffer = 0;
+static size_t cache_length = 0;
+static unsigned long cache_generation = 0;
+
+/* The state of the metrics worker */
+static struct metrics_client metrics_clients[MAX_METRICS_CLIENTS];
+static struct io_watcher metrics_accept[MAX_METRICS_LISTENERS];
+static int metrics_accept_length = 0;
+static int metrics_exit_code = 0;
+static bool metrics_stopping = false;
+
+/* The connection the responses are queued on, NULL outside of the metrics worker */
+static struct metrics_client* metrics_output = NULL;
 
 void
-pgagroal_prometheus(SSL* client_ssl, int client_fd)
+pgagroal_prometheus_worker(int* fds, int length)
 {
-   int status;
-   int page;
-   struct message* msg = NULL;
-   struct main_configuration* config;
-
-   if (!is_prometheus_enabled())
-   {
-      exit(1);
-   }
+   struct signal_watcher signal_watcher;
+   struct periodic_watcher idle_watcher;
 
    pgagroal_start_logging();
    pgagroal_memory_init();
 
-   config = (struct main_configuration*)shmem;
-
-   if (client_ssl)
+   if (!is_prometheus_enabled())
    {
-      if (pgagroal_is_ssl_request(client_fd))
-      {
-         if (SSL_accept(client_ssl) <= 0)
-         {
-            pgagroal_log_debug("Failed to accept SSL connection: disconnect %d", client_fd);
-            goto error;
-         }
-      }
-      else
-      {
-         char* path = "/";
-         char* base_url = NULL;
+      goto error;
+   }
 
-         if (pgagroal_read_timeout_message(NULL, client_fd, pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S), &msg) != MESSAGE_STATUS_OK)
-         {
-            pgagroal_log_error("Failed to read message");
-            goto error;
-         }
+   memset(&metrics_clients, 0, sizeof(metrics_clients));
+   memset(&metrics_accept, 0, sizeof(metrics_accept));
 
-         char* path_start = strstr(msg->data, " ");
-         if (path_start)
-         {
-            path_start++;
-            char* path_end = strstr(path_start, " ");
-            if (path_end)
-            {
-               *path_end = '\0';
-               path = path_start;
-            }
-         }
+   pgagroal_event_set_context(PGAGROAL_CONTEXT_WORKER);
+   if (!pgagroal_event_loop_init())
+   {
+      pgagroal_log_fatal("pgagroal_prometheus_worker: Failed to create loop");
+      goto error;
+   }
 
-         base_url = pgagroal_format_and_append(base_url, "https://%s:%d%s", config->common.host, config->common.metrics, path);
+   pgagroal_signal_init(&signal_watcher, metrics_shutdown_cb, SIGTERM);
+   pgagroal_signal_start(&signal_watcher);
 
-         if (redirect_page(NULL, client_fd, base_url) != MESSAGE_STATUS_OK)
-         {
-            pgagroal_log_error("Failed to redirect to: %s", base_url);
-            free(base_url);
-            goto error;
-         }
+   metrics_accept_length = MIN(length, MAX_METRICS_LISTENERS);
+   for (int i = 0; i < metrics_accept_length; i++)
+   {
+      pgagroal_event_accept_init(&metrics_accept[i], *(fds + i), metrics_accept_cb);
+      pgagroal_io_start(&metrics_accept[i]);
+   }
 
-         pgagroal_close_ssl(client_ssl);
-         pgagroal_disconnect(client_fd);
+   pgagroal_periodic_init(&idle_watcher, metrics_idle_cb, METRICS_IDLE_INTERVAL, METRICS_IDLE_INTERVAL);
+   pgagroal_periodic_start(&idle_watcher);
 
-         pgagroal_memory_destroy();
-         pgagroal_stop_logging();
+   pgagroal_log_debug("Metrics worker started (%d)", getpid());
 
-         free(base_url);
+   pgagroal_event_loop_run();
 
-         exit(0);
+   for (int i = 0; i < MAX_METRICS_CLIENTS; i++)
+   {
+      if (metrics_clients[i].active)
+      {
+         metrics_client_close(&metrics_clients[i]);
       }
    }
 
-   status = pgagroal_read_timeout_message(client_ssl, client_fd, pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S), &msg);
-   if (status != MESSAGE_STATUS_OK)
+   for (int i = 0; !metrics_stopping && i < metrics_accept_length; i++)
    {
-      goto error;
+      pgagroal_io_stop(&metrics_accept[i]);
    }
 
-   page = resolve_page(msg);
+   pgagroal_periodic_stop(&idle_watcher);
+   pgagroal_signal_stop(&signal_watcher);
 
-   if (page == PAGE_HOME)
-   {
-      home_page(client_ssl, client_fd);
-   }
-   else if (page == PAGE_METRICS)
-   {
-      metrics_page(client_ssl, client_fd);
-   }
-   else if (page == PAGE_UNKNOWN)
-   {
-      unknown_page(client_ssl, client_fd);
-   }
-   else
-   {
-      bad_request(client_ssl, client_fd);
-   }
+   pgagroal_event_loop_destroy();
 
-   pgagroal_close_ssl(client_ssl);
-   pgagroal_disconnect(client_fd);
+   pgagroal_log_debug("Metrics worker stopped (%d)", getpid());
+
+   free(chunk_buffer.data);
 
    pgagroal_memory_destroy();
    pgagroal_stop_logging();
 
-   exit(0);
+   exit(metrics_exit_code);
 
 error:
 
-   badrequest_page(client_ssl, client_fd);
-
-   pgagroal_log_debug("pgagroal_prometheus: disconnect %d", client_fd);
-   pgagroal_close_ssl(client_ssl);
-   pgagroal_disconnect(client_fd);
-
    pgagroal_memory_destroy();
    pgagroal_stop_logging();
 
@@ -277,6 +361,7 @@ pgagroal_vault_prometheus(SSL* client_ssl, int client_fd)
 {
    int status;
    int page;
+   int encoding;
    struct message* msg = NULL;
    struct vault_configuration* config;
 
@@ -296,6 +381,8 @@ pgagroal_vault_prometheus(SSL* client_ssl, int client_fd)
       goto error;
    }
 
+   encoding = accept_encoding(msg);
+
    page = resolve_page(msg);
 
    if (page == PAGE_HOME)
@@ -304,7 +391,7 @@ pgagroal_vault_prometheus(SSL* client_ssl, int client_fd)
    }
    else if (page == PAGE_METRICS)
    {
-      metrics_vault_page(client_ssl, client_fd);
+      metrics_vault_page(client_ssl, client_fd, encoding);
    }
    else if (page == PAGE_UNKNOWN)
    {
@@ -360,6 +447,13 @@ pgagroal_init_prometheus(size_t* p_size, void** p_shmem)
    }
    atomic_init(&prometheus->session_time_sum, 0);
 
+   for (int i = 0; i < NUMBER_OF_LIMITS + 1; i++)
+   {
+      latency_init(&prometheus->acquire_time[i]);
+      latency_init(&prometheus->connect_time[i]);
+      latency_init(&prometheus->auth_time[i]);
+   }
+
    atomic_init(&prometheus->connection_error, 0);
    atomic_init(&prometheus->connection_kill, 0);
    atomic_init(&prometheus->connection_remove, 0);
@@ -394,11 +488,19 @@ pgagroal_init_prometheus(size_t* p_size, void** p_shmem)
    atomic_init(&prometheus->client_active, 0);
    atomic_init(&prometheus->client_wait_time, 0);
 
-   atomic_init(&prometheus->query_count, 0);
-   atomic_init(&prometheus->tx_count, 0);
+   for (int i = 0; i < PROMETHEUS_SHARDS; i++)
+   {
+      atomic_init(&prometheus->shards[i].query_count, 0);
+      atomic_init(&prometheus->shards[i].tx_count, 0);
+      atomic_init(&prometheus->shards[i].network_sent, 0);
+      atomic_init(&prometheus->shards[i].network_received, 0);
+   }
 
-   atomic_init(&prometheus->network_sent, 0);
-   atomic_init(&prometheus->network_received, 0);
+   for (int i = 0; i < NUMBER_OF_TRAFFIC_ENTRIES + 1; i++)
+   {
+      traffic_init(&prometheus->databases[i]);
+      traffic_init(&prometheus->users[i]);
+   }
 
    atomic_init(&prometheus->prometheus_base.client_sockets, 0);
    atomic_init(&prometheus->prometheus_base.self_sockets, 0);
@@ -471,9 +573,8 @@ error:
 }
 
 void
-pgagroal_prometheus_session_time(double time)
+pgagroal_prometheus_acquire_time(int limit, uint64_t us)
 {
-   unsigned long t;
    struct main_prometheus* prometheus;
 
    if (!is_prometheus_enabled())
@@ -482,82 +583,66 @@ pgagroal_prometheus_session_time(double time)
    }
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
-   t = (unsigned long)time;
 
-   atomic_fetch_add(&prometheus->session_time_sum, t);
+   latency_add(&prometheus->acquire_time[0], limit, us);
+}
 
-   if (t <= FIVE_SECONDS)
-   {
-      atomic_fetch_add(&prometheus->session_time[0], 1);
-   }
-   else if (t > FIVE_SECONDS && t <= TEN_SECONDS)
-   {
-      atomic_fetch_add(&prometheus->session_time[1], 1);
-   }
-   else if (t > TEN_SECONDS && t <= TWENTY_SECONDS)
-   {
-      atomic_fetch_add(&prometheus->session_time[2], 1);
-   }
-   else if (t > TWENTY_SECONDS && t <= THIRTY_SECONDS)
-   {
-      atomic_fetch_add(&prometheus->session_time[3], 1);
-   }
-   else if (t > THIRTY_SECONDS && t <= FOURTYFIVE_SECONDS)
-   {
-      atomic_fetch_add(&prometheus->session_time[4], 1);
-   }
-   else if (t > FOURTYFIVE_SECONDS && t <= ONE_MINUTE)
-   {
-      atomic_fetch_add(&prometheus->session_time[5], 1);
-   }
-   else if (t > ONE_MINUTE && t <= FIVE_MINUTES)
-   {
-      atomic_fetch_add(&prometheus->session_time[6], 1);
-   }
-   else if (t > FIVE_MINUTES && t <= TEN_MINUTES)
-   {
-      atomic_fetch_add(&prometheus->session_time[7], 1);
-   }
-   else if (t > TEN_MINUTES && t <= TWENTY_MINUTES)
-   {
-      atomic_fetch_add(&prometheus->session_time[8], 1);
-   }
-   else if (t > TWENTY_MINUTES && t <= THIRTY_MINUTES)
-   {
-      atomic_fetch_add(&prometheus->session_time[9], 1);
-   }
-   else if (t > THIRTY_MINUTES && t <= FOURTYFIVE_MINUTES)
-   {
-      atomic_fetch_add(&prometheus->session_time[10], 1);
-   }
-   else if (t > FOURTYFIVE_MINUTES && t <= ONE_HOUR)
-   {
-      atomic_fetch_add(&prometheus->session_time[11], 1);
-   }
-   else if (t > ONE_HOUR && t <= TWO_HOURS)
-   {
-      atomic_fetch_add(&prometheus->session_time[12], 1);
-   }
-   else if (t > TWO_HOURS && t <= FOUR_HOURS)
-   {
-      atomic_fetch_add(&prometheus->session_time[13], 1);
-   }
-   else if (t > FOUR_HOURS && t <= SIX_HOURS)
+void
+pgagroal_prometheus_connect_time(int limit, uint64_t us)
+{
+   struct main_prometheus* prometheus;
+
+   if (!is_prometheus_enabled())
    {
-      atomic_fetch_add(&prometheus->session_time[14], 1);
+      return;
    }
-   else if (t > SIX_HOURS && t <= TWELVE_HOURS)
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   latency_add(&prometheus->connect_time[0], limit, us);
+}
+
+void
+pgagroal_prometheus_auth_time(int limit, uint64_t us)
+{
+   struct main_prometheus* prometheus;
+
+   if (!is_prometheus_enabled())
    {
-      atomic_fetch_add(&prometheus->session_time[15], 1);
+      return;
    }
-   else if (t > TWELVE_HOURS && t <= TWENTYFOUR_HOURS)
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   latency_add(&prometheus->auth_time[0], limit, us);
+}
+
+void
+pgagroal_prometheus_session_time(double time)
+{
+   int bucket;
+   unsigned long t;
+   struct main_prometheus* prometheus;
+
+   if (!is_prometheus_enabled())
    {
-      atomic_fetch_add(&prometheus->session_time[16], 1);
+      return;
    }
-   else
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+   t = (unsigned long)time;
+
+   atomic_fetch_add(&prometheus->session_time_sum, t);
+
+   for (bucket = 0; bucket < HISTOGRAM_BUCKETS - 1; bucket++)
    {
-      atomic_fetch_add(&prometheus->session_time[17], 1);
+      if (t <= session_time_bounds[bucket])
+      {
+         break;
+      }
    }
+
+   atomic_fetch_add(&prometheus->session_time[bucket], 1);
 }
 
 void
@@ -873,6 +958,12 @@ pgagroal_prometheus_client_active_sub(void)
    atomic_fetch_sub(&prometheus->client_active, 1);
 }
 
+void
+pgagroal_prometheus_shard_select(void)
+{
+   prometheus_shard = getpid() % PROMETHEUS_SHARDS;
+}
+
 void
 pgagroal_prometheus_query_count_add(void)
 {
@@ -885,7 +976,8 @@ pgagroal_prometheus_query_count_add(void)
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
 
-   atomic_fetch_add(&prometheus->query_count, 1);
+   atomic_fetch_add_explicit(&prometheus->shards[prometheus_shard].query_count, 1, memory_order_relaxed);
+   traffic_queries += 1;
 }
 
 void
@@ -930,7 +1022,8 @@ pgagroal_prometheus_tx_count_add(void)
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
 
-   atomic_fetch_add(&prometheus->tx_count, 1);
+   atomic_fetch_add_explicit(&prometheus->shards[prometheus_shard].tx_count, 1, memory_order_relaxed);
+   traffic_transactions += 1;
 }
 
 void
@@ -945,7 +1038,8 @@ pgagroal_prometheus_network_sent_add(ssize_t s)
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
 
-   atomic_fetch_add(&prometheus->network_sent, s);
+   atomic_fetch_add_explicit(&prometheus->shards[prometheus_shard].network_sent, s, memory_order_relaxed);
+   traffic_sent += s;
 }
 
 void
@@ -960,7 +1054,52 @@ pgagroal_prometheus_network_received_add(ssize_t s)
 
    prometheus = (struct main_prometheus*)prometheus_shmem;
 
-   atomic_fetch_add(&prometheus->network_received, s);
+   atomic_fetch_add_explicit(&prometheus->shards[prometheus_shard].network_received, s, memory_order_relaxed);
+   traffic_received += s;
+}
+
+void
+pgagroal_prometheus_traffic_select(char* database, char* username)
+{
+   struct main_prometheus* prometheus;
+
+   if (!is_prometheus_enabled())
+   {
+      return;
+   }
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   traffic_database = traffic_entry(prometheus->databases, database);
+   traffic_user = traffic_entry(prometheus->users, username);
+}
+
+void
+pgagroal_prometheus_traffic_error_add(void)
+{
+   traffic_errors++;
+}
+
+void
+pgagroal_prometheus_traffic_flush(void)
+{
+   struct main_prometheus* prometheus;
+
+   if (!is_prometheus_enabled() || traffic_database == -1)
+   {
+      return;
+   }
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   traffic_add(&prometheus->databases[traffic_database]);
+   traffic_add(&prometheus->users[traffic_user]);
+
+   traffic_sent = 0;
+   traffic_received = 0;
+   traffic_queries = 0;
+   traffic_transactions = 0;
+   traffic_errors = 0;
 }
 
 void
@@ -1026,10 +1165,8 @@ pgagroal_prometheus_self_sockets_sub(void)
 void
 pgagroal_prometheus_clear(void)
 {
-   signed char cache_is_free;
    struct main_configuration* config;
    struct main_prometheus* prometheus;
-   struct prometheus_cache* cache;
 
    if (!is_prometheus_enabled())
    {
@@ -1038,7 +1175,6 @@ pgagroal_prometheus_clear(void)
 
    config = (struct main_configuration*)shmem;
    prometheus = (struct main_prometheus*)prometheus_shmem;
-   cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
    {
@@ -1046,6 +1182,13 @@ pgagroal_prometheus_clear(void)
    }
    atomic_store(&prometheus->session_time_sum, 0);
 
+   for (int i = 0; i < NUMBER_OF_LIMITS + 1; i++)
+   {
+      latency_clear(&prometheus->acquire_time[i]);
+      latency_clear(&prometheus->connect_time[i]);
+      latency_clear(&prometheus->auth_time[i]);
+   }
+
    atomic_store(&prometheus->connection_error, 0);
    atomic_store(&prometheus->connection_kill, 0);
    atomic_store(&prometheus->connection_remove, 0);
@@ -1078,11 +1221,19 @@ pgagroal_prometheus_clear(void)
    atomic_store(&prometheus->client_wait, 0);
    atomic_store(&prometheus->client_wait_time, 0);
 
-   atomic_store(&prometheus->query_count, 0);
-   atomic_store(&prometheus->tx_count, 0);
+   for (int i = 0; i < PROMETHEUS_SHARDS; i++)
+   {
+      atomic_store(&prometheus->shards[i].query_count, 0);
+      atomic_store(&prometheus->shards[i].tx_count, 0);
+      atomic_store(&prometheus->shards[i].network_sent, 0);
+      atomic_store(&prometheus->shards[i].network_received, 0);
+   }
 
-   atomic_store(&prometheus->network_sent, 0);
-   atomic_store(&prometheus->network_received, 0);
+   for (int i = 0; i < NUMBER_OF_TRAFFIC_ENTRIES + 1; i++)
+   {
+      traffic_clear(&prometheus->databases[i]);
+      traffic_clear(&prometheus->users[i]);
+   }
 
    atomic_store(&prometheus->prometheus_base.client_sockets, 0);
    atomic_store(&prometheus->prometheus_base.self_sockets, 0);
@@ -1097,19 +1248,65 @@ pgagroal_prometheus_clear(void)
       atomic_store(&prometheus->prometheus_connections[i].query_count, 0);
    }
 
-retry_cache_locking:
-   cache_is_free = STATE_FREE;
-   if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   for (int i = 0; i < EV_STATS_ROLES; i++)
    {
-      metrics_cache_invalidate();
+      struct prometheus_event_loop* ev = &prometheus->event_loop[i];
 
-      atomic_store(&cache->lock, STATE_FREE);
+      atomic_store(&ev->iterations, 0);
+      atomic_store(&ev->events, 0);
+      atomic_store(&ev->wait_time, 0);
+      atomic_store(&ev->busy_time, 0);
+      atomic_store(&ev->sends, 0);
+      atomic_store(&ev->partial_sends, 0);
+      for (int j = 0; j < EV_STATS_WAKEUP_BUCKETS; j++)
+      {
+         atomic_store(&ev->events_per_wakeup[j], 0);
+      }
+      for (int j = 0; j < EV_STATS_CALLBACK_BUCKETS; j++)
+      {
+         atomic_store(&ev->callback_time[j], 0);
+      }
+      atomic_store(&ev->callback_time_sum, 0);
    }
-   else
+
+   metrics_cache_invalidate();
+}
+
+void
+pgagroal_prometheus_event_loop(int role, struct event_loop_stats* stats)
+{
+   struct prometheus_event_loop* ev;
+
+   if (!is_prometheus_enabled())
+   {
+      return;
+   }
+
+   ev = &((struct main_prometheus*)prometheus_shmem)->event_loop[role];
+
+   atomic_fetch_add(&ev->iterations, stats->iterations);
+   atomic_fetch_add(&ev->events, stats->events);
+   atomic_fetch_add(&ev->wait_time, stats->wait_time);
+   atomic_fetch_add(&ev->busy_time, stats->busy_time);
+   atomic_fetch_add(&ev->sends, stats->sends);
+   atomic_fetch_add(&ev->partial_sends, stats->partial_sends);
+
+   for (int i = 0; i < EV_STATS_WAKEUP_BUCKETS; i++)
+   {
+      if (stats->events_per_wakeup[i] > 0)
+      {
+         atomic_fetch_add(&ev->events_per_wakeup[i], stats->events_per_wakeup[i]);
+      }
+   }
+
+   for (int i = 0; i < EV_STATS_CALLBACK_BUCKETS; i++)
    {
-      /* Sleep for 1ms */
-      SLEEP_AND_GOTO(1000000L, retry_cache_locking);
+      if (stats->callback_time[i] > 0)
+      {
+         atomic_fetch_add(&ev->callback_time[i], stats->callback_time[i]);
+      }
    }
+   atomic_fetch_add(&ev->callback_time_sum, stats->callback_time_sum);
 }
 
 void
@@ -1187,40 +1384,885 @@ pgagroal_prometheus_logging(int type)
    }
 }
 
-static int
-redirect_page(SSL* client_ssl, int client_fd, char* path)
+static void
+metrics_shutdown_cb(void)
 {
-   char* data = NULL;
-   time_t now;
-   char time_buf[32];
-   int status;
-   struct message msg;
+   metrics_exit_code = 0;
 
-   memset(&msg, 0, sizeof(struct message));
-   memset(&data, 0, sizeof(data));
+   /* A response being sent is allowed to finish */
+   if (!metrics_stopping)
+   {
+      metrics_stopping = true;
 
-   now = time(NULL);
+      for (int i = 0; i < metrics_accept_length; i++)
+      {
+         pgagroal_io_stop(&metrics_accept[i]);
+      }
+   }
 
-   memset(&time_buf, 0, sizeof(time_buf));
-   ctime_r(&now, &time_buf[0]);
-   time_buf[strlen(time_buf) - 1] = 0;
+   if (metrics_drained())
+   {
+      pgagroal_event_loop_break();
+   }
+}
 
-   data = pgagroal_append(data, "HTTP/1.1 301 Moved Permanently\r\n");
-   data = pgagroal_append(data, "Location: ");
-   data = pgagroal_append(data, path);
-   data = pgagroal_append(data, "\r\n");
-   data = pgagroal_append(data, "Date: ");
-   data = pgagroal_append(data, &time_buf[0]);
-   data = pgagroal_append(data, "\r\n");
-   data = pgagroal_append(data, "Content-Length: 0\r\n");
-   data = pgagroal_append(data, "Connection: close\r\n");
-   data = pgagroal_append(data, "\r\n");
+static void
+metrics_idle_cb(void)
+{
+   time_t now = time(NULL);
 
-   msg.kind = 0;
+   for (int i = 0; i < MAX_METRICS_CLIENTS; i++)
+   {
+      if (metrics_clients[i].active && metrics_clients[i].deadline <= now)
+      {
+         pgagroal_log_debug("Metrics: idle connection: disconnect %d", metrics_clients[i].fd);
+         metrics_client_close(&metrics_clients[i]);
+      }
+   }
+}
+
+static void
+metrics_accept_cb(struct io_watcher* watcher)
+{
+   int client_fd;
+   struct metrics_client* client = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   client_fd = watcher->fds.main.client_fd;
+
+   if (client_fd == -1)
+   {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+          errno != ECONNABORTED && errno != EMFILE && errno != ENFILE)
+      {
+         /* The main process binds the port again, and restarts the worker */
+         pgagroal_log_warn("Metrics: accept: %s", strerror(errno));
+         metrics_exit_code = 1;
+         pgagroal_event_loop_break();
+      }
+      else
+      {
+         pgagroal_log_debug("Metrics: accept: %s", strerror(errno));
+      }
+      errno = 0;
+      return;
+   }
+
+   for (int i = 0; client == NULL && i < MAX_METRICS_CLIENTS; i++)
+   {
+      if (!metrics_clients[i].active)
+      {
+         client = &metrics_clients[i];
+      }
+   }
+
+   if (client == NULL)
+   {
+      pgagroal_log_debug("Metrics: too many connections: disconnect %d", client_fd);
+      pgagroal_disconnect(client_fd);
+      return;
+   }
+
+   pgagroal_prometheus_self_sockets_add();
+
+   memset(client, 0, sizeof(struct metrics_client));
+   client->fd = client_fd;
+   client->state = METRICS_CLIENT_REQUEST;
+   client->deadline = time(NULL) + MAX((time_t)pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S), 1);
+
+   /* A stalled client must not hold up the other scrapes */
+   pgagroal_socket_nonblocking(client_fd);
+
+   if (strlen(config->common.metrics_cert_file) > 0 && strlen(config->common.metrics_key_file) > 0)
+   {
+      if (pgagroal_tls_create_ssl_server(PGAGROAL_TLS_CTX_METRICS, client_fd, &client->ssl))
+      {
+         pgagroal_log_error("Could not create metrics SSL server");
+         pgagroal_disconnect(client_fd);
+         pgagroal_prometheus_self_sockets_sub();
+         return;
+      }
+
+      /* A write that has to be tried again is given from the output, which may move */
+      SSL_set_mode(client->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+      client->state = METRICS_CLIENT_DETECT;
+   }
+
+   pgagroal_event_client_init(&client->watcher, client_fd, metrics_client_cb);
+   client->watcher.writable = true;
+   if (pgagroal_io_start(&client->watcher))
+   {
+      pgagroal_close_ssl(client->ssl);
+      pgagroal_disconnect(client_fd);
+      pgagroal_prometheus_self_sockets_sub();
+      return;
+   }
+
+   client->active = true;
+
+   /* The request may be here already */
+   metrics_client_cb(&client->watcher);
+}
+
+static void
+metrics_client_cb(struct io_watcher* watcher)
+{
+   int status;
+   size_t length;
+   struct metrics_client* client;
+
+   client = (struct metrics_client*)watcher;
+
+   if (!client->active)
+   {
+      return;
+   }
+
+   /* The rest of the last response goes first */
+   status = metrics_client_flush(client);
+   if (status <= 0)
+   {
+      if (status < 0)
+      {
+         metrics_client_close(client);
+      }
+      return;
+   }
+
+   if (client->closing)
+   {
+      metrics_client_close(client);
+      return;
+   }
+
+   if (client->state == METRICS_CLIENT_DETECT || client->state == METRICS_CLIENT_HANDSHAKE)
+   {
+      status = metrics_client_handshake(client);
+      if (status <= 0)
+      {
+         if (status < 0)
+         {
+            metrics_client_close(client);
+         }
+         return;
+      }
+   }
+
+   do
+   {
+      status = metrics_client_read(client);
+      if (status < 0)
+      {
+         metrics_client_close(client);
+         return;
+      }
+
+      /* Requests sent ahead are answered in order */
+      while ((length = metrics_client_request_length(client)) > 0)
+      {
+         if (client->state == METRICS_CLIENT_REDIRECT)
+         {
+            metrics_client_redirect(client, length);
+            client->closing = true;
+         }
+         else if (!metrics_client_request(client, length))
+         {
+            client->closing = true;
+         }
+
+         memmove(&client->input[0], &client->input[length], client->input_length - length);
+         client->input_length -= length;
+
+         if (metrics_stopping)
+         {
+            client->closing = true;
+         }
+
+         /* The watcher is called again when the client has read the response */
+         status = metrics_client_flush(client);
+         if (status <= 0)
+         {
+            if (status < 0)
+            {
+               metrics_client_close(client);
+            }
+            return;
+         }
+
+         if (client->closing)
+         {
+            metrics_client_close(client);
+            return;
+         }
+      }
+
+      if (client->input_length == sizeof(client->input))
+      {
+         pgagroal_log_debug("Metrics: request too large: disconnect %d", client->fd);
+
+         metrics_output = client;
+         badrequest_page(client->ssl, client->fd);
+         metrics_output = NULL;
+
+         client->closing = true;
+         if (metrics_client_flush(client) != 0)
+         {
+            metrics_client_close(client);
+         }
+         return;
+      }
+   }
+   while (status > 0);
+}
+
+/**
+ * Do the TLS handshake of a connection, or find that the
+ * request is plain HTTP such that it is redirected
+ * @param client The client
+ * @return 1 when done, 0 when waiting for the client, -1 upon error
+ */
+static int
+metrics_client_handshake(struct metrics_client* client)
+{
+   int rc;
+   int error;
+   char first;
+   ssize_t n;
+
+   if (client->state == METRICS_CLIENT_DETECT)
+   {
+      n = recv(client->fd, &first, 1, MSG_PEEK);
+      if (n == 0)
+      {
+         return -1;
+      }
+      else if (n == -1)
+      {
+         rc = (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+         errno = 0;
+         return rc;
+      }
+
+      /* A TLS handshake record, where HTTP starts with the method */
+      if (first != 0x16)
+      {
+         /* The TLS structure is not used for the plain connection */
+         SSL_free(client->ssl);
+         client->ssl = NULL;
+
+         client->state = METRICS_CLIENT_REDIRECT;
+         return 1;
+      }
+
+      client->state = METRICS_CLIENT_HANDSHAKE;
+   }
+
+   ERR_clear_error();
+   rc = SSL_accept(client->ssl);
+   if (rc == 1)
+   {
+      client->state = METRICS_CLIENT_REQUEST;
+      return 1;
+   }
+
+   error = SSL_get_error(client->ssl, rc);
+   if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+   {
+      return 0;
+   }
+
+   pgagroal_log_debug("Failed to accept SSL connection: disconnect %d", client->fd);
+   errno = 0;
+
+   return -1;
+}
+
+/**
+ * Read what the client has sent, as long as there is room for it
+ * @param client The client
+ * @return 1 if the input is full, 0 if everything was read, -1 if the connection was closed
+ */
+static int
+metrics_client_read(struct metrics_client* client)
+{
+   int error;
+   ssize_t n;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   while (client->input_length < sizeof(client->input))
+   {
+      if (client->ssl != NULL)
+      {
+         ERR_clear_error();
+         n = SSL_read(client->ssl, &client->input[client->input_length], (int)(sizeof(client->input) - client->input_length));
+         if (n <= 0)
+         {
+            error = SSL_get_error(client->ssl, (int)n);
+            errno = 0;
+            return (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) ? 0 : -1;
+         }
+      }
+      else
+      {
+         n = recv(client->fd, &client->input[client->input_length], sizeof(client->input) - client->input_length, 0);
+         if (n == 0)
+         {
+            return -1;
+         }
+         else if (n == -1)
+         {
+            if (errno == EINTR)
+            {
+               continue;
+            }
+
+            n = (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            errno = 0;
+            return (int)n;
+         }
+      }
+
+      /* The rest of the request must arrive within the authentication timeout */
+      if (client->input_length == 0)
+      {
+         client->deadline = time(NULL) + MAX((time_t)pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S), 1);
+      }
+
+      client->input_length += n;
+   }
+
+   return 1;
+}
+
+/**
+ * The length of the first request in the input
+ * @param client The client
+ * @return The length including the end of the header, or 0 if the request isn't complete
+ */
+static size_t
+metrics_client_request_length(struct metrics_client* client)
+{
+   for (size_t i = 0; i + 4 <= client->input_length; i++)
+   {
+      if (!memcmp(&client->input[i], "\r\n\r\n", 4))
+      {
+         return i + 4;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Answer a request. The response is queued on the connection
+ * @param client The client
+ * @param length The length of the request in the input
+ * @return true if the connection is kept alive
+ */
+static bool
+metrics_client_request(struct metrics_client* client, size_t length)
+{
+   int status = 0;
+   int page;
+   int encoding;
+   bool keep_alive;
+   struct message msg;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   memset(&msg, 0, sizeof(struct message));
+
+   msg.kind = 0;
+   msg.length = (ssize_t)length;
+   msg.data = &client->input[0];
+
+   metrics_output = client;
+
+   /* Decided first, as the page resolution changes the request */
+   keep_alive = is_keep_alive(&msg);
+   encoding = accept_encoding(&msg);
+
+   page = resolve_page(&msg);
+
+   if (page == PAGE_HOME)
+   {
+      status = home_page(client->ssl, client->fd) == MESSAGE_STATUS_OK ? 0 : 1;
+   }
+   else if (page == PAGE_METRICS)
+   {
+      status = metrics_page(client->ssl, client->fd, encoding);
+   }
+   else
+   {
+      /* The response has no length, so the connection ends it */
+      if (page == PAGE_UNKNOWN)
+      {
+         unknown_page(client->ssl, client->fd);
+      }
+      else
+      {
+         bad_request(client->ssl, client->fd);
+      }
+      keep_alive = false;
+   }
+
+   metrics_output = NULL;
+
+   /* The response must be read within the authentication timeout */
+   client->deadline = time(NULL) + MAX((time_t)pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S), 1);
+
+   return status == 0 && keep_alive;
+}
+
+/**
+ * Redirect a plain HTTP request to the TLS endpoint
+ * @param client The client
+ * @param length The length of the request in the input
+ */
+static void
+metrics_client_redirect(struct metrics_client* client, size_t length)
+{
+   char* path = "/";
+   char* path_start = NULL;
+   char* path_end = NULL;
+   char* base_url = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* The end of the request is a line break, which ends the path at the latest */
+   client->input[length - 1] = '\0';
+
+   path_start = strchr(&client->input[0], ' ');
+   if (path_start)
+   {
+      path_start++;
+      path_end = strchr(path_start, ' ');
+      if (path_end)
+      {
+         *path_end = '\0';
+         path = path_start;
+      }
+   }
+
+   base_url = pgagroal_format_and_append(base_url, "https://%s:%d%s", config->common.host, config->common.metrics, path);
+
+   metrics_output = client;
+   if (redirect_page(NULL, client->fd, base_url) != MESSAGE_STATUS_OK)
+   {
+      pgagroal_log_error("Failed to redirect to: %s", base_url);
+   }
+   metrics_output = NULL;
+
+   free(base_url);
+}
+
+/**
+ * Write as much as the connection takes without blocking
+ * @param client The client
+ * @param data The data
+ * @param length The length of the data
+ * @return The number of bytes written, or -1 upon error
+ */
+static ssize_t
+metrics_client_write(struct metrics_client* client, void* data, size_t length)
+{
+   int error;
+   ssize_t n;
+   size_t written = 0;
+
+   while (written < length)
+   {
+      if (client->ssl != NULL)
+      {
+         ERR_clear_error();
+         n = SSL_write(client->ssl, (char*)data + written, (int)MIN(length - written, (size_t)INT_MAX));
+         if (n <= 0)
+         {
+            error = SSL_get_error(client->ssl, (int)n);
+            errno = 0;
+            if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+            {
+               break;
+            }
+            return -1;
+         }
+      }
+      else
+      {
+         n = send(client->fd, (char*)data + written, length - written, 0);
+         if (n == -1)
+         {
+            if (errno == EINTR)
+            {
+               continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+               errno = 0;
+               break;
+            }
+
+            errno = 0;
+            return -1;
+         }
+      }
+
+      written += n;
+   }
+
+   return (ssize_t)written;
+}
+
+/**
+ * Send data on a connection, and queue what the connection
+ * doesn't take yet behind the output that is already queued
+ * @param client The client
+ * @param data The data
+ * @param length The length of the data
+ * @return 0 upon success, otherwise 1
+ */
+static int
+metrics_client_send(struct metrics_client* client, void* data, size_t length)
+{
+   ssize_t n = 0;
+   size_t size;
+   char* output = NULL;
+
+   if (client->output_offset == client->output_length)
+   {
+      client->output_offset = 0;
+      client->output_length = 0;
+
+      n = metrics_client_write(client, data, length);
+      if (n < 0)
+      {
+         return 1;
+      }
+   }
+
+   if ((size_t)n == length)
+   {
+      return 0;
+   }
+
+   if (client->output_length + (length - n) > client->output_size)
+   {
+      size = client->output_size > 0 ? client->output_size : METRICS_CHUNK_SIZE;
+      while (size < client->output_length + (length - n))
+      {
+         size *= 2;
+      }
+
+      output = realloc(client->output, size);
+      if (output == NULL)
+      {
+         pgagroal_log_error("Couldn't allocate %zu bytes for the metrics", size);
+         return 1;
+      }
+
+      client->output = output;
+      client->output_size = size;
+   }
+
+   memcpy(client->output + client->output_length, (char*)data + n, length - n);
+   client->output_length += length - n;
+
+   return 0;
+}
+
+/**
+ * Send the output queued on a connection
+ * @param client The client
+ * @return 1 if everything was sent, 0 if there is more to send, -1 upon error
+ */
+static int
+metrics_client_flush(struct metrics_client* client)
+{
+   ssize_t n;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (client->output_offset == client->output_length)
+   {
+      return 1;
+   }
+
+   n = metrics_client_write(client, client->output + client->output_offset, client->output_length - client->output_offset);
+   if (n < 0)
+   {
+      return -1;
+   }
+
+   client->output_offset += n;
+
+   if (client->output_offset < client->output_length)
+   {
+      /* A client that doesn't read is dropped */
+      if (n > 0)
+      {
+         client->deadline = time(NULL) + MAX((time_t)pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S), 1);
+      }
+      return 0;
+   }
+
+   client->output_offset = 0;
+   client->output_length = 0;
+
+   /* Don't hold on to the memory of a large response */
+   if (client->output_size > METRICS_CHUNK_SIZE)
+   {
+      free(client->output);
+      client->output = NULL;
+      client->output_size = 0;
+   }
+
+   client->deadline = time(NULL) + METRICS_IDLE_TIMEOUT;
+
+   if (metrics_stopping && metrics_drained())
+   {
+      pgagroal_event_loop_break();
+   }
+
+   return 1;
+}
+
+static void
+metrics_client_close(struct metrics_client* client)
+{
+   pgagroal_io_stop(&client->watcher);
+   client->active = false;
+
+   pgagroal_close_ssl(client->ssl);
+   client->ssl = NULL;
+
+   pgagroal_disconnect(client->fd);
+   client->fd = -1;
+
+   free(client->output);
+   client->output = NULL;
+   client->output_offset = 0;
+   client->output_length = 0;
+   client->output_size = 0;
+
+   pgagroal_prometheus_self_sockets_sub();
+
+   if (metrics_stopping && metrics_drained())
+   {
+      pgagroal_event_loop_break();
+   }
+}
+
+/**
+ * Has every response been sent
+ * @return true if no connection has output queued
+ */
+static bool
+metrics_drained(void)
+{
+   for (int i = 0; i < MAX_METRICS_CLIENTS; i++)
+   {
+      if (metrics_clients[i].active && metrics_clients[i].output_offset < metrics_clients[i].output_length)
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+/**
+ * Send a message to the client. In the metrics worker the message is
+ * queued on the connection, such that a slow client doesn't block it
+ * @param client_ssl The client SSL
+ * @param client_fd The client descriptor
+ * @param msg The message
+ * @return MESSAGE_STATUS_OK upon success
+ */
+static int
+metrics_send(SSL* client_ssl, int client_fd, struct message* msg)
+{
+   if (metrics_output != NULL)
+   {
+      return metrics_client_send(metrics_output, msg->data, (size_t)msg->length) ? MESSAGE_STATUS_ERROR : MESSAGE_STATUS_OK;
+   }
+
+   return pgagroal_write_message(client_ssl, client_fd, msg);
+}
+
+/**
+ * Copy the header of a request in lower case
+ * @param msg The request
+ * @param request The copy
+ * @param size The size of the copy
+ */
+static void
+request_headers(struct message* msg, char* request, size_t size)
+{
+   char* end = NULL;
+   size_t length;
+
+   length = MIN((size_t)msg->length, size - 1);
+
+   for (size_t i = 0; i < length; i++)
+   {
+      request[i] = (char)tolower(*((unsigned char*)msg->data + i));
+   }
+   request[length] = '\0';
+
+   end = strstr(request, "\r\n\r\n");
+   if (end != NULL)
+   {
+      *end = '\0';
+   }
+}
+
+/**
+ * Can the connection be kept alive after the response
+ * @param msg The request
+ * @return true if the client didn't ask to close it
+ */
+static bool
+is_keep_alive(struct message* msg)
+{
+   char request[METRICS_REQUEST_LENGTH];
+   char* end = NULL;
+
+   request_headers(msg, &request[0], sizeof(request));
+
+   if (strstr(&request[0], "\r\nconnection: close") != NULL)
+   {
+      return false;
+   }
+
+   if (strstr(&request[0], "\r\nconnection: keep-alive") != NULL)
+   {
+      return true;
+   }
+
+   /* HTTP/1.0 closes unless asked otherwise */
+   end = strstr(&request[0], "\r\n");
+   if (end != NULL)
+   {
+      *end = '\0';
+   }
+
+   return strstr(&request[0], " http/1.0") == NULL;
+}
+
+/**
+ * Select the encoding of the metrics from the Accept-Encoding
+ * header of the request. zstd is preferred over gzip, and an
+ * encoding with a zero quality is not used
+ * @param msg The request
+ * @return The encoding
+ */
+static int
+accept_encoding(struct message* msg)
+{
+   char request[METRICS_REQUEST_LENGTH];
+   char* line = NULL;
+   char* end = NULL;
+   char* token = NULL;
+   char* save = NULL;
+   bool gzip = false;
+   bool zstd = false;
+
+   request_headers(msg, &request[0], sizeof(request));
+
+   line = strstr(&request[0], "\r\naccept-encoding:");
+   if (line == NULL)
+   {
+      return METRICS_ENCODING_NONE;
+   }
+
+   line += strlen("\r\naccept-encoding:");
+   end = strstr(line, "\r\n");
+   if (end != NULL)
+   {
+      *end = '\0';
+   }
+
+   token = strtok_r(line, ",", &save);
+   while (token != NULL)
+   {
+      char* q = NULL;
+
+      while (*token == ' ' || *token == '\t')
+      {
+         token++;
+      }
+
+      q = strstr(token, "q=");
+      if (q == NULL || strtod(q + 2, NULL) > 0.0)
+      {
+         if (!strncmp(token, "zstd", 4))
+         {
+            zstd = true;
+         }
+         else if (!strncmp(token, "gzip", 4))
+         {
+            gzip = true;
+         }
+      }
+
+      token = strtok_r(NULL, ",", &save);
+   }
+
+   if (zstd)
+   {
+      return METRICS_ENCODING_ZSTD;
+   }
+   else if (gzip)
+   {
+      return METRICS_ENCODING_GZIP;
+   }
+
+   return METRICS_ENCODING_NONE;
+}
+
+static int
+redirect_page(SSL* client_ssl, int client_fd, char* path)
+{
+   char* data = NULL;
+   time_t now;
+   char time_buf[32];
+   int status;
+   struct message msg;
+
+   memset(&msg, 0, sizeof(struct message));
+   memset(&data, 0, sizeof(data));
+
+   now = time(NULL);
+
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
+
+   data = pgagroal_append(data, "HTTP/1.1 301 Moved Permanently\r\n");
+   data = pgagroal_append(data, "Location: ");
+   data = pgagroal_append(data, path);
+   data = pgagroal_append(data, "\r\n");
+   data = pgagroal_append(data, "Date: ");
+   data = pgagroal_append(data, &time_buf[0]);
+   data = pgagroal_append(data, "\r\n");
+   data = pgagroal_append(data, "Content-Length: 0\r\n");
+   data = pgagroal_append(data, "Connection: close\r\n");
+   data = pgagroal_append(data, "\r\n");
+
+   msg.kind = 0;
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
 
    free(data);
 
@@ -1242,11 +2284,16 @@ resolve_page(struct message* msg)
    index = 4;
    from = (char*)msg->data + index;
 
-   while (pgagroal_read_byte(msg->data + index) != ' ')
+   while (index < msg->length && pgagroal_read_byte(msg->data + index) != ' ')
    {
       index++;
    }
 
+   if (index >= msg->length)
+   {
+      return BAD_REQUEST;
+   }
+
    pgagroal_write_byte(msg->data + index, '\0');
 
    if (strcmp(from, "/") == 0 || strcmp(from, "/index.html") == 0)
@@ -1288,7 +2335,7 @@ badrequest_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
 
    free(data);
 
@@ -1322,7 +2369,7 @@ unknown_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
 
    free(data);
 
@@ -1378,7 +2425,7 @@ home_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
    if (status != MESSAGE_STATUS_OK)
    {
       goto done;
@@ -1479,6 +2526,9 @@ home_page(SSL* client_ssl, int client_fd)
    data = pgagroal_append(data, "  <h2>pgagroal_logging_fatal</h2>\n");
    data = pgagroal_append(data, "  The number of FATAL logging statements\n");
    data = pgagroal_append(data, "  <p>\n");
+   data = pgagroal_append(data, "  <h2>pgagroal_logging_dropped</h2>\n");
+   data = pgagroal_append(data, "  The number of log lines dropped because the log queue was full\n");
+   data = pgagroal_append(data, "  <p>\n");
    data = pgagroal_append(data, "  <h2>pgagroal_server_error</h2>\n");
    data = pgagroal_append(data, "  <p>\n");
    data = pgagroal_append(data, "   Errors for servers\n");
@@ -1919,7 +2969,7 @@ home_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
 
 done:
    if (data != NULL)
@@ -1960,7 +3010,7 @@ home_vault_page(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
    if (status != MESSAGE_STATUS_OK)
    {
       goto done;
@@ -2010,282 +3060,273 @@ home_vault_page(SSL* client_ssl, int client_fd)
    data = pgagroal_append(data, "</body>\n");
    data = pgagroal_append(data, "</html>\n");
 
-   send_chunk(client_ssl, client_fd, data);
-   free(data);
-   data = NULL;
+   send_chunk(client_ssl, client_fd, data);
+   free(data);
+   data = NULL;
+
+   /* Footer */
+   data = pgagroal_append(data, "0\r\n\r\n");
+
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
+
+   status = metrics_send(client_ssl, client_fd, &msg);
+
+done:
+   if (data != NULL)
+   {
+      free(data);
+   }
+
+   return status;
+}
+
+/**
+ * Build the HTTP header of a metrics response
+ * @param content_type The content type
+ * @param encoding The content encoding
+ * @param length The length of the body, or 0 for a chunked body
+ * @return The header
+ */
+static char*
+response_header(char* content_type, int encoding, size_t length)
+{
+   char* data = NULL;
+   time_t now;
+   char time_buf[32];
+   char length_buf[32];
+
+   now = time(NULL);
+
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
+
+   data = pgagroal_append(data, "HTTP/1.1 200 OK\r\n");
+   data = pgagroal_append(data, "Content-Type: ");
+   data = pgagroal_append(data, content_type);
+   data = pgagroal_append(data, "\r\n");
+   if (encoding == METRICS_ENCODING_GZIP)
+   {
+      data = pgagroal_append(data, "Content-Encoding: gzip\r\n");
+   }
+   else if (encoding == METRICS_ENCODING_ZSTD)
+   {
+      data = pgagroal_append(data, "Content-Encoding: zstd\r\n");
+   }
+   data = pgagroal_append(data, "Vary: Accept-Encoding\r\n");
+   data = pgagroal_append(data, "Date: ");
+   data = pgagroal_append(data, &time_buf[0]);
+   data = pgagroal_append(data, "\r\n");
+   if (length > 0)
+   {
+      pgagroal_snprintf(&length_buf[0], sizeof(length_buf), "%zu", length);
+      data = pgagroal_append(data, "Content-Length: ");
+      data = pgagroal_append(data, &length_buf[0]);
+      data = pgagroal_append(data, "\r\n");
+   }
+   else
+   {
+      data = pgagroal_append(data, "Transfer-Encoding: chunked\r\n");
+   }
+   data = pgagroal_append(data, "\r\n");
+
+   return data;
+}
+
+/**
+ * Write the HTTP header of the chunked metrics response
+ * @param client_ssl The client SSL
+ * @param client_fd The client descriptor
+ * @return 0 upon success
+ */
+static int
+metrics_header(SSL* client_ssl, int client_fd)
+{
+   char* data = NULL;
+   int status;
+   struct message msg;
+
+   memset(&msg, 0, sizeof(struct message));
 
-   /* Footer */
-   data = pgagroal_append(data, "0\r\n\r\n");
+   data = response_header(METRICS_CONTENT_TYPE, metrics_encoding, 0);
 
    msg.kind = 0;
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
 
-done:
-   if (data != NULL)
-   {
-      free(data);
-   }
+   free(data);
 
-   return status;
+   return status == MESSAGE_STATUS_OK ? 0 : 1;
 }
 
 static int
-metrics_page(SSL* client_ssl, int client_fd)
+metrics_page(SSL* client_ssl, int client_fd, int encoding)
 {
    char* data = NULL;
-   time_t now;
-   char time_buf[32];
    int status;
    struct message msg;
-   struct prometheus_cache* cache;
-   signed char cache_is_free;
-
-   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+   prometheus_metrics_container_t* container = NULL;
 
    memset(&msg, 0, sizeof(struct message));
 
-retry_cache_locking:
-   cache_is_free = STATE_FREE;
-   if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   // can serve the message out of cache?
+   if (metrics_cache_serve(client_ssl, client_fd, encoding, &status))
    {
-      // can serve the message out of cache?
-      if (is_metrics_cache_configured() && is_metrics_cache_valid())
-      {
-         // serve the message directly out of the cache
-         pgagroal_log_debug("Serving metrics out of cache (%d/%d bytes valid until %lld)",
-                            strlen(cache->data),
-                            cache->size,
-                            cache->valid_until);
-
-         msg.kind = 0;
-         msg.length = strlen(cache->data);
-         msg.data = cache->data;
-      }
-      else
-      {
-         // build the message without the cache
-         metrics_cache_invalidate();
-
-         now = time(NULL);
-
-         memset(&time_buf, 0, sizeof(time_buf));
-         ctime_r(&now, &time_buf[0]);
-         time_buf[strlen(time_buf) - 1] = 0;
-
-         data = pgagroal_append(data, "HTTP/1.1 200 OK\r\n");
-         data = pgagroal_append(data, "Content-Type: text/plain; version=0.0.3; charset=utf-8\r\n");
-         data = pgagroal_append(data, "Date: ");
-         data = pgagroal_append(data, &time_buf[0]);
-         data = pgagroal_append(data, "\r\n");
-         metrics_cache_append(data); // cache here to avoid the chunking for the cache
-         data = pgagroal_append(data, "Transfer-Encoding: chunked\r\n");
-         data = pgagroal_append(data, "\r\n");
-
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
-
-         status = pgagroal_write_message(client_ssl, client_fd, &msg);
-         if (status != MESSAGE_STATUS_OK)
-         {
-            metrics_cache_invalidate();
-            atomic_store(&cache->lock, STATE_FREE);
-
-            goto error;
-         }
-
-         free(data);
-         data = NULL;
-
-         /* ART-based metrics container */
-         prometheus_metrics_container_t* container = NULL;
-         if (create_metrics_container(&container))
-         {
-            pgagroal_log_error("Failed to create metrics container");
-            metrics_cache_invalidate();
-            atomic_store(&cache->lock, STATE_FREE);
-            goto error;
-         }
-
-         general_information(container);
-         connection_information(container);
-         limit_information(container);
-         session_information(container);
-         pool_information(container);
-         auth_information(container);
-         client_information(container);
-         internal_information(container);
-         connection_awaiting_information(container);
-         write_os_kernel_version(container);
-         certificate_information(container);
+      return status == MESSAGE_STATUS_OK ? 0 : 1;
+   }
 
-         /* Output ART metrics */
-         output_all_metrics(client_ssl, client_fd, container);
+   // build the message, and publish it when we are the one refreshing the cache
+   metrics_cache_begin();
+   metrics_stream_begin(encoding);
 
-         /* Destroy container */
-         destroy_metrics_container(container);
+   if (metrics_header(client_ssl, client_fd))
+   {
+      goto error;
+   }
 
-         /* Footer */
-         data = pgagroal_append(data, "0\r\n\r\n");
+   /* ART-based metrics container */
+   if (create_metrics_container(&container))
+   {
+      pgagroal_log_error("Failed to create metrics container");
+      goto error;
+   }
 
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
+   if (general_information(container) || connection_information(container))
+   {
+      destroy_metrics_container(container);
+      goto error;
+   }
+   limit_information(container);
+   session_information(container);
+   latency_information(container);
+   traffic_information(container);
+   pool_information(container);
+   auth_information(container);
+   client_information(container);
+   internal_information(container);
+   connection_awaiting_information(container);
+   event_loop_information(container);
+   write_os_kernel_version(container);
+   certificate_information(container);
 
-         metrics_cache_finalize();
-      }
+   /* Output ART metrics */
+   output_all_metrics(client_ssl, client_fd, container);
 
-      // free the cache
-      atomic_store(&cache->lock, STATE_FREE);
+   /* Destroy container */
+   destroy_metrics_container(container);
 
-   } // end of cache locking
-   else
+   if (metrics_stream_write(client_ssl, client_fd, NULL, 0, true) != MESSAGE_STATUS_OK)
    {
-      /* Sleep for 1ms */
-      SLEEP_AND_GOTO(1000000L, retry_cache_locking)
+      goto error;
    }
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   /* Footer */
+   data = pgagroal_append(data, "0\r\n\r\n");
+
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
+
+   status = metrics_send(client_ssl, client_fd, &msg);
 
    if (status != MESSAGE_STATUS_OK)
    {
       goto error;
    }
 
+   metrics_cache_finalize();
+   metrics_stream_end();
+
    free(data);
 
    return 0;
 
 error:
 
+   metrics_cache_abort();
+   metrics_stream_end();
+
    free(data);
 
    return 1;
 }
 
 static int
-metrics_vault_page(SSL* client_ssl, int client_fd)
+metrics_vault_page(SSL* client_ssl, int client_fd, int encoding)
 {
    char* data = NULL;
-   time_t now;
-   char time_buf[32];
    int status;
    struct message msg;
-   struct prometheus_cache* cache;
-   signed char cache_is_free;
-
-   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+   prometheus_metrics_container_t* container = NULL;
 
    memset(&msg, 0, sizeof(struct message));
 
-retry_cache_locking:
-   cache_is_free = STATE_FREE;
-   if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   // can serve the message out of cache?
+   if (metrics_cache_serve(client_ssl, client_fd, encoding, &status))
    {
-      // can serve the message out of cache?
-      if (is_metrics_cache_configured() && is_metrics_cache_valid())
-      {
-         // serve the message directly out of the cache
-         pgagroal_log_debug("Serving metrics out of cache (%d/%d bytes valid until %lld)",
-                            strlen(cache->data),
-                            cache->size,
-                            cache->valid_until);
-
-         msg.kind = 0;
-         msg.length = strlen(cache->data);
-         msg.data = cache->data;
-      }
-      else
-      {
-         // build the message without the cache
-         metrics_cache_invalidate();
-
-         now = time(NULL);
-
-         memset(&time_buf, 0, sizeof(time_buf));
-         ctime_r(&now, &time_buf[0]);
-         time_buf[strlen(time_buf) - 1] = 0;
-
-         data = pgagroal_append(data, "HTTP/1.1 200 OK\r\n");
-         data = pgagroal_append(data, "Content-Type: text/plain; version=0.0.3; charset=utf-8\r\n");
-         data = pgagroal_append(data, "Date: ");
-         data = pgagroal_append(data, &time_buf[0]);
-         data = pgagroal_append(data, "\r\n");
-         metrics_cache_append(data); // cache here to avoid the chunking for the cache
-         data = pgagroal_append(data, "Transfer-Encoding: chunked\r\n");
-         data = pgagroal_append(data, "\r\n");
-
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
-
-         status = pgagroal_write_message(client_ssl, client_fd, &msg);
-         if (status != MESSAGE_STATUS_OK)
-         {
-            metrics_cache_invalidate();
-            atomic_store(&cache->lock, STATE_FREE);
-
-            goto error;
-         }
-
-         free(data);
-         data = NULL;
-
-         /* ART-based metrics container */
-         prometheus_metrics_container_t* container = NULL;
-         if (create_metrics_container(&container))
-         {
-            pgagroal_log_error("Failed to create metrics container");
-            metrics_cache_invalidate();
-            atomic_store(&cache->lock, STATE_FREE);
-            goto error;
-         }
-
-         general_vault_information(container);
-         internal_vault_information(container);
+      return status == MESSAGE_STATUS_OK ? 0 : 1;
+   }
 
-         /* Output ART metrics */
-         output_all_metrics(client_ssl, client_fd, container);
+   // build the message, and publish it when we are the one refreshing the cache
+   metrics_cache_begin();
+   metrics_stream_begin(encoding);
 
-         /* Destroy container */
-         destroy_metrics_container(container);
+   if (metrics_header(client_ssl, client_fd))
+   {
+      goto error;
+   }
 
-         /* Footer */
-         data = pgagroal_append(data, "0\r\n\r\n");
+   /* ART-based metrics container */
+   if (create_metrics_container(&container))
+   {
+      pgagroal_log_error("Failed to create metrics container");
+      goto error;
+   }
 
-         msg.kind = 0;
-         msg.length = strlen(data);
-         msg.data = data;
+   general_vault_information(container);
+   internal_vault_information(container);
 
-         metrics_cache_finalize();
-      }
+   /* Output ART metrics */
+   output_all_metrics(client_ssl, client_fd, container);
 
-      // free the cache
-      atomic_store(&cache->lock, STATE_FREE);
+   /* Destroy container */
+   destroy_metrics_container(container);
 
-   } // end of cache locking
-   else
+   if (metrics_stream_write(client_ssl, client_fd, NULL, 0, true) != MESSAGE_STATUS_OK)
    {
-      /* Sleep for 1ms */
-      SLEEP_AND_GOTO(1000000L, retry_cache_locking)
+      goto error;
    }
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   /* Footer */
+   data = pgagroal_append(data, "0\r\n\r\n");
+
+   msg.kind = 0;
+   msg.length = strlen(data);
+   msg.data = data;
+
+   status = metrics_send(client_ssl, client_fd, &msg);
 
    if (status != MESSAGE_STATUS_OK)
    {
       goto error;
    }
 
+   metrics_cache_finalize();
+   metrics_stream_end();
+
    free(data);
 
    return 0;
 
 error:
 
+   metrics_cache_abort();
+   metrics_stream_end();
+
    free(data);
 
    return 1;
@@ -2318,17 +3359,18 @@ bad_request(SSL* client_ssl, int client_fd)
    msg.length = strlen(data);
    msg.data = data;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
 
    free(data);
 
    return status;
 }
 
-static void
+static int
 general_information(prometheus_metrics_container_t* container)
 {
    char* data = NULL;
+   struct metrics_buffer buffer;
    struct main_configuration* config;
    struct main_prometheus* prometheus;
 
@@ -2474,6 +3516,15 @@ general_information(prometheus_metrics_container_t* container)
    free(data);
    data = NULL;
 
+   data = pgagroal_append(data, "#HELP pgagroal_logging_dropped The number of log lines dropped because the log queue was full\n");
+   data = pgagroal_append(data, "#TYPE pgagroal_logging_dropped counter\n");
+   data = pgagroal_append(data, "pgagroal_logging_dropped ");
+   data = pgagroal_append_ulong(data, pgagroal_log_queue_dropped());
+   data = pgagroal_append(data, "\n");
+   add_metric_to_art(container->general_metrics, "pgagroal_logging_dropped", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+
    data = pgagroal_append(data, "#HELP pgagroal_failed_servers The number of failed servers\n");
    data = pgagroal_append(data, "#TYPE pgagroal_failed_servers gauge\n");
    data = pgagroal_append(data, "pgagroal_failed_servers ");
@@ -2555,52 +3606,57 @@ general_information(prometheus_metrics_container_t* container)
    data = pgagroal_append(data, "#HELP pgagroal_query_count The number of queries\n");
    data = pgagroal_append(data, "#TYPE pgagroal_query_count counter\n");
    data = pgagroal_append(data, "pgagroal_query_count ");
-   data = pgagroal_append_ullong(data, atomic_load(&prometheus->query_count));
+   data = pgagroal_append_ullong(data, sum_shards(prometheus, offsetof(struct prometheus_shard, query_count)));
    data = pgagroal_append(data, "\n");
    add_metric_to_art(container->general_metrics, "pgagroal_query_count", data, NULL, NULL, 0);
    free(data);
    data = NULL;
 
-   data = pgagroal_append(data, "#HELP pgagroal_connection_query_count The number of queries per connection\n");
-   data = pgagroal_append(data, "#TYPE pgagroal_connection_query_count counter\n");
-   for (int i = 0; i < config->max_connections; i++)
-   {
-      data = pgagroal_append(data, "pgagroal_connection_query_count{");
-
-      data = pgagroal_append(data, "id=\"");
-      data = pgagroal_append_int(data, i);
-      data = pgagroal_append(data, "\",");
-
-      data = pgagroal_append(data, "user=\"");
-      data = pgagroal_append(data, config->connections[i].username);
-      data = pgagroal_append(data, "\",");
-
-      data = pgagroal_append(data, "database=\"");
-      data = pgagroal_append(data, config->connections[i].database);
-      data = pgagroal_append(data, "\",");
-
-      data = pgagroal_append(data, "application_name=\"");
-      data = pgagroal_append(data, config->connections[i].appname);
-      data = pgagroal_append(data, "\"} ");
+   memset(&buffer, 0, sizeof(struct metrics_buffer));
 
-      data = pgagroal_append_ullong(data, atomic_load(&prometheus->prometheus_connections[i].query_count));
-      data = pgagroal_append(data, "\n");
+   if (!metrics_buffer_reserve(&buffer, (size_t)config->max_connections * METRICS_CONNECTION_LENGTH) ||
+       !metrics_buffer_append(&buffer, "#HELP pgagroal_connection_query_count The number of queries per connection\n") ||
+       !metrics_buffer_append(&buffer, "#TYPE pgagroal_connection_query_count counter\n"))
+   {
+      goto error;
    }
-   if (data != NULL)
+   for (int i = 0; i < config->max_connections; i++)
    {
-      add_metric_to_art(container->general_metrics, "pgagroal_connection_query_count", data, NULL, NULL, 0);
-      free(data);
-      data = NULL;
+      if (!metrics_buffer_append(&buffer, "pgagroal_connection_query_count{id=\"") ||
+          !metrics_buffer_append_int(&buffer, i) ||
+          !metrics_buffer_append(&buffer, "\",user=\"") ||
+          !metrics_buffer_append(&buffer, config->connections[i].username) ||
+          !metrics_buffer_append(&buffer, "\",database=\"") ||
+          !metrics_buffer_append(&buffer, config->connections[i].database) ||
+          !metrics_buffer_append(&buffer, "\",application_name=\"") ||
+          !metrics_buffer_append(&buffer, config->connections[i].appname) ||
+          !metrics_buffer_append(&buffer, "\"} ") ||
+          !metrics_buffer_append_ullong(&buffer, atomic_load(&prometheus->prometheus_connections[i].query_count)) ||
+          !metrics_buffer_append(&buffer, "\n"))
+      {
+         goto error;
+      }
    }
+   add_metric_to_art(container->general_metrics, "pgagroal_connection_query_count", buffer.data, NULL, NULL, 0);
+   free(buffer.data);
 
    data = pgagroal_append(data, "#HELP pgagroal_tx_count The number of transactions\n");
    data = pgagroal_append(data, "#TYPE pgagroal_tx_count counter\n");
    data = pgagroal_append(data, "pgagroal_tx_count ");
-   data = pgagroal_append_ullong(data, atomic_load(&prometheus->tx_count));
+   data = pgagroal_append_ullong(data, sum_shards(prometheus, offsetof(struct prometheus_shard, tx_count)));
    data = pgagroal_append(data, "\n");
    add_metric_to_art(container->general_metrics, "pgagroal_tx_count", data, NULL, NULL, 0);
    free(data);
    data = NULL;
+
+   return 0;
+
+error:
+
+   pgagroal_log_error("Couldn't build the pgagroal_connection_query_count metric");
+   free(buffer.data);
+
+   return 1;
 }
 
 static void
@@ -2648,12 +3704,13 @@ general_vault_information(prometheus_metrics_container_t* container)
    data = NULL;
 }
 
-static void
+static int
 connection_information(prometheus_metrics_container_t* container)
 {
    char* data = NULL;
    int active;
    int total;
+   struct metrics_buffer buffer;
    struct main_configuration* config;
 
    config = (struct main_configuration*)shmem;
@@ -2711,99 +3768,87 @@ connection_information(prometheus_metrics_container_t* container)
    free(data);
    data = NULL;
 
-   data = pgagroal_append(data, "#HELP pgagroal_connection The connection information\n");
-   data = pgagroal_append(data, "#TYPE pgagroal_connection gauge\n");
+   memset(&buffer, 0, sizeof(struct metrics_buffer));
+
+   if (!metrics_buffer_reserve(&buffer, (size_t)config->max_connections * METRICS_CONNECTION_LENGTH) ||
+       !metrics_buffer_append(&buffer, "#HELP pgagroal_connection The connection information\n") ||
+       !metrics_buffer_append(&buffer, "#TYPE pgagroal_connection gauge\n"))
+   {
+      goto error;
+   }
    for (int i = 0; i < config->max_connections; i++)
    {
       int state = atomic_load(&config->states[i]);
-
-      data = pgagroal_append(data, "pgagroal_connection{");
-
-      data = pgagroal_append(data, "id=\"");
-      data = pgagroal_append_int(data, i);
-      data = pgagroal_append(data, "\",");
-
-      data = pgagroal_append(data, "user=\"");
-      data = pgagroal_append(data, config->connections[i].username);
-      data = pgagroal_append(data, "\",");
-
-      data = pgagroal_append(data, "database=\"");
-      data = pgagroal_append(data, config->connections[i].database);
-      data = pgagroal_append(data, "\",");
-
-      data = pgagroal_append(data, "application_name=\"");
-      data = pgagroal_append(data, config->connections[i].appname);
-      data = pgagroal_append(data, "\",");
-
-      data = pgagroal_append(data, "state=\"");
+      char* label = NULL;
+      char* value = "1";
 
       switch (state)
       {
          case STATE_NOTINIT:
-            data = pgagroal_append(data, "not_init");
+            label = "not_init";
+            value = "0";
             break;
          case STATE_INIT:
-            data = pgagroal_append(data, "init");
+            label = "init";
             break;
          case STATE_FREE:
-            data = pgagroal_append(data, "free");
+            label = "free";
             break;
          case STATE_IN_USE:
-            data = pgagroal_append(data, "in_use");
+            label = "in_use";
             break;
          case STATE_GRACEFULLY:
-            data = pgagroal_append(data, "gracefully");
+            label = "gracefully";
             break;
          case STATE_FLUSH:
-            data = pgagroal_append(data, "flush");
+            label = "flush";
             break;
          case STATE_IDLE_CHECK:
-            data = pgagroal_append(data, "idle_check");
+            label = "idle_check";
             break;
          case STATE_MAX_CONNECTION_AGE:
-            data = pgagroal_append(data, "max_connection_age");
+            label = "max_connection_age";
             break;
          case STATE_VALIDATION:
-            data = pgagroal_append(data, "validation");
+            label = "validation";
             break;
          case STATE_REMOVE:
-            data = pgagroal_append(data, "remove");
+            label = "remove";
             break;
          default:
+            value = NULL;
             break;
       }
 
-      data = pgagroal_append(data, "\"} ");
-
-      switch (state)
+      if (!metrics_buffer_append(&buffer, "pgagroal_connection{id=\"") ||
+          !metrics_buffer_append_int(&buffer, i) ||
+          !metrics_buffer_append(&buffer, "\",user=\"") ||
+          !metrics_buffer_append(&buffer, config->connections[i].username) ||
+          !metrics_buffer_append(&buffer, "\",database=\"") ||
+          !metrics_buffer_append(&buffer, config->connections[i].database) ||
+          !metrics_buffer_append(&buffer, "\",application_name=\"") ||
+          !metrics_buffer_append(&buffer, config->connections[i].appname) ||
+          !metrics_buffer_append(&buffer, "\",state=\"") ||
+          !metrics_buffer_append(&buffer, label) ||
+          !metrics_buffer_append(&buffer, "\"} ") ||
+          !metrics_buffer_append(&buffer, value) ||
+          !metrics_buffer_append(&buffer, "\n"))
       {
-         case STATE_NOTINIT:
-            data = pgagroal_append(data, "0");
-            break;
-         case STATE_INIT:
-         case STATE_FREE:
-         case STATE_IN_USE:
-         case STATE_GRACEFULLY:
-         case STATE_FLUSH:
-         case STATE_IDLE_CHECK:
-         case STATE_MAX_CONNECTION_AGE:
-         case STATE_VALIDATION:
-         case STATE_REMOVE:
-            data = pgagroal_append(data, "1");
-            break;
-         default:
-            break;
+         goto error;
       }
-
-      data = pgagroal_append(data, "\n");
    }
 
-   if (data != NULL)
-   {
-      add_metric_to_art(container->connection_metrics, "pgagroal_connection", data, NULL, NULL, 0);
-      free(data);
-      data = NULL;
-   }
+   add_metric_to_art(container->connection_metrics, "pgagroal_connection", buffer.data, NULL, NULL, 0);
+   free(buffer.data);
+
+   return 0;
+
+error:
+
+   pgagroal_log_error("Couldn't build the pgagroal_connection metric");
+   free(buffer.data);
+
+   return 1;
 }
 
 static void
@@ -2914,107 +3959,204 @@ session_information(prometheus_metrics_container_t* container)
    data = pgagroal_append(data, "#HELP pgagroal_session_time_seconds The session times\n");
    data = pgagroal_append(data, "#TYPE pgagroal_session_time_seconds histogram\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"5\"} ");
-   counter += atomic_load(&prometheus->session_time[0]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+   {
+      counter += atomic_load(&prometheus->session_time[i]);
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"10\"} ");
-   counter += atomic_load(&prometheus->session_time[1]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"");
+      if (i < HISTOGRAM_BUCKETS - 1)
+      {
+         data = pgagroal_append_ulong(data, session_time_bounds[i]);
+      }
+      else
+      {
+         data = pgagroal_append(data, "+Inf");
+      }
+      data = pgagroal_append(data, "\"} ");
+      data = pgagroal_append_ulong(data, counter);
+      data = pgagroal_append(data, "\n");
+   }
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"20\"} ");
-   counter += atomic_load(&prometheus->session_time[2]);
-   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_sum ");
+   data = pgagroal_append_ulong(data, atomic_load(&prometheus->session_time_sum));
    data = pgagroal_append(data, "\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"30\"} ");
-   counter += atomic_load(&prometheus->session_time[3]);
+   data = pgagroal_append(data, "pgagroal_session_time_seconds_count ");
    data = pgagroal_append_ulong(data, counter);
    data = pgagroal_append(data, "\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"45\"} ");
-   counter += atomic_load(&prometheus->session_time[4]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   add_metric_to_art(container->session_metrics, "pgagroal_session_time_seconds", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+}
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"60\"} ");
-   counter += atomic_load(&prometheus->session_time[5]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+static void
+latency_histogram(prometheus_metrics_container_t* container, char* name, char* help, struct prometheus_latency* latencies)
+{
+   char* data = NULL;
+   unsigned long long counter;
+   struct main_configuration* config;
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"300\"} ");
-   counter += atomic_load(&prometheus->session_time[6]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   config = (struct main_configuration*)shmem;
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"600\"} ");
-   counter += atomic_load(&prometheus->session_time[7]);
-   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "#HELP ");
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, " ");
+   data = pgagroal_append(data, help);
    data = pgagroal_append(data, "\n");
+   data = pgagroal_append(data, "#TYPE ");
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, " histogram\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"1200\"} ");
-   counter += atomic_load(&prometheus->session_time[8]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   for (int i = -1; i < config->number_of_limits; i++)
+   {
+      char* labels = NULL;
+      struct prometheus_latency* latency = &latencies[i + 1];
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"1800\"} ");
-   counter += atomic_load(&prometheus->session_time[9]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      labels = pgagroal_append(labels, "user=\"");
+      labels = pgagroal_append(labels, i >= 0 ? config->limits[i].username : "all");
+      labels = pgagroal_append(labels, "\",database=\"");
+      labels = pgagroal_append(labels, i >= 0 ? config->limits[i].database : "all");
+      labels = pgagroal_append(labels, "\"");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"2700\"} ");
-   counter += atomic_load(&prometheus->session_time[10]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      counter = 0;
+      for (int j = 0; j < LATENCY_HISTOGRAM_BUCKETS; j++)
+      {
+         counter += atomic_load(&latency->buckets[j]);
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"3600\"} ");
-   counter += atomic_load(&prometheus->session_time[11]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+         data = pgagroal_append(data, name);
+         data = pgagroal_append(data, "_bucket{");
+         data = pgagroal_append(data, labels);
+         data = pgagroal_append(data, ",le=\"");
+         if (j < LATENCY_HISTOGRAM_BUCKETS - 1)
+         {
+            data = pgagroal_append_ullong(data, latency_bound(j));
+         }
+         else
+         {
+            data = pgagroal_append(data, "+Inf");
+         }
+         data = pgagroal_append(data, "\"} ");
+         data = pgagroal_append_ullong(data, counter);
+         data = pgagroal_append(data, "\n");
+      }
+
+      data = pgagroal_append(data, name);
+      data = pgagroal_append(data, "_sum{");
+      data = pgagroal_append(data, labels);
+      data = pgagroal_append(data, "} ");
+      data = pgagroal_append_ullong(data, atomic_load(&latency->sum));
+      data = pgagroal_append(data, "\n");
+
+      data = pgagroal_append(data, name);
+      data = pgagroal_append(data, "_count{");
+      data = pgagroal_append(data, labels);
+      data = pgagroal_append(data, "} ");
+      data = pgagroal_append_ullong(data, counter);
+      data = pgagroal_append(data, "\n");
+
+      free(labels);
+   }
+
+   add_metric_to_art(container->session_metrics, name, data, NULL, NULL, 0);
+   free(data);
+}
+
+static void
+latency_information(prometheus_metrics_container_t* container)
+{
+   struct main_prometheus* prometheus;
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   latency_histogram(container, "pgagroal_connection_acquire_microseconds",
+                     "Time waiting for a connection from the pool", prometheus->acquire_time);
+   latency_histogram(container, "pgagroal_connection_connect_microseconds",
+                     "Time connecting to a server", prometheus->connect_time);
+   latency_histogram(container, "pgagroal_connection_auth_microseconds",
+                     "Time authenticating a client and its connection", prometheus->auth_time);
+}
+
+static void
+traffic_information(prometheus_metrics_container_t* container)
+{
+   struct main_prometheus* prometheus;
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   traffic_counter(container, "pgagroal_database_network_sent", "Bytes sent by clients per database", "database",
+                   prometheus->databases, offsetof(struct prometheus_traffic, bytes_sent));
+   traffic_counter(container, "pgagroal_database_network_received", "Bytes received from servers per database", "database",
+                   prometheus->databases, offsetof(struct prometheus_traffic, bytes_received));
+   traffic_counter(container, "pgagroal_database_query_count", "The number of queries per database", "database",
+                   prometheus->databases, offsetof(struct prometheus_traffic, queries));
+   traffic_counter(container, "pgagroal_database_tx_count", "The number of transactions per database", "database",
+                   prometheus->databases, offsetof(struct prometheus_traffic, transactions));
+   traffic_counter(container, "pgagroal_database_error_count", "The number of server errors per database", "database",
+                   prometheus->databases, offsetof(struct prometheus_traffic, errors));
+
+   traffic_counter(container, "pgagroal_user_network_sent", "Bytes sent by clients per user", "user",
+                   prometheus->users, offsetof(struct prometheus_traffic, bytes_sent));
+   traffic_counter(container, "pgagroal_user_network_received", "Bytes received from servers per user", "user",
+                   prometheus->users, offsetof(struct prometheus_traffic, bytes_received));
+   traffic_counter(container, "pgagroal_user_query_count", "The number of queries per user", "user",
+                   prometheus->users, offsetof(struct prometheus_traffic, queries));
+   traffic_counter(container, "pgagroal_user_tx_count", "The number of transactions per user", "user",
+                   prometheus->users, offsetof(struct prometheus_traffic, transactions));
+   traffic_counter(container, "pgagroal_user_error_count", "The number of server errors per user", "user",
+                   prometheus->users, offsetof(struct prometheus_traffic, errors));
+}
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"7200\"} ");
-   counter += atomic_load(&prometheus->session_time[12]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+static void
+traffic_counter(prometheus_metrics_container_t* container, char* name, char* help, char* label,
+                struct prometheus_traffic* entries, int offset)
+{
+   char* data = NULL;
+   char* escaped = NULL;
+   atomic_ullong* value = NULL;
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"14400\"} ");
-   counter += atomic_load(&prometheus->session_time[13]);
-   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, "#HELP ");
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, " ");
+   data = pgagroal_append(data, help);
    data = pgagroal_append(data, "\n");
+   data = pgagroal_append(data, "#TYPE ");
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, " counter\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"21600\"} ");
-   counter += atomic_load(&prometheus->session_time[14]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+   for (int i = 0; i < NUMBER_OF_TRAFFIC_ENTRIES; i++)
+   {
+      if (atomic_load(&entries[i].state) != STATE_IN_USE)
+      {
+         continue;
+      }
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"43200\"} ");
-   counter += atomic_load(&prometheus->session_time[15]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      value = (atomic_ullong*)((char*)&entries[i] + offset);
+      escaped = pgagroal_escape_string(entries[i].name);
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"86400\"} ");
-   counter += atomic_load(&prometheus->session_time[16]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      data = pgagroal_append(data, name);
+      data = pgagroal_append(data, "{");
+      data = pgagroal_append(data, label);
+      data = pgagroal_append(data, "=\"");
+      data = pgagroal_append(data, escaped);
+      data = pgagroal_append(data, "\"} ");
+      data = pgagroal_append_ullong(data, atomic_load(value));
+      data = pgagroal_append(data, "\n");
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_bucket{le=\"+Inf\"} ");
-   counter += atomic_load(&prometheus->session_time[17]);
-   data = pgagroal_append_ulong(data, counter);
-   data = pgagroal_append(data, "\n");
+      free(escaped);
+      escaped = NULL;
+   }
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_sum ");
-   data = pgagroal_append_ulong(data, atomic_load(&prometheus->session_time_sum));
-   data = pgagroal_append(data, "\n");
+   /* The overflow bucket holds the names that did not fit in the table */
+   value = (atomic_ullong*)((char*)&entries[NUMBER_OF_TRAFFIC_ENTRIES] + offset);
 
-   data = pgagroal_append(data, "pgagroal_session_time_seconds_count ");
-   data = pgagroal_append_ulong(data, counter);
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, "{overflow=\"true\"} ");
+   data = pgagroal_append_ullong(data, atomic_load(value));
    data = pgagroal_append(data, "\n");
 
-   add_metric_to_art(container->session_metrics, "pgagroal_session_time_seconds", data, NULL, NULL, 0);
+   add_metric_to_art(container->session_metrics, name, data, NULL, NULL, 0);
    free(data);
-   data = NULL;
 }
 
 static void
@@ -3241,7 +4383,7 @@ internal_information(prometheus_metrics_container_t* container)
    data = pgagroal_append(data, "#HELP pgagroal_network_sent Bytes sent by clients\n");
    data = pgagroal_append(data, "#TYPE pgagroal_network_sent gauge\n");
    data = pgagroal_append(data, "pgagroal_network_sent ");
-   data = pgagroal_append_ullong(data, atomic_load(&prometheus->network_sent));
+   data = pgagroal_append_ullong(data, sum_shards(prometheus, offsetof(struct prometheus_shard, network_sent)));
    data = pgagroal_append(data, "\n");
    add_metric_to_art(container->internal_metrics, "pgagroal_network_sent", data, NULL, NULL, 0);
    free(data);
@@ -3250,7 +4392,7 @@ internal_information(prometheus_metrics_container_t* container)
    data = pgagroal_append(data, "#HELP pgagroal_network_received Bytes received from servers\n");
    data = pgagroal_append(data, "#TYPE pgagroal_network_received gauge\n");
    data = pgagroal_append(data, "pgagroal_network_received ");
-   data = pgagroal_append_ullong(data, atomic_load(&prometheus->network_received));
+   data = pgagroal_append_ullong(data, sum_shards(prometheus, offsetof(struct prometheus_shard, network_received)));
    data = pgagroal_append(data, "\n");
    add_metric_to_art(container->internal_metrics, "pgagroal_network_received", data, NULL, NULL, 0);
    free(data);
@@ -3356,6 +4498,136 @@ connection_awaiting_information(prometheus_metrics_container_t* container)
    }
 }
 
+static void
+event_loop_counter(prometheus_metrics_container_t* container, char* name, char* help, int offset)
+{
+   char* data = NULL;
+   struct main_prometheus* prometheus;
+   static char* roles[EV_STATS_ROLES] = {"main", "worker"};
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   data = pgagroal_append(data, "#HELP ");
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, " ");
+   data = pgagroal_append(data, help);
+   data = pgagroal_append(data, "\n");
+   data = pgagroal_append(data, "#TYPE ");
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, " counter\n");
+
+   for (int i = 0; i < EV_STATS_ROLES; i++)
+   {
+      atomic_ullong* value = (atomic_ullong*)((char*)&prometheus->event_loop[i] + offset);
+
+      data = pgagroal_append(data, name);
+      data = pgagroal_append(data, "{role=\"");
+      data = pgagroal_append(data, roles[i]);
+      data = pgagroal_append(data, "\"} ");
+      data = pgagroal_append_ullong(data, atomic_load(value));
+      data = pgagroal_append(data, "\n");
+   }
+
+   add_metric_to_art(container->internal_metrics, name, data, NULL, NULL, 0);
+   free(data);
+}
+
+static void
+event_loop_histogram(prometheus_metrics_container_t* container, char* name, char* help,
+                     int offset, int buckets, char** bounds, int sum_offset)
+{
+   char* data = NULL;
+   unsigned long long counter;
+   struct main_prometheus* prometheus;
+   static char* roles[EV_STATS_ROLES] = {"main", "worker"};
+
+   prometheus = (struct main_prometheus*)prometheus_shmem;
+
+   data = pgagroal_append(data, "#HELP ");
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, " ");
+   data = pgagroal_append(data, help);
+   data = pgagroal_append(data, "\n");
+   data = pgagroal_append(data, "#TYPE ");
+   data = pgagroal_append(data, name);
+   data = pgagroal_append(data, " histogram\n");
+
+   for (int i = 0; i < EV_STATS_ROLES; i++)
+   {
+      atomic_ullong* values = (atomic_ullong*)((char*)&prometheus->event_loop[i] + offset);
+
+      counter = 0;
+      for (int j = 0; j < buckets; j++)
+      {
+         counter += atomic_load(&values[j]);
+
+         data = pgagroal_append(data, name);
+         data = pgagroal_append(data, "_bucket{role=\"");
+         data = pgagroal_append(data, roles[i]);
+         data = pgagroal_append(data, "\",le=\"");
+         data = pgagroal_append(data, bounds[j]);
+         data = pgagroal_append(data, "\"} ");
+         data = pgagroal_append_ullong(data, counter);
+         data = pgagroal_append(data, "\n");
+      }
+
+      if (sum_offset >= 0)
+      {
+         data = pgagroal_append(data, name);
+         data = pgagroal_append(data, "_sum{role=\"");
+         data = pgagroal_append(data, roles[i]);
+         data = pgagroal_append(data, "\"} ");
+         data = pgagroal_append_ullong(data, atomic_load((atomic_ullong*)((char*)&prometheus->event_loop[i] + sum_offset)));
+         data = pgagroal_append(data, "\n");
+      }
+
+      data = pgagroal_append(data, name);
+      data = pgagroal_append(data, "_count{role=\"");
+      data = pgagroal_append(data, roles[i]);
+      data = pgagroal_append(data, "\"} ");
+      data = pgagroal_append_ullong(data, counter);
+      data = pgagroal_append(data, "\n");
+   }
+
+   add_metric_to_art(container->internal_metrics, name, data, NULL, NULL, 0);
+   free(data);
+}
+
+static void
+event_loop_information(prometheus_metrics_container_t* container)
+{
+   struct main_configuration* config;
+   static char* wakeup_bounds[EV_STATS_WAKEUP_BUCKETS] = {"1", "2", "4", "8", "16", "32", "+Inf"};
+   static char* callback_bounds[EV_STATS_CALLBACK_BUCKETS] = {"10", "50", "100", "500", "1000", "5000", "10000", "50000", "100000", "+Inf"};
+
+   config = (struct main_configuration*)shmem;
+
+   if (!config->ev_stats)
+   {
+      return;
+   }
+
+   event_loop_counter(container, "pgagroal_event_loop_iterations", "Number of event loop wakeups",
+                      offsetof(struct prometheus_event_loop, iterations));
+   event_loop_counter(container, "pgagroal_event_loop_events", "Number of events dispatched by the event loop",
+                      offsetof(struct prometheus_event_loop, events));
+   event_loop_counter(container, "pgagroal_event_loop_wait_microseconds", "Time the event loop spent waiting for events",
+                      offsetof(struct prometheus_event_loop, wait_time));
+   event_loop_counter(container, "pgagroal_event_loop_busy_microseconds", "Time the event loop spent handling events",
+                      offsetof(struct prometheus_event_loop, busy_time));
+   event_loop_counter(container, "pgagroal_event_loop_sends", "Number of send operations",
+                      offsetof(struct prometheus_event_loop, sends));
+   event_loop_counter(container, "pgagroal_event_loop_partial_sends", "Number of sends that did not complete in one operation",
+                      offsetof(struct prometheus_event_loop, partial_sends));
+
+   event_loop_histogram(container, "pgagroal_event_loop_events_per_wakeup", "Events returned per event loop wakeup",
+                        offsetof(struct prometheus_event_loop, events_per_wakeup), EV_STATS_WAKEUP_BUCKETS,
+                        wakeup_bounds, -1);
+   event_loop_histogram(container, "pgagroal_event_loop_callback_microseconds", "Duration of event loop callbacks",
+                        offsetof(struct prometheus_event_loop, callback_time), EV_STATS_CALLBACK_BUCKETS,
+                        callback_bounds, offsetof(struct prometheus_event_loop, callback_time_sum));
+}
+
 static int
 send_chunk(SSL* client_ssl, int client_fd, char* data)
 {
@@ -3381,13 +4653,319 @@ send_chunk(SSL* client_ssl, int client_fd, char* data)
    msg.length = strlen(m);
    msg.data = m;
 
-   status = pgagroal_write_message(client_ssl, client_fd, &msg);
+   status = metrics_send(client_ssl, client_fd, &msg);
 
    free(m);
 
    return status;
 }
 
+static bool
+metrics_buffer_reserve(struct metrics_buffer* buffer, size_t length)
+{
+   size_t size;
+   char* data = NULL;
+
+   if (length + 1 <= buffer->size)
+   {
+      return true;
+   }
+
+   size = buffer->size > 0 ? buffer->size : 4096;
+   while (size < length + 1)
+   {
+      size *= 2;
+   }
+
+   data = realloc(buffer->data, size);
+   if (data == NULL)
+   {
+      pgagroal_log_error("Couldn't allocate %zu bytes for the metrics", size);
+      return false;
+   }
+
+   buffer->data = data;
+   buffer->size = size;
+
+   return true;
+}
+
+static bool
+metrics_buffer_append(struct metrics_buffer* buffer, char* data)
+{
+   size_t length;
+
+   if (data == NULL)
+   {
+      return true;
+   }
+
+   length = strlen(data);
+
+   if (!metrics_buffer_reserve(buffer, buffer->length + length))
+   {
+      return false;
+   }
+
+   memcpy(buffer->data + buffer->length, data, length);
+   buffer->length += length;
+   buffer->data[buffer->length] = '\0';
+
+   return true;
+}
+
+static bool
+metrics_buffer_append_int(struct metrics_buffer* buffer, int i)
+{
+   char number[12];
+
+   pgagroal_snprintf(&number[0], sizeof(number), "%d", i);
+
+   return metrics_buffer_append(buffer, &number[0]);
+}
+
+static bool
+metrics_buffer_append_ullong(struct metrics_buffer* buffer, unsigned long long l)
+{
+   char number[21];
+
+   pgagroal_snprintf(&number[0], sizeof(number), "%llu", l);
+
+   return metrics_buffer_append(buffer, &number[0]);
+}
+
+/**
+ * Write metrics to the client. The data is collected in the chunk
+ * buffer behind room for the chunk header, and the buffer is sent
+ * as one chunk when it passes METRICS_CHUNK_SIZE
+ * @param client_ssl The client SSL
+ * @param client_fd The client descriptor
+ * @param data The data
+ * @return MESSAGE_STATUS_OK upon success
+ */
+static int
+metrics_write(SSL* client_ssl, int client_fd, char* data)
+{
+   if (chunk_buffer.length < METRICS_CHUNK_HEADER)
+   {
+      if (!metrics_buffer_reserve(&chunk_buffer, METRICS_CHUNK_HEADER + METRICS_CHUNK_SIZE + 2))
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      chunk_buffer.length = METRICS_CHUNK_HEADER;
+      chunk_buffer.data[chunk_buffer.length] = '\0';
+   }
+
+   if (!metrics_buffer_append(&chunk_buffer, data))
+   {
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   if (chunk_buffer.length - METRICS_CHUNK_HEADER >= METRICS_CHUNK_SIZE)
+   {
+      return metrics_flush(client_ssl, client_fd);
+   }
+
+   return MESSAGE_STATUS_OK;
+}
+
+/**
+ * Send the chunk buffer as one chunk
+ * @param client_ssl The client SSL
+ * @param client_fd The client descriptor
+ * @return MESSAGE_STATUS_OK upon success
+ */
+static int
+metrics_flush(SSL* client_ssl, int client_fd)
+{
+   int status;
+   int header_length;
+   char header[METRICS_CHUNK_HEADER + 1];
+   struct message msg;
+
+   if (chunk_buffer.length <= METRICS_CHUNK_HEADER)
+   {
+      return MESSAGE_STATUS_OK;
+   }
+
+   metrics_cache_append(chunk_buffer.data + METRICS_CHUNK_HEADER);
+
+   if (metrics_stream != NULL)
+   {
+      status = metrics_stream_write(client_ssl, client_fd, chunk_buffer.data + METRICS_CHUNK_HEADER,
+                                    chunk_buffer.length - METRICS_CHUNK_HEADER, false);
+
+      chunk_buffer.length = METRICS_CHUNK_HEADER;
+      chunk_buffer.data[chunk_buffer.length] = '\0';
+
+      return status;
+   }
+
+   header_length = pgagroal_snprintf(&header[0], sizeof(header), "%zX\r\n", chunk_buffer.length - METRICS_CHUNK_HEADER);
+   memcpy(chunk_buffer.data + METRICS_CHUNK_HEADER - header_length, &header[0], header_length);
+
+   if (!metrics_buffer_append(&chunk_buffer, "\r\n"))
+   {
+      chunk_buffer.length = METRICS_CHUNK_HEADER;
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   memset(&msg, 0, sizeof(struct message));
+
+   msg.kind = 0;
+   msg.length = chunk_buffer.length - (METRICS_CHUNK_HEADER - header_length);
+   msg.data = chunk_buffer.data + METRICS_CHUNK_HEADER - header_length;
+
+   status = metrics_send(client_ssl, client_fd, &msg);
+
+   chunk_buffer.length = METRICS_CHUNK_HEADER;
+   chunk_buffer.data[chunk_buffer.length] = '\0';
+
+   return status;
+}
+
+/**
+ * Start the compression of the metrics response. The response
+ * is sent plain if the stream can't be created
+ * @param encoding The encoding
+ */
+static void
+metrics_stream_begin(int encoding)
+{
+   metrics_encoding = METRICS_ENCODING_NONE;
+   metrics_stream = NULL;
+
+   if (encoding != METRICS_ENCODING_NONE && !stream_create(encoding, &metrics_stream))
+   {
+      metrics_encoding = encoding;
+   }
+}
+
+/**
+ * End the compression of the metrics response
+ */
+static void
+metrics_stream_end(void)
+{
+   stream_destroy(metrics_encoding, metrics_stream);
+
+   metrics_encoding = METRICS_ENCODING_NONE;
+   metrics_stream = NULL;
+}
+
+/**
+ * Compress data into the metrics response, and send the
+ * compressed data as one chunk when there is any
+ * @param client_ssl The client SSL
+ * @param client_fd The client descriptor
+ * @param data The data
+ * @param length The length of the data
+ * @param finish Is this the end of the response
+ * @return MESSAGE_STATUS_OK upon success
+ */
+static int
+metrics_stream_write(SSL* client_ssl, int client_fd, void* data, size_t length, bool finish)
+{
+   int status;
+   int header_length;
+   char header[METRICS_CHUNK_HEADER + 1];
+   unsigned char* compressed = NULL;
+   size_t compressed_length = 0;
+   char* chunk = NULL;
+   struct message msg;
+
+   if (metrics_stream == NULL)
+   {
+      return MESSAGE_STATUS_OK;
+   }
+
+   if (stream_compress(metrics_encoding, metrics_stream, data, length, finish, &compressed, &compressed_length))
+   {
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   /* An empty chunk would end the response */
+   if (compressed_length == 0)
+   {
+      return MESSAGE_STATUS_OK;
+   }
+
+   header_length = pgagroal_snprintf(&header[0], sizeof(header), "%zX\r\n", compressed_length);
+
+   chunk = malloc(header_length + compressed_length + 2);
+   if (chunk == NULL)
+   {
+      free(compressed);
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   memcpy(chunk, &header[0], header_length);
+   memcpy(chunk + header_length, compressed, compressed_length);
+   memcpy(chunk + header_length + compressed_length, "\r\n", 2);
+
+   memset(&msg, 0, sizeof(struct message));
+
+   msg.kind = 0;
+   msg.length = header_length + compressed_length + 2;
+   msg.data = chunk;
+
+   status = metrics_send(client_ssl, client_fd, &msg);
+
+   free(compressed);
+   free(chunk);
+
+   return status;
+}
+
+static int
+stream_create(int encoding, void** stream)
+{
+   switch (encoding)
+   {
+      case METRICS_ENCODING_GZIP:
+         return pgagroal_gzip_stream_create(stream);
+      case METRICS_ENCODING_ZSTD:
+         return pgagroal_zstdc_stream_create(stream);
+      default:
+         break;
+   }
+
+   return 1;
+}
+
+static int
+stream_compress(int encoding, void* stream, void* data, size_t length, bool finish, unsigned char** buffer, size_t* buffer_size)
+{
+   switch (encoding)
+   {
+      case METRICS_ENCODING_GZIP:
+         return pgagroal_gzip_stream(stream, data, length, finish, buffer, buffer_size);
+      case METRICS_ENCODING_ZSTD:
+         return pgagroal_zstdc_stream(stream, data, length, finish, buffer, buffer_size);
+      default:
+         break;
+   }
+
+   return 1;
+}
+
+static void
+stream_destroy(int encoding, void* stream)
+{
+   switch (encoding)
+   {
+      case METRICS_ENCODING_GZIP:
+         pgagroal_gzip_stream_destroy(stream);
+         break;
+      case METRICS_ENCODING_ZSTD:
+         pgagroal_zstdc_stream_destroy(stream);
+         break;
+      default:
+         break;
+   }
+}
+
 /**
  * Checks if the Prometheus cache configuration setting
  * (`metrics_cache`) has a non-zero value, that means there
@@ -3412,32 +4990,6 @@ is_metrics_cache_configured(void)
    return pgagroal_time_is_valid(config->common.metrics_cache_max_age);
 }
 
-/**
- * Checks if the cache is still valid, and therefore can be
- * used to serve as a response.
- * A cache is considered valid if it has non-empty payload and
- * a timestamp in the future.
- *
- * @return true if the cache is still valid
- */
-static bool
-is_metrics_cache_valid(void)
-{
-   time_t now;
-
-   struct prometheus_cache* cache;
-
-   cache = (struct prometheus_cache*)prometheus_cache_shmem;
-
-   if (cache->valid_until == 0 || strlen(cache->data) == 0)
-   {
-      return false;
-   }
-
-   now = time(NULL);
-   return now <= cache->valid_until;
-}
-
 int
 pgagroal_init_prometheus_cache(size_t* p_size, void** p_shmem)
 {
@@ -3450,19 +5002,29 @@ pgagroal_init_prometheus_cache(size_t* p_size, void** p_shmem)
    cache_size = metrics_cache_size_to_alloc();
    struct_size = sizeof(struct prometheus_cache);
 
-   if (pgagroal_create_shared_memory(struct_size + cache_size, config->hugepage, (void*)&cache))
+   if (pgagroal_create_shared_memory(struct_size + METRICS_ENCODINGS * 2 * cache_size, config->hugepage, (void*)&cache))
    {
       goto error;
    }
 
-   memset(cache, 0, struct_size + cache_size);
-   cache->valid_until = 0;
-   cache->size = cache_size;
+   memset(cache, 0, struct_size + METRICS_ENCODINGS * 2 * cache_size);
+   atomic_init(&cache->valid_until, 0);
    atomic_init(&cache->lock, STATE_FREE);
+   atomic_init(&cache->current, -1);
+   atomic_init(&cache->generation, 0);
+   for (int i = 0; i < 2; i++)
+   {
+      atomic_init(&cache->sequence[i], 0);
+      for (int e = 0; e < METRICS_ENCODINGS; e++)
+      {
+         atomic_init(&cache->length[e][i], 0);
+      }
+   }
+   cache->size = cache_size;
 
    // success! do the memory swap
    *p_shmem = cache;
-   *p_size = cache_size + struct_size;
+   *p_size = METRICS_ENCODINGS * 2 * cache_size + struct_size;
    return 0;
 
 error:
@@ -3508,12 +5070,8 @@ metrics_cache_size_to_alloc(void)
 }
 
 /**
- * Invalidates the cache.
- *
- * Requires the caller to hold the lock on the cache!
- *
- * Invalidating the cache means that the payload is zero-filled
- * and that the valid_until field is set to zero too.
+ * Invalidates the cache, so that the next request
+ * refreshes it.
  */
 static void
 metrics_cache_invalidate(void)
@@ -3522,23 +5080,174 @@ metrics_cache_invalidate(void)
 
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
-   memset(cache->data, 0, cache->size);
-   cache->valid_until = 0;
+   if (cache == NULL)
+   {
+      return;
+   }
+
+   atomic_fetch_add(&cache->generation, 1);
+   atomic_store(&cache->valid_until, 0);
+   atomic_store(&cache->current, -1);
 }
 
 /**
- * Appends data to the cache.
+ * Serves the response out of the cache.
  *
- * Requires the caller to hold the lock on the cache!
+ * The published response is served while it is valid, and
+ * also after it has expired while another process is
+ * refreshing it, so that requests never wait for each other.
+ * The cache only holds the body, and the header gets its length
+ * such that the connection can be kept alive. The compressed body
+ * is served when the client accepts it, and it is available.
+ *
+ * @param client_ssl The client SSL
+ * @param client_fd The client descriptor
+ * @param encoding The encoding accepted by the client
+ * @param status The status of the write
+ * @return true if the response was served out of the cache
+ */
+static bool
+metrics_cache_serve(SSL* client_ssl, int client_fd, int encoding, int* status)
+{
+   int current;
+   int served;
+   unsigned long sequence;
+   size_t length;
+   size_t header_length;
+   char* header = NULL;
+   char* data = NULL;
+   struct message msg;
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   if (!is_metrics_cache_configured() || cache == NULL)
+   {
+      return false;
+   }
+
+   for (int attempt = 0; attempt < METRICS_CACHE_RETRIES; attempt++)
+   {
+      current = atomic_load(&cache->current);
+      if (current < 0)
+      {
+         return false;
+      }
+
+      if ((long long)time(NULL) > atomic_load(&cache->valid_until) && atomic_load(&cache->lock) == STATE_FREE)
+      {
+         // expired, and nobody is refreshing it
+         break;
+      }
+
+      sequence = atomic_load_explicit(&cache->sequence[current], memory_order_acquire);
+      if (sequence & 1)
+      {
+         continue;
+      }
+
+      served = encoding;
+      length = atomic_load(&cache->length[served][current]);
+      if (length == 0)
+      {
+         served = METRICS_ENCODING_NONE;
+         length = atomic_load(&cache->length[served][current]);
+      }
+
+      if (length == 0 || length > cache->size)
+      {
+         continue;
+      }
+
+      free(header);
+      header = response_header(METRICS_CONTENT_TYPE, served, length);
+      header_length = strlen(header);
+
+      free(data);
+      data = malloc(header_length + length);
+      if (data == NULL)
+      {
+         break;
+      }
+
+      memcpy(data, header, header_length);
+      memcpy(data + header_length, cache->data + (served * 2 + current) * cache->size, length);
+
+      atomic_thread_fence(memory_order_acquire);
+      if (atomic_load_explicit(&cache->sequence[current], memory_order_relaxed) != sequence)
+      {
+         continue;
+      }
+
+      pgagroal_log_debug("Serving metrics out of cache (%zu/%zu bytes valid until %lld)",
+                         length, cache->size, atomic_load(&cache->valid_until));
+
+      memset(&msg, 0, sizeof(struct message));
+
+      msg.kind = 0;
+      msg.length = header_length + length;
+      msg.data = data;
+
+      *status = metrics_send(client_ssl, client_fd, &msg);
+
+      free(header);
+      free(data);
+
+      return true;
+   }
+
+   free(header);
+   free(data);
+
+   return false;
+}
+
+/**
+ * Starts the refresh of the cache when no other process is
+ * refreshing it. The response is then collected into the buffer
+ * that isn't published.
+ */
+static void
+metrics_cache_begin(void)
+{
+   int current;
+   signed char cache_is_free;
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   cache_producer = false;
+   cache_overflow = false;
+   cache_length = 0;
+
+   if (!is_metrics_cache_configured() || cache == NULL || cache->size == 0)
+   {
+      return;
+   }
+
+   cache_is_free = STATE_FREE;
+   if (!atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   {
+      return;
+   }
+
+   cache_generation = atomic_load(&cache->generation);
+
+   current = atomic_load(&cache->current);
+   cache_buffer = current == 0 ? 1 : 0;
+
+   atomic_fetch_add_explicit(&cache->sequence[cache_buffer], 1, memory_order_relaxed);
+   atomic_thread_fence(memory_order_release);
+
+   cache_producer = true;
+}
+
+/**
+ * Appends data to the buffer being refreshed.
  *
- * If the input data is empty, nothing happens.
- * The data is appended only if the cache does not overflows, that
- * means the current size of the cache plus the size of the data
- * to append does not exceed the current cache size.
- * If the cache overflows, the cache is flushed and marked
- * as invalid.
- * This makes safe to call this method along the workflow of
- * building the Prometheus response.
+ * Only the process refreshing the cache appends, for
+ * all others this is a no-op. If the data doesn't fit
+ * the buffer is not published.
  *
  * @param data the string to append to the cache
  * @return true on success
@@ -3546,44 +5255,35 @@ metrics_cache_invalidate(void)
 static bool
 metrics_cache_append(char* data)
 {
-   size_t origin_length = 0;
    size_t append_length = 0;
    struct prometheus_cache* cache;
 
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
-   if (!is_metrics_cache_configured())
+   if (!cache_producer || cache_overflow)
    {
       return false;
    }
 
-   origin_length = strlen(cache->data);
    append_length = strlen(data);
-   // need to append the data to the cache
-   if (origin_length + append_length >= cache->size)
+   if (cache_length + append_length > cache->size)
    {
-      // cannot append new data, so invalidate cache
-      pgagroal_log_debug("Cannot append %d bytes to the Prometheus cache because it will overflow the size of %d bytes (currently at %d bytes). HINT: try adjusting `metrics_cache_max_size`",
+      pgagroal_log_debug("Cannot append %zu bytes to the Prometheus cache because it will overflow the size of %zu bytes (currently at %zu bytes). HINT: try adjusting `metrics_cache_max_size`",
                          append_length,
                          cache->size,
-                         origin_length);
-      metrics_cache_invalidate();
+                         cache_length);
+      cache_overflow = true;
       return false;
    }
 
-   // append the data to the data field
-   memcpy(cache->data + origin_length, data, append_length);
-   cache->data[origin_length + append_length + 1] = '\0';
+   memcpy(cache->data + cache_buffer * cache->size + cache_length, data, append_length);
+   cache_length += append_length;
+
    return true;
 }
 
 /**
- * Finalizes the cache.
- *
- * Requires the caller to hold the lock on the cache!
- *
- * This method should be invoked when the cache is complete
- * and therefore can be served.
+ * Publishes the refreshed buffer, and releases the cache.
  *
  * @return true if the cache has a validity
  */
@@ -3597,14 +5297,106 @@ metrics_cache_finalize(void)
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
    config = (struct main_configuration*)shmem;
 
-   if (!is_metrics_cache_configured())
+   if (!cache_producer)
+   {
+      return false;
+   }
+
+   /* The counters were collected before an invalidation, so they are stale */
+   if (cache_overflow || atomic_load(&cache->generation) != cache_generation)
    {
+      metrics_cache_abort();
       return false;
    }
 
+   atomic_store(&cache->length[METRICS_ENCODING_NONE][cache_buffer], cache_length);
+
+   for (int e = METRICS_ENCODING_NONE + 1; e < METRICS_ENCODINGS; e++)
+   {
+      atomic_store(&cache->length[e][cache_buffer],
+                   metrics_cache_compress(e, cache->data + cache_buffer * cache->size, cache_length,
+                                          cache->data + (e * 2 + cache_buffer) * cache->size, cache->size));
+   }
+
    now = time(NULL);
-   cache->valid_until = now + pgagroal_time_convert(config->common.metrics_cache_max_age, FORMAT_TIME_S);
-   return cache->valid_until > now;
+
+   atomic_fetch_add_explicit(&cache->sequence[cache_buffer], 1, memory_order_release);
+   atomic_store(&cache->valid_until, (long long)(now + pgagroal_time_convert(config->common.metrics_cache_max_age, FORMAT_TIME_S)));
+   atomic_store(&cache->current, cache_buffer);
+
+   /* An invalidation that raced the publication wins */
+   if (atomic_load(&cache->generation) != cache_generation)
+   {
+      atomic_store(&cache->valid_until, 0);
+      atomic_store(&cache->current, -1);
+   }
+
+   cache_producer = false;
+   atomic_store(&cache->lock, STATE_FREE);
+
+   return true;
+}
+
+/**
+ * Releases the cache without publishing the refreshed buffer.
+ */
+static void
+metrics_cache_abort(void)
+{
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   if (!cache_producer)
+   {
+      return;
+   }
+
+   for (int e = 0; e < METRICS_ENCODINGS; e++)
+   {
+      atomic_store(&cache->length[e][cache_buffer], 0);
+   }
+   atomic_fetch_add_explicit(&cache->sequence[cache_buffer], 1, memory_order_release);
+
+   cache_producer = false;
+   atomic_store(&cache->lock, STATE_FREE);
+}
+
+/**
+ * Compresses the refreshed response into the buffer of an encoding.
+ *
+ * @param encoding The encoding
+ * @param data The response
+ * @param length The length of the response
+ * @param buffer The buffer of the encoding
+ * @param size The size of the buffer
+ * @return The compressed length, or 0 if it isn't available
+ */
+static size_t
+metrics_cache_compress(int encoding, char* data, size_t length, char* buffer, size_t size)
+{
+   void* stream = NULL;
+   unsigned char* compressed = NULL;
+   size_t compressed_length = 0;
+
+   if (length == 0 || stream_create(encoding, &stream))
+   {
+      return 0;
+   }
+
+   if (stream_compress(encoding, stream, data, length, true, &compressed, &compressed_length) || compressed_length > size)
+   {
+      compressed_length = 0;
+   }
+   else
+   {
+      memcpy(buffer, compressed, compressed_length);
+   }
+
+   free(compressed);
+   stream_destroy(encoding, stream);
+
+   return compressed_length;
 }
 
 static bool
@@ -3615,6 +5407,185 @@ is_prometheus_enabled(void)
    return (config->metrics > 0 && prometheus != NULL);
 }
 
+static unsigned long long
+sum_shards(struct main_prometheus* prometheus, size_t offset)
+{
+   unsigned long long sum = 0;
+
+   for (int i = 0; i < PROMETHEUS_SHARDS; i++)
+   {
+      sum += atomic_load_explicit((atomic_ullong*)((char*)&prometheus->shards[i] + offset), memory_order_relaxed);
+   }
+
+   return sum;
+}
+
+static void
+latency_init(struct prometheus_latency* latency)
+{
+   for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+   {
+      atomic_init(&latency->buckets[i], 0);
+   }
+   atomic_init(&latency->sum, 0);
+}
+
+static void
+latency_clear(struct prometheus_latency* latency)
+{
+   for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+   {
+      atomic_store(&latency->buckets[i], 0);
+   }
+   atomic_store(&latency->sum, 0);
+}
+
+static void
+latency_add(struct prometheus_latency* latencies, int limit, uint64_t us)
+{
+   int bucket;
+   int power;
+   uint64_t v;
+   struct prometheus_latency* latency;
+
+   if (limit < -1 || limit >= NUMBER_OF_LIMITS)
+   {
+      limit = -1;
+   }
+
+   latency = &latencies[limit + 1];
+
+   /* The bucket of v is found from its highest bit, and the bit below it
+      selects the lower or upper half of that power of two */
+   if (us <= LATENCY_FIRST_BOUND)
+   {
+      bucket = 0;
+   }
+   else
+   {
+      v = us - 1;
+      power = 63 - __builtin_clzll(v);
+      bucket = 1 + (power - LATENCY_FIRST_POWER) * 2 + (int)((v >> (power - 1)) & 1);
+      bucket = MIN(bucket, LATENCY_HISTOGRAM_BUCKETS - 1);
+   }
+
+   atomic_fetch_add_explicit(&latency->buckets[bucket], 1, memory_order_relaxed);
+   atomic_fetch_add_explicit(&latency->sum, us, memory_order_relaxed);
+}
+
+static uint64_t
+latency_bound(int bucket)
+{
+   int power;
+
+   if (bucket == 0)
+   {
+      return LATENCY_FIRST_BOUND;
+   }
+
+   power = (bucket - 1) / 2 + LATENCY_FIRST_POWER;
+
+   return (uint64_t)(3 + (bucket - 1) % 2) << (power - 1);
+}
+
+static void
+traffic_init(struct prometheus_traffic* entry)
+{
+   atomic_init(&entry->state, STATE_FREE);
+   atomic_init(&entry->bytes_sent, 0);
+   atomic_init(&entry->bytes_received, 0);
+   atomic_init(&entry->queries, 0);
+   atomic_init(&entry->transactions, 0);
+   atomic_init(&entry->errors, 0);
+   memset(entry->name, 0, sizeof(entry->name));
+}
+
+static void
+traffic_clear(struct prometheus_traffic* entry)
+{
+   atomic_store(&entry->bytes_sent, 0);
+   atomic_store(&entry->bytes_received, 0);
+   atomic_store(&entry->queries, 0);
+   atomic_store(&entry->transactions, 0);
+   atomic_store(&entry->errors, 0);
+}
+
+static int
+traffic_entry(struct prometheus_traffic* entries, char* name)
+{
+   int index;
+   uint32_t hash = 2166136261u;
+   signed char state;
+   signed char free_state;
+
+   if (name == NULL || strlen(name) == 0)
+   {
+      return NUMBER_OF_TRAFFIC_ENTRIES;
+   }
+
+   /* FNV-1a */
+   for (char* c = name; *c != '\0'; c++)
+   {
+      hash ^= (unsigned char)*c;
+      hash *= 16777619u;
+   }
+
+   /* Entries are claimed with a compare-and-swap and never released, so
+      a name found once is found again by every later lookup */
+   for (int i = 0; i < NUMBER_OF_TRAFFIC_ENTRIES; i++)
+   {
+      index = (hash + i) % NUMBER_OF_TRAFFIC_ENTRIES;
+
+      state = atomic_load(&entries[index].state);
+
+      if (state == STATE_FREE)
+      {
+         free_state = STATE_FREE;
+
+         if (atomic_compare_exchange_strong(&entries[index].state, &free_state, STATE_INIT))
+         {
+            memset(entries[index].name, 0, sizeof(entries[index].name));
+            strncpy(entries[index].name, name, sizeof(entries[index].name) - 1);
+            atomic_store(&entries[index].state, STATE_IN_USE);
+
+            return index;
+         }
+
+         state = free_state;
+      }
+
+      /* Another process is writing the name of the entry */
+      for (int retries = 0; state == STATE_INIT; retries++)
+      {
+         if (retries == TRAFFIC_ENTRY_RETRIES)
+         {
+            /* The process died while claiming the entry */
+            return NUMBER_OF_TRAFFIC_ENTRIES;
+         }
+
+         SLEEP(1000L);
+         state = atomic_load(&entries[index].state);
+      }
+
+      if (!strncmp(entries[index].name, name, sizeof(entries[index].name) - 1))
+      {
+         return index;
+      }
+   }
+
+   return NUMBER_OF_TRAFFIC_ENTRIES;
+}
+
+static void
+traffic_add(struct prometheus_traffic* entry)
+{
+   atomic_fetch_add_explicit(&entry->bytes_sent, traffic_sent, memory_order_relaxed);
+   atomic_fetch_add_explicit(&entry->bytes_received, traffic_received, memory_order_relaxed);
+   atomic_fetch_add_explicit(&entry->queries, traffic_queries, memory_order_relaxed);
+   atomic_fetch_add_explicit(&entry->transactions, traffic_transactions, memory_order_relaxed);
+   atomic_fetch_add_explicit(&entry->errors, traffic_errors, memory_order_relaxed);
+}
+
 static int
 parse_certificate_file(const char* cert_path, struct certificate_info* cert_info)
 {
@@ -4547,8 +6518,7 @@ output_art_metrics(SSL* client_ssl, int client_fd, struct art* art_tree)
       prometheus_metric_value_t* mv = (prometheus_metric_value_t*)pgagroal_value_data(iter->value);
       if (mv != NULL && mv->value != NULL)
       {
-         send_chunk(client_ssl, client_fd, mv->value);
-         metrics_cache_append(mv->value);
+         metrics_write(client_ssl, client_fd, mv->value);
       }
    }
 
@@ -4574,4 +6544,6 @@ output_all_metrics(SSL* client_ssl, int client_fd, prometheus_metrics_container_
    output_art_metrics(client_ssl, client_fd, container->awaiting_metrics);
    output_art_metrics(client_ssl, client_fd, container->os_metrics);
    output_art_metrics(client_ssl, client_fd, container->certificate_metrics_tree);
+
+   metrics_flush(client_ssl, client_fd);
 }
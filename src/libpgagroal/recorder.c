@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgagroal */
+#include <pgagroal.h>
+#include <json.h>
+#include <logging.h>
+#include <management.h>
+#include <memory.h>
+#include <network.h>
+#include <recorder.h>
+#include <recorder_internal.h>
+#include <shmem.h>
+#include <utils.h>
+
+/* system */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct recorder* recorder_slot(int slot);
+static uint64_t recorder_read(int slot, struct recorder_event* events);
+static void recorder_log(int slot, int64_t duration);
+
+/* The layout of the flight recorder, inherited by the workers */
+static uint64_t recorder_size = 0;
+static size_t recorder_stride = 0;
+
+/* The state of the worker */
+static int64_t recorder_time = 0;
+static int64_t recorder_start = 0;
+static int32_t recorder_pid = 0;
+
+int
+pgagroal_recorder_init(size_t* p_size, void** p_shmem)
+{
+   uint64_t size = 1;
+   size_t tmp_p_size = 0;
+   void* tmp_p_shmem = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   if (config->flight_recorder <= 0)
+   {
+      return 0;
+   }
+
+   while (size < (uint64_t)config->flight_recorder)
+   {
+      size <<= 1;
+   }
+
+   recorder_size = size;
+   recorder_stride = sizeof(struct recorder) + size * sizeof(struct recorder_event);
+   recorder_stride = (recorder_stride + 63) & ~(size_t)63;
+
+   tmp_p_size = config->max_connections * recorder_stride;
+   if (pgagroal_create_shared_memory(tmp_p_size, config->common.hugepage, &tmp_p_shmem))
+   {
+      goto error;
+   }
+
+   memset(tmp_p_shmem, 0, tmp_p_size);
+
+   for (int i = 0; i < config->max_connections; i++)
+   {
+      struct recorder* r = (struct recorder*)((char*)tmp_p_shmem + i * recorder_stride);
+
+      atomic_init(&r->head, 0);
+   }
+
+   *p_size = tmp_p_size;
+   *p_shmem = tmp_p_shmem;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+void
+pgagroal_recorder_clock(void)
+{
+   struct timespec ts;
+
+   if (recorder_shmem == NULL)
+   {
+      return;
+   }
+
+   if (recorder_pid == 0)
+   {
+      recorder_pid = getpid();
+   }
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+   recorder_time = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+pgagroal_recorder_add(int slot, char direction, char kind, int length)
+{
+   uint64_t head;
+   struct recorder* r = NULL;
+   struct recorder_event* event = NULL;
+
+   if (recorder_shmem == NULL || slot < 0)
+   {
+      return;
+   }
+
+   /* A slot is used by a single worker at a time, so the worker owns the head */
+   r = recorder_slot(slot);
+   head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+   event = (struct recorder_event*)(r + 1) + (head & (recorder_size - 1));
+   event->timestamp = recorder_time;
+   event->length = length;
+   event->pid = recorder_pid;
+   event->kind = kind;
+   event->direction = direction;
+
+   atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+   if (direction == RECORDER_CLIENT && recorder_start == 0)
+   {
+      recorder_start = recorder_time;
+   }
+}
+
+void
+pgagroal_recorder_ready(int slot, char tx_state)
+{
+   int64_t duration;
+   struct main_configuration* config;
+
+   if (recorder_shmem == NULL || slot < 0 || tx_state != 'I' || recorder_start == 0)
+   {
+      return;
+   }
+
+   config = (struct main_configuration*)shmem;
+
+   duration = recorder_time - recorder_start;
+   recorder_start = 0;
+
+   if (config->flight_recorder_threshold > 0 && duration >= (int64_t)config->flight_recorder_threshold * 1000)
+   {
+      recorder_log(slot, duration);
+   }
+}
+
+void
+pgagroal_recorder_dump(SSL* ssl __attribute__((unused)), int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
+{
+   char* elapsed = NULL;
+   time_t start_time;
+   time_t end_time;
+   int total_seconds;
+   int32_t slot = -1;
+   uint64_t count;
+   char kind[2];
+   struct recorder_event* events = NULL;
+   struct json* request = NULL;
+   struct json* response = NULL;
+   struct json* slots = NULL;
+   struct json* js = NULL;
+   struct json* jevents = NULL;
+   struct json* je = NULL;
+   struct main_configuration* config;
+
+   pgagroal_memory_init();
+   pgagroal_start_logging();
+
+   config = (struct main_configuration*)shmem;
+
+   start_time = time(NULL);
+
+   if (recorder_shmem == NULL)
+   {
+      pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_FLIGHT_RECORDER_DISABLED, compression, encryption, payload);
+      pgagroal_log_error("Flight recorder: Not enabled (%d)", MANAGEMENT_ERROR_FLIGHT_RECORDER_DISABLED);
+
+      goto error;
+   }
+
+   request = (struct json*)pgagroal_json_get(payload, MANAGEMENT_CATEGORY_REQUEST);
+   if (request != NULL && pgagroal_json_contains_key(request, MANAGEMENT_ARGUMENT_SLOT))
+   {
+      slot = (int32_t)pgagroal_json_get(request, MANAGEMENT_ARGUMENT_SLOT);
+   }
+
+   if (slot < -1 || slot >= config->max_connections)
+   {
+      pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_FLIGHT_RECORDER_SLOT, compression, encryption, payload);
+      pgagroal_log_error("Flight recorder: Unknown slot %d (%d)", slot, MANAGEMENT_ERROR_FLIGHT_RECORDER_SLOT);
+
+      goto error;
+   }
+
+   events = (struct recorder_event*)malloc(recorder_size * sizeof(struct recorder_event));
+   if (events == NULL)
+   {
+      goto error;
+   }
+
+   if (pgagroal_management_create_response(payload, -1, &response))
+   {
+      goto error;
+   }
+
+   if (pgagroal_json_create(&slots))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < config->max_connections; i++)
+   {
+      if (slot != -1 && slot != i)
+      {
+         continue;
+      }
+
+      count = recorder_read(i, events);
+      if (count == 0)
+      {
+         continue;
+      }
+
+      if (pgagroal_json_create(&js) || pgagroal_json_create(&jevents))
+      {
+         goto error;
+      }
+
+      for (uint64_t j = 0; j < count; j++)
+      {
+         if (pgagroal_json_create(&je))
+         {
+            goto error;
+         }
+
+         kind[0] = isprint((unsigned char)events[j].kind) ? events[j].kind : '?';
+         kind[1] = '\0';
+
+         pgagroal_json_put(je, MANAGEMENT_ARGUMENT_TIMESTAMP, (uintptr_t)events[j].timestamp, ValueInt64);
+         pgagroal_json_put(je, MANAGEMENT_ARGUMENT_DIRECTION, (uintptr_t)(events[j].direction == RECORDER_CLIENT ? "client" : "server"), ValueString);
+         pgagroal_json_put(je, MANAGEMENT_ARGUMENT_KIND, (uintptr_t)kind, ValueString);
+         pgagroal_json_put(je, MANAGEMENT_ARGUMENT_LENGTH, (uintptr_t)events[j].length, ValueInt32);
+         pgagroal_json_put(je, MANAGEMENT_ARGUMENT_PID, (uintptr_t)events[j].pid, ValueInt32);
+
+         pgagroal_json_append(jevents, (uintptr_t)je, ValueJSON);
+         je = NULL;
+      }
+
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_SLOT, (uintptr_t)i, ValueInt32);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_EVENTS, (uintptr_t)jevents, ValueJSON);
+      jevents = NULL;
+
+      pgagroal_json_append(slots, (uintptr_t)js, ValueJSON);
+      js = NULL;
+   }
+
+   pgagroal_json_put(response, MANAGEMENT_ARGUMENT_SLOTS, (uintptr_t)slots, ValueJSON);
+   slots = NULL;
+
+   end_time = time(NULL);
+
+   if (pgagroal_management_response_ok(NULL, client_fd, start_time, end_time, compression, encryption, payload))
+   {
+      pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_FLIGHT_RECORDER_NETWORK, compression, encryption, payload);
+      pgagroal_log_error("Flight recorder: Error sending response");
+
+      goto error;
+   }
+
+   elapsed = pgagroal_get_timestamp_string(start_time, end_time, &total_seconds);
+
+   pgagroal_log_info("Flight recorder (Elapsed: %s)", elapsed);
+
+   free(elapsed);
+   free(events);
+
+   pgagroal_json_destroy(payload);
+
+   pgagroal_disconnect(client_fd);
+
+   pgagroal_stop_logging();
+   pgagroal_memory_destroy();
+
+   exit(0);
+
+error:
+
+   free(events);
+
+   pgagroal_json_destroy(je);
+   pgagroal_json_destroy(jevents);
+   pgagroal_json_destroy(js);
+   pgagroal_json_destroy(slots);
+   pgagroal_json_destroy(payload);
+
+   pgagroal_disconnect(client_fd);
+
+   pgagroal_stop_logging();
+   pgagroal_memory_destroy();
+
+   exit(1);
+}
+
+static struct recorder*
+recorder_slot(int slot)
+{
+   return (struct recorder*)((char*)recorder_shmem + slot * recorder_stride);
+}
+
+static uint64_t
+recorder_read(int slot, struct recorder_event* events)
+{
+   uint64_t head;
+   uint64_t start;
+   uint64_t first;
+   uint64_t count;
+   struct recorder* r = NULL;
+   struct recorder_event* ring = NULL;
+
+   r = recorder_slot(slot);
+   ring = (struct recorder_event*)(r + 1);
+
+   head = atomic_load_explicit(&r->head, memory_order_acquire);
+   start = head > recorder_size ? head - recorder_size : 0;
+
+   for (uint64_t p = start; p < head; p++)
+   {
+      events[p - start] = ring[p & (recorder_size - 1)];
+   }
+
+   atomic_thread_fence(memory_order_acquire);
+
+   /* The events the owner wrote over during the copy are dropped */
+   first = start;
+   count = pgagroal_recorder_window(head, atomic_load_explicit(&r->head, memory_order_relaxed), recorder_size, &start);
+
+   if (count > 0 && start > first)
+   {
+      memmove(events, events + (start - first), count * sizeof(struct recorder_event));
+   }
+
+   return count;
+}
+
+uint64_t
+pgagroal_recorder_window(uint64_t head, uint64_t now, uint64_t size, uint64_t* start)
+{
+   uint64_t valid;
+
+   /* The owner writes the entry at now over the one at now - size before it moves the head */
+   valid = now >= size ? now - size + 1 : 0;
+
+   if (valid >= head)
+   {
+      return 0;
+   }
+
+   if (valid > *start)
+   {
+      *start = valid;
+   }
+
+   return head - *start;
+}
+
+static void
+recorder_log(int slot, int64_t duration)
+{
+   char line[64];
+   char* data = NULL;
+   uint64_t count;
+   struct recorder_event* events = NULL;
+
+   events = (struct recorder_event*)malloc(recorder_size * sizeof(struct recorder_event));
+   if (events == NULL)
+   {
+      return;
+   }
+
+   count = recorder_read(slot, events);
+
+   for (uint64_t i = 0; i < count; i++)
+   {
+      pgagroal_snprintf(line, sizeof(line), " %c%c:%d+%lld",
+                        events[i].direction,
+                        isprint((unsigned char)events[i].kind) ? events[i].kind : '?',
+                        events[i].length,
+                        (long long)(events[i].timestamp - events[0].timestamp));
+      data = pgagroal_append(data, line);
+   }
+
+   /* Each message is logged as <direction><kind>:<length>+<us since the first message> */
+   pgagroal_log_event_warn("slow_transaction", duration / 1000, "Flight recorder: Slot %d PID %d transaction %lld us:%s",
+                           slot, recorder_pid, (long long)duration, data != NULL ? data : "");
+
+   free(data);
+   free(events);
+}
@@ -39,20 +39,28 @@
 
 /* system */
 #include <ev.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 
+static bool wait_request(SSL* ssl, int socket, int64_t timeout);
+
 void
 pgagroal_remote_management(int client_fd, char* address)
 {
    int server_fd = -1;
    int exit_code;
    int auth_status;
+   int64_t timeout = -1;
+   int64_t requests = 0;
    uint8_t compression;
    uint8_t encryption;
    SSL* client_ssl = NULL;
+   struct json* header = NULL;
    struct json* payload = NULL;
    struct main_configuration* config;
 
@@ -68,32 +76,54 @@ pgagroal_remote_management(int client_fd, char* address)
    auth_status = pgagroal_remote_management_auth(client_fd, address, &client_ssl);
    if (auth_status == AUTH_SUCCESS)
    {
-      if (pgagroal_connect_unix_socket(config->unix_socket_dir, MAIN_UDS, &server_fd))
-      {
-         goto done;
-      }
-
-      if (pgagroal_management_read_json(client_ssl, client_fd, &compression, &encryption, &payload))
-      {
-         goto done;
-      }
-
-      if (pgagroal_management_write_json(NULL, server_fd, compression, encryption, payload))
-      {
-         goto done;
-      }
-
-      pgagroal_json_destroy(payload);
-      payload = NULL;
-
-      if (pgagroal_management_read_json(NULL, server_fd, &compression, &encryption, &payload))
+      if (pgagroal_time_is_valid(config->management_idle_timeout))
       {
-         goto done;
+         timeout = pgagroal_time_convert(config->management_idle_timeout, FORMAT_TIME_S) * 1000;
       }
 
-      if (pgagroal_management_write_json(client_ssl, client_fd, compression, encryption, payload))
+      /* The session serves the requests in order until the client leaves or is idle */
+      while (wait_request(client_ssl, client_fd, timeout))
       {
-         goto done;
+         if (pgagroal_management_read_json(client_ssl, client_fd, &compression, &encryption, &payload))
+         {
+            goto done;
+         }
+
+         header = (struct json*)pgagroal_json_get(payload, MANAGEMENT_CATEGORY_HEADER);
+         pgagroal_log_debug("pgagroal_remote_management: request %lld (%d)",
+                            (long long)pgagroal_json_get(header, MANAGEMENT_ARGUMENT_REQUEST_ID), client_fd);
+
+         /* Every request has its own local connection, as the main process answers once */
+         if (pgagroal_connect_unix_socket(config->unix_socket_dir, MAIN_UDS, &server_fd))
+         {
+            goto done;
+         }
+
+         if (pgagroal_management_write_json(NULL, server_fd, compression, encryption, payload))
+         {
+            goto done;
+         }
+
+         pgagroal_json_destroy(payload);
+         payload = NULL;
+
+         if (pgagroal_management_read_json(NULL, server_fd, &compression, &encryption, &payload))
+         {
+            goto done;
+         }
+
+         if (pgagroal_management_write_json(client_ssl, client_fd, compression, encryption, payload))
+         {
+            goto done;
+         }
+
+         pgagroal_json_destroy(payload);
+         payload = NULL;
+
+         pgagroal_disconnect(server_fd);
+         server_fd = -1;
+
+         requests++;
       }
    }
    else
@@ -119,7 +149,7 @@ done:
       SSL_CTX_free(ctx);
    }
 
-   pgagroal_log_debug("pgagroal_remote_management: disconnect %d", client_fd);
+   pgagroal_log_debug("pgagroal_remote_management: disconnect %d after %lld requests", client_fd, (long long)requests);
    pgagroal_disconnect(client_fd);
    pgagroal_disconnect(server_fd);
 
@@ -130,3 +160,31 @@ done:
 
    exit(exit_code);
 }
+
+static bool
+wait_request(SSL* ssl, int socket, int64_t timeout)
+{
+   char b;
+   struct pollfd pfd;
+
+   if (ssl == NULL || SSL_pending(ssl) == 0)
+   {
+      pfd.fd = socket;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+
+      if (poll(&pfd, 1, (int)MIN(timeout, (int64_t)INT_MAX)) <= 0)
+      {
+         pgagroal_log_debug("pgagroal_remote_management: idle %d", socket);
+         return false;
+      }
+   }
+
+   /* A closed session is not an error */
+   if (ssl != NULL)
+   {
+      return SSL_peek(ssl, &b, 1) > 0;
+   }
+
+   return recv(socket, &b, 1, MSG_PEEK) > 0;
+}
@@ -29,6 +29,7 @@
 /* pgagroal */
 #include <pgagroal.h>
 #include <aes.h>
+#include <art.h>
 #include <logging.h>
 #include <memory.h>
 #include <message.h>
@@ -36,6 +37,7 @@
 #include <pool.h>
 #include <prometheus.h>
 #include <security.h>
+#include <security_internal.h>
 #include <server.h>
 #include <tls.h>
 #include <tracker.h>
@@ -53,6 +55,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <poll.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <openssl/err.h>
@@ -78,13 +81,39 @@ static char CHARS[] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L
 static int get_auth_type(struct message* msg, int* auth_type);
 static int compare_auth_response(struct message* orig, struct message* response, int auth_type);
 
+/** @struct hba_rule
+ * Defines a compiled HBA entry
+ */
+struct hba_rule
+{
+   bool all_addresses;       /**< Does the entry match any address */
+   int family;               /**< The address family, AF_UNSPEC if the entry is invalid */
+   unsigned char prefix[16]; /**< The network prefix in network byte order */
+   int prefix_length;        /**< The prefix length in bits */
+   int method;               /**< The access method */
+};
+
+/* The HBA entries compiled in the main process and inherited by every fork().
+ * Each index maps a user name or database to the bitmap of the entries naming
+ * it; the bitmaps of 'all' entries are kept apart */
+#if NUMBER_OF_HBAS > 64
+#error "The HBA bitmaps hold at most 64 entries"
+#endif
+static struct hba_rule hba_rules[NUMBER_OF_HBAS];
+static int hba_rules_length = 0;
+static uint64_t hba_all_users = 0;
+static uint64_t hba_all_databases = 0;
+static struct art* hba_users = NULL;
+static struct art* hba_databases = NULL;
+static bool hba_compiled = false;
+
 static int use_pooled_connection(SSL* c_ssl, int client_fd, int slot, char* username, char* database, int hba_method, SSL** server_ssl);
-static int resume_backend_tls(int slot, SSL** server_ssl);
 static int use_unpooled_connection(struct message* msg, SSL* c_ssl, int client_fd, int slot,
                                    char* username, int hba_method, SSL** server_ssl);
 static int client_trust(SSL* c_ssl, int client_fd, char* username, char* password, int slot);
 static int client_password(SSL* c_ssl, int client_fd, char* username, char* password, int slot);
 static int client_scram256(SSL* c_ssl, int client_fd, char* username, char* password, int slot);
+static int client_read_message(SSL* c_ssl, int client_fd, time_t start_time, struct message** msg);
 static int client_ok(SSL* c_ssl, int client_fd, int slot);
 static int server_passthrough(struct message* msg, int auth_type, SSL* c_ssl, SSL* s_ssl, int client_fd, int slot);
 static void scram_strip_channel_binding(struct message* msg);
@@ -94,10 +123,9 @@ static int server_trust(int slot, SSL* server_ssl);
 static int server_password(char* username, char* password, int slot, SSL* server_ssl);
 static int server_scram256(char* username, char* password, int slot, SSL* server_ssl);
 
-static bool is_allowed(char* username, char* database, char* address, int* hba_method);
-static bool is_allowed_username(char* username, char* entry);
-static bool is_allowed_database(char* database, char* entry);
-static bool is_allowed_address(char* address, char* entry);
+static bool is_allowed_address(struct hba_rule* rule, int family, unsigned char* address);
+static int compile_hba_address(char* entry, struct hba_rule* rule);
+static int add_hba_index(struct art* index, char* key, int rule);
 static bool is_disabled(char* database);
 
 static int get_hba_method(int index);
@@ -129,6 +157,8 @@ static int salted_password_key(unsigned char* salted_password, int salted_passwo
                                unsigned char** result, int* result_length);
 static int stored_key(unsigned char* client_key, int client_key_length, unsigned char** result, int* result_length);
 static int generate_salt(char** salt, int* size);
+static struct user* scram_user(char* username, char* password);
+static int scram_keys(char* username, char* password, char* salt, unsigned char* s_key, unsigned char* srv_key);
 static int server_signature(char* password, char* salt, int salt_length, int iterations,
                             char* server_key, int server_key_length,
                             char* client_first_message_bare, size_t client_first_message_bare_length,
@@ -138,9 +168,12 @@ static int server_signature(char* password, char* salt, int salt_length, int ite
 
 static bool is_tls_user(char* username, char* database);
 static int establish_client_tls_connection(int server, int fd, SSL** ssl);
-static int create_client_tls_connection(int fd, SSL** ssl, char* tls_key_file, char* tls_cert_file, char* tls_ca_file);
+static int create_client_tls_connection(int server, int fd, SSL** ssl);
 
 static int auth_query(SSL* c_ssl, int client_fd, int slot, char* username, char* database, int hba_method);
+static struct auth_query_entry* auth_query_cache_entry(char* username, char* database);
+static bool auth_query_cache_get(char* username, char* database, char** shadow);
+static void auth_query_cache_put(char* username, char* database, char* shadow);
 static int auth_query_get_connection(char* username, char* password, char* database, int* server_fd, SSL** server_ssl);
 
 static int auth_query_get_password(int socket, SSL* server_ssl, char* username, char* database, char** password);
@@ -155,6 +188,7 @@ pgagroal_authenticate(int client_fd, char* address, int* slot, SSL** client_ssl,
    int server = 0;
    int server_fd = -1;
    int hba_method;
+   uint64_t auth_us;
    struct main_configuration* config;
    struct message* msg = NULL;
    struct message* request_msg = NULL;
@@ -203,7 +237,7 @@ pgagroal_authenticate(int client_fd, char* address, int* slot, SSL** client_ssl,
       }
       else
       {
-         ret = pgagroal_connect(config->servers[server].host, config->servers[server].port, &server_fd, config->keep_alive, config->nodelay);
+         ret = pgagroal_connect_server(server, &server_fd, config->keep_alive, config->nodelay);
       }
 
       if (ret)
@@ -255,15 +289,16 @@ pgagroal_authenticate(int client_fd, char* address, int* slot, SSL** client_ssl,
          SSL_CTX* ctx = NULL;
 
          /* We are acting as a server against the client */
-         if (pgagroal_create_ssl_ctx(false, &ctx))
+         if (pgagroal_tls_server_ctx(PGAGROAL_TLS_CTX_FRONTEND, &ctx))
          {
             goto error;
          }
 
          struct tls* c_tls = NULL;
 
-         if (pgagroal_tls_create_server(ctx, config->common.tls_key_file, config->common.tls_cert_file, config->common.tls_ca_file, &c_tls))
+         if (pgagroal_tls_create(ctx, true, &c_tls) != PGAGROAL_TLS_OK)
          {
+            SSL_CTX_free(ctx);
             pgagroal_log_debug("authenticate: connection error");
             pgagroal_write_connection_refused(NULL, client_fd);
             pgagroal_write_empty(NULL, client_fd);
@@ -336,7 +371,7 @@ pgagroal_authenticate(int client_fd, char* address, int* slot, SSL** client_ssl,
       }
 
       /* Verify client against pgagroal_hba.conf */
-      if (!is_allowed(username, database, address, &hba_method))
+      if (!pgagroal_hba_is_allowed(username, database, address, &hba_method))
       {
          /* User not allowed */
          pgagroal_log_debug("authenticate: not allowed: %s / %s / %s", username, database, address);
@@ -395,6 +430,8 @@ pgagroal_authenticate(int client_fd, char* address, int* slot, SSL** client_ssl,
          }
       }
 
+      auth_us = pgagroal_monotonic_us();
+
       /* Set the application_name on the connection */
       if (appname != NULL)
       {
@@ -442,6 +479,7 @@ pgagroal_authenticate(int client_fd, char* address, int* slot, SSL** client_ssl,
       free(appname);
 
       pgagroal_prometheus_auth_user_success();
+      pgagroal_prometheus_auth_time(config->connections[*slot].limit_rule, pgagroal_monotonic_us() - auth_us);
 
       pgagroal_log_debug("authenticate: SUCCESS");
       return AUTH_SUCCESS;
@@ -682,15 +720,8 @@ pgagroal_remote_management_auth(int client_fd, char* address, SSL** client_ssl)
 
       if (config->common.tls)
       {
-         SSL_CTX* ctx = NULL;
-
          /* We are acting as a server against the client */
-         if (pgagroal_create_ssl_ctx(false, &ctx))
-         {
-            goto error;
-         }
-
-         if (pgagroal_create_ssl_server(ctx, config->common.tls_key_file, config->common.tls_cert_file, config->common.tls_ca_file, client_fd, &c_ssl))
+         if (pgagroal_tls_create_ssl_server(PGAGROAL_TLS_CTX_FRONTEND, client_fd, &c_ssl))
          {
             goto error;
          }
@@ -768,7 +799,7 @@ pgagroal_remote_management_auth(int client_fd, char* address, SSL** client_ssl)
       }
 
       /* Verify client against pgagroal_hba.conf */
-      if (!is_allowed(username, "admin", address, &hba_method))
+      if (!pgagroal_hba_is_allowed(username, "admin", address, &hba_method))
       {
          /* User not allowed */
          pgagroal_log_debug("remote_management_auth: not allowed: %s / admin / %s", username, address);
@@ -1374,10 +1405,8 @@ compare_auth_response(struct message* orig, struct message* response, int auth_t
    return 1;
 }
 
-/* Resume a parked backend TLS context on checkout. The carrier SSL is never
- * handshaken; only the imported record layer moves traffic. */
-static int
-resume_backend_tls(int slot, SSL** server_ssl)
+int
+pgagroal_resume_backend_tls(int slot, SSL** server_ssl)
 {
    SSL_CTX* ctx = NULL;
    struct tls* t = NULL;
@@ -1385,22 +1414,22 @@ resume_backend_tls(int slot, SSL** server_ssl)
 
    config = (struct main_configuration*)shmem;
 
-   if (pgagroal_create_ssl_ctx(true, &ctx))
+   if (pgagroal_tls_client_ctx(config->connections[slot].server, &ctx))
    {
-      pgagroal_log_error("resume_backend_tls: CTX failed for slot %d", slot);
+      pgagroal_log_error("pgagroal_resume_backend_tls: CTX failed for slot %d", slot);
       goto error;
    }
 
    if (pgagroal_tls_create(ctx, false, &t))
    {
-      pgagroal_log_error("resume_backend_tls: wrapper failed for slot %d", slot);
+      pgagroal_log_error("pgagroal_resume_backend_tls: wrapper failed for slot %d", slot);
       goto error;
    }
 
    if (pgagroal_tls_record_import((const unsigned char*)config->connections[slot].tls_context,
                                   config->connections[slot].tls_context_length, &t->record))
    {
-      pgagroal_log_error("resume_backend_tls: context import failed for slot %d", slot);
+      pgagroal_log_error("pgagroal_resume_backend_tls: context import failed for slot %d", slot);
       goto error;
    }
 
@@ -1408,7 +1437,7 @@ resume_backend_tls(int slot, SSL** server_ssl)
    pgagroal_tls_set_fd(t, config->connections[slot].fd);
    *server_ssl = t->ssl;
 
-   pgagroal_log_debug("resume_backend_tls: Slot %d resumed parked TLS context (%zu bytes)", slot, config->connections[slot].tls_context_length);
+   pgagroal_log_debug("pgagroal_resume_backend_tls: Slot %d resumed parked TLS context (%zu bytes)", slot, config->connections[slot].tls_context_length);
 
    return 0;
 
@@ -1443,7 +1472,7 @@ use_pooled_connection(SSL* c_ssl, int client_fd, int slot, char* username, char*
     * this the proxy would speak plaintext into an encrypted backend socket. */
    if (config->connections[slot].tls_context_length > 0)
    {
-      if (resume_backend_tls(slot, server_ssl))
+      if (pgagroal_resume_backend_tls(slot, server_ssl))
       {
          goto error;
       }
@@ -1872,13 +1901,10 @@ client_password(SSL* c_ssl, int client_fd, char* username, char* password, int s
 {
    int status;
    time_t start_time;
-   struct main_configuration* config;
    struct message* msg = NULL;
 
    pgagroal_log_debug("client_password %d %d", client_fd, slot);
 
-   config = (struct main_configuration*)shmem;
-
    status = pgagroal_write_auth_password(c_ssl, client_fd);
    if (status != MESSAGE_STATUS_OK)
    {
@@ -1887,20 +1913,7 @@ client_password(SSL* c_ssl, int client_fd, char* username, char* password, int s
 
    start_time = time(NULL);
 
-   /* psql may just close the connection without word, so loop */
-retry:
-   status = pgagroal_read_timeout_message(c_ssl, client_fd, 1, &msg);
-   if (status != MESSAGE_STATUS_OK)
-   {
-      if (difftime(time(NULL), start_time) < pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S))
-      {
-         if (pgagroal_socket_isvalid(client_fd))
-         /* Sleep for 100ms */
-         {
-            SLEEP_AND_GOTO(100000000L, retry)
-         }
-      }
-   }
+   status = client_read_message(c_ssl, client_fd, start_time, &msg);
 
    if (status != MESSAGE_STATUS_OK)
    {
@@ -1931,10 +1944,79 @@ error:
    return AUTH_ERROR;
 }
 
+/**
+ * Read the next message of a client during its authentication. The client
+ * socket is polled until the authentication timeout, so the message is read
+ * as soon as it arrives.
+ * @param c_ssl The client SSL
+ * @param client_fd The client descriptor
+ * @param start_time The start of the authentication
+ * @param msg The resulting message
+ * @return MESSAGE_STATUS_OK upon success
+ */
+static int
+client_read_message(SSL* c_ssl, int client_fd, time_t start_time, struct message** msg)
+{
+   int status = MESSAGE_STATUS_ZERO;
+   int ready;
+   int64_t remaining;
+   char b;
+   struct pollfd pfd;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   while (pgagroal_socket_isvalid(client_fd))
+   {
+      remaining = pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S) - (int64_t)difftime(time(NULL), start_time);
+      if (remaining <= 0)
+      {
+         break;
+      }
+
+      /* Data already decrypted by OpenSSL is not seen by poll() */
+      if (c_ssl == NULL || SSL_pending(c_ssl) == 0)
+      {
+         pfd.fd = client_fd;
+         pfd.events = POLLIN;
+         pfd.revents = 0;
+
+         ready = poll(&pfd, 1, (int)MIN(remaining * 1000, (int64_t)INT_MAX));
+         if (ready < 0 && errno == EINTR)
+         {
+            errno = 0;
+            continue;
+         }
+         else if (ready <= 0)
+         {
+            break;
+         }
+      }
+
+      status = pgagroal_read_timeout_message(c_ssl, client_fd, (int)remaining, msg);
+      if (status != MESSAGE_STATUS_ZERO)
+      {
+         break;
+      }
+
+      /* psql may just close the connection without word */
+      if (recv(client_fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+      {
+         break;
+      }
+      errno = 0;
+   }
+
+   return status;
+}
+
 static int
-client_scram256(SSL* c_ssl, int client_fd, char* username __attribute__((unused)), char* password, int slot)
+client_scram256(SSL* c_ssl, int client_fd, char* username, char* password, int slot)
 {
    int status;
+   bool cached = false;
+   unsigned char cached_stored_key[SCRAM_KEY_LENGTH];
+   unsigned char cached_server_key[SCRAM_KEY_LENGTH];
    time_t start_time;
    char* password_prep = NULL;
    char* client_first_message_bare = NULL;
@@ -1978,20 +2060,7 @@ client_scram256(SSL* c_ssl, int client_fd, char* username __attribute__((unused)
 
    start_time = time(NULL);
 
-   /* psql may just close the connection without word, so loop */
-retry:
-   status = pgagroal_read_timeout_message(c_ssl, client_fd, 1, &msg);
-   if (status != MESSAGE_STATUS_OK)
-   {
-      if (difftime(time(NULL), start_time) < pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S))
-      {
-         if (pgagroal_socket_isvalid(client_fd))
-         /* Sleep for 100ms */
-         {
-            SLEEP_AND_GOTO(100000000L, retry)
-         }
-      }
-   }
+   status = client_read_message(c_ssl, client_fd, start_time, &msg);
 
    if (status != MESSAGE_STATUS_OK)
    {
@@ -2069,7 +2138,19 @@ retry:
    }
 
    generate_nounce(&server_nounce);
-   generate_salt(&salt, &salt_length);
+
+   /* Use the derived keys of a known user; PBKDF2 then only runs once per password */
+   salt = calloc(1, SCRAM_SALT_LENGTH);
+   if (salt != NULL && !scram_keys(username, password, salt, &cached_stored_key[0], &cached_server_key[0]))
+   {
+      cached = true;
+      salt_length = SCRAM_SALT_LENGTH;
+   }
+   else
+   {
+      free(salt);
+      generate_salt(&salt, &salt_length);
+   }
    pgagroal_base64_encode(salt, salt_length, &base64_salt, &base64_salt_length);
 
    server_first_message = calloc(1, 89);
@@ -2163,25 +2244,41 @@ retry:
       }
    }
 
-   sasl_prep(password, &password_prep);
-
-   if (client_proof(password_prep, salt, salt_length, 4096,
-                    client_first_message_bare, strlen(client_first_message_bare),
-                    server_first_message, strlen(server_first_message),
-                    client_final_message_without_proof, strlen(client_final_message_without_proof),
-                    &client_proof_calc, &client_proof_calc_length))
+   if (cached)
    {
-      goto error;
+      if (client_proof_received_length != SCRAM_KEY_LENGTH ||
+          verify_client_proof((char*)&cached_stored_key[0], SCRAM_KEY_LENGTH,
+                              client_proof_received, client_proof_received_length,
+                              salt, salt_length, 4096,
+                              client_first_message_bare, strlen(client_first_message_bare),
+                              server_first_message, strlen(server_first_message),
+                              client_final_message_without_proof, strlen(client_final_message_without_proof)))
+      {
+         goto bad_password;
+      }
    }
-
-   if (client_proof_received_length != client_proof_calc_length ||
-       memcmp(client_proof_received, client_proof_calc, client_proof_calc_length) != 0)
+   else
    {
-      goto bad_password;
+      sasl_prep(password, &password_prep);
+
+      if (client_proof(password_prep, salt, salt_length, 4096,
+                       client_first_message_bare, strlen(client_first_message_bare),
+                       server_first_message, strlen(server_first_message),
+                       client_final_message_without_proof, strlen(client_final_message_without_proof),
+                       &client_proof_calc, &client_proof_calc_length))
+      {
+         goto error;
+      }
+
+      if (client_proof_received_length != client_proof_calc_length ||
+          memcmp(client_proof_received, client_proof_calc, client_proof_calc_length) != 0)
+      {
+         goto bad_password;
+      }
    }
 
    if (server_signature(password_prep, salt, salt_length, 4096,
-                        NULL, 0,
+                        cached ? (char*)&cached_server_key[0] : NULL, cached ? SCRAM_KEY_LENGTH : 0,
                         client_first_message_bare, strlen(client_first_message_bare),
                         server_first_message, strlen(server_first_message),
                         client_final_message_without_proof, strlen(client_final_message_without_proof),
@@ -3168,20 +3265,41 @@ error:
    return AUTH_ERROR;
 }
 
-static bool
-is_allowed(char* username, char* database, char* address, int* hba_method)
+bool
+pgagroal_hba_is_allowed(char* username, char* database, char* address, int* hba_method)
 {
-   struct main_configuration* config;
+   int family;
+   uint64_t candidates;
+   unsigned char addr[16];
 
-   config = (struct main_configuration*)shmem;
+   if (!hba_compiled && pgagroal_hba_compile())
+   {
+      pgagroal_log_error("HBA: Unable to compile the entries");
+      return false;
+   }
 
-   for (int i = 0; i < config->number_of_hbas; i++)
+   candidates = (hba_all_users | (uint64_t)pgagroal_art_search(hba_users, username)) &
+                (hba_all_databases | (uint64_t)pgagroal_art_search(hba_databases, database));
+
+   if (candidates == 0)
    {
-      if (is_allowed_address(address, config->hbas[i].address) &&
-          is_allowed_database(database, config->hbas[i].database) &&
-          is_allowed_username(username, config->hbas[i].username))
+      return false;
+   }
+
+   memset(&addr, 0, sizeof(addr));
+
+   family = strchr(address, ':') == NULL ? AF_INET : AF_INET6;
+   if (inet_pton(family, address, &addr[0]) != 1)
+   {
+      family = AF_UNSPEC;
+   }
+
+   /* The lowest bit is the first entry in the file */
+   for (int i = 0; i < hba_rules_length; i++)
+   {
+      if ((candidates & ((uint64_t)1 << i)) && is_allowed_address(&hba_rules[i], family, &addr[0]))
       {
-         *hba_method = get_hba_method(i);
+         *hba_method = hba_rules[i].method;
 
          return true;
       }
@@ -3191,180 +3309,208 @@ is_allowed(char* username, char* database, char* address, int* hba_method)
 }
 
 static bool
-is_allowed_username(char* username, char* entry)
+is_allowed_address(struct hba_rule* rule, int family, unsigned char* address)
 {
-   if (!strcasecmp(entry, "all") || !strcmp(username, entry))
+   int bytes;
+   int bits;
+
+   if (rule->all_addresses)
    {
       return true;
    }
 
-   return false;
-}
+   if (rule->family == AF_UNSPEC || rule->family != family)
+   {
+      return false;
+   }
 
-static bool
-is_allowed_database(char* database, char* entry)
-{
-   struct main_configuration* config = (struct main_configuration*)shmem;
+   bytes = rule->prefix_length / 8;
+   bits = rule->prefix_length % 8;
 
-   if (!strcasecmp(entry, "all") || !strcmp(database, entry))
+   if (memcmp(address, &rule->prefix[0], bytes))
    {
-      return true;
+      return false;
    }
 
-   // Check if the database is an alias in any limit entry
-   for (int i = 0; i < config->number_of_limits; i++)
+   if (bits > 0)
    {
-      if (!strcmp(entry, config->limits[i].database))
-      {
-         // Check if database is an alias of this entry
-         for (int j = 0; j < config->limits[i].aliases_count; j++)
-         {
-            if (!strcmp(database, config->limits[i].aliases[j]))
-            {
-               pgagroal_log_debug("HBA: Database '%s' matched as alias of '%s'", database, entry);
-               return true;
-            }
-         }
-      }
+      unsigned char mask = (unsigned char)(0xffU << (8 - bits));
+
+      return (address[bytes] & mask) == rule->prefix[bytes];
    }
 
-   return false;
+   return true;
 }
 
-static bool
-is_allowed_address(char* address, char* entry)
+static int
+compile_hba_address(char* entry, struct hba_rule* rule)
 {
-   struct sockaddr_in address_sa4;
-   struct sockaddr_in6 address_sa6;
-   struct sockaddr_in entry_sa4;
-   struct sockaddr_in6 entry_sa6;
    char addr[INET6_ADDRSTRLEN];
-   char s_mask[4];
-   int mask;
-   char* marker;
-   bool ipv4 = true;
+   char* marker = NULL;
+   char* end = NULL;
+   long mask;
+   int bytes;
+   int bits;
 
    memset(&addr, 0, sizeof(addr));
-   memset(&s_mask, 0, sizeof(s_mask));
+
+   rule->all_addresses = false;
+   rule->family = AF_UNSPEC;
+   rule->prefix_length = 0;
+   memset(&rule->prefix[0], 0, sizeof(rule->prefix));
 
    if (!strcasecmp(entry, "all"))
    {
-      return true;
+      rule->all_addresses = true;
+      return 0;
    }
 
    marker = strchr(entry, '/');
-   if (!marker)
+   if (!marker || (size_t)(marker - entry) >= sizeof(addr))
    {
-      pgagroal_log_warn("Invalid HBA entry: %s", entry);
-      return false;
+      goto error;
    }
 
    memcpy(&addr, entry, marker - entry);
-   marker += sizeof(char);
-   memcpy(&s_mask, marker, strlen(marker));
-   mask = atoi(s_mask);
 
-   if (strchr(addr, ':') == NULL)
+   errno = 0;
+   mask = strtol(marker + 1, &end, 10);
+   if (errno != 0 || end == marker + 1 || *end != '\0')
    {
-      inet_pton(AF_INET, addr, &(entry_sa4.sin_addr));
+      goto error;
+   }
 
-      if (strchr(address, ':') == NULL)
-      {
-         inet_pton(AF_INET, address, &(address_sa4.sin_addr));
-      }
-      else
-      {
-         return false;
-      }
+   rule->family = strchr(addr, ':') == NULL ? AF_INET : AF_INET6;
+
+   if (inet_pton(rule->family, addr, &rule->prefix[0]) != 1 ||
+       mask < 0 || mask > (rule->family == AF_INET ? 32 : 128))
+   {
+      goto error;
    }
-   else
+
+   rule->prefix_length = (int)mask;
+
+   /* Clear the host bits so that the match is a plain comparison */
+   bytes = rule->prefix_length / 8;
+   bits = rule->prefix_length % 8;
+
+   if (bits > 0)
    {
-      ipv4 = false;
+      rule->prefix[bytes] &= (unsigned char)(0xffU << (8 - bits));
+      bytes++;
+   }
 
-      inet_pton(AF_INET6, addr, &(entry_sa6.sin6_addr));
+   memset(&rule->prefix[bytes], 0, sizeof(rule->prefix) - bytes);
 
-      if (strchr(address, ':') != NULL)
-      {
-         inet_pton(AF_INET6, address, &(address_sa6.sin6_addr));
-      }
-      else
-      {
-         return false;
-      }
+   return 0;
+
+error:
+
+   pgagroal_log_warn("Invalid HBA entry: %s", entry);
+
+   rule->family = AF_UNSPEC;
+
+   return 1;
+}
+
+static int
+add_hba_index(struct art* index, char* key, int rule)
+{
+   uint64_t rules;
+
+   if (key == NULL || strlen(key) == 0)
+   {
+      return 0;
    }
 
-   if (ipv4)
+   rules = (uint64_t)pgagroal_art_search(index, key);
+   rules |= (uint64_t)1 << rule;
+
+   return pgagroal_art_insert(index, key, (uintptr_t)rules, ValueUInt64);
+}
+
+int
+pgagroal_hba_compile(void)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   pgagroal_hba_destroy();
+
+   if (pgagroal_art_create(&hba_users) || pgagroal_art_create(&hba_databases))
    {
-      if (!strcmp(entry, "0.0.0.0/0"))
-      {
-         return true;
-      }
+      goto error;
+   }
 
-      if (mask < 0 || mask > 32)
-      {
-         pgagroal_log_warn("Invalid HBA entry: %s", entry);
-         return false;
-      }
+   hba_rules_length = MIN(config->number_of_hbas, NUMBER_OF_HBAS);
 
-      unsigned char a1 = (ntohl(address_sa4.sin_addr.s_addr) >> 24) & 0xff;
-      unsigned char a2 = (ntohl(address_sa4.sin_addr.s_addr) >> 16) & 0xff;
-      unsigned char a3 = (ntohl(address_sa4.sin_addr.s_addr) >> 8) & 0xff;
-      unsigned char a4 = (ntohl(address_sa4.sin_addr.s_addr)) & 0xff;
+   for (int i = 0; i < hba_rules_length; i++)
+   {
+      struct hba* hba = &config->hbas[i];
 
-      unsigned char e1 = (ntohl(entry_sa4.sin_addr.s_addr) >> 24) & 0xff;
-      unsigned char e2 = (ntohl(entry_sa4.sin_addr.s_addr) >> 16) & 0xff;
-      unsigned char e3 = (ntohl(entry_sa4.sin_addr.s_addr) >> 8) & 0xff;
-      unsigned char e4 = (ntohl(entry_sa4.sin_addr.s_addr)) & 0xff;
+      compile_hba_address(hba->address, &hba_rules[i]);
+      hba_rules[i].method = get_hba_method(i);
 
-      if (mask <= 8)
+      if (!strcasecmp(hba->username, "all"))
       {
-         return a1 == e1;
+         hba_all_users |= (uint64_t)1 << i;
       }
-      else if (mask <= 16)
+      else if (add_hba_index(hba_users, hba->username, i))
       {
-         return a1 == e1 && a2 == e2;
-      }
-      else if (mask <= 24)
-      {
-         return a1 == e1 && a2 == e2 && a3 == e3;
+         goto error;
       }
-      else
+
+      if (!strcasecmp(hba->database, "all"))
       {
-         return a1 == e1 && a2 == e2 && a3 == e3 && a4 == e4;
+         hba_all_databases |= (uint64_t)1 << i;
+         continue;
       }
-   }
-   else
-   {
-      if (!strcmp(entry, "::0/0"))
+
+      if (add_hba_index(hba_databases, hba->database, i))
       {
-         return true;
+         goto error;
       }
 
-      if (mask < 0 || mask > 128)
+      /* The aliases of the database match the entry as well */
+      for (int j = 0; j < config->number_of_limits; j++)
       {
-         pgagroal_log_warn("Invalid HBA entry: %s", entry);
-         return false;
+         if (!strcmp(hba->database, config->limits[j].database))
+         {
+            for (int k = 0; k < config->limits[j].aliases_count; k++)
+            {
+               if (add_hba_index(hba_databases, config->limits[j].aliases[k], i))
+               {
+                  goto error;
+               }
+            }
+         }
       }
+   }
 
-      struct sockaddr_in6 netmask;
-      bool result = false;
+   hba_compiled = true;
 
-      memset(&netmask, 0, sizeof(struct sockaddr_in6));
+   return 0;
 
-      for (long i = mask, j = 0; i > 0; i -= 8, ++j)
-      {
-         netmask.sin6_addr.s6_addr[j] = i >= 8 ? 0xff : (unsigned long int)((0xffU << (8 - i)) & 0xffU);
-      }
+error:
 
-      for (unsigned i = 0; i < 16; i++)
-      {
-         result |= (0 != (address_sa6.sin6_addr.s6_addr[i] & !netmask.sin6_addr.s6_addr[i]));
-      }
+   pgagroal_hba_destroy();
 
-      return result;
-   }
+   return 1;
+}
 
-   return false;
+void
+pgagroal_hba_destroy(void)
+{
+   pgagroal_art_destroy(hba_users);
+   pgagroal_art_destroy(hba_databases);
+
+   hba_users = NULL;
+   hba_databases = NULL;
+   hba_all_users = 0;
+   hba_all_databases = 0;
+   hba_rules_length = 0;
+   hba_compiled = false;
 }
 
 static bool
@@ -4471,6 +4617,151 @@ error:
    return 1;
 }
 
+/* The frontend or backend user entry that owns this password */
+static struct user*
+scram_user(char* username, char* password)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (username == NULL || password == NULL)
+   {
+      return NULL;
+   }
+
+   for (int i = 0; i < config->number_of_frontend_users; i++)
+   {
+      if (!strcmp(config->frontend_users[i].username, username) &&
+          !strcmp(config->frontend_users[i].password, password))
+      {
+         return &config->frontend_users[i];
+      }
+   }
+
+   for (int i = 0; i < config->number_of_users; i++)
+   {
+      if (!strcmp(config->users[i].username, username) &&
+          !strcmp(config->users[i].password, password))
+      {
+         return &config->users[i];
+      }
+   }
+
+   return NULL;
+}
+
+/* Get the salt, StoredKey and ServerKey of a known user. They are derived
+ * once per password and kept in shared memory next to the user entry; a
+ * reload clears them and a changed password is detected by its digest. */
+static int
+scram_keys(char* username, char* password, char* salt, unsigned char* s_key, unsigned char* srv_key)
+{
+   bool found = false;
+   signed char lock;
+   unsigned char digest[SCRAM_KEY_LENGTH];
+   unsigned int digest_length = 0;
+   char* password_prep = NULL;
+   char* new_salt = NULL;
+   int new_salt_length = 0;
+   unsigned char* s_p = NULL;
+   int s_p_length = 0;
+   unsigned char* c_k = NULL;
+   int c_k_length = 0;
+   unsigned char* st_k = NULL;
+   int st_k_length = 0;
+   unsigned char* sv_k = NULL;
+   int sv_k_length = 0;
+   struct user* user;
+
+   user = scram_user(username, password);
+   if (user == NULL)
+   {
+      return 1;
+   }
+
+   if (EVP_Digest(password, strlen(password), &digest[0], &digest_length, EVP_sha256(), NULL) != 1)
+   {
+      return 1;
+   }
+
+retry:
+   lock = STATE_FREE;
+   if (atomic_compare_exchange_strong(&user->scram_lock, &lock, STATE_IN_USE))
+   {
+      if (user->scram_valid && !memcmp(user->scram_password, &digest[0], SCRAM_KEY_LENGTH))
+      {
+         memcpy(salt, user->scram_salt, SCRAM_SALT_LENGTH);
+         memcpy(s_key, user->scram_stored_key, SCRAM_KEY_LENGTH);
+         memcpy(srv_key, user->scram_server_key, SCRAM_KEY_LENGTH);
+         found = true;
+      }
+
+      atomic_store(&user->scram_lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000L, retry);
+   }
+
+   if (found)
+   {
+      return 0;
+   }
+
+   /* Derive outside of the lock; concurrent first logins may both do this */
+   if (sasl_prep(password, &password_prep) ||
+       generate_salt(&new_salt, &new_salt_length) ||
+       salted_password(password_prep, new_salt, new_salt_length, 4096, &s_p, &s_p_length) ||
+       salted_password_key(s_p, s_p_length, "Client Key", &c_k, &c_k_length) ||
+       stored_key(c_k, c_k_length, &st_k, &st_k_length) ||
+       salted_password_key(s_p, s_p_length, "Server Key", &sv_k, &sv_k_length))
+   {
+      goto error;
+   }
+
+retry_store:
+   lock = STATE_FREE;
+   if (atomic_compare_exchange_strong(&user->scram_lock, &lock, STATE_IN_USE))
+   {
+      memcpy(user->scram_password, &digest[0], SCRAM_KEY_LENGTH);
+      memcpy(user->scram_salt, new_salt, SCRAM_SALT_LENGTH);
+      memcpy(user->scram_stored_key, st_k, SCRAM_KEY_LENGTH);
+      memcpy(user->scram_server_key, sv_k, SCRAM_KEY_LENGTH);
+      user->scram_valid = true;
+
+      atomic_store(&user->scram_lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000L, retry_store);
+   }
+
+   memcpy(salt, new_salt, SCRAM_SALT_LENGTH);
+   memcpy(s_key, st_k, SCRAM_KEY_LENGTH);
+   memcpy(srv_key, sv_k, SCRAM_KEY_LENGTH);
+
+   free(password_prep);
+   free(new_salt);
+   free(s_p);
+   free(c_k);
+   free(st_k);
+   free(sv_k);
+
+   return 0;
+
+error:
+
+   free(password_prep);
+   free(new_salt);
+   free(s_p);
+   free(c_k);
+   free(st_k);
+   free(sv_k);
+
+   return 1;
+}
+
 static int
 generate_salt(char** salt, int* size)
 {
@@ -4661,6 +4952,12 @@ auth_query(SSL* c_ssl, int client_fd, int slot, char* username, char* database,
 
    config = (struct main_configuration*)shmem;
 
+   if (auth_query_cache_get(username, database, &shadow))
+   {
+      pgagroal_log_debug("auth_query: cached entry for %s/%s", username, database);
+      goto client;
+   }
+
    /* Get connection to server using the superuser */
    ret = auth_query_get_connection(config->superuser.username, config->superuser.password, database, &su_socket, &su_ssl);
    if (ret == AUTH_BAD_PASSWORD)
@@ -4698,6 +4995,18 @@ auth_query(SSL* c_ssl, int client_fd, int slot, char* username, char* database,
    pgagroal_disconnect(su_socket);
    atomic_store(&config->su_connection, STATE_FREE);
 
+   auth_query_cache_put(username, database, shadow);
+
+client:
+
+   /* Unknown user */
+   if (shadow == NULL || strlen(shadow) == 0)
+   {
+      pgagroal_write_bad_password(c_ssl, client_fd, username);
+      pgagroal_write_empty(c_ssl, client_fd);
+      goto bad_password;
+   }
+
    /* Client security */
    if (config->connections[slot].has_security == SECURITY_SCRAM256)
    {
@@ -4746,6 +5055,154 @@ error:
    return AUTH_ERROR;
 }
 
+static struct auth_query_entry*
+auth_query_cache_entry(char* username, char* database)
+{
+   uint32_t hash = 2166136261u;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   /* FNV-1a over "username\0database"; a colliding pair simply evicts the other */
+   for (char* c = username; *c != '\0'; c++)
+   {
+      hash = (hash ^ (unsigned char)*c) * 16777619u;
+   }
+   hash *= 16777619u;
+   for (char* c = database; *c != '\0'; c++)
+   {
+      hash = (hash ^ (unsigned char)*c) * 16777619u;
+   }
+
+   return &config->auth_query_cache[hash % NUMBER_OF_AUTH_QUERY_ENTRIES];
+}
+
+static bool
+auth_query_cache_get(char* username, char* database, char** shadow)
+{
+   bool found = false;
+   signed char lock;
+   time_t now;
+   struct auth_query_entry* entry = NULL;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   *shadow = NULL;
+
+   if (!pgagroal_time_is_valid(config->auth_query_cache_ttl))
+   {
+      return false;
+   }
+
+   entry = auth_query_cache_entry(username, database);
+   now = time(NULL);
+
+retry:
+   lock = STATE_FREE;
+   if (atomic_compare_exchange_strong(&entry->lock, &lock, STATE_IN_USE))
+   {
+      if (entry->expires > now &&
+          !strncmp(entry->username, username, MAX_USERNAME_LENGTH) &&
+          !strncmp(entry->database, database, MAX_DATABASE_LENGTH))
+      {
+         *shadow = strdup(entry->found ? entry->shadow : "");
+         found = true;
+      }
+
+      atomic_store(&entry->lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000L, retry);
+   }
+
+   return found;
+}
+
+static void
+auth_query_cache_put(char* username, char* database, char* shadow)
+{
+   bool found;
+   signed char lock;
+   pgagroal_time_t ttl;
+   struct auth_query_entry* entry = NULL;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   /* An empty shadow means that the user doesn't exist */
+   found = shadow != NULL && strlen(shadow) > 0;
+   ttl = found ? config->auth_query_cache_ttl : config->auth_query_negative_ttl;
+
+   if (!pgagroal_time_is_valid(config->auth_query_cache_ttl) || !pgagroal_time_is_valid(ttl))
+   {
+      return;
+   }
+
+   if (strlen(username) >= MAX_USERNAME_LENGTH || strlen(database) >= MAX_DATABASE_LENGTH ||
+       (found && strlen(shadow) >= MAX_SHADOW_LENGTH))
+   {
+      return;
+   }
+
+   entry = auth_query_cache_entry(username, database);
+
+retry:
+   lock = STATE_FREE;
+   if (atomic_compare_exchange_strong(&entry->lock, &lock, STATE_IN_USE))
+   {
+      memset(entry->username, 0, sizeof(entry->username));
+      memset(entry->database, 0, sizeof(entry->database));
+      memset(entry->shadow, 0, sizeof(entry->shadow));
+
+      memcpy(entry->username, username, strlen(username));
+      memcpy(entry->database, database, strlen(database));
+      if (found)
+      {
+         memcpy(entry->shadow, shadow, strlen(shadow));
+      }
+      entry->found = found;
+      entry->expires = time(NULL) + (time_t)pgagroal_time_convert(ttl, FORMAT_TIME_S);
+
+      atomic_store(&entry->lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000L, retry);
+   }
+}
+
+void
+pgagroal_auth_query_cache_clear(void)
+{
+   signed char lock;
+   struct auth_query_entry* entry = NULL;
+   struct main_configuration* config = NULL;
+
+   config = (struct main_configuration*)shmem;
+
+   for (int i = 0; i < NUMBER_OF_AUTH_QUERY_ENTRIES; i++)
+   {
+      entry = &config->auth_query_cache[i];
+
+retry:
+      lock = STATE_FREE;
+      if (atomic_compare_exchange_strong(&entry->lock, &lock, STATE_IN_USE))
+      {
+         entry->expires = 0;
+         entry->found = false;
+         pgagroal_cleanse(entry->shadow, sizeof(entry->shadow));
+
+         atomic_store(&entry->lock, STATE_FREE);
+      }
+      else
+      {
+         SLEEP_AND_GOTO(1000L, retry);
+      }
+   }
+}
+
 static int
 auth_query_get_connection(char* username, char* password, char* database, int* server_fd, SSL** server_ssl)
 {
@@ -4793,7 +5250,7 @@ retry:
       }
       else
       {
-         ret = pgagroal_connect(config->servers[server].host, config->servers[server].port, server_fd, config->keep_alive, config->nodelay);
+         ret = pgagroal_connect_server(server, server_fd, config->keep_alive, config->nodelay);
       }
 
       if (ret)
@@ -5338,20 +5795,7 @@ auth_query_client_scram256(SSL* c_ssl, int client_fd, char* username __attribute
 
    start_time = time(NULL);
 
-   /* psql may just close the connection without word, so loop */
-retry:
-   status = pgagroal_read_timeout_message(c_ssl, client_fd, 1, &msg);
-   if (status != MESSAGE_STATUS_OK)
-   {
-      if (difftime(time(NULL), start_time) < pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S))
-      {
-         if (pgagroal_socket_isvalid(client_fd))
-         /* Sleep for 100ms */
-         {
-            SLEEP_AND_GOTO(100000000L, retry)
-         }
-      }
-   }
+   status = client_read_message(c_ssl, client_fd, start_time, &msg);
 
    if (status != MESSAGE_STATUS_OK)
    {
@@ -5580,7 +6024,7 @@ establish_client_tls_connection(int server, int fd, SSL** ssl)
 
       if (msg->kind == 'S')
       {
-         create_client_tls_connection(fd, ssl, config->servers[server].tls_key_file, config->servers[server].tls_cert_file, config->servers[server].tls_ca_file);
+         create_client_tls_connection(server, fd, ssl);
       }
    }
 
@@ -5598,32 +6042,23 @@ error:
 }
 
 static int
-create_client_tls_connection(int fd, SSL** ssl, char* tls_key_file, char* tls_cert_file, char* tls_ca_file)
+create_client_tls_connection(int server, int fd, SSL** ssl)
 {
    SSL_CTX* ctx = NULL;
    struct tls* t = NULL;
 
-   /* We are acting as a client against the server */
-   if (pgagroal_create_ssl_ctx(true, &ctx))
+   /* We are acting as a client against the server; the context is built once
+    * and restricted to TLS 1.3 AES-GCM so a session can always be parked */
+   if (pgagroal_tls_client_ctx(server, &ctx))
    {
       pgagroal_log_error("CTX failed");
       goto error;
    }
 
-   /* The record layer supports only TLS 1.3 AES-GCM; enforce it on the backend so
-    * a session can always be parked and no weaker protocol/cipher is negotiated. */
-   if (SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION) == 0 ||
-       SSL_CTX_set_ciphersuites(ctx, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384") == 0)
-   {
-      pgagroal_log_error("Backend TLS 1.3 policy failed");
-      goto error;
-   }
-
    /* Create a socket-decoupled client context */
-   if (pgagroal_tls_create_client(ctx, tls_key_file, tls_cert_file, tls_ca_file, &t))
+   if (pgagroal_tls_create(ctx, false, &t) != PGAGROAL_TLS_OK)
    {
       pgagroal_log_error("Client failed");
-      ctx = NULL; /* pgagroal_tls_create_client already released the context */
       goto error;
    }
 
@@ -349,7 +349,7 @@ pgagroal_server_query_execute(int server_idx, char* user, char* database, char*
    config = (struct main_configuration*)shmem;
    srv = &config->servers[server_idx];
 
-   if (pgagroal_connect(srv->host, srv->port, &fd, true, false) != 0)
+   if (pgagroal_connect_server(server_idx, &fd, true, false) != 0)
    {
       pgagroal_log_debug("server_query: Failed to connect to server %d (%s:%d)",
                          server_idx, srv->host, srv->port);
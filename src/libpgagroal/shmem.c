@@ -39,6 +39,9 @@ void* shmem = NULL;
 void* pipeline_shmem = NULL;
 void* prometheus_shmem = NULL;
 void* prometheus_cache_shmem = NULL;
+void* tracker_shmem = NULL;
+void* recorder_shmem = NULL;
+void* log_shmem = NULL;
 
 int
 pgagroal_create_shared_memory(size_t size, unsigned char hp, void** shmem)
@@ -34,10 +34,16 @@
 #include <memory.h>
 #include <network.h>
 #include <server.h>
+#include <shmem.h>
 #include <status.h>
+#include <status_internal.h>
 #include <utils.h>
 
-static void status_details(bool details, struct json* response);
+/* system */
+#include <ctype.h>
+#include <string.h>
+
+static void status_details(bool details, struct json* request, struct json* response);
 
 void
 pgagroal_status(SSL* ssl __attribute__((unused)), int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
@@ -58,7 +64,7 @@ pgagroal_status(SSL* ssl __attribute__((unused)), int client_fd, uint8_t compres
       goto error;
    }
 
-   status_details(false, response);
+   status_details(false, NULL, response);
 
    end_time = time(NULL);
 
@@ -114,7 +120,7 @@ pgagroal_status_details(SSL* ssl __attribute__((unused)), int client_fd, uint8_t
       goto error;
    }
 
-   status_details(true, response);
+   status_details(true, (struct json*)pgagroal_json_get(payload, MANAGEMENT_CATEGORY_REQUEST), response);
 
    end_time = time(NULL);
 
@@ -152,7 +158,7 @@ error:
 }
 
 static void
-status_details(bool details, struct json* response)
+status_details(bool details, struct json* request, struct json* response)
 {
    int active = 0;
    int total = 0;
@@ -305,10 +311,8 @@ status_details(bool details, struct json* response)
       int number_of_disabled = 0;
       struct json* limits = NULL;
       struct json* databases = NULL;
-      struct json* connections = NULL;
 
       pgagroal_json_create(&limits);
-      pgagroal_json_create(&connections);
 
       for (int i = 0; i < config->number_of_limits; i++)
       {
@@ -363,28 +367,141 @@ status_details(bool details, struct json* response)
 
       pgagroal_json_put(response, MANAGEMENT_ARGUMENT_DATABASES, (uintptr_t)databases, ValueJSON);
 
-      for (int i = 0; i < config->max_connections; i++)
+      pgagroal_status_connections(request, response);
+
+      if (config->ev_stats && prometheus_shmem != NULL)
       {
-         int state = atomic_load(&config->states[i]);
-         struct json* js = NULL;
+         struct json* event_loop = NULL;
+         struct main_prometheus* prometheus = (struct main_prometheus*)prometheus_shmem;
+         char* roles[EV_STATS_ROLES] = {"Main", "Worker"};
 
-         pgagroal_json_create(&js);
+         pgagroal_json_create(&event_loop);
+
+         for (int i = 0; i < EV_STATS_ROLES; i++)
+         {
+            struct json* js = NULL;
+            struct prometheus_event_loop* ev = &prometheus->event_loop[i];
+
+            pgagroal_json_create(&js);
 
-         pgagroal_json_put(js, MANAGEMENT_ARGUMENT_STATE, (uintptr_t)pgagroal_connection_state_as_string(state), ValueString);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_ITERATIONS, (uintptr_t)atomic_load(&ev->iterations), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_EVENTS, (uintptr_t)atomic_load(&ev->events), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_WAIT_TIME, (uintptr_t)atomic_load(&ev->wait_time), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_BUSY_TIME, (uintptr_t)atomic_load(&ev->busy_time), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_CALLBACK_TIME, (uintptr_t)atomic_load(&ev->callback_time_sum), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_SENDS, (uintptr_t)atomic_load(&ev->sends), ValueUInt64);
+            pgagroal_json_put(js, MANAGEMENT_ARGUMENT_PARTIAL_SENDS, (uintptr_t)atomic_load(&ev->partial_sends), ValueUInt64);
+
+            pgagroal_json_put(event_loop, roles[i], (uintptr_t)js, ValueJSON);
+         }
+
+         pgagroal_json_put(response, MANAGEMENT_ARGUMENT_EVENT_LOOP, (uintptr_t)event_loop, ValueJSON);
+      }
+   }
+}
+
+void
+pgagroal_status_connections(struct json* request, struct json* response)
+{
+   int rows = 0;
+   int64_t offset = 0;
+   int64_t limit = 0;
+   int64_t next_offset = -1;
+   char* state_filter = NULL;
+   char* username_filter = NULL;
+   char* database_filter = NULL;
+   struct json* connections = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (request != NULL)
+   {
+      state_filter = (char*)pgagroal_json_get(request, MANAGEMENT_ARGUMENT_STATE);
+      username_filter = (char*)pgagroal_json_get(request, MANAGEMENT_ARGUMENT_USERNAME);
+      database_filter = (char*)pgagroal_json_get(request, MANAGEMENT_ARGUMENT_DATABASE);
+      offset = (int64_t)pgagroal_json_get(request, MANAGEMENT_ARGUMENT_OFFSET);
+      limit = (int64_t)pgagroal_json_get(request, MANAGEMENT_ARGUMENT_LIMIT);
+   }
+
+   if (offset < 0)
+   {
+      offset = 0;
+   }
+
+   pgagroal_json_create(&connections);
+
+   /* The offset is a slot, so a page never skips or repeats a slot when the pool changes */
+   for (int i = (int)MIN(offset, (int64_t)config->max_connections); i < config->max_connections; i++)
+   {
+      int state = atomic_load(&config->states[i]);
+      char* state_str = pgagroal_connection_state_as_string(state);
+      struct json* js = NULL;
 
-         pgagroal_json_put(js, MANAGEMENT_ARGUMENT_START_TIME, (uintptr_t)config->connections[i].start_time, ValueInt64);
-         pgagroal_json_put(js, MANAGEMENT_ARGUMENT_TIMESTAMP, (uintptr_t)config->connections[i].timestamp, ValueInt64);
+      if (state_filter != NULL && !pgagroal_status_state_matches(state_filter, state_str))
+      {
+         continue;
+      }
 
-         pgagroal_json_put(js, MANAGEMENT_ARGUMENT_PID, (uintptr_t)config->connections[i].pid, ValueInt32);
-         pgagroal_json_put(js, MANAGEMENT_ARGUMENT_FD, (uintptr_t)config->connections[i].fd, ValueInt32);
+      if (username_filter != NULL && strcmp(username_filter, config->connections[i].username))
+      {
+         continue;
+      }
 
-         pgagroal_json_put(js, MANAGEMENT_ARGUMENT_DATABASE, (uintptr_t)config->connections[i].database, ValueString);
-         pgagroal_json_put(js, MANAGEMENT_ARGUMENT_USERNAME, (uintptr_t)config->connections[i].username, ValueString);
-         pgagroal_json_put(js, MANAGEMENT_ARGUMENT_APPNAME, (uintptr_t)config->connections[i].appname, ValueString);
+      if (database_filter != NULL && strcmp(database_filter, config->connections[i].database))
+      {
+         continue;
+      }
 
-         pgagroal_json_append(connections, (uintptr_t)js, ValueJSON);
+      if (limit > 0 && rows == limit)
+      {
+         next_offset = i;
+         break;
       }
 
-      pgagroal_json_put(response, MANAGEMENT_ARGUMENT_CONNECTIONS, (uintptr_t)connections, ValueJSON);
+      pgagroal_json_create(&js);
+
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_SLOT, (uintptr_t)i, ValueInt32);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_STATE, (uintptr_t)state_str, ValueString);
+
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_START_TIME, (uintptr_t)config->connections[i].start_time, ValueInt64);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_TIMESTAMP, (uintptr_t)config->connections[i].timestamp, ValueInt64);
+
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_PID, (uintptr_t)config->connections[i].pid, ValueInt32);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_FD, (uintptr_t)config->connections[i].fd, ValueInt32);
+
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_DATABASE, (uintptr_t)config->connections[i].database, ValueString);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_USERNAME, (uintptr_t)config->connections[i].username, ValueString);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_APPNAME, (uintptr_t)config->connections[i].appname, ValueString);
+
+      pgagroal_json_append(connections, (uintptr_t)js, ValueJSON);
+
+      rows++;
+   }
+
+   pgagroal_json_put(response, MANAGEMENT_ARGUMENT_CONNECTIONS, (uintptr_t)connections, ValueJSON);
+
+   if (limit > 0)
+   {
+      pgagroal_json_put(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET, (uintptr_t)next_offset, ValueInt64);
    }
 }
+
+bool
+pgagroal_status_state_matches(char* filter, char* state)
+{
+   size_t i = 0;
+
+   /* 'idle_check' and 'idle-check' match 'Idle check' */
+   for (; filter[i] != '\0' && state[i] != '\0'; i++)
+   {
+      char f = (filter[i] == '_' || filter[i] == '-') ? ' ' : filter[i];
+
+      if (tolower((unsigned char)f) != tolower((unsigned char)state[i]))
+      {
+         return false;
+      }
+   }
+
+   return filter[i] == '\0' && state[i] == '\0';
+}
@@ -36,14 +36,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include <openssl/bio.h>
 #include <openssl/core_names.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/kdf.h>
+#include <openssl/rand.h>
 #include <openssl/x509.h>
 
+/* TLS contexts built once in the main process and inherited by every fork() */
+static SSL_CTX* shared_server_ctx[PGAGROAL_TLS_CTX_SIZE];
+static SSL_CTX* shared_client_ctx[NUMBER_OF_SERVERS];
+static time_t shared_mtime = 0;
+
+static void tls_files(int type, char** key_file, char** cert_file, char** ca_file);
+static int build_client_ctx(int server, SSL_CTX** ctx);
+static time_t newest_mtime(void);
+static void session_tickets(SSL_CTX* ctx);
+static int ticket_key_cb(SSL* ssl, unsigned char key_name[16], unsigned char* iv, EVP_CIPHER_CTX* ectx, EVP_MAC_CTX* hctx, int enc);
+static int current_ticket_key(struct tls_ticket_key* key);
+static int find_ticket_key(unsigned char* name, struct tls_ticket_key* key, bool* renew);
+
 static int
 classify(SSL* ssl, int rc)
 {
@@ -941,6 +956,40 @@ error:
    return 1;
 }
 
+int
+pgagroal_tls_create_ssl_server(int type, int socket, SSL** ssl)
+{
+   SSL_CTX* ctx = NULL;
+   SSL* s = NULL;
+
+   if (pgagroal_tls_server_ctx(type, &ctx))
+   {
+      return 1;
+   }
+
+   s = SSL_new(ctx);
+
+   if (s == NULL || SSL_set_fd(s, socket) == 0)
+   {
+      goto error;
+   }
+
+   /* The SSL object keeps the context reference, released by pgagroal_close_ssl() */
+   *ssl = s;
+
+   return 0;
+
+error:
+
+   if (s != NULL)
+   {
+      SSL_free(s);
+   }
+   SSL_CTX_free(ctx);
+
+   return 1;
+}
+
 int
 pgagroal_create_ssl_client(SSL_CTX* ctx, char* key, char* cert, char* root, int socket, SSL** ssl)
 {
@@ -1034,6 +1083,484 @@ error:
    return 1;
 }
 
+int
+pgagroal_tls_contexts_init(void)
+{
+   char* key_file = NULL;
+   char* cert_file = NULL;
+   char* ca_file = NULL;
+   SSL_CTX* ctx = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   pgagroal_tls_contexts_destroy();
+
+   for (int type = 0; type < PGAGROAL_TLS_CTX_SIZE; type++)
+   {
+      tls_files(type, &key_file, &cert_file, &ca_file);
+
+      if ((type == PGAGROAL_TLS_CTX_FRONTEND && !config->common.tls) ||
+          strlen(cert_file) == 0 || strlen(key_file) == 0)
+      {
+         continue;
+      }
+
+      ctx = NULL;
+      if (pgagroal_create_ssl_ctx(false, &ctx) ||
+          pgagroal_tls_configure_server_ctx(ctx, key_file, cert_file, ca_file))
+      {
+         /* Connections fall back to building their own context and report the error */
+         pgagroal_log_warn("Could not build the shared TLS context for %s", cert_file);
+         if (ctx != NULL)
+         {
+            SSL_CTX_free(ctx);
+         }
+         continue;
+      }
+
+      if (type == PGAGROAL_TLS_CTX_FRONTEND)
+      {
+         session_tickets(ctx);
+      }
+
+      SSL_CTX_set_keylog_callback(ctx, keylog_cb);
+      shared_server_ctx[type] = ctx;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (!config->servers[i].tls)
+      {
+         continue;
+      }
+
+      if (build_client_ctx(i, &shared_client_ctx[i]))
+      {
+         pgagroal_log_warn("Could not build the shared TLS context for server %s", config->servers[i].name);
+         shared_client_ctx[i] = NULL;
+      }
+   }
+
+   shared_mtime = newest_mtime();
+
+   return 0;
+}
+
+bool
+pgagroal_tls_contexts_changed(void)
+{
+   return newest_mtime() != shared_mtime;
+}
+
+void
+pgagroal_tls_contexts_destroy(void)
+{
+   for (int i = 0; i < PGAGROAL_TLS_CTX_SIZE; i++)
+   {
+      if (shared_server_ctx[i] != NULL)
+      {
+         /* Connections that still use the context hold their own reference */
+         SSL_CTX_free(shared_server_ctx[i]);
+         shared_server_ctx[i] = NULL;
+      }
+   }
+
+   for (int i = 0; i < NUMBER_OF_SERVERS; i++)
+   {
+      if (shared_client_ctx[i] != NULL)
+      {
+         SSL_CTX_free(shared_client_ctx[i]);
+         shared_client_ctx[i] = NULL;
+      }
+   }
+
+   shared_mtime = 0;
+}
+
+int
+pgagroal_tls_server_ctx(int type, SSL_CTX** ctx)
+{
+   char* key_file = NULL;
+   char* cert_file = NULL;
+   char* ca_file = NULL;
+   SSL_CTX* c = NULL;
+
+   *ctx = NULL;
+
+   if (type < 0 || type >= PGAGROAL_TLS_CTX_SIZE)
+   {
+      return 1;
+   }
+
+   if (shared_server_ctx[type] != NULL)
+   {
+      SSL_CTX_up_ref(shared_server_ctx[type]);
+      *ctx = shared_server_ctx[type];
+      return 0;
+   }
+
+   tls_files(type, &key_file, &cert_file, &ca_file);
+
+   if (pgagroal_create_ssl_ctx(false, &c))
+   {
+      return 1;
+   }
+
+   if (pgagroal_tls_configure_server_ctx(c, key_file, cert_file, ca_file))
+   {
+      SSL_CTX_free(c);
+      return 1;
+   }
+
+   if (type == PGAGROAL_TLS_CTX_FRONTEND)
+   {
+      session_tickets(c);
+   }
+
+   *ctx = c;
+
+   return 0;
+}
+
+int
+pgagroal_tls_client_ctx(int server, SSL_CTX** ctx)
+{
+   *ctx = NULL;
+
+   if (server < 0 || server >= NUMBER_OF_SERVERS)
+   {
+      return 1;
+   }
+
+   if (shared_client_ctx[server] != NULL)
+   {
+      SSL_CTX_up_ref(shared_client_ctx[server]);
+      *ctx = shared_client_ctx[server];
+      return 0;
+   }
+
+   return build_client_ctx(server, ctx);
+}
+
+static void
+tls_files(int type, char** key_file, char** cert_file, char** ca_file)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (type == PGAGROAL_TLS_CTX_METRICS)
+   {
+      *key_file = config->common.metrics_key_file;
+      *cert_file = config->common.metrics_cert_file;
+      *ca_file = config->common.metrics_ca_file;
+   }
+   else
+   {
+      *key_file = config->common.tls_key_file;
+      *cert_file = config->common.tls_cert_file;
+      *ca_file = config->common.tls_ca_file;
+   }
+}
+
+/* A backend context with the server's certificate, key and root loaded once;
+ * only TLS 1.3 AES-GCM so every session can be parked by the record layer. */
+static int
+build_client_ctx(int server, SSL_CTX** ctx)
+{
+   SSL_CTX* c = NULL;
+   struct server* srv;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   srv = &config->servers[server];
+
+   *ctx = NULL;
+
+   if (pgagroal_create_ssl_ctx(true, &c))
+   {
+      goto error;
+   }
+
+   if (SSL_CTX_set_min_proto_version(c, TLS1_3_VERSION) == 0 ||
+       SSL_CTX_set_ciphersuites(c, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384") == 0)
+   {
+      pgagroal_log_error("Backend TLS 1.3 policy failed");
+      goto error;
+   }
+
+   if (strlen(srv->tls_ca_file) > 0)
+   {
+      if (SSL_CTX_load_verify_locations(c, srv->tls_ca_file, NULL) != 1)
+      {
+         pgagroal_log_error("Couldn't load TLS CA: %s", srv->tls_ca_file);
+         pgagroal_log_error("Reason: %s", ERR_reason_error_string(ERR_get_error()));
+         goto error;
+      }
+
+      SSL_CTX_set_verify(c, SSL_VERIFY_PEER | SSL_VERIFY_CLIENT_ONCE, NULL);
+   }
+
+   if (strlen(srv->tls_cert_file) > 0)
+   {
+      if (SSL_CTX_use_certificate_chain_file(c, srv->tls_cert_file) != 1)
+      {
+         pgagroal_log_error("Couldn't load TLS certificate: %s", srv->tls_cert_file);
+         pgagroal_log_error("Reason: %s", ERR_reason_error_string(ERR_get_error()));
+         goto error;
+      }
+
+      if (strlen(srv->tls_key_file) > 0)
+      {
+         if (SSL_CTX_use_PrivateKey_file(c, srv->tls_key_file, SSL_FILETYPE_PEM) != 1)
+         {
+            pgagroal_log_error("Couldn't load TLS private key: %s", srv->tls_key_file);
+            pgagroal_log_error("Reason: %s", ERR_reason_error_string(ERR_get_error()));
+            goto error;
+         }
+
+         if (SSL_CTX_check_private_key(c) != 1)
+         {
+            pgagroal_log_error("TLS private key check failed: %s", srv->tls_key_file);
+            pgagroal_log_error("Reason: %s", ERR_reason_error_string(ERR_get_error()));
+            goto error;
+         }
+      }
+   }
+
+   SSL_CTX_set_keylog_callback(c, keylog_cb);
+
+   *ctx = c;
+
+   return 0;
+
+error:
+
+   if (c != NULL)
+   {
+      SSL_CTX_free(c);
+   }
+
+   return 1;
+}
+
+/* Stateless TLS 1.3 tickets sealed with keys from shared memory, so a client
+ * can resume against any worker process. */
+static void
+session_tickets(SSL_CTX* ctx)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (!config->tls_session_tickets || !pgagroal_time_is_valid(config->tls_ticket_lifetime))
+   {
+      return;
+   }
+
+   SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+   SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"pgagroal", 8);
+   SSL_CTX_set_timeout(ctx, (long)pgagroal_time_convert(config->tls_ticket_lifetime, FORMAT_TIME_S));
+   SSL_CTX_set_num_tickets(ctx, 1);
+   SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_cb);
+}
+
+static int
+ticket_key_cb(SSL* ssl __attribute__((unused)), unsigned char key_name[16], unsigned char* iv, EVP_CIPHER_CTX* ectx, EVP_MAC_CTX* hctx, int enc)
+{
+   int rc = -1;
+   bool renew = false;
+   struct tls_ticket_key key;
+   OSSL_PARAM params[3];
+
+   memset(&key, 0, sizeof(key));
+
+   if (enc)
+   {
+      if (current_ticket_key(&key))
+      {
+         goto done;
+      }
+
+      memcpy(key_name, key.name, sizeof(key.name));
+
+      if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1 ||
+          EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1)
+      {
+         goto done;
+      }
+   }
+   else
+   {
+      if (find_ticket_key(key_name, &key, &renew))
+      {
+         /* Unknown or expired key: fall back to a full handshake */
+         rc = 0;
+         goto done;
+      }
+
+      if (EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1)
+      {
+         goto done;
+      }
+   }
+
+   params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key, sizeof(key.hmac_key));
+   params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0);
+   params[2] = OSSL_PARAM_construct_end();
+
+   if (EVP_MAC_CTX_set_params(hctx, params) != 1)
+   {
+      goto done;
+   }
+
+   rc = renew ? 2 : 1;
+
+done:
+
+   OPENSSL_cleanse(&key, sizeof(key));
+
+   return rc;
+}
+
+
+static int
+current_ticket_key(struct tls_ticket_key* key)
+{
+   int next;
+   time_t now;
+   int64_t lifetime;
+   signed char free;
+   struct tls_ticket_key* current;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   lifetime = pgagroal_time_convert(config->tls_ticket_lifetime, FORMAT_TIME_S);
+   now = time(NULL);
+
+retry:
+   free = STATE_FREE;
+   if (atomic_compare_exchange_strong(&config->tls_ticket_lock, &free, STATE_IN_USE))
+   {
+      current = &config->tls_ticket_keys[config->tls_ticket_key];
+
+      if (current->created == 0 || now - current->created >= lifetime)
+      {
+         /* Rotate; the previous key keeps decrypting for one more lifetime */
+         next = (config->tls_ticket_key + 1) % NUMBER_OF_TLS_TICKET_KEYS;
+
+         if (RAND_bytes(config->tls_ticket_keys[next].name, sizeof(current->name)) != 1 ||
+             RAND_bytes(config->tls_ticket_keys[next].aes_key, sizeof(current->aes_key)) != 1 ||
+             RAND_bytes(config->tls_ticket_keys[next].hmac_key, sizeof(current->hmac_key)) != 1)
+         {
+            memset(&config->tls_ticket_keys[next], 0, sizeof(struct tls_ticket_key));
+            atomic_store(&config->tls_ticket_lock, STATE_FREE);
+            return 1;
+         }
+
+         config->tls_ticket_keys[next].created = now;
+         config->tls_ticket_key = next;
+         current = &config->tls_ticket_keys[next];
+      }
+
+      memcpy(key, current, sizeof(struct tls_ticket_key));
+
+      atomic_store(&config->tls_ticket_lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000L, retry);
+   }
+
+   return 0;
+}
+
+static int
+find_ticket_key(unsigned char* name, struct tls_ticket_key* key, bool* renew)
+{
+   int result = 1;
+   time_t now;
+   int64_t lifetime;
+   signed char free;
+   struct tls_ticket_key* k;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   lifetime = pgagroal_time_convert(config->tls_ticket_lifetime, FORMAT_TIME_S);
+   now = time(NULL);
+
+retry:
+   free = STATE_FREE;
+   if (atomic_compare_exchange_strong(&config->tls_ticket_lock, &free, STATE_IN_USE))
+   {
+      for (int i = 0; i < NUMBER_OF_TLS_TICKET_KEYS; i++)
+      {
+         k = &config->tls_ticket_keys[i];
+
+         if (k->created != 0 && now - k->created < NUMBER_OF_TLS_TICKET_KEYS * lifetime &&
+             !memcmp(k->name, name, sizeof(k->name)))
+         {
+            memcpy(key, k, sizeof(struct tls_ticket_key));
+            *renew = i != config->tls_ticket_key || now - k->created >= lifetime;
+            result = 0;
+            break;
+         }
+      }
+
+      atomic_store(&config->tls_ticket_lock, STATE_FREE);
+   }
+   else
+   {
+      SLEEP_AND_GOTO(1000L, retry);
+   }
+
+   return result;
+}
+
+static time_t
+newest_mtime(void)
+{
+   char* key_file = NULL;
+   char* cert_file = NULL;
+   char* ca_file = NULL;
+   char* files[3];
+   time_t newest = 0;
+   struct stat st;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   for (int i = 0; i < PGAGROAL_TLS_CTX_SIZE + config->number_of_servers; i++)
+   {
+      if (i < PGAGROAL_TLS_CTX_SIZE)
+      {
+         tls_files(i, &key_file, &cert_file, &ca_file);
+      }
+      else
+      {
+         key_file = config->servers[i - PGAGROAL_TLS_CTX_SIZE].tls_key_file;
+         cert_file = config->servers[i - PGAGROAL_TLS_CTX_SIZE].tls_cert_file;
+         ca_file = config->servers[i - PGAGROAL_TLS_CTX_SIZE].tls_ca_file;
+      }
+
+      files[0] = key_file;
+      files[1] = cert_file;
+      files[2] = ca_file;
+
+      for (int j = 0; j < 3; j++)
+      {
+         if (strlen(files[j]) > 0 && stat(files[j], &st) == 0 && st.st_mtime > newest)
+         {
+            newest = st.st_mtime;
+         }
+      }
+   }
+
+   return newest;
+}
+
 /* The fixed AEAD parameters for each supported TLS 1.3 suite. */
 static int
 aead_lookup(int aead, const EVP_CIPHER** cipher, size_t* key_len, const char** hash)
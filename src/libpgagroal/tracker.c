@@ -28,11 +28,19 @@
 
 /* pgagroal */
 #include <pgagroal.h>
+#include <json.h>
 #include <logging.h>
+#include <management.h>
+#include <memory.h>
+#include <network.h>
 #include <server.h>
+#include <shmem.h>
 #include <tracker.h>
+#include <tracker_internal.h>
+#include <utils.h>
 
 /* system */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,150 +48,433 @@
 #include <sys/time.h>
 #include <sys/types.h>
 
-static int count_connections(void);
+static struct tracker_event* event_begin(int id, uint64_t* position);
+static void event_end(struct tracker_event* event, uint64_t position);
+static void event_name(char* to, char* from, size_t size);
+static char* event_id(int id);
 
-void
-pgagroal_tracking_event_basic(int id, char* username, char* database)
+int
+pgagroal_tracker_init(size_t* p_size, void** p_shmem)
 {
-   int primary;
+   uint64_t size = 1;
+   size_t tmp_p_size = 0;
+   void* tmp_p_shmem = NULL;
+   struct tracker_ring* ring = NULL;
    struct main_configuration* config;
 
    config = (struct main_configuration*)shmem;
 
-   if (config->tracker)
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   if (config->tracker_events <= 0)
+   {
+      return 0;
+   }
+
+   while (size < (uint64_t)config->tracker_events)
    {
-      struct timeval t;
-      long long milliseconds;
+      size <<= 1;
+   }
 
-      gettimeofday(&t, NULL);
-      milliseconds = t.tv_sec * 1000 + t.tv_usec / 1000;
+   tmp_p_size = sizeof(struct tracker_ring) + size * sizeof(struct tracker_event);
+   if (pgagroal_create_shared_memory(tmp_p_size, config->common.hugepage, &tmp_p_shmem))
+   {
+      goto error;
+   }
 
-      if (username == NULL)
-      {
-         username = "";
-      }
+   memset(tmp_p_shmem, 0, tmp_p_size);
 
-      if (database == NULL)
-      {
-         database = "";
-      }
+   ring = (struct tracker_ring*)tmp_p_shmem;
+   atomic_init(&ring->head, 0);
+   ring->size = size;
+
+   for (uint64_t i = 0; i < size; i++)
+   {
+      atomic_init(&ring->events[i].sequence, 0);
+   }
+
+   *p_size = tmp_p_size;
+   *p_shmem = tmp_p_shmem;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+void
+pgagroal_tracking_event_basic(int id, char* username, char* database)
+{
+   int primary;
+   uint64_t position;
+   struct tracker_event* event = NULL;
+   struct main_configuration* config;
 
+   config = (struct main_configuration*)shmem;
+
+   if (config->tracker && tracker_shmem != NULL)
+   {
       pgagroal_get_primary(&primary);
 
-      pgagroal_log_info("PGAGROAL|%d|%d|%d|%lld|%d|%s|%s|%s|%d|%d|%d|%d|%d|%d|%d|%d|",
-                        id,
-                        -1,
-                        -3,
-                        milliseconds,
-                        getpid(),
-                        username,
-                        database,
-                        "",
-                        -1,
-                        primary,
-                        -1,
-                        -3,
-                        -1,
-                        -1,
-                        atomic_load(&config->active_connections),
-                        count_connections());
+      event = event_begin(id, &position);
+
+      event->slot = -1;
+      event->state = -3;
+      event->socket = -1;
+      event->server = primary;
+      event->new = -1;
+      event->tx_mode = -1;
+      event->has_security = -3;
+      event->limit_rule = -1;
+      event_name(event->username, username, sizeof(event->username));
+      event_name(event->database, database, sizeof(event->database));
+      event_name(event->appname, NULL, sizeof(event->appname));
+
+      event_end(event, position);
    }
 }
 
 void
 pgagroal_tracking_event_slot(int id, int slot)
 {
+   uint64_t position;
+   struct tracker_event* event = NULL;
    struct main_configuration* config;
 
    config = (struct main_configuration*)shmem;
 
-   if (config->tracker)
+   if (config->tracker && tracker_shmem != NULL)
    {
-      char* username = NULL;
-      char* database = NULL;
-      char* appname = NULL;
-      struct timeval t;
-      long long milliseconds;
+      event = event_begin(id, &position);
 
-      gettimeofday(&t, NULL);
-      milliseconds = t.tv_sec * 1000 + t.tv_usec / 1000;
+      event->slot = slot;
 
       if (slot != -1)
       {
-         username = &config->connections[slot].username[0];
-         database = &config->connections[slot].database[0];
-         appname = &config->connections[slot].appname[0];
+         event->state = atomic_load(&config->states[slot]);
+         event->socket = config->connections[slot].fd;
+         event->server = config->connections[slot].server;
+         event->new = config->connections[slot].new;
+         event->tx_mode = config->connections[slot].tx_mode;
+         event->has_security = config->connections[slot].has_security;
+         event->limit_rule = config->connections[slot].limit_rule;
+         event_name(event->username, config->connections[slot].username, sizeof(event->username));
+         event_name(event->database, config->connections[slot].database, sizeof(event->database));
+         event_name(event->appname, config->connections[slot].appname, sizeof(event->appname));
       }
       else
       {
-         username = "";
-         database = "";
-         appname = "";
+         event->state = -3;
+         event->socket = -1;
+         event->server = -1;
+         event->new = -1;
+         event->tx_mode = -1;
+         event->has_security = -3;
+         event->limit_rule = -1;
+         event_name(event->username, NULL, sizeof(event->username));
+         event_name(event->database, NULL, sizeof(event->database));
+         event_name(event->appname, NULL, sizeof(event->appname));
       }
 
-      pgagroal_log_info("PGAGROAL|%d|%d|%d|%lld|%d|%s|%s|%s|%d|%d|%d|%d|%d|%d|%d|%d|",
-                        id,
-                        slot,
-                        atomic_load(&config->states[slot]),
-                        milliseconds,
-                        getpid(),
-                        username,
-                        database,
-                        appname,
-                        config->connections[slot].new,
-                        config->connections[slot].server,
-                        config->connections[slot].tx_mode,
-                        config->connections[slot].has_security,
-                        config->connections[slot].limit_rule,
-                        config->connections[slot].fd,
-                        atomic_load(&config->active_connections),
-                        count_connections());
+      event_end(event, position);
    }
 }
 
 void
 pgagroal_tracking_event_socket(int id, int socket)
 {
+   uint64_t position;
+   struct tracker_event* event = NULL;
    struct main_configuration* config;
 
    config = (struct main_configuration*)shmem;
 
-   if (config->tracker)
+   if (config->tracker && tracker_shmem != NULL)
    {
-      struct timeval t;
-      long long milliseconds;
+      event = event_begin(id, &position);
 
-      gettimeofday(&t, NULL);
-      milliseconds = t.tv_sec * 1000 + t.tv_usec / 1000;
+      event->slot = -1;
+      event->state = -3;
+      event->socket = socket;
+      event->server = -1;
+      event->new = -1;
+      event->tx_mode = -1;
+      event->has_security = -3;
+      event->limit_rule = -1;
+      event_name(event->username, NULL, sizeof(event->username));
+      event_name(event->database, NULL, sizeof(event->database));
+      event_name(event->appname, NULL, sizeof(event->appname));
 
-      pgagroal_log_info("PGAGROAL|%d|%lld|%d|%d|",
-                        id,
-                        milliseconds,
-                        getpid(),
-                        socket);
+      event_end(event, position);
    }
 }
 
-static int
-count_connections(void)
+void
+pgagroal_tracker_dump(SSL* ssl __attribute__((unused)), int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
 {
-   int active = 0;
-   struct main_configuration* config;
+   char* elapsed = NULL;
+   time_t start_time;
+   time_t end_time;
+   int total_seconds;
+   uint64_t head;
+   uint64_t start;
+   struct tracker_ring* ring = NULL;
+   struct tracker_event event;
+   struct json* response = NULL;
+   struct json* events = NULL;
+   struct json* js = NULL;
 
-   config = (struct main_configuration*)shmem;
+   pgagroal_memory_init();
+   pgagroal_start_logging();
+
+   start_time = time(NULL);
+
+   if (tracker_shmem == NULL)
+   {
+      pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_TRACKER_DISABLED, compression, encryption, payload);
+      pgagroal_log_error("Tracker: No tracker events (%d)", MANAGEMENT_ERROR_TRACKER_DISABLED);
+
+      goto error;
+   }
+
+   if (pgagroal_management_create_response(payload, -1, &response))
+   {
+      goto error;
+   }
+
+   if (pgagroal_json_create(&events))
+   {
+      goto error;
+   }
+
+   ring = (struct tracker_ring*)tracker_shmem;
+
+   /* The oldest events may be overwritten while they are read, and are skipped */
+   head = atomic_load(&ring->head);
+   start = head > ring->size ? head - ring->size : 0;
 
-   for (int i = 0; i < config->max_connections; i++)
+   for (uint64_t position = start; position < head; position++)
    {
-      int state = atomic_load(&config->states[i]);
-      switch (state)
+      if (!pgagroal_tracker_event_read(ring, position, &event))
       {
-         case STATE_IN_USE:
-         case STATE_GRACEFULLY:
-            active++;
-         default:
-            break;
+         continue;
       }
+
+      if (pgagroal_json_create(&js))
+      {
+         goto error;
+      }
+
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_EVENT, (uintptr_t)event_id(event.id), ValueString);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_TIMESTAMP, (uintptr_t)event.timestamp, ValueInt64);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_PID, (uintptr_t)event.pid, ValueInt32);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_SLOT, (uintptr_t)event.slot, ValueInt32);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_STATE, (uintptr_t)event.state, ValueInt8);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_USERNAME, (uintptr_t)event.username, ValueString);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_DATABASE, (uintptr_t)event.database, ValueString);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_APPNAME, (uintptr_t)event.appname, ValueString);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_NEW, (uintptr_t)event.new, ValueInt8);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)event.server, ValueInt32);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_TX_MODE, (uintptr_t)event.tx_mode, ValueInt8);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_SECURITY, (uintptr_t)event.has_security, ValueInt8);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_LIMIT_RULE, (uintptr_t)event.limit_rule, ValueInt16);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_SOCKET, (uintptr_t)event.socket, ValueInt32);
+      pgagroal_json_put(js, MANAGEMENT_ARGUMENT_ACTIVE_CONNECTIONS, (uintptr_t)event.active_connections, ValueInt32);
+
+      pgagroal_json_append(events, (uintptr_t)js, ValueJSON);
+      js = NULL;
    }
 
-   return active;
+   pgagroal_json_put(response, MANAGEMENT_ARGUMENT_EVENTS, (uintptr_t)events, ValueJSON);
+   events = NULL;
+
+   end_time = time(NULL);
+
+   if (pgagroal_management_response_ok(NULL, client_fd, start_time, end_time, compression, encryption, payload))
+   {
+      pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_TRACKER_NETWORK, compression, encryption, payload);
+      pgagroal_log_error("Tracker: Error sending response");
+
+      goto error;
+   }
+
+   elapsed = pgagroal_get_timestamp_string(start_time, end_time, &total_seconds);
+
+   pgagroal_log_info("Tracker (Elapsed: %s)", elapsed);
+
+   free(elapsed);
+
+   pgagroal_json_destroy(payload);
+
+   pgagroal_disconnect(client_fd);
+
+   pgagroal_stop_logging();
+   pgagroal_memory_destroy();
+
+   exit(0);
+
+error:
+
+   pgagroal_json_destroy(js);
+   pgagroal_json_destroy(events);
+   pgagroal_json_destroy(payload);
+
+   pgagroal_disconnect(client_fd);
+
+   pgagroal_stop_logging();
+   pgagroal_memory_destroy();
+
+   exit(1);
+}
+
+static struct tracker_event*
+event_begin(int id, uint64_t* position)
+{
+   struct timeval t;
+   struct tracker_ring* ring = NULL;
+   struct tracker_event* event = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   ring = (struct tracker_ring*)tracker_shmem;
+
+   *position = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+   event = &ring->events[*position & (ring->size - 1)];
+
+   /* Readers skip the event until its sequence is published */
+   atomic_store_explicit(&event->sequence, 0, memory_order_relaxed);
+   atomic_thread_fence(memory_order_release);
+
+   gettimeofday(&t, NULL);
+
+   event->timestamp = (int64_t)t.tv_sec * 1000000 + t.tv_usec;
+   event->pid = getpid();
+   event->id = id;
+   event->active_connections = atomic_load_explicit(&config->active_connections, memory_order_relaxed);
+
+   return event;
+}
+
+static void
+event_end(struct tracker_event* event, uint64_t position)
+{
+   atomic_store_explicit(&event->sequence, position + 1, memory_order_release);
+}
+
+static void
+event_name(char* to, char* from, size_t size)
+{
+   size_t length = 0;
+
+   if (from != NULL)
+   {
+      length = strnlen(from, size - 1);
+      memcpy(to, from, length);
+   }
+
+   to[length] = '\0';
+}
+
+bool
+pgagroal_tracker_event_read(struct tracker_ring* ring, uint64_t position, struct tracker_event* event)
+{
+   uint64_t sequence;
+   struct tracker_event* e = NULL;
+
+   e = &ring->events[position & (ring->size - 1)];
+
+   sequence = atomic_load_explicit(&e->sequence, memory_order_acquire);
+   if (sequence != position + 1)
+   {
+      return false;
+   }
+
+   memcpy((char*)event + offsetof(struct tracker_event, timestamp),
+          (char*)e + offsetof(struct tracker_event, timestamp),
+          sizeof(struct tracker_event) - offsetof(struct tracker_event, timestamp));
+
+   atomic_thread_fence(memory_order_acquire);
+
+   if (atomic_load_explicit(&e->sequence, memory_order_relaxed) != sequence)
+   {
+      return false;
+   }
+
+   event->username[sizeof(event->username) - 1] = '\0';
+   event->database[sizeof(event->database) - 1] = '\0';
+   event->appname[sizeof(event->appname) - 1] = '\0';
+
+   return true;
+}
+
+static char*
+event_id(int id)
+{
+   switch (id)
+   {
+      case TRACKER_CLIENT_START:
+         return "ClientStart";
+      case TRACKER_CLIENT_STOP:
+         return "ClientStop";
+      case TRACKER_GET_CONNECTION_SUCCESS:
+         return "GetConnectionSuccess";
+      case TRACKER_GET_CONNECTION_TIMEOUT:
+         return "GetConnectionTimeout";
+      case TRACKER_GET_CONNECTION_ERROR:
+         return "GetConnectionError";
+      case TRACKER_RETURN_CONNECTION_SUCCESS:
+         return "ReturnConnectionSuccess";
+      case TRACKER_RETURN_CONNECTION_KILL:
+         return "ReturnConnectionKill";
+      case TRACKER_KILL_CONNECTION:
+         return "KillConnection";
+      case TRACKER_AUTHENTICATE:
+         return "Authenticate";
+      case TRACKER_BAD_CONNECTION:
+         return "BadConnection";
+      case TRACKER_IDLE_TIMEOUT:
+         return "IdleTimeout";
+      case TRACKER_MAX_CONNECTION_AGE:
+         return "MaxConnectionAge";
+      case TRACKER_INVALID_CONNECTION:
+         return "InvalidConnection";
+      case TRACKER_FLUSH:
+         return "Flush";
+      case TRACKER_REMOVE_CONNECTION:
+         return "RemoveConnection";
+      case TRACKER_PREFILL:
+         return "Prefill";
+      case TRACKER_PREFILL_RETURN:
+         return "PrefillReturn";
+      case TRACKER_PREFILL_KILL:
+         return "PrefillKill";
+      case TRACKER_WORKER_RETURN1:
+         return "WorkerReturn1";
+      case TRACKER_WORKER_RETURN2:
+         return "WorkerReturn2";
+      case TRACKER_WORKER_KILL1:
+         return "WorkerKill1";
+      case TRACKER_WORKER_KILL2:
+         return "WorkerKill2";
+      case TRACKER_TX_RETURN_CONNECTION_START:
+         return "TxReturnConnectionStart";
+      case TRACKER_TX_RETURN_CONNECTION_STOP:
+         return "TxReturnConnectionStop";
+      case TRACKER_TX_GET_CONNECTION:
+         return "TxGetConnection";
+      case TRACKER_TX_RETURN_CONNECTION:
+         return "TxReturnConnection";
+      case TRACKER_SOCKET_ASSOCIATE_CLIENT:
+         return "SocketAssociateClient";
+      case TRACKER_SOCKET_ASSOCIATE_SERVER:
+         return "SocketAssociateServer";
+      case TRACKER_SOCKET_DISASSOCIATE_CLIENT:
+         return "SocketDisassociateClient";
+      case TRACKER_SOCKET_DISASSOCIATE_SERVER:
+         return "SocketDisassociateServer";
+      default:
+         return "Unknown";
+   }
 }
@@ -42,6 +42,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 #include <openssl/pem.h>
 #include <sys/types.h>
@@ -475,6 +476,16 @@ pgagroal_swap(unsigned int i)
           ((i >> 24) & 0x000000ff);
 }
 
+uint64_t
+pgagroal_monotonic_us(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
 char*
 pgagroal_get_timestamp_string(time_t start_time, time_t end_time, int32_t* seconds)
 {
@@ -72,6 +72,7 @@ pgagroal_worker(int client_fd, char* address, char** argv)
    SSL* server_ssl = NULL;
 
    pgagroal_start_logging();
+   pgagroal_prometheus_shard_select();
    pgagroal_memory_init();
 
    config = (struct main_configuration*)shmem;
@@ -97,14 +98,17 @@ pgagroal_worker(int client_fd, char* address, char** argv)
 
       pgagroal_tracking_event_socket(TRACKER_SOCKET_ASSOCIATE_SERVER, config->connections[slot].fd);
 
+      pgagroal_log_context(slot, config->connections[slot].username, config->connections[slot].database);
+
       if (config->common.log_connections)
       {
-         pgagroal_log_info("connect: user=%s database=%s address=%s", config->connections[slot].username,
-                           config->connections[slot].database, address);
+         pgagroal_log_event_info("connect", -1, "connect: user=%s database=%s address=%s", config->connections[slot].username,
+                                 config->connections[slot].database, address);
       }
 
       pgagroal_prometheus_client_wait_sub();
       pgagroal_prometheus_client_active_add();
+      pgagroal_prometheus_traffic_select(config->connections[slot].database, config->connections[slot].username);
 
       pgagroal_pool_status();
 
@@ -161,6 +165,7 @@ pgagroal_worker(int client_fd, char* address, char** argv)
          server_io.io.ssl = (server_ssl != NULL);
       }
 
+      pgagroal_event_set_context(PGAGROAL_CONTEXT_WORKER);
       loop = pgagroal_event_loop_init();
       if (!loop)
       {
@@ -190,12 +195,13 @@ pgagroal_worker(int client_fd, char* address, char** argv)
       }
 
       pgagroal_prometheus_client_active_sub();
+      pgagroal_prometheus_traffic_flush();
    }
    else
    {
       if (config->common.log_connections)
       {
-         pgagroal_log_info("connect: address=%s", address);
+         pgagroal_log_event_info("connect", -1, "connect: address=%s", address);
       }
       pgagroal_prometheus_client_wait_sub();
    }
@@ -204,12 +210,13 @@ pgagroal_worker(int client_fd, char* address, char** argv)
    {
       if (auth_status == AUTH_SUCCESS)
       {
-         pgagroal_log_info("disconnect: user=%s database=%s address=%s", config->connections[slot].username,
-                           config->connections[slot].database, address);
+         pgagroal_log_event_info("disconnect", (int64_t)(time(NULL) - start_time) * 1000,
+                                 "disconnect: user=%s database=%s address=%s", config->connections[slot].username,
+                                 config->connections[slot].database, address);
       }
       else
       {
-         pgagroal_log_info("disconnect: address=%s", address);
+         pgagroal_log_event_info("disconnect", (int64_t)(time(NULL) - start_time) * 1000, "disconnect: address=%s", address);
       }
    }
 
@@ -219,6 +226,11 @@ pgagroal_worker(int client_fd, char* address, char** argv)
       if (started)
       {
          p.stop(loop, &client_io);
+         if (config->pipeline == PIPELINE_TRANSACTION)
+         {
+            /* The backend TLS state follows the slot between transactions */
+            server_ssl = client_io.server_ssl;
+         }
          pgagroal_prometheus_session_time(difftime(time(NULL), start_time));
          pgagroal_event_loop_destroy();
       }
@@ -112,3 +112,102 @@ pgagroal_zstdd_string(unsigned char* compressed_buffer, size_t compressed_size,
 
    return 0;
 }
+
+int
+pgagroal_zstdc_stream_create(void** stream)
+{
+   ZSTD_CCtx* cctx = NULL;
+
+   *stream = NULL;
+
+   cctx = ZSTD_createCCtx();
+   if (cctx == NULL)
+   {
+      pgagroal_log_error("ZSTD: Allocation failed");
+      return 1;
+   }
+
+   ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 1);
+
+   *stream = cctx;
+
+   return 0;
+}
+
+int
+pgagroal_zstdc_stream(void* stream, void* data, size_t length, bool finish, unsigned char** buffer, size_t* buffer_size)
+{
+   size_t chunk_size;
+   size_t total_out = 0;
+   size_t remaining;
+   unsigned char* temp_buffer;
+   ZSTD_inBuffer input;
+   ZSTD_outBuffer output;
+
+   *buffer = NULL;
+   *buffer_size = 0;
+
+   chunk_size = ZSTD_CStreamOutSize();
+
+   temp_buffer = (unsigned char*)malloc(chunk_size);
+   if (temp_buffer == NULL)
+   {
+      pgagroal_log_error("ZSTD: Allocation failed");
+      return 1;
+   }
+
+   input.src = data;
+   input.size = length;
+   input.pos = 0;
+
+   do
+   {
+      if (total_out >= chunk_size)
+      {
+         chunk_size *= 2;
+         unsigned char* new_buffer = (unsigned char*)realloc(temp_buffer, chunk_size);
+         if (new_buffer == NULL)
+         {
+            free(temp_buffer);
+            pgagroal_log_error("ZSTD: Allocation failed");
+            return 1;
+         }
+         temp_buffer = new_buffer;
+      }
+
+      output.dst = temp_buffer + total_out;
+      output.size = chunk_size - total_out;
+      output.pos = 0;
+
+      remaining = ZSTD_compressStream2((ZSTD_CCtx*)stream, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+      if (ZSTD_isError(remaining))
+      {
+         free(temp_buffer);
+         pgagroal_log_error("ZSTD: Compression error: %s", ZSTD_getErrorName(remaining));
+         return 1;
+      }
+
+      total_out += output.pos;
+   }
+   while (finish ? remaining != 0 : input.pos < input.size);
+
+   if (total_out == 0)
+   {
+      free(temp_buffer);
+      return 0;
+   }
+
+   *buffer = temp_buffer;
+   *buffer_size = total_out;
+
+   return 0;
+}
+
+void
+pgagroal_zstdc_stream_destroy(void* stream)
+{
+   if (stream != NULL)
+   {
+      ZSTD_freeCCtx((ZSTD_CCtx*)stream);
+   }
+}
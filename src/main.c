@@ -41,12 +41,14 @@
 #include <pipeline.h>
 #include <pool.h>
 #include <prometheus.h>
+#include <recorder.h>
 #include <remote.h>
 #include <security.h>
 #include <server.h>
 #include <shmem.h>
 #include <status.h>
 #include <tls.h>
+#include <tracker.h>
 #include <utils.h>
 #include <worker.h>
 
@@ -62,6 +64,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -74,13 +77,23 @@
 #include <systemd/sd-daemon.h>
 #endif
 
-#define MAX_FDS        64
-#define SIGNALS_NUMBER 8
+#define MAX_FDS              64
+#define SIGNALS_NUMBER       8
+#define TLS_REFRESH_INTERVAL 60000
+
+#define PENDING_CLIENT_HEADER     0
+#define PENDING_CLIENT_PACKET     1
+#define PENDING_CLIENT_INTERVAL   1000
+#define MAX_STARTUP_PACKET_LENGTH 10000
+#define METRICS_RESTART_DELAY     1
+#define METRICS_RESTART_MAX       60
+#define METRICS_STOP_TIMEOUT      2
+#define METRICS_INTERVAL          1000
+#define LOG_WRITER_RESTART_DELAY  1
 
 static void accept_main_cb(struct io_watcher* watcher);
 static void accept_mgt_cb(struct io_watcher* watcher);
 static void accept_transfer_cb(struct io_watcher* watcher);
-static void accept_metrics_cb(struct io_watcher* watcher);
 static void accept_console_cb(struct io_watcher* watcher);
 static void accept_management_cb(struct io_watcher* watcher);
 static void shutdown_cb(void);
@@ -96,12 +109,23 @@ static void validation_cb(void);
 static void disconnect_client_cb(void);
 static void shutdown_timeout_cb(void);
 static void flush_alarm_cb(void);
+static void dns_refresh_cb(void);
+static void tls_refresh_cb(void);
+static void pending_clients_cb(void);
+static void metrics_cb(void);
+static void pending_client_cb(struct io_watcher* watcher);
+static bool hold_client(int client_fd, char* address, char** argv);
+static void release_pending_client(struct pending_client* pc);
+static void drop_pending_client(struct pending_client* pc);
+static void close_pending_clients(bool drop);
+static void start_client(int client_fd, char* address, char** argv);
 static void arm_flush_timeout(int64_t seconds, const char* database);
 static void rearm_flush_alarm(void);
 static void frontend_user_password_startup(struct main_configuration* config);
 static bool accept_fatal(int error);
 static void add_client(pid_t pid);
 static void remove_client(pid_t pid);
+static bool any_server_tls(void);
 static void refresh_periodic_watchers(void);
 static void start_periodic_watcher(struct periodic_watcher* watcher, bool* started, periodic_cb cb, int64_t timeout_ms, int64_t repeat_ms);
 static void stop_periodic_watcher(struct periodic_watcher* watcher, bool* started);
@@ -123,9 +147,18 @@ static int main_fds_length = -1;
 static int unix_management_socket = -1;
 static int unix_transfer_socket = -1;
 static int unix_pgsql_socket = -1;
-static struct accept_io io_metrics[MAX_FDS];
 static int* metrics_fds = NULL;
 static int metrics_fds_length = -1;
+static pid_t metrics_pid = 0;
+static time_t metrics_started = 0;
+static pid_t metrics_stopping_pid = 0;
+static time_t metrics_stopping_since = 0;
+static time_t metrics_backoff = 0;
+static time_t metrics_retry_at = 0;
+static int metrics_retry_status = 0;
+static char* metrics_tls = NULL;
+static pid_t log_writer_pid = 0;
+static time_t log_writer_started = 0;
 static struct accept_io io_console[MAX_FDS];
 static int* console_fds = NULL;
 static int console_fds_length = -1;
@@ -143,6 +176,11 @@ static struct periodic_watcher disconnect_client_watcher;
 static struct periodic_watcher rotate_frontend_password_watcher;
 static struct periodic_watcher shutdown_timeout_watcher;
 static struct periodic_watcher flush_alarm;
+static struct periodic_watcher dns_refresh_watcher;
+static struct periodic_watcher tls_refresh_watcher;
+static struct periodic_watcher pending_clients_watcher;
+static struct periodic_watcher metrics_watcher;
+static struct pending_client pending_clients[MAX_PENDING_CLIENTS];
 static struct flush_timeout_slot flush_timeouts[NUMBER_OF_LIMITS];
 static bool idle_timeout_started = false;
 static bool max_connection_age_started = false;
@@ -151,6 +189,10 @@ static bool disconnect_client_started = false;
 static bool rotate_frontend_password_started = false;
 static bool shutdown_timeout_started = false;
 static bool flush_alarm_started = false;
+static bool dns_refresh_started = false;
+static bool tls_refresh_started = false;
+static bool pending_clients_started = false;
+static bool metrics_watcher_started = false;
 
 static void
 start_mgt(void)
@@ -262,31 +304,6 @@ shutdown_io(void)
    }
 }
 
-static void
-start_metrics(void)
-{
-   for (int i = 0; i < metrics_fds_length; i++)
-   {
-      int sockfd = *(metrics_fds + i);
-
-      memset(&io_metrics[i], 0, sizeof(struct accept_io));
-      pgagroal_event_accept_init(&io_metrics[i].watcher, sockfd, accept_metrics_cb);
-      io_metrics[i].socket = sockfd;
-      io_metrics[i].argv = argv_ptr;
-      pgagroal_io_start(&io_metrics[i].watcher);
-   }
-}
-
-static void
-shutdown_metrics(void)
-{
-   for (int i = 0; i < metrics_fds_length; i++)
-   {
-      pgagroal_disconnect(io_metrics[i].socket);
-      errno = 0;
-   }
-}
-
 static void
 start_management(void)
 {
@@ -337,6 +354,298 @@ shutdown_console(void)
    }
 }
 
+static void
+shutdown_metrics(void)
+{
+   for (int i = 0; i < metrics_fds_length; i++)
+   {
+      pgagroal_disconnect(*(metrics_fds + i));
+      errno = 0;
+   }
+}
+
+/**
+ * The metrics TLS files, and when they were last changed
+ * @return The description, which the caller frees
+ */
+static char*
+metrics_tls_files(void)
+{
+   char* files[3];
+   char* description = NULL;
+   struct stat st;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   files[0] = config->common.metrics_cert_file;
+   files[1] = config->common.metrics_key_file;
+   files[2] = config->common.metrics_ca_file;
+
+   for (int i = 0; i < 3; i++)
+   {
+      long long mtime = 0;
+
+      if (strlen(files[i]) > 0 && stat(files[i], &st) == 0)
+      {
+         mtime = (long long)st.st_mtime;
+      }
+
+      description = pgagroal_format_and_append(description, "%s:%lld;", files[i], mtime);
+   }
+
+   return description;
+}
+
+static void
+start_metrics(void)
+{
+   pid_t pid;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   metrics_retry_at = 0;
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgagroal_log_error("Unable to fork metrics process");
+      return;
+   }
+   else if (pid == 0)
+   {
+      /* The worker keeps the metrics descriptors, and lets go of the others */
+      pgagroal_event_loop_fork();
+      shutdown_uds(false);
+      close_pending_clients(false);
+      if (config->management > 0)
+      {
+         shutdown_management(false);
+      }
+      if (config->console > 0)
+      {
+         shutdown_console();
+      }
+
+      pgagroal_set_proc_title(main_argc, main_argv, "metrics worker", NULL);
+      pgagroal_prometheus_worker(metrics_fds, metrics_fds_length);
+   }
+
+   metrics_pid = pid;
+   metrics_started = time(NULL);
+
+   /* The worker holds the TLS context of these files */
+   free(metrics_tls);
+   metrics_tls = metrics_tls_files();
+}
+
+static void
+stop_metrics(void)
+{
+   pid_t pid = metrics_pid;
+
+   metrics_retry_at = 0;
+
+   if (pid == 0)
+   {
+      return;
+   }
+
+   metrics_pid = 0;
+
+   /* Only one worker is left to finish its scrape */
+   if (metrics_stopping_pid != 0)
+   {
+      kill(metrics_stopping_pid, SIGKILL);
+   }
+
+   /* A scrape in progress is allowed to finish, sigchld_cb reaps the worker
+    * and metrics_cb kills it if it is still there after METRICS_STOP_TIMEOUT */
+   kill(pid, SIGTERM);
+
+   metrics_stopping_pid = pid;
+   metrics_stopping_since = time(NULL);
+}
+
+static void
+restart_metrics(void)
+{
+   char* files = NULL;
+
+   if (metrics_fds_length <= 0 || (metrics_pid == 0 && metrics_retry_at == 0))
+   {
+      return;
+   }
+
+   /* The worker reads the other metrics settings from the shared memory */
+   files = metrics_tls_files();
+   if (metrics_tls == NULL || strcmp(files, metrics_tls))
+   {
+      pgagroal_log_info("pgagroal: Metrics TLS files changed, restarting the metrics worker");
+      stop_metrics();
+      start_metrics();
+   }
+   free(files);
+}
+
+static void
+respawn_metrics(int status)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+   {
+      pgagroal_log_warn("Restarting metrics port");
+
+      shutdown_metrics();
+
+      free(metrics_fds);
+      metrics_fds = NULL;
+      metrics_fds_length = 0;
+
+      if (pgagroal_bind(config->common.host, config->common.metrics, &metrics_fds, &metrics_fds_length, config->nodelay, config->backlog))
+      {
+         pgagroal_log_fatal("pgagroal: Could not bind to %s:%d", config->common.host, config->common.metrics);
+         exit(1);
+      }
+
+      if (metrics_fds_length > MAX_FDS)
+      {
+         pgagroal_log_fatal("pgagroal: Too many descriptors %d", metrics_fds_length);
+         exit(1);
+      }
+
+      for (int i = 0; i < metrics_fds_length; i++)
+      {
+         pgagroal_log_debug("Metrics: %d", *(metrics_fds + i));
+      }
+   }
+   else
+   {
+      pgagroal_log_warn("pgagroal: Metrics worker stopped (%d), restarting", status);
+   }
+
+   start_metrics();
+}
+
+static void
+metrics_exited(int status)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (!config->keep_running || config->common.metrics <= 0)
+   {
+      return;
+   }
+
+   if (time(NULL) - metrics_started < METRICS_RESTART_DELAY)
+   {
+      /* metrics_cb tries again, waiting longer after each failure */
+      metrics_backoff = MIN(metrics_backoff > 0 ? 2 * metrics_backoff : METRICS_RESTART_DELAY, METRICS_RESTART_MAX);
+      metrics_retry_at = time(NULL) + metrics_backoff;
+      metrics_retry_status = status;
+
+      pgagroal_log_error("pgagroal: Metrics worker failed at startup (%d), restarting in %lld seconds", status, (long long)metrics_backoff);
+      return;
+   }
+
+   metrics_backoff = 0;
+
+   respawn_metrics(status);
+}
+
+static void
+start_log_writer(void)
+{
+   pid_t pid;
+
+   if (log_shmem == NULL)
+   {
+      return;
+   }
+
+   /* Lines queued from now on are written when the log writer starts */
+   pgagroal_log_queue_enable(true);
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgagroal_log_queue_enable(false);
+      pgagroal_log_error("Unable to fork log writer process");
+      return;
+   }
+   else if (pid == 0)
+   {
+      pgagroal_event_loop_fork();
+      shutdown_ports(false);
+
+      pgagroal_set_proc_title(main_argc, main_argv, "log writer", NULL);
+      pgagroal_log_writer();
+   }
+
+   log_writer_pid = pid;
+   log_writer_started = time(NULL);
+}
+
+static void
+stop_log_writer(void)
+{
+   pid_t pid = log_writer_pid;
+
+   if (pid == 0)
+   {
+      return;
+   }
+
+   log_writer_pid = 0;
+
+   /* The log writer exits once the queues are empty */
+   pgagroal_log_queue_enable(false);
+
+   for (int i = 0; i < 10; i++)
+   {
+      if (waitpid(pid, NULL, WNOHANG) != 0)
+      {
+         return;
+      }
+      SLEEP(200000000L);
+   }
+
+   kill(pid, SIGKILL);
+   waitpid(pid, NULL, 0);
+}
+
+static void
+log_writer_exited(int status)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   /* The processes write their lines themselves until a log writer is back */
+   pgagroal_log_queue_enable(false);
+
+   if (!config->keep_running)
+   {
+      return;
+   }
+
+   if (time(NULL) - log_writer_started < LOG_WRITER_RESTART_DELAY)
+   {
+      pgagroal_log_error("pgagroal: Log writer failed at startup (%d), not restarting", status);
+      return;
+   }
+
+   pgagroal_log_warn("pgagroal: Log writer stopped (%d), restarting", status);
+
+   start_log_writer();
+}
+
 static void
 version(void)
 {
@@ -414,6 +723,9 @@ main(int argc, char** argv)
    size_t pipeline_shmem_size = 0;
    size_t prometheus_shmem_size = 0;
    size_t prometheus_cache_shmem_size = 0;
+   size_t tracker_shmem_size = 0;
+   size_t recorder_shmem_size = 0;
+   size_t log_shmem_size = 0;
    size_t tmp_size;
    struct main_configuration* config = NULL;
    int ret;
@@ -1007,6 +1319,14 @@ read_superuser_path:
       }
    }
 
+   if (pgagroal_log_queue_init(&log_shmem_size, &log_shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating and initializing log queue shared memory");
+#endif
+      errx(1, "Error in creating and initializing log queue shared memory");
+   }
+
    if (pgagroal_validate_configuration(shmem, has_unix_socket, has_main_sockets))
    {
 #ifdef HAVE_SYSTEMD
@@ -1015,6 +1335,23 @@ read_superuser_path:
       errx(1, "Invalid configuration");
    }
 
+   /* Sized from the validated configuration */
+   if (pgagroal_tracker_init(&tracker_shmem_size, &tracker_shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating and initializing tracker shared memory");
+#endif
+      errx(1, "Error in creating and initializing tracker shared memory");
+   }
+
+   if (pgagroal_recorder_init(&recorder_shmem_size, &recorder_shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating and initializing flight recorder shared memory");
+#endif
+      errx(1, "Error in creating and initializing flight recorder shared memory");
+   }
+
    frontend_user_password_startup(config);
 
    if (pgagroal_validate_hba_configuration(shmem))
@@ -1193,6 +1530,11 @@ read_superuser_path:
 #endif
       goto error;
    }
+
+   for (int i = 0; i < main_fds_length; i++)
+   {
+      pgagroal_socket_busy_poll(main_fds[i], config->busy_poll);
+   }
    pgagroal_event_set_context(PGAGROAL_CONTEXT_MAIN);
    main_loop = pgagroal_event_loop_init();
    if (!main_loop)
@@ -1218,6 +1560,8 @@ read_superuser_path:
       pgagroal_signal_start(&signal_watcher[i].sig_w);
    }
 
+   start_log_writer();
+
    if (config->pipeline == PIPELINE_PERFORMANCE)
    {
       main_pipeline = performance_pipeline();
@@ -1266,6 +1610,10 @@ read_superuser_path:
       goto error;
    }
 
+   /* Parse the certificates and the HBA entries once; every fork() inherits them */
+   pgagroal_tls_contexts_init();
+   pgagroal_hba_compile();
+
    start_transfer();
    start_mgt();
    start_uds();
@@ -1456,11 +1804,10 @@ read_superuser_path:
    }
    shutdown_console();
 
-   for (int i = 0; i < metrics_fds_length; i++)
-   {
-      pgagroal_io_stop(&io_metrics[i].watcher);
-   }
+   stop_metrics();
    shutdown_metrics();
+   free(metrics_tls);
+   metrics_tls = NULL;
 
    shutdown_mgt(true);
    shutdown_transfer(true);
@@ -1468,6 +1815,7 @@ read_superuser_path:
 
    pgagroal_io_stop(&io_uds.watcher);
    shutdown_uds(true);
+   close_pending_clients(true);
 
    pgagroal_event_loop_destroy();
 
@@ -1479,11 +1827,19 @@ read_superuser_path:
 
    main_pipeline.destroy(pipeline_shmem, pipeline_shmem_size);
 
+   pgagroal_tls_contexts_destroy();
+   pgagroal_hba_destroy();
+
    remove_pidfile();
 
+   stop_log_writer();
+
    pgagroal_stop_logging();
    pgagroal_destroy_shared_memory(prometheus_shmem, prometheus_shmem_size);
    pgagroal_destroy_shared_memory(prometheus_cache_shmem, prometheus_cache_shmem_size);
+   pgagroal_destroy_shared_memory(tracker_shmem, tracker_shmem_size);
+   pgagroal_destroy_shared_memory(recorder_shmem, recorder_shmem_size);
+   pgagroal_destroy_shared_memory(log_shmem, log_shmem_size);
    pgagroal_destroy_shared_memory(shmem, shmem_size);
 
    pgagroal_memory_destroy();
@@ -1503,7 +1859,6 @@ accept_main_cb(struct io_watcher* watcher)
    struct sockaddr_in6 client_addr;
    int client_fd;
    char address[INET6_ADDRSTRLEN];
-   pid_t pid;
    struct accept_io* ai;
    struct main_configuration* config;
 
@@ -1552,6 +1907,11 @@ accept_main_cb(struct io_watcher* watcher)
             exit(1);
          }
 
+         for (int i = 0; i < main_fds_length; i++)
+         {
+            pgagroal_socket_busy_poll(main_fds[i], config->busy_poll);
+         }
+
          if (!fork())
          {
             shutdown_ports(false);
@@ -1586,6 +1946,20 @@ accept_main_cb(struct io_watcher* watcher)
 
    pgagroal_log_trace("accept_main_cb: client address: %s", address);
 
+   /* Wait for the startup packet here rather than in a process of its own */
+   if (hold_client(client_fd, address, ai->argv))
+   {
+      return;
+   }
+
+   start_client(client_fd, address, ai->argv);
+}
+
+static void
+start_client(int client_fd, char* address, char** argv)
+{
+   pid_t pid;
+
    pid = fork();
    if (pid == -1)
    {
@@ -1618,11 +1992,147 @@ accept_main_cb(struct io_watcher* watcher)
       pgagroal_event_loop_fork();
       shutdown_ports(false);
       /* We are leaving the socket descriptor valid such that the client won't reuse it */
-      pgagroal_worker(client_fd, addr, ai->argv);
+      pgagroal_worker(client_fd, addr, argv);
    }
    pgagroal_disconnect(client_fd);
 }
 
+static bool
+hold_client(int client_fd, char* address, char** argv)
+{
+   struct pending_client* pc = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   for (int i = 0; pc == NULL && i < config->max_pending_clients; i++)
+   {
+      if (!pending_clients[i].active)
+      {
+         pc = &pending_clients[i];
+      }
+   }
+
+   if (pc == NULL)
+   {
+      return false;
+   }
+
+   memset(pc, 0, sizeof(struct pending_client));
+   pc->state = PENDING_CLIENT_HEADER;
+   pc->fd = client_fd;
+   pc->argv = argv;
+   pc->deadline = time(NULL) + MAX((time_t)pgagroal_time_convert(config->common.authentication_timeout, FORMAT_TIME_S), 1);
+   memcpy(&pc->address[0], address, MIN(strlen(address), sizeof(pc->address) - 1));
+
+   pgagroal_event_client_init(&pc->watcher, client_fd, pending_client_cb);
+   if (pgagroal_io_start(&pc->watcher))
+   {
+      return false;
+   }
+
+   pc->active = true;
+
+   /* The packet may be here already */
+   pending_client_cb(&pc->watcher);
+
+   return true;
+}
+
+static void
+pending_client_cb(struct io_watcher* watcher)
+{
+   int available = 0;
+   ssize_t n;
+   char header[8];
+   struct pending_client* pc;
+
+   pc = (struct pending_client*)watcher;
+
+   if (!pc->active)
+   {
+      return;
+   }
+
+   if (pc->state == PENDING_CLIENT_HEADER)
+   {
+      n = recv(pc->fd, &header[0], sizeof(header), MSG_PEEK | MSG_DONTWAIT);
+      if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+      {
+         pgagroal_log_debug("pgagroal: %s left before the startup packet", pc->address);
+         drop_pending_client(pc);
+         errno = 0;
+         return;
+      }
+
+      errno = 0;
+
+      if (n < (ssize_t)sizeof(header))
+      {
+         return;
+      }
+
+      pc->length = pgagroal_read_int32(&header[0]);
+      pc->state = PENDING_CLIENT_PACKET;
+   }
+
+   /* A bogus length is left for the worker to refuse */
+   if (pc->length >= (int32_t)sizeof(header) && pc->length <= MAX_STARTUP_PACKET_LENGTH)
+   {
+      if (ioctl(pc->fd, FIONREAD, &available) == 0 && available < pc->length)
+      {
+         return;
+      }
+   }
+
+   release_pending_client(pc);
+}
+
+static void
+release_pending_client(struct pending_client* pc)
+{
+   char address[MAX_ADDRESS_LENGTH];
+
+   memcpy(&address[0], &pc->address[0], sizeof(address));
+
+   pgagroal_io_stop(&pc->watcher);
+   pc->active = false;
+
+   start_client(pc->fd, &address[0], pc->argv);
+}
+
+static void
+drop_pending_client(struct pending_client* pc)
+{
+   pgagroal_io_stop(&pc->watcher);
+   pc->active = false;
+
+   pgagroal_disconnect(pc->fd);
+   pgagroal_prometheus_client_sockets_sub();
+}
+
+static void
+close_pending_clients(bool drop)
+{
+   /* The main process drops them off the client sockets gauge; a fork() just
+    * lets go of the descriptors, as the main process still counts them */
+   for (int i = 0; i < MAX_PENDING_CLIENTS; i++)
+   {
+      if (pending_clients[i].active)
+      {
+         if (drop)
+         {
+            drop_pending_client(&pending_clients[i]);
+         }
+         else
+         {
+            pending_clients[i].active = false;
+            close(pending_clients[i].fd);
+         }
+      }
+   }
+}
+
 static void
 accept_mgt_cb(struct io_watcher* watcher)
 {
@@ -1972,6 +2482,52 @@ accept_mgt_cb(struct io_watcher* watcher)
          pgagroal_status_details(NULL, client_fd, compression, encryption, pyl);
       }
    }
+   else if (id == MANAGEMENT_TRACKER)
+   {
+      pgagroal_log_debug("pgagroal: Management tracker");
+
+      pid = fork();
+      if (pid == -1)
+      {
+         pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_TRACKER_NOFORK, compression, encryption, payload);
+         pgagroal_log_error("Tracker: No fork %s (%d)", NULL, MANAGEMENT_ERROR_TRACKER_NOFORK);
+         goto error;
+      }
+      else if (pid == 0)
+      {
+         struct json* pyl = NULL;
+
+         shutdown_ports(true);
+
+         pgagroal_json_clone(payload, &pyl);
+
+         pgagroal_set_proc_title(1, ai->argv, "tracker", NULL);
+         pgagroal_tracker_dump(NULL, client_fd, compression, encryption, pyl);
+      }
+   }
+   else if (id == MANAGEMENT_FLIGHT_RECORDER)
+   {
+      pgagroal_log_debug("pgagroal: Management flight recorder");
+
+      pid = fork();
+      if (pid == -1)
+      {
+         pgagroal_management_response_error(NULL, client_fd, NULL, MANAGEMENT_ERROR_FLIGHT_RECORDER_NOFORK, compression, encryption, payload);
+         pgagroal_log_error("Flight recorder: No fork %s (%d)", NULL, MANAGEMENT_ERROR_FLIGHT_RECORDER_NOFORK);
+         goto error;
+      }
+      else if (pid == 0)
+      {
+         struct json* pyl = NULL;
+
+         shutdown_ports(true);
+
+         pgagroal_json_clone(payload, &pyl);
+
+         pgagroal_set_proc_title(1, ai->argv, "flight recorder", NULL);
+         pgagroal_recorder_dump(NULL, client_fd, compression, encryption, pyl);
+      }
+   }
    else if (id == MANAGEMENT_PING)
    {
       struct json* response = NULL;
@@ -2072,6 +2628,18 @@ accept_mgt_cb(struct io_watcher* watcher)
 
       pgagroal_management_response_ok(NULL, client_fd, start_time, end_time, compression, encryption, payload);
    }
+   else if (id == MANAGEMENT_CLEAR_AUTH_QUERY)
+   {
+      pgagroal_log_debug("pgagroal: Management clear auth_query");
+
+      start_time = time(NULL);
+
+      pgagroal_auth_query_cache_clear();
+
+      end_time = time(NULL);
+
+      pgagroal_management_response_ok(NULL, client_fd, start_time, end_time, compression, encryption, payload);
+   }
    else if (id == MANAGEMENT_SWITCH_TO)
    {
       pgagroal_log_debug("pgagroal: Management switch to");
@@ -2489,94 +3057,6 @@ error:
    pgagroal_prometheus_self_sockets_sub();
 }
 
-static void
-accept_metrics_cb(struct io_watcher* watcher)
-{
-   int client_fd;
-   struct main_configuration* config;
-   SSL_CTX* ctx = NULL;
-   SSL* client_ssl = NULL;
-
-   config = (struct main_configuration*)shmem;
-
-   errno = 0;
-
-   client_fd = watcher->fds.main.client_fd;
-
-   pgagroal_prometheus_self_sockets_add();
-
-   if (client_fd == -1)
-   {
-      if (accept_fatal(errno) && config->keep_running)
-      {
-         pgagroal_log_warn("Restarting listening port due to: %s (%d)", strerror(errno), client_fd);
-
-         for (int i = 0; i < metrics_fds_length; i++)
-         {
-            pgagroal_io_stop(&io_metrics[i].watcher);
-         }
-         shutdown_metrics();
-
-         free(metrics_fds);
-         metrics_fds = NULL;
-         metrics_fds_length = 0;
-
-         if (pgagroal_bind(config->common.host, config->common.metrics, &metrics_fds, &metrics_fds_length, config->nodelay, config->backlog))
-         {
-            pgagroal_log_fatal("pgagroal: Could not bind to %s:%d", config->common.host, config->common.metrics);
-            exit(1);
-         }
-
-         if (metrics_fds_length > MAX_FDS)
-         {
-            pgagroal_log_fatal("pgagroal: Too many descriptors %d", metrics_fds_length);
-            exit(1);
-         }
-
-         start_metrics();
-
-         for (int i = 0; i < metrics_fds_length; i++)
-         {
-            pgagroal_log_debug("Metrics: %d", *(metrics_fds + i));
-         }
-      }
-      else
-      {
-         pgagroal_log_debug("accept: %s (%d)", strerror(errno), client_fd);
-      }
-      errno = 0;
-      return;
-   }
-
-   if (!fork())
-   {
-      pgagroal_event_loop_fork();
-      shutdown_ports(false);
-      if (strlen(config->common.metrics_cert_file) > 0 && strlen(config->common.metrics_key_file) > 0)
-      {
-         if (pgagroal_create_ssl_ctx(false, &ctx))
-         {
-            pgagroal_log_error("Could not create metrics SSL context");
-            pgagroal_disconnect(client_fd);
-            exit(1);
-         }
-
-         if (pgagroal_create_ssl_server(ctx, config->common.metrics_key_file, config->common.metrics_cert_file, config->common.metrics_ca_file, client_fd, &client_ssl))
-         {
-            pgagroal_log_error("Could not create metrics SSL server");
-            pgagroal_disconnect(client_fd);
-            exit(1);
-         }
-      }
-      /* We are leaving the socket descriptor valid such that the client won't reuse it */
-      pgagroal_prometheus(client_ssl, client_fd);
-   }
-
-   pgagroal_close_ssl(client_ssl);
-   pgagroal_disconnect(client_fd);
-   pgagroal_prometheus_self_sockets_sub();
-}
-
 static void
 accept_management_cb(struct io_watcher* watcher)
 {
@@ -2784,9 +3264,25 @@ coredump_cb(void)
 static void
 sigchld_cb(void)
 {
-   while (waitpid(-1, NULL, WNOHANG) > 0)
+   int status;
+   pid_t pid;
+
+   while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
    {
-      ;
+      if (pid == metrics_pid)
+      {
+         metrics_pid = 0;
+         metrics_exited(status);
+      }
+      else if (pid == metrics_stopping_pid)
+      {
+         metrics_stopping_pid = 0;
+      }
+      else if (pid == log_writer_pid)
+      {
+         log_writer_pid = 0;
+         log_writer_exited(status);
+      }
    }
 }
 
@@ -2838,6 +3334,81 @@ disconnect_client_cb(void)
    }
 }
 
+static void
+dns_refresh_cb(void)
+{
+   /* Resolving may block, so it is always in a fork() */
+   if (!fork())
+   {
+      pgagroal_event_loop_fork();
+      shutdown_ports(false);
+
+      pgagroal_start_logging();
+      pgagroal_resolve_servers();
+      pgagroal_stop_logging();
+
+      exit(0);
+   }
+}
+
+static void
+pending_clients_cb(void)
+{
+   time_t now = time(NULL);
+
+   for (int i = 0; i < MAX_PENDING_CLIENTS; i++)
+   {
+      if (pending_clients[i].active && pending_clients[i].deadline <= now)
+      {
+         pgagroal_log_debug("pgagroal: No startup packet from %s", pending_clients[i].address);
+         drop_pending_client(&pending_clients[i]);
+      }
+   }
+}
+
+static void
+tls_refresh_cb(void)
+{
+   /* The contexts must live in the main process to be inherited */
+   if (pgagroal_tls_contexts_changed())
+   {
+      pgagroal_log_info("pgagroal: TLS files changed, rebuilding the TLS contexts");
+      pgagroal_tls_contexts_init();
+      restart_metrics();
+   }
+}
+
+static void
+metrics_cb(void)
+{
+   time_t now = time(NULL);
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   if (metrics_stopping_pid != 0 && now - metrics_stopping_since >= METRICS_STOP_TIMEOUT)
+   {
+      /* sigchld_cb reaps it */
+      kill(metrics_stopping_pid, SIGKILL);
+      metrics_stopping_pid = 0;
+   }
+
+   if (metrics_pid != 0 && now - metrics_started >= METRICS_RESTART_DELAY)
+   {
+      metrics_backoff = 0;
+   }
+
+   if (metrics_retry_at != 0 && metrics_retry_at <= now)
+   {
+      metrics_retry_at = 0;
+
+      if (config->keep_running && config->common.metrics > 0 && metrics_pid == 0)
+      {
+         respawn_metrics(metrics_retry_status);
+      }
+   }
+}
+
 static void
 shutdown_timeout_cb(void)
 {
@@ -3177,6 +3748,24 @@ rearm_flush_alarm(void)
                           0);
 }
 
+static bool
+any_server_tls(void)
+{
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (config->servers[i].tls)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
 static void
 refresh_periodic_watchers(void)
 {
@@ -3189,6 +3778,10 @@ refresh_periodic_watchers(void)
    stop_periodic_watcher(&validation_watcher, &validation_started);
    stop_periodic_watcher(&disconnect_client_watcher, &disconnect_client_started);
    stop_periodic_watcher(&rotate_frontend_password_watcher, &rotate_frontend_password_started);
+   stop_periodic_watcher(&dns_refresh_watcher, &dns_refresh_started);
+   stop_periodic_watcher(&tls_refresh_watcher, &tls_refresh_started);
+   stop_periodic_watcher(&pending_clients_watcher, &pending_clients_started);
+   stop_periodic_watcher(&metrics_watcher, &metrics_watcher_started);
 
    if (pgagroal_time_is_valid(config->idle_timeout))
    {
@@ -3219,6 +3812,28 @@ refresh_periodic_watchers(void)
       int64_t t = 1000 * pgagroal_time_convert(config->rotate_frontend_password_timeout, FORMAT_TIME_S);
       start_periodic_watcher(&rotate_frontend_password_watcher, &rotate_frontend_password_started, rotate_frontend_password_cb, t, t);
    }
+
+   if (pgagroal_time_is_valid(config->dns_cache_ttl))
+   {
+      /* Refresh well before the entries expire so connects never wait on DNS */
+      int64_t t = 1000 * (int64_t)MAX(1. * pgagroal_time_convert(config->dns_cache_ttl, FORMAT_TIME_S) / 2., 1.);
+      start_periodic_watcher(&dns_refresh_watcher, &dns_refresh_started, dns_refresh_cb, t, t);
+   }
+
+   if (config->common.tls || strlen(config->common.metrics_cert_file) > 0 || any_server_tls())
+   {
+      start_periodic_watcher(&tls_refresh_watcher, &tls_refresh_started, tls_refresh_cb, TLS_REFRESH_INTERVAL, TLS_REFRESH_INTERVAL);
+   }
+
+   if (config->max_pending_clients > 0)
+   {
+      start_periodic_watcher(&pending_clients_watcher, &pending_clients_started, pending_clients_cb, PENDING_CLIENT_INTERVAL, PENDING_CLIENT_INTERVAL);
+   }
+
+   if (config->common.metrics > 0)
+   {
+      start_periodic_watcher(&metrics_watcher, &metrics_watcher_started, metrics_cb, METRICS_INTERVAL, METRICS_INTERVAL);
+   }
 }
 
 static void
@@ -3249,7 +3864,11 @@ reload_configuration(bool* restart)
 
    if (!*restart)
    {
+      pgagroal_tls_contexts_init();
+      pgagroal_hba_compile();
+      pgagroal_auth_query_cache_clear();
       refresh_periodic_watchers();
+      restart_metrics();
 
       if (health_check_changed)
       {
@@ -3319,6 +3938,7 @@ service_reload_cb(void)
    pgagroal_log_debug("pgagroal: service reload requested (SIGUSR1)");
    pgagroal_stop_logging();
    pgagroal_start_logging();
+   pgagroal_hba_compile();
    refresh_periodic_watchers();
 
    /* Check if we need to start or stop workers based on modified shared memory */
@@ -3396,6 +4016,7 @@ shutdown_ports(bool remove)
    config = (struct main_configuration*)shmem;
 
    shutdown_uds(remove);
+   close_pending_clients(false);
 
    if (config->common.metrics > 0)
    {
@@ -0,0 +1,127 @@
+#!/bin/bash
+#
+# Copyright (C) 2026 The pgagroal community
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this list
+# of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice, this
+# list of conditions and the following disclaimer in the documentation and/or other
+# materials provided with the distribution.
+#
+# 3. Neither the name of the copyright holder nor the names of its contributors may
+# be used to endorse or promote products derived from this software without specific
+# prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+# THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+# OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+# TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# Measure the time of a scrape of the metrics endpoint against the size of the
+# pool. For each size pgagroal is started with that max_connections, scraped
+# SCRAPE_COUNT times, and stopped; the median and the largest scrape time are
+# reported together with the size of the response. No backend is needed, as the
+# per-connection series are written for every slot.
+#
+# Usage: scrape_bench.sh <pgagroal_bindir> <out.json>
+# Env: PGA_PORT, METRICS_PORT, SCRAPE_SIZES (default "100 1000 10000"),
+#      SCRAPE_COUNT (default 50), PGAGROAL_RUN_AS (run pgagroal as this user when
+#      current uid is 0).
+
+set -uo pipefail
+
+BINDIR="$(cd "${1:?bindir}" && pwd)"
+OUT="${2:?out.json}"
+
+PGA_PORT="${PGA_PORT:-6432}"
+METRICS_PORT="${METRICS_PORT:-6433}"
+SIZES="${SCRAPE_SIZES:-100 1000 10000}"
+COUNT="${SCRAPE_COUNT:-50}"
+LOG="/tmp/pgagroal-scrape.log"
+
+fail() { echo "SCRAPE BENCH FAILURE: $*" >&2; [ -f "$LOG" ] && sed 's/^/  log| /' "$LOG" >&2; exit 1; }
+
+command -v curl >/dev/null 2>&1 || fail "curl is required"
+
+# pgagroal refuses root; run as PGAGROAL_RUN_AS when we are root, else directly.
+run_pgagroal() {
+   if [ -n "${PGAGROAL_RUN_AS:-}" ] && [ "$(id -u)" = "0" ]; then
+      sudo -u "$PGAGROAL_RUN_AS" env "LD_LIBRARY_PATH=$BINDIR" "$@"
+   else
+      LD_LIBRARY_PATH="$BINDIR" "$@"
+   fi
+}
+
+CFG="$(mktemp -d)"
+chmod 755 "$CFG"
+
+stop_pgagroal() {
+   run_pgagroal "$BINDIR/pgagroal-cli" -c "$CFG/pgagroal.conf" shutdown >/dev/null 2>&1 || true
+   pkill -f "$CFG/pgagroal.conf" 2>/dev/null || true
+   for _ in $(seq 1 10); do curl -s -o /dev/null "http://localhost:$METRICS_PORT/" || break; sleep 1; done
+}
+trap 'stop_pgagroal; rm -rf "$CFG"' EXIT
+
+RESULTS=""
+
+for SIZE in $SIZES; do
+   cat > "$CFG/pgagroal.conf" <<EOF
+[pgagroal]
+host = localhost
+port = $PGA_PORT
+metrics = $METRICS_PORT
+log_type = file
+log_path = $LOG
+log_level = warn
+max_connections = $SIZE
+unix_socket_dir = /tmp/
+
+[primary]
+host = localhost
+port = 5432
+EOF
+   printf 'host all all all all\n' > "$CFG/pgagroal_hba.conf"
+   chmod 644 "$CFG"/*.conf
+
+   rm -f "$LOG" 2>/dev/null || true
+   run_pgagroal "$BINDIR/pgagroal" -c "$CFG/pgagroal.conf" -a "$CFG/pgagroal_hba.conf" -d \
+      || fail "pgagroal failed to launch (max_connections = $SIZE)"
+
+   reachable=0
+   for _ in $(seq 1 30); do
+      if curl -s -o /dev/null "http://localhost:$METRICS_PORT/metrics"; then reachable=1; break; fi
+      sleep 1
+   done
+   [ "$reachable" = "1" ] || fail "metrics endpoint not reachable on port $METRICS_PORT (max_connections = $SIZE)"
+
+   TIMES="$(mktemp)"
+   BYTES=0
+   for _ in $(seq 1 "$COUNT"); do
+      line="$(curl -s -o /dev/null -w '%{time_total} %{size_download}\n' "http://localhost:$METRICS_PORT/metrics")" \
+         || fail "scrape failed (max_connections = $SIZE)"
+      echo "${line% *}" >> "$TIMES"
+      BYTES="${line#* }"
+   done
+
+   MEDIAN="$(sort -n "$TIMES" | awk '{ v[NR] = $1 } END { printf "%.3f", v[int((NR + 1) / 2)] * 1000 }')"
+   MAX="$(sort -n "$TIMES" | tail -1 | awk '{ printf "%.3f", $1 * 1000 }')"
+   rm -f "$TIMES"
+
+   echo "max_connections=$SIZE median=${MEDIAN}ms max=${MAX}ms bytes=$BYTES"
+
+   [ -n "$RESULTS" ] && RESULTS="$RESULTS,"
+   RESULTS="$RESULTS{\"max_connections\": $SIZE, \"median_ms\": $MEDIAN, \"max_ms\": $MAX, \"bytes\": $BYTES}"
+
+   stop_pgagroal
+done
+
+echo "{\"scrape\": [$RESULTS]}" > "$OUT"
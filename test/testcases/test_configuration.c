@@ -518,6 +518,24 @@ MCTF_TEST(test_configuration_reject_invalid_log_mode)
    MCTF_FINISH();
 }
 
+MCTF_TEST(test_configuration_accept_log_format)
+{
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_LOG_FORMAT, "text");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_LOG_FORMAT, "json");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_LOG_FORMAT, "logfmt");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_LOG_FORMAT, "JSON");
+
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_configuration_reject_invalid_log_format)
+{
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_LOG_FORMAT, "xml");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_LOG_FORMAT, "");
+
+   MCTF_FINISH();
+}
+
 MCTF_TEST(test_configuration_accept_update_process_title)
 {
    pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_UPDATE_PROCESS_TITLE, "never");
@@ -676,6 +694,123 @@ MCTF_TEST(test_configuration_reject_invalid_int)
    MCTF_FINISH();
 }
 
+MCTF_TEST(test_configuration_accept_sizes)
+{
+   // max_pending_clients
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_MAX_PENDING_CLIENTS, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_MAX_PENDING_CLIENTS, "1024");
+
+   // busy_poll
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_BUSY_POLL, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_BUSY_POLL, "50");
+
+   // tracker_events
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_TRACKER_EVENTS, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_TRACKER_EVENTS, "65536");
+
+   // flight_recorder
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_FLIGHT_RECORDER, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_FLIGHT_RECORDER, "64");
+
+   // flight_recorder_threshold
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_FLIGHT_RECORDER_THRESHOLD, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_FLIGHT_RECORDER_THRESHOLD, "500");
+
+   // log_queue
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_LOG_QUEUE, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_LOG_QUEUE, "8192");
+
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_configuration_reject_invalid_sizes)
+{
+   // Non-numeric
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_MAX_PENDING_CLIENTS, "abc");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_BUSY_POLL, "on");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_TRACKER_EVENTS, "many");
+
+   // Units are not supported
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_FLIGHT_RECORDER, "64K");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_FLIGHT_RECORDER_THRESHOLD, "500ms");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_LOG_QUEUE, "8k");
+
+   // Empty string
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_LOG_QUEUE, "");
+
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_configuration_accept_cache_times)
+{
+   // auth_query_cache_ttl
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_AUTH_QUERY_CACHE_TTL, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_AUTH_QUERY_CACHE_TTL, "5m");
+
+   // auth_query_negative_ttl
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_AUTH_QUERY_NEGATIVE_TTL, "30s");
+
+   // dns_cache_ttl
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_DNS_CACHE_TTL, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_DNS_CACHE_TTL, "60");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_DNS_CACHE_TTL, "1h");
+
+   // connect_timeout
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_CONNECT_TIMEOUT, "5s");
+
+   // tls_ticket_lifetime
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_TLS_TICKET_LIFETIME, "1h");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_TLS_TICKET_LIFETIME, "1d");
+
+   // management_idle_timeout
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_MANAGEMENT_IDLE_TIMEOUT, "0");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_MANAGEMENT_IDLE_TIMEOUT, "2m");
+
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_configuration_reject_invalid_cache_times)
+{
+   // Invalid suffix
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_AUTH_QUERY_CACHE_TTL, "10x");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_DNS_CACHE_TTL, "5ms");
+
+   // Negative value
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_AUTH_QUERY_NEGATIVE_TTL, "-1s");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_CONNECT_TIMEOUT, "-5s");
+
+   // Mixed units
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_TLS_TICKET_LIFETIME, "1h30m");
+
+   // Non-numeric
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_MANAGEMENT_IDLE_TIMEOUT, "never");
+
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_configuration_accept_feature_switches)
+{
+   // ev_stats
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_EV_STATS, "on");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_EV_STATS, "off");
+
+   // tls_session_tickets
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_TLS_SESSION_TICKETS, "true");
+   pgagroal_test_assert_conf_set_ok(CONFIGURATION_ARGUMENT_TLS_SESSION_TICKETS, "false");
+
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_configuration_reject_invalid_feature_switches)
+{
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_EV_STATS, "enabled");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_EV_STATS, "");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_TLS_SESSION_TICKETS, "2");
+   pgagroal_test_assert_conf_set_fail(CONFIGURATION_ARGUMENT_TLS_SESSION_TICKETS, "maybe");
+
+   MCTF_FINISH();
+}
+
 MCTF_TEST(test_configuration_server_section_keys)
 {
    struct main_configuration config;
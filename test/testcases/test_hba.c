@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgagroal.h>
+#include <security.h>
+#include <security_internal.h>
+#include <shmem.h>
+#include <mctf.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void
+hba_add(struct main_configuration* config, char* database, char* username, char* address, char* method)
+{
+   struct hba* hba = &config->hbas[config->number_of_hbas++];
+
+   memset(hba, 0, sizeof(struct hba));
+   snprintf(&hba->type[0], sizeof(hba->type), "%s", "host");
+   snprintf(&hba->database[0], sizeof(hba->database), "%s", database);
+   snprintf(&hba->username[0], sizeof(hba->username), "%s", username);
+   snprintf(&hba->address[0], sizeof(hba->address), "%s", address);
+   snprintf(&hba->method[0], sizeof(hba->method), "%s", method);
+}
+
+/**
+ * The method of the first matching entry
+ * @return The method, or SECURITY_INVALID if no entry matches
+ */
+static int
+hba_method(char* username, char* database, char* address)
+{
+   int method = SECURITY_INVALID;
+
+   if (!pgagroal_hba_is_allowed(username, database, address, &method))
+   {
+      return SECURITY_INVALID;
+   }
+
+   return method;
+}
+
+// The first entry that matches decides, even when a later one would allow more
+MCTF_TEST(test_hba_first_match)
+{
+   struct main_configuration* config;
+   struct main_configuration backup;
+
+   config = (struct main_configuration*)shmem;
+   memcpy(&backup, config, sizeof(struct main_configuration));
+
+   config->number_of_hbas = 0;
+   config->number_of_limits = 0;
+   hba_add(config, "mydb", "alice", "10.0.0.0/8", "reject");
+   hba_add(config, "mydb", "alice", "all", "password");
+   hba_add(config, "all", "all", "all", "trust");
+
+   MCTF_ASSERT_INT_EQ(pgagroal_hba_compile(), 0, cleanup, "HBA compile should succeed");
+
+   MCTF_ASSERT_INT_EQ(hba_method("alice", "mydb", "10.1.2.3"), SECURITY_REJECT, cleanup, "first entry should reject alice from 10/8");
+   MCTF_ASSERT_INT_EQ(hba_method("alice", "mydb", "192.168.1.1"), SECURITY_PASSWORD, cleanup, "second entry should match alice elsewhere");
+   MCTF_ASSERT_INT_EQ(hba_method("bob", "mydb", "10.1.2.3"), SECURITY_TRUST, cleanup, "other users should fall through to the last entry");
+   MCTF_ASSERT_INT_EQ(hba_method("alice", "otherdb", "10.1.2.3"), SECURITY_TRUST, cleanup, "other databases should fall through to the last entry");
+
+cleanup:
+   pgagroal_hba_destroy();
+   memcpy(config, &backup, sizeof(struct main_configuration));
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_hba_ipv4_prefix)
+{
+   struct main_configuration* config;
+   struct main_configuration backup;
+
+   config = (struct main_configuration*)shmem;
+   memcpy(&backup, config, sizeof(struct main_configuration));
+
+   config->number_of_hbas = 0;
+   config->number_of_limits = 0;
+   hba_add(config, "all", "all", "192.168.1.0/24", "password");
+   hba_add(config, "all", "all", "10.0.0.5/32", "scram-sha-256");
+   hba_add(config, "all", "all", "172.16.0.0/12", "trust");
+
+   MCTF_ASSERT_INT_EQ(pgagroal_hba_compile(), 0, cleanup, "HBA compile should succeed");
+
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "192.168.1.200"), SECURITY_PASSWORD, cleanup, "address inside /24 should match");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "192.168.2.1"), SECURITY_INVALID, cleanup, "address outside /24 should not match");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "10.0.0.5"), SECURITY_SCRAM256, cleanup, "exact address should match /32");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "10.0.0.6"), SECURITY_INVALID, cleanup, "other address should not match /32");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "172.31.255.255"), SECURITY_TRUST, cleanup, "last address inside /12 should match");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "172.32.0.0"), SECURITY_INVALID, cleanup, "first address after /12 should not match");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "::ffff:192.168.1.1"), SECURITY_INVALID, cleanup, "IPv6 address should not match an IPv4 entry");
+
+cleanup:
+   pgagroal_hba_destroy();
+   memcpy(config, &backup, sizeof(struct main_configuration));
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_hba_ipv6_prefix)
+{
+   struct main_configuration* config;
+   struct main_configuration backup;
+
+   config = (struct main_configuration*)shmem;
+   memcpy(&backup, config, sizeof(struct main_configuration));
+
+   config->number_of_hbas = 0;
+   config->number_of_limits = 0;
+   hba_add(config, "all", "all", "2001:db8::/32", "password");
+   hba_add(config, "all", "all", "::1/128", "trust");
+   hba_add(config, "all", "all", "fe80::/10", "scram-sha-256");
+
+   MCTF_ASSERT_INT_EQ(pgagroal_hba_compile(), 0, cleanup, "HBA compile should succeed");
+
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "2001:db8:1::5"), SECURITY_PASSWORD, cleanup, "address inside /32 should match");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "2001:db9::1"), SECURITY_INVALID, cleanup, "address outside /32 should not match");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "::1"), SECURITY_TRUST, cleanup, "exact address should match /128");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "::2"), SECURITY_INVALID, cleanup, "other address should not match /128");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "febf::1"), SECURITY_SCRAM256, cleanup, "last block inside /10 should match");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "fec0::1"), SECURITY_INVALID, cleanup, "first block after /10 should not match");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "127.0.0.1"), SECURITY_INVALID, cleanup, "IPv4 address should not match an IPv6 entry");
+
+cleanup:
+   pgagroal_hba_destroy();
+   memcpy(config, &backup, sizeof(struct main_configuration));
+   MCTF_FINISH();
+}
+
+// A /0 entry matches every address of its own family only
+MCTF_TEST(test_hba_zero_prefix)
+{
+   struct main_configuration* config;
+   struct main_configuration backup;
+
+   config = (struct main_configuration*)shmem;
+   memcpy(&backup, config, sizeof(struct main_configuration));
+
+   config->number_of_hbas = 0;
+   config->number_of_limits = 0;
+   hba_add(config, "all", "all", "0.0.0.0/0", "password");
+
+   MCTF_ASSERT_INT_EQ(pgagroal_hba_compile(), 0, cleanup, "HBA compile should succeed");
+
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "1.2.3.4"), SECURITY_PASSWORD, cleanup, "any IPv4 address should match 0.0.0.0/0");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "255.255.255.255"), SECURITY_PASSWORD, cleanup, "any IPv4 address should match 0.0.0.0/0");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "::1"), SECURITY_INVALID, cleanup, "IPv6 address should not match 0.0.0.0/0");
+
+   hba_add(config, "all", "all", "::/0", "trust");
+
+   MCTF_ASSERT_INT_EQ(pgagroal_hba_compile(), 0, cleanup, "HBA compile should succeed");
+
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "2001:db8::1"), SECURITY_TRUST, cleanup, "any IPv6 address should match ::/0");
+   MCTF_ASSERT_INT_EQ(hba_method("u", "d", "1.2.3.4"), SECURITY_PASSWORD, cleanup, "IPv4 address should still match the first entry");
+
+cleanup:
+   pgagroal_hba_destroy();
+   memcpy(config, &backup, sizeof(struct main_configuration));
+   MCTF_FINISH();
+}
+
+// 'all' matches any user, database or address, and a database entry covers its aliases
+MCTF_TEST(test_hba_all_and_alias)
+{
+   struct main_configuration* config;
+   struct main_configuration backup;
+
+   config = (struct main_configuration*)shmem;
+   memcpy(&backup, config, sizeof(struct main_configuration));
+
+   config->number_of_hbas = 0;
+   config->number_of_limits = 1;
+   memset(&config->limits[0], 0, sizeof(struct limit));
+   snprintf(&config->limits[0].database[0], sizeof(config->limits[0].database), "%s", "mydb");
+   snprintf(&config->limits[0].aliases[0][0], sizeof(config->limits[0].aliases[0]), "%s", "mydbalias");
+   config->limits[0].aliases_count = 1;
+
+   hba_add(config, "mydb", "alice", "all", "password");
+   hba_add(config, "all", "bob", "all", "trust");
+   hba_add(config, "ALL", "carol", "all", "scram-sha-256");
+
+   MCTF_ASSERT_INT_EQ(pgagroal_hba_compile(), 0, cleanup, "HBA compile should succeed");
+
+   MCTF_ASSERT_INT_EQ(hba_method("alice", "mydb", "10.0.0.1"), SECURITY_PASSWORD, cleanup, "alice should match mydb");
+   MCTF_ASSERT_INT_EQ(hba_method("alice", "mydbalias", "::1"), SECURITY_PASSWORD, cleanup, "alice should match the alias of mydb");
+   MCTF_ASSERT_INT_EQ(hba_method("alice", "otherdb", "10.0.0.1"), SECURITY_INVALID, cleanup, "alice should not match another database");
+   MCTF_ASSERT_INT_EQ(hba_method("bob", "otherdb", "10.0.0.1"), SECURITY_TRUST, cleanup, "bob should match every database");
+   MCTF_ASSERT_INT_EQ(hba_method("carol", "mydbalias", "10.0.0.1"), SECURITY_SCRAM256, cleanup, "'ALL' should match every database");
+   MCTF_ASSERT_INT_EQ(hba_method("dave", "mydb", "10.0.0.1"), SECURITY_INVALID, cleanup, "unknown user should not match");
+
+cleanup:
+   pgagroal_hba_destroy();
+   memcpy(config, &backup, sizeof(struct main_configuration));
+   MCTF_FINISH();
+}
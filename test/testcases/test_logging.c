@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgagroal.h>
+#include <logging.h>
+#include <logging_internal.h>
+#include <mctf.h>
+#include <shmem.h>
+#include <utils.h>
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static void
+entry_init(struct log_entry* entry, char* event, char* username, char* database, char* message)
+{
+   memset(entry, 0, sizeof(struct log_entry));
+
+   entry->level = PGAGROAL_LOGGING_LEVEL_INFO;
+   entry->line = 1;
+   entry->pid = 1;
+   entry->slot = -1;
+   entry->duration = -1;
+
+   snprintf(&entry->file[0], sizeof(entry->file), "%s", "test.c");
+   snprintf(&entry->event[0], sizeof(entry->event), "%s", event);
+   snprintf(&entry->username[0], sizeof(entry->username), "%s", username);
+   snprintf(&entry->database[0], sizeof(entry->database), "%s", database);
+   snprintf(&entry->message[0], sizeof(entry->message), "%s", message);
+   entry->length = strlen(&entry->message[0]);
+}
+
+/**
+ * Create the log queues, with four entries per queue
+ * @param config The configuration
+ * @param size The resulting size of the shared memory
+ * @return The log queues, or NULL
+ */
+static struct log_queues*
+queue_create(struct main_configuration* config, size_t* size)
+{
+   config->log_queue = 4 * PGAGROAL_LOGGING_QUEUES;
+
+   if (pgagroal_log_queue_init(size, &log_shmem))
+   {
+      return NULL;
+   }
+
+   pgagroal_log_queue_enable(true);
+
+   return (struct log_queues*)log_shmem;
+}
+
+/**
+ * Add a line to the queue of this process
+ * @param fmt The format
+ * @return True if the line was queued or dropped
+ */
+static bool
+queue_add(char* fmt, ...)
+{
+   bool queued;
+   va_list ap;
+
+   va_start(ap, fmt);
+   queued = pgagroal_log_queue_add(PGAGROAL_LOGGING_LEVEL_INFO, __FILE__, __LINE__, NULL, -1, fmt, ap);
+   va_end(ap);
+
+   return queued;
+}
+
+/**
+ * Get the identifier of a process that is gone
+ * @return The process identifier
+ */
+static pid_t
+gone_pid(void)
+{
+   pid_t pid;
+
+   pid = fork();
+   if (pid == 0)
+   {
+      _exit(0);
+   }
+
+   waitpid(pid, NULL, 0);
+
+   return pid;
+}
+
+MCTF_TEST(test_logging_json_escape)
+{
+   struct log_entry entry;
+   char buffer[1024];
+   size_t length;
+
+   entry_init(&entry, "", "", "", "say \"hi\"\\ok\n\t\r\x01");
+
+   length = pgagroal_log_entry_format(&entry, PGAGROAL_LOGGING_FORMAT_JSON, &buffer[0], sizeof(buffer));
+   MCTF_ASSERT(length > 0 && length < sizeof(buffer), cleanup, "line should fit the buffer");
+   buffer[length] = '\0';
+
+   MCTF_ASSERT(buffer[0] == '{', cleanup, "json line should be an object");
+   MCTF_ASSERT(strstr(&buffer[0], "\"msg\":\"say \\\"hi\\\"\\\\ok\\n\\t\\r\\u0001\"}\n") != NULL, cleanup,
+               "quotes and control characters should be escaped: %s", &buffer[0]);
+   MCTF_ASSERT(strstr(&buffer[0], "\"user\"") == NULL, cleanup, "empty user should be left out");
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_logging_logfmt_escape)
+{
+   struct log_entry entry;
+   char buffer[1024];
+   size_t length;
+
+   entry_init(&entry, "pool full", "alice", "a=b", "line\none");
+
+   length = pgagroal_log_entry_format(&entry, PGAGROAL_LOGGING_FORMAT_LOGFMT, &buffer[0], sizeof(buffer));
+   MCTF_ASSERT(length > 0 && length < sizeof(buffer), cleanup, "line should fit the buffer");
+   buffer[length] = '\0';
+
+   MCTF_ASSERT(strstr(&buffer[0], " user=alice ") != NULL, cleanup, "plain value should not be quoted: %s", &buffer[0]);
+   MCTF_ASSERT(strstr(&buffer[0], " database=\"a=b\"") != NULL, cleanup, "value with '=' should be quoted: %s", &buffer[0]);
+   MCTF_ASSERT(strstr(&buffer[0], " event=\"pool full\"") != NULL, cleanup, "value with a space should be quoted: %s", &buffer[0]);
+   MCTF_ASSERT(strstr(&buffer[0], " msg=\"line\\none\"\n") != NULL, cleanup, "message should be quoted and escaped: %s", &buffer[0]);
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_logging_truncate_at_buffer_end)
+{
+   struct log_entry entry;
+   char message[PGAGROAL_LOGGING_MESSAGE_LENGTH];
+   char buffer[160];
+   char* json_end = "\",\"truncated\":true}\n";
+   char* logfmt_end = "\" truncated=true\n";
+   size_t length;
+   size_t backslashes = 0;
+
+   /* Every character needs an escape, so the cut can't split one */
+   memset(&message[0], '"', sizeof(message) - 1);
+   message[sizeof(message) - 1] = '\0';
+
+   entry_init(&entry, "", "", "", &message[0]);
+
+   length = pgagroal_log_entry_format(&entry, PGAGROAL_LOGGING_FORMAT_JSON, &buffer[0], sizeof(buffer));
+   MCTF_ASSERT(length > strlen(json_end) && length < sizeof(buffer), cleanup, "json line should be cut within the buffer (%zu)", length);
+   MCTF_ASSERT(!memcmp(&buffer[length - strlen(json_end)], json_end, strlen(json_end)), cleanup,
+               "json line should be marked and closed after the cut: %s", &buffer[0]);
+
+   for (size_t i = length - strlen(json_end) - 1; buffer[i] == '\\'; i--)
+   {
+      backslashes++;
+   }
+   MCTF_ASSERT(backslashes % 2 == 0, cleanup, "json line should not end in half an escape");
+
+   length = pgagroal_log_entry_format(&entry, PGAGROAL_LOGGING_FORMAT_LOGFMT, &buffer[0], sizeof(buffer));
+   MCTF_ASSERT(length > strlen(logfmt_end) && length < sizeof(buffer), cleanup, "logfmt line should be cut within the buffer (%zu)", length);
+   MCTF_ASSERT(!memcmp(&buffer[length - strlen(logfmt_end)], logfmt_end, strlen(logfmt_end)), cleanup,
+               "logfmt line should be marked and closed after the cut: %s", &buffer[0]);
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_logging_small_buffer)
+{
+   struct log_entry entry;
+   char name[PGAGROAL_LOGGING_NAME_LENGTH];
+   char buffer[256];
+   size_t length;
+   int formats[] = {PGAGROAL_LOGGING_FORMAT_JSON, PGAGROAL_LOGGING_FORMAT_LOGFMT};
+
+   /* Names that double when escaped, in buffers too small for any of them */
+   for (size_t i = 0; i < sizeof(name) - 1; i++)
+   {
+      name[i] = i % 2 == 0 ? '"' : '\\';
+   }
+   name[sizeof(name) - 1] = '\0';
+
+   entry_init(&entry, "event", &name[0], &name[0], "message");
+
+   for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+   {
+      for (size_t size = 25; size <= 192; size++)
+      {
+         memset(&buffer[0], 'X', sizeof(buffer));
+
+         length = pgagroal_log_entry_format(&entry, formats[f], &buffer[0], size);
+         MCTF_ASSERT(length > 0 && length < size, cleanup, "line should fit a buffer of %zu (%zu)", size, length);
+
+         for (size_t i = size; i < sizeof(buffer); i++)
+         {
+            MCTF_ASSERT(buffer[i] == 'X', cleanup, "nothing should be written past a buffer of %zu", size);
+         }
+
+         MCTF_ASSERT(buffer[length - 1] == '\n', cleanup, "line should end in a newline for %zu", size);
+         MCTF_ASSERT(strstr(&buffer[0], formats[f] == PGAGROAL_LOGGING_FORMAT_JSON ? "\"truncated\":true}" : "truncated=true") != NULL,
+                     cleanup, "cut line should be marked for %zu: %s", size, &buffer[0]);
+      }
+   }
+
+   length = pgagroal_log_entry_format(&entry, PGAGROAL_LOGGING_FORMAT_JSON, &buffer[0], 24);
+   MCTF_ASSERT_INT_EQ((int)length, 0, cleanup, "a buffer without room for the end of a line should stay empty");
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_logging_queue_claim_and_write)
+{
+   int log_queue;
+   int queue = getpid() % PGAGROAL_LOGGING_QUEUES;
+   char message[32];
+   size_t size = 0;
+   void* saved = log_shmem;
+   struct log_stall stall;
+   struct log_entry* entry = NULL;
+   struct log_queues* queues = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   log_queue = config->log_queue;
+   memset(&stall, 0, sizeof(stall));
+
+   queues = queue_create(config, &size);
+   MCTF_ASSERT(queues != NULL, cleanup, "log queues should be created");
+   MCTF_ASSERT_INT_EQ((int)queues->size, 4, cleanup, "a queue should hold 4 entries");
+
+   for (int i = 0; i < 4; i++)
+   {
+      MCTF_ASSERT(queue_add("line %d", i), cleanup, "line %d should be queued", i);
+   }
+
+   MCTF_ASSERT_INT_EQ((int)atomic_load(&queues->queues[queue].tail), 4, cleanup, "every line should take an entry");
+
+   for (int i = 0; i < 4; i++)
+   {
+      entry = pgagroal_log_queue_entry(queues, queue, i);
+      snprintf(&message[0], sizeof(message), "line %d", i);
+
+      MCTF_ASSERT_INT_EQ((int)atomic_load(&entry->sequence), i + 1, cleanup, "entry %d should be published", i);
+      MCTF_ASSERT_INT_EQ(atomic_load(&entry->owner), 0, cleanup, "entry %d should have no owner once filled", i);
+      MCTF_ASSERT_INT_EQ(entry->pid, getpid(), cleanup, "entry %d should hold the process", i);
+      MCTF_ASSERT(entry->length == (int32_t)strlen(&message[0]) && !memcmp(&entry->message[0], &message[0], entry->length),
+                  cleanup, "entry %d should hold its message", i);
+   }
+
+   /* A full queue counts the line as dropped */
+   MCTF_ASSERT(queue_add("line 4"), cleanup, "line on a full queue should be handled");
+   MCTF_ASSERT_INT_EQ((int)pgagroal_log_queue_dropped(), 1, cleanup, "line on a full queue should be dropped");
+   MCTF_ASSERT_INT_EQ((int)atomic_load(&queues->queues[queue].tail), 4, cleanup, "dropped line should not take an entry");
+
+   MCTF_ASSERT_INT_EQ(pgagroal_log_queue_write(queues, queue, &stall), 4, cleanup, "every filled entry should be written");
+   MCTF_ASSERT_INT_EQ((int)queues->queues[queue].head, 4, cleanup, "head should follow the written entries");
+
+   for (int i = 0; i < 4; i++)
+   {
+      entry = pgagroal_log_queue_entry(queues, queue, i);
+      MCTF_ASSERT_INT_EQ((int)atomic_load(&entry->sequence), i + 4, cleanup, "entry %d should be handed back for the next lap", i);
+   }
+
+   /* The next lap reuses the entries */
+   MCTF_ASSERT(queue_add("line 5"), cleanup, "line of the next lap should be queued");
+   MCTF_ASSERT_INT_EQ((int)atomic_load(&pgagroal_log_queue_entry(queues, queue, 4)->sequence), 5, cleanup,
+                      "entry of the next lap should be published");
+   MCTF_ASSERT_INT_EQ(pgagroal_log_queue_write(queues, queue, &stall), 1, cleanup, "line of the next lap should be written");
+   MCTF_ASSERT_INT_EQ(pgagroal_log_queue_write(queues, queue, &stall), 0, cleanup, "an empty queue should write nothing");
+
+cleanup:
+   pgagroal_log_queue_enable(false);
+   if (log_shmem != saved)
+   {
+      pgagroal_destroy_shared_memory(log_shmem, size);
+   }
+   log_shmem = saved;
+   config->log_queue = log_queue;
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_logging_queue_long_line)
+{
+   int log_queue;
+   int queue = getpid() % PGAGROAL_LOGGING_QUEUES;
+   char message[PGAGROAL_LOGGING_MESSAGE_LENGTH + 1];
+   size_t size = 0;
+   void* saved = log_shmem;
+   struct log_queues* queues = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   log_queue = config->log_queue;
+
+   queues = queue_create(config, &size);
+   MCTF_ASSERT(queues != NULL, cleanup, "log queues should be created");
+
+   memset(&message[0], 'a', sizeof(message) - 1);
+   message[sizeof(message) - 1] = '\0';
+
+   /* The process writes the line itself rather than cut it */
+   MCTF_ASSERT(!queue_add("%s", &message[0]), cleanup, "line longer than an entry should not be queued");
+   MCTF_ASSERT_INT_EQ((int)atomic_load(&queues->queues[queue].tail), 0, cleanup, "long line should not take an entry");
+   MCTF_ASSERT_INT_EQ((int)pgagroal_log_queue_dropped(), 0, cleanup, "long line should not be dropped");
+
+   message[PGAGROAL_LOGGING_MESSAGE_LENGTH - 1] = '\0';
+   MCTF_ASSERT(queue_add("%s", &message[0]), cleanup, "line that fills an entry should be queued");
+   MCTF_ASSERT_INT_EQ(pgagroal_log_queue_entry(queues, queue, 0)->length, PGAGROAL_LOGGING_MESSAGE_LENGTH - 1, cleanup,
+                      "line that fills an entry should be whole");
+
+cleanup:
+   pgagroal_log_queue_enable(false);
+   if (log_shmem != saved)
+   {
+      pgagroal_destroy_shared_memory(log_shmem, size);
+   }
+   log_shmem = saved;
+   config->log_queue = log_queue;
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_logging_queue_stall_reclaim)
+{
+   int log_queue;
+   int queue = getpid() % PGAGROAL_LOGGING_QUEUES;
+   size_t size = 0;
+   void* saved = log_shmem;
+   uint64_t abandoned;
+   struct log_stall stall;
+   struct log_entry* entry = NULL;
+   struct log_queues* queues = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   log_queue = config->log_queue;
+   memset(&stall, 0, sizeof(stall));
+
+   queues = queue_create(config, &size);
+   MCTF_ASSERT(queues != NULL, cleanup, "log queues should be created");
+
+   /* A process took the first entry and stopped before it filled it */
+   entry = pgagroal_log_queue_entry(queues, queue, 0);
+   atomic_fetch_add(&queues->queues[queue].tail, 1);
+   atomic_store(&entry->owner, getpid());
+
+   MCTF_ASSERT_INT_EQ(pgagroal_log_queue_write(queues, queue, &stall), 0, cleanup, "unfilled entry should not be written");
+   MCTF_ASSERT(stall.since != 0, cleanup, "unfilled entry should be noticed");
+
+   stall.since = time(NULL) - 60;
+   MCTF_ASSERT_INT_EQ(pgagroal_log_queue_write(queues, queue, &stall), 0, cleanup, "abandoned entry should not be written");
+   MCTF_ASSERT_INT_EQ((int)queues->queues[queue].head, 1, cleanup, "head should skip the abandoned entry");
+   MCTF_ASSERT_INT_EQ((int)pgagroal_log_queue_dropped(), 1, cleanup, "abandoned entry should be counted as dropped");
+   MCTF_ASSERT(stall.abandoned != 0 && atomic_load(&entry->sequence) == stall.abandoned, cleanup,
+               "entry should be marked as abandoned");
+
+   /* Its process is alive, so it may still write the entry */
+   abandoned = stall.abandoned;
+   pgagroal_log_queue_write(queues, queue, &stall);
+   MCTF_ASSERT(stall.abandoned == abandoned && atomic_load(&entry->sequence) == abandoned, cleanup,
+               "entry of a live process should not be reclaimed");
+
+   /* Its process is gone */
+   atomic_store(&entry->owner, gone_pid());
+   pgagroal_log_queue_write(queues, queue, &stall);
+   MCTF_ASSERT_INT_EQ((int)stall.abandoned, 0, cleanup, "entry of a process that is gone should be reclaimed");
+   MCTF_ASSERT_INT_EQ((int)atomic_load(&entry->sequence), (int)queues->size, cleanup, "entry should be handed back for the next lap");
+   MCTF_ASSERT_INT_EQ(atomic_load(&entry->owner), 0, cleanup, "reclaimed entry should have no owner");
+
+   /* The queue is whole again */
+   for (int i = 0; i < 4; i++)
+   {
+      MCTF_ASSERT(queue_add("line %d", i), cleanup, "line %d should be queued", i);
+   }
+   MCTF_ASSERT_INT_EQ((int)pgagroal_log_queue_dropped(), 1, cleanup, "no line should be dropped after the reclaim");
+   MCTF_ASSERT_INT_EQ(pgagroal_log_queue_write(queues, queue, &stall), 4, cleanup, "every line should be written");
+
+cleanup:
+   pgagroal_log_queue_enable(false);
+   if (log_shmem != saved)
+   {
+      pgagroal_destroy_shared_memory(log_shmem, size);
+   }
+   log_shmem = saved;
+   config->log_queue = log_queue;
+   MCTF_FINISH();
+}
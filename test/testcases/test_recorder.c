@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgagroal.h>
+#include <recorder.h>
+#include <recorder_internal.h>
+#include <mctf.h>
+
+#include <stdint.h>
+
+MCTF_TEST(test_recorder_window_quiet)
+{
+   uint64_t start;
+   uint64_t count;
+
+   /* Less than a lap, nothing written during the copy */
+   start = 0;
+   count = pgagroal_recorder_window(5, 5, 8, &start);
+   MCTF_ASSERT_INT_EQ((int)count, 5, cleanup, "every event should be valid");
+   MCTF_ASSERT_INT_EQ((int)start, 0, cleanup, "start should not move");
+
+   /* A full ring, where the owner may be writing the oldest entry */
+   start = 0;
+   count = pgagroal_recorder_window(8, 8, 8, &start);
+   MCTF_ASSERT_INT_EQ((int)count, 7, cleanup, "the oldest event of a full ring should be dropped");
+   MCTF_ASSERT_INT_EQ((int)start, 1, cleanup, "start should skip the oldest event");
+
+   start = 12;
+   count = pgagroal_recorder_window(20, 20, 8, &start);
+   MCTF_ASSERT_INT_EQ((int)count, 7, cleanup, "a wrapped ring should keep all but the oldest event");
+   MCTF_ASSERT_INT_EQ((int)start, 13, cleanup, "start should skip the oldest event");
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_recorder_window_overwritten)
+{
+   uint64_t start;
+   uint64_t count;
+
+   /* Four events were added during the copy */
+   start = 2;
+   count = pgagroal_recorder_window(10, 14, 8, &start);
+   MCTF_ASSERT_INT_EQ((int)count, 3, cleanup, "the events written over should be dropped");
+   MCTF_ASSERT_INT_EQ((int)start, 7, cleanup, "start should move past the events written over");
+
+   /* The last copied event is being written over */
+   start = 2;
+   count = pgagroal_recorder_window(10, 17, 8, &start);
+   MCTF_ASSERT_INT_EQ((int)count, 0, cleanup, "nothing should be valid");
+
+   /* More than a lap during the copy */
+   start = 2;
+   count = pgagroal_recorder_window(10, 30, 8, &start);
+   MCTF_ASSERT_INT_EQ((int)count, 0, cleanup, "nothing should be valid after a lap");
+
+   /* Fewer events than the ring holds, so nothing is written over */
+   start = 0;
+   count = pgagroal_recorder_window(3, 7, 8, &start);
+   MCTF_ASSERT_INT_EQ((int)count, 3, cleanup, "a ring that did not wrap should stay valid");
+   MCTF_ASSERT_INT_EQ((int)start, 0, cleanup, "start should not move");
+
+cleanup:
+   MCTF_FINISH();
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgagroal.h>
+#include <json.h>
+#include <management.h>
+#include <shmem.h>
+#include <status.h>
+#include <status_internal.h>
+#include <mctf.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Set up four slots: Free, Idle check, Active, Idle check
+ * @param config The configuration
+ */
+static void
+status_slots(struct main_configuration* config)
+{
+   config->max_connections = 4;
+
+   atomic_store(&config->states[0], STATE_FREE);
+   atomic_store(&config->states[1], STATE_IDLE_CHECK);
+   atomic_store(&config->states[2], STATE_IN_USE);
+   atomic_store(&config->states[3], STATE_IDLE_CHECK);
+}
+
+/**
+ * Get a page of connections
+ * @param state The state filter, or NULL
+ * @param offset The offset
+ * @param limit The limit
+ * @param response The response
+ */
+static void
+status_page(char* state, int64_t offset, int64_t limit, struct json** response)
+{
+   struct json* request = NULL;
+
+   pgagroal_json_create(&request);
+   pgagroal_json_create(response);
+
+   if (state != NULL)
+   {
+      pgagroal_json_put(request, MANAGEMENT_ARGUMENT_STATE, (uintptr_t)state, ValueString);
+   }
+   pgagroal_json_put(request, MANAGEMENT_ARGUMENT_OFFSET, (uintptr_t)offset, ValueInt64);
+   pgagroal_json_put(request, MANAGEMENT_ARGUMENT_LIMIT, (uintptr_t)limit, ValueInt64);
+
+   pgagroal_status_connections(request, *response);
+
+   pgagroal_json_destroy(request);
+}
+
+/**
+ * The slot of a row in a response
+ * @param response The response
+ * @param index The row
+ * @return The slot, or -1 if there is no such row
+ */
+static int
+status_slot(struct json* response, int index)
+{
+   struct json* connections = (struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS);
+   struct json_iterator* iter = NULL;
+   int slot = -1;
+
+   pgagroal_json_iterator_create(connections, &iter);
+   for (int i = 0; pgagroal_json_iterator_next(iter); i++)
+   {
+      if (i == index)
+      {
+         slot = (int)pgagroal_json_get((struct json*)iter->value->data, MANAGEMENT_ARGUMENT_SLOT);
+         break;
+      }
+   }
+   pgagroal_json_iterator_destroy(iter);
+
+   return slot;
+}
+
+// '_' and '-' match the space in the state, case insensitive
+MCTF_TEST(test_status_state_matches)
+{
+   MCTF_ASSERT(pgagroal_status_state_matches("idle_check", "Idle check"), cleanup, "idle_check should match");
+   MCTF_ASSERT(pgagroal_status_state_matches("idle-check", "Idle check"), cleanup, "idle-check should match");
+   MCTF_ASSERT(pgagroal_status_state_matches("IDLE CHECK", "Idle check"), cleanup, "IDLE CHECK should match");
+   MCTF_ASSERT(pgagroal_status_state_matches("active", "Active"), cleanup, "active should match");
+
+   MCTF_ASSERT(!pgagroal_status_state_matches("idle", "Idle check"), cleanup, "a prefix should not match");
+   MCTF_ASSERT(!pgagroal_status_state_matches("idle_check_", "Idle check"), cleanup, "a longer filter should not match");
+   MCTF_ASSERT(!pgagroal_status_state_matches("idle_check", "Active"), cleanup, "idle_check should not match Active");
+   MCTF_ASSERT(!pgagroal_status_state_matches("", "Free"), cleanup, "an empty filter should not match");
+
+cleanup:
+   MCTF_FINISH();
+}
+
+// A full page points at the next slot, the last page has NextOffset -1
+MCTF_TEST(test_status_paging)
+{
+   struct main_configuration* config;
+   struct main_configuration backup;
+   struct json* response = NULL;
+
+   config = (struct main_configuration*)shmem;
+   memcpy(&backup, config, sizeof(struct main_configuration));
+
+   status_slots(config);
+
+   status_page(NULL, 0, 3, &response);
+   MCTF_ASSERT_INT_EQ(pgagroal_json_array_length((struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS)), 3, cleanup, "first page should have 3 rows");
+   MCTF_ASSERT_INT_EQ((int64_t)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET), 3, cleanup, "next offset should be slot 3");
+   pgagroal_json_destroy(response);
+   response = NULL;
+
+   status_page(NULL, 3, 3, &response);
+   MCTF_ASSERT_INT_EQ(pgagroal_json_array_length((struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS)), 1, cleanup, "last page should have 1 row");
+   MCTF_ASSERT_INT_EQ(status_slot(response, 0), 3, cleanup, "last page should start at slot 3");
+   MCTF_ASSERT_INT_EQ((int64_t)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET), -1, cleanup, "next offset should be -1 at the last page");
+   pgagroal_json_destroy(response);
+   response = NULL;
+
+   // A page that ends exactly at the last slot is the last page
+   status_page(NULL, 0, 4, &response);
+   MCTF_ASSERT_INT_EQ(pgagroal_json_array_length((struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS)), 4, cleanup, "exact page should have 4 rows");
+   MCTF_ASSERT_INT_EQ((int64_t)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET), -1, cleanup, "next offset should be -1 at an exact last page");
+
+cleanup:
+   pgagroal_json_destroy(response);
+   memcpy(config, &backup, sizeof(struct main_configuration));
+   MCTF_FINISH();
+}
+
+// An offset past max_connections gives an empty last page
+MCTF_TEST(test_status_paging_past_end)
+{
+   struct main_configuration* config;
+   struct main_configuration backup;
+   struct json* response = NULL;
+
+   config = (struct main_configuration*)shmem;
+   memcpy(&backup, config, sizeof(struct main_configuration));
+
+   status_slots(config);
+
+   status_page(NULL, 100, 2, &response);
+   MCTF_ASSERT_INT_EQ(pgagroal_json_array_length((struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS)), 0, cleanup, "page past the end should be empty");
+   MCTF_ASSERT_INT_EQ((int64_t)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET), -1, cleanup, "next offset should be -1 past the end");
+
+cleanup:
+   pgagroal_json_destroy(response);
+   memcpy(config, &backup, sizeof(struct main_configuration));
+   MCTF_FINISH();
+}
+
+// The state filter pages over the matching slots only
+MCTF_TEST(test_status_paging_state)
+{
+   struct main_configuration* config;
+   struct main_configuration backup;
+   struct json* response = NULL;
+
+   config = (struct main_configuration*)shmem;
+   memcpy(&backup, config, sizeof(struct main_configuration));
+
+   status_slots(config);
+
+   status_page("idle_check", 0, 1, &response);
+   MCTF_ASSERT_INT_EQ(pgagroal_json_array_length((struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS)), 1, cleanup, "first idle_check page should have 1 row");
+   MCTF_ASSERT_INT_EQ(status_slot(response, 0), 1, cleanup, "first idle_check row should be slot 1");
+   MCTF_ASSERT_INT_EQ((int64_t)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET), 3, cleanup, "next offset should skip to slot 3");
+   pgagroal_json_destroy(response);
+   response = NULL;
+
+   status_page("idle-check", 3, 1, &response);
+   MCTF_ASSERT_INT_EQ(pgagroal_json_array_length((struct json*)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_CONNECTIONS)), 1, cleanup, "last idle-check page should have 1 row");
+   MCTF_ASSERT_INT_EQ(status_slot(response, 0), 3, cleanup, "last idle-check row should be slot 3");
+   MCTF_ASSERT_INT_EQ((int64_t)pgagroal_json_get(response, MANAGEMENT_ARGUMENT_NEXT_OFFSET), -1, cleanup, "next offset should be -1 after slot 3");
+
+cleanup:
+   pgagroal_json_destroy(response);
+   memcpy(config, &backup, sizeof(struct main_configuration));
+   MCTF_FINISH();
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2026 The pgagroal community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgagroal.h>
+#include <shmem.h>
+#include <tracker.h>
+#include <tracker_internal.h>
+#include <mctf.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Create a tracker ring
+ * @param config The configuration
+ * @param events The number of events
+ * @param size The resulting size of the shared memory
+ * @return The tracker ring, or NULL
+ */
+static struct tracker_ring*
+tracker_ring_create(struct main_configuration* config, int events, size_t* size)
+{
+   config->tracker = true;
+   config->tracker_events = events;
+
+   if (pgagroal_tracker_init(size, &tracker_shmem))
+   {
+      return NULL;
+   }
+
+   return (struct tracker_ring*)tracker_shmem;
+}
+
+MCTF_TEST(test_tracker_ring_wrap_around)
+{
+   char name[TRACKER_NAME_LENGTH];
+   bool tracker;
+   int tracker_events;
+   size_t size = 0;
+   void* saved = tracker_shmem;
+   struct tracker_event event;
+   struct tracker_ring* ring = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   tracker = config->tracker;
+   tracker_events = config->tracker_events;
+
+   /* Rounded up to a power of two */
+   ring = tracker_ring_create(config, 3, &size);
+   MCTF_ASSERT(ring != NULL, cleanup, "tracker ring should be created");
+   MCTF_ASSERT_INT_EQ((int)ring->size, 4, cleanup, "tracker ring should hold 4 events");
+
+   for (int i = 0; i < 10; i++)
+   {
+      snprintf(&name[0], sizeof(name), "user%d", i);
+      pgagroal_tracking_event_basic(TRACKER_CLIENT_START, &name[0], "db");
+   }
+
+   MCTF_ASSERT_INT_EQ((int)atomic_load(&ring->head), 10, cleanup, "head should count every event");
+
+   /* The first laps are written over */
+   for (uint64_t position = 0; position < 6; position++)
+   {
+      MCTF_ASSERT(!pgagroal_tracker_event_read(ring, position, &event), cleanup,
+                  "event %d should be written over", (int)position);
+   }
+
+   for (uint64_t position = 6; position < 10; position++)
+   {
+      MCTF_ASSERT(pgagroal_tracker_event_read(ring, position, &event), cleanup, "event %d should be read", (int)position);
+
+      snprintf(&name[0], sizeof(name), "user%d", (int)position);
+      MCTF_ASSERT_STR_EQ(event.username, &name[0], cleanup, "event %d should hold its own user", (int)position);
+      MCTF_ASSERT_INT_EQ(event.id, TRACKER_CLIENT_START, cleanup, "event %d should hold its identifier", (int)position);
+   }
+
+cleanup:
+   if (tracker_shmem != saved)
+   {
+      pgagroal_destroy_shared_memory(tracker_shmem, size);
+   }
+   tracker_shmem = saved;
+   config->tracker = tracker;
+   config->tracker_events = tracker_events;
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_tracker_ring_torn_read)
+{
+   bool tracker;
+   int tracker_events;
+   size_t size = 0;
+   void* saved = tracker_shmem;
+   struct tracker_event event;
+   struct tracker_event* e = NULL;
+   struct tracker_ring* ring = NULL;
+   struct main_configuration* config;
+
+   config = (struct main_configuration*)shmem;
+   tracker = config->tracker;
+   tracker_events = config->tracker_events;
+
+   ring = tracker_ring_create(config, 4, &size);
+   MCTF_ASSERT(ring != NULL, cleanup, "tracker ring should be created");
+
+   pgagroal_tracking_event_basic(TRACKER_CLIENT_START, "alice", "db");
+   e = &ring->events[0];
+
+   MCTF_ASSERT(pgagroal_tracker_event_read(ring, 0, &event), cleanup, "published event should be read");
+
+   /* A writer clears the sequence before it writes the event */
+   atomic_store(&e->sequence, 0);
+   MCTF_ASSERT(!pgagroal_tracker_event_read(ring, 0, &event), cleanup, "event being written should be skipped");
+
+   /* A writer of the next lap took the entry */
+   atomic_store(&e->sequence, 0 + ring->size + 1);
+   MCTF_ASSERT(!pgagroal_tracker_event_read(ring, 0, &event), cleanup, "event written over should be skipped");
+
+   /* The reader retries once the event is published again */
+   atomic_store(&e->sequence, 1);
+   MCTF_ASSERT(pgagroal_tracker_event_read(ring, 0, &event), cleanup, "republished event should be read");
+   MCTF_ASSERT_STR_EQ(event.username, "alice", cleanup, "event should hold its user");
+
+cleanup:
+   if (tracker_shmem != saved)
+   {
+      pgagroal_destroy_shared_memory(tracker_shmem, size);
+   }
+   tracker_shmem = saved;
+   config->tracker = tracker;
+   config->tracker_events = tracker_events;
+   MCTF_FINISH();
+}